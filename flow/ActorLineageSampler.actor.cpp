@@ -0,0 +1,267 @@
+/*
+ * ActorLineageSampler.actor.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flow/ActorLineageSampler.h"
+
+#ifdef ENABLE_SAMPLING
+#include <algorithm>
+#include <cstring>
+
+#include "flow/UnitTest.h"
+#include "flow/WriteOnlySet.h"
+#include "flow/actorcompiler.h" // This must be the last #include.
+
+namespace {
+
+// The most recent lineage handed over by sample(), and the priority it was running at (-1 if unknown). The sampler
+// thread takes it, so each sample is counted once.
+WriteOnlyVariable<ActorLineage, unsigned> sampledLineage;
+std::atomic<int64_t> sampledPriority = -1;
+
+const std::string otherStacks = "[other]";
+
+void appendFrame(std::string& folded, StringRef frame) {
+	if (!folded.empty()) {
+		folded += ';';
+	}
+	if (frame.size() == 0) {
+		folded += '?';
+	} else {
+		folded.append(reinterpret_cast<const char*>(frame.begin()), frame.size());
+	}
+}
+
+} // namespace
+
+// Declared by flow.cpp, which calls it from replaceLineage() on the first lineage switch after startSampling is set
+void sample(LineageReference* lineagePtr) {
+	if (!lineagePtr->isValid()) {
+		return;
+	}
+	const char* actorName = lineagePtr->actorName();
+	(*lineagePtr)->modify(&StackLineage::actorName) =
+	    StringRef(reinterpret_cast<const uint8_t*>(actorName), strlen(actorName));
+	bool onNetwork = g_network && g_network->isOnMainThread();
+	sampledPriority.store(onNetwork ? static_cast<int64_t>(g_network->getCurrentTask()) : -1);
+	sampledLineage.replace(*lineagePtr);
+}
+
+ActorLineageSampler& ActorLineageSampler::instance() {
+	static ActorLineageSampler sampler(FLOW_KNOBS->ACTOR_LINEAGE_SAMPLER_MAX_STACKS);
+	return sampler;
+}
+
+ActorLineageSampler::ActorLineageSampler(int maxStacks) : maxStacks(maxStacks) {}
+
+ActorLineageSampler::~ActorLineageSampler() {
+	stop();
+}
+
+void ActorLineageSampler::start() {
+	if (isRunning()) {
+		return;
+	}
+	stopping = false;
+	thread = std::thread([this]() { run(); });
+}
+
+void ActorLineageSampler::stop() {
+	if (!isRunning()) {
+		return;
+	}
+	{
+		std::unique_lock<std::mutex> lock(stopMutex);
+		stopping = true;
+	}
+	stopped.notify_all();
+	thread.join();
+}
+
+void ActorLineageSampler::run() {
+	auto interval = std::chrono::duration<double>(FLOW_KNOBS->ACTOR_LINEAGE_SAMPLING_INTERVAL);
+	std::unique_lock<std::mutex> lock(stopMutex);
+	while (!stopped.wait_for(lock, interval, [this]() { return stopping; })) {
+		// Take what the network thread handed over since the last round, then ask it for the next one
+		Reference<ActorLineage> running = sampledLineage.get();
+		if (running.isValid()) {
+			sampledLineage.replace(Reference<ActorLineage>());
+			int64_t priority = sampledPriority.load();
+			aggregate(running,
+			          priority < 0 ? Optional<TaskPriority>() : Optional<TaskPriority>(TaskPriority(priority)));
+		}
+		startSampling = true;
+
+		for (const auto& blocked : g_network->getActorLineageSet().copy()) {
+			aggregate(blocked, Optional<TaskPriority>());
+		}
+	}
+}
+
+std::string ActorLineageSampler::foldStack(const Reference<ActorLineage>& lineage, Optional<TaskPriority> priority) {
+	std::string folded;
+	appendFrame(folded, lineage->get(&OperationLineage::role).value_or(StringRef()));
+	appendFrame(folded, lineage->get(&OperationLineage::operation).value_or(StringRef()));
+	folded += ';';
+	folded += priority.present() ? std::to_string(static_cast<int64_t>(priority.get())) : "blocked";
+
+	// stack() returns the actor names leaf first
+	std::vector<StringRef> frames = lineage->stack(&StackLineage::actorName);
+	for (auto frame = frames.rbegin(); frame != frames.rend(); ++frame) {
+		appendFrame(folded, *frame);
+	}
+	return folded;
+}
+
+void ActorLineageSampler::aggregate(const Reference<ActorLineage>& lineage, Optional<TaskPriority> priority) {
+	std::string folded = foldStack(lineage, priority);
+	std::unique_lock<std::mutex> lock(mutex);
+	auto iter = counts.find(folded);
+	if (iter != counts.end()) {
+		++iter->second;
+	} else if (counts.size() < static_cast<size_t>(maxStacks)) {
+		counts.emplace(std::move(folded), 1);
+	} else {
+		++counts[otherStacks];
+	}
+}
+
+std::map<std::string, int64_t> ActorLineageSampler::takeFoldedStacks() {
+	std::map<std::string, int64_t> result;
+	std::unique_lock<std::mutex> lock(mutex);
+	result.swap(counts);
+	return result;
+}
+
+void ActorLineageSampler::traceFoldedStacks() {
+	std::map<std::string, int64_t> stacks = takeFoldedStacks();
+	int64_t total = 0;
+	std::vector<std::pair<int64_t, const std::string*>> byCount;
+	byCount.reserve(stacks.size());
+	for (const auto& [stack, count] : stacks) {
+		total += count;
+		byCount.emplace_back(count, &stack);
+	}
+	size_t top = std::min<size_t>(byCount.size(), std::max(0, FLOW_KNOBS->ACTOR_LINEAGE_TRACE_MAX_STACKS));
+	std::partial_sort(byCount.begin(), byCount.begin() + top, byCount.end(), [](const auto& a, const auto& b) {
+		return a.first > b.first;
+	});
+
+	TraceEvent("ActorLineageSamples").detail("Samples", total).detail("Stacks", stacks.size());
+	for (size_t i = 0; i < top; i++) {
+		TraceEvent("ActorLineageSample")
+		    .detail("Stack", *byCount[i].second)
+		    .detail("Count", byCount[i].first)
+		    .detail("Fraction", double(byCount[i].first) / total);
+	}
+}
+
+ACTOR Future<Void> runActorLineageSampler() {
+	// A sampler thread would make simulation nondeterministic
+	if (g_network->isSimulated() || FLOW_KNOBS->ACTOR_LINEAGE_SAMPLING_INTERVAL <= 0) {
+		return Void();
+	}
+	ActorLineageSampler::instance().start();
+	try {
+		loop {
+			wait(delay(FLOW_KNOBS->ACTOR_LINEAGE_TRACE_INTERVAL));
+			ActorLineageSampler::instance().traceFoldedStacks();
+		}
+	} catch (Error& e) {
+		ActorLineageSampler::instance().stop();
+		throw;
+	}
+}
+
+TEST_CASE("/flow/ActorLineageSampler/foldedStacks") {
+	ActorLineageSampler sampler(2);
+	LineageReference parent;
+	parent.allocate();
+	parent->modify(&OperationLineage::role) = "Storage"_sr;
+	parent->modify(&OperationLineage::operation) = "GetValue"_sr;
+	parent->modify(&StackLineage::actorName) = "serveGetValue"_sr;
+
+	LineageReference child;
+	{
+		LineageScope scope(&parent);
+		child.allocate();
+	}
+	child->modify(&StackLineage::actorName) = "readValue"_sr;
+
+	std::string running = "Storage;GetValue;" + std::to_string(static_cast<int64_t>(TaskPriority::DefaultEndpoint)) +
+	                      ";serveGetValue;readValue";
+	ASSERT_EQ(ActorLineageSampler::foldStack(child, TaskPriority::DefaultEndpoint), running);
+	std::string blocked = "Storage;GetValue;blocked;serveGetValue";
+	ASSERT_EQ(ActorLineageSampler::foldStack(parent, Optional<TaskPriority>()), blocked);
+
+	sampler.aggregate(child, TaskPriority::DefaultEndpoint);
+	sampler.aggregate(child, TaskPriority::DefaultEndpoint);
+	sampler.aggregate(parent, Optional<TaskPriority>());
+	// Only two distinct stacks are kept, so this one is counted as [other]
+	sampler.aggregate(child, TaskPriority::DefaultYield);
+
+	std::map<std::string, int64_t> stacks = sampler.takeFoldedStacks();
+	ASSERT_EQ(stacks.size(), size_t(3));
+	ASSERT_EQ(stacks[running], 2);
+	ASSERT_EQ(stacks[blocked], 1);
+	ASSERT_EQ(stacks["[other]"], 1);
+	ASSERT(sampler.takeFoldedStacks().empty());
+	return Void();
+}
+
+namespace {
+
+ACTOR Future<Void> switchLineages(int count) {
+	state int i = 0;
+	for (i = 0; i < count; i++) {
+		wait(delay(0));
+	}
+	return Void();
+}
+
+ACTOR Future<Void> blockOn(Future<Void> f) {
+	wait(f);
+	return Void();
+}
+
+} // namespace
+
+// What sampling costs the network thread: |count| (default 1e5) delay(0) round trips, each of which switches lineage,
+// with |blocked| (default 1000) actors waiting in the lineage set, first with the process wide sampler stopped and then
+// with it running.
+TEST_CASE("noSim/performance/flow/ActorLineageSampler/overhead") {
+	state int count = params.getInt("count").orDefault(100000);
+	int blocked = params.getInt("blocked").orDefault(1000);
+	state Promise<Void> never;
+	state std::vector<Future<Void>> waiting;
+	state bool wasRunning = ActorLineageSampler::instance().isRunning();
+	for (int i = 0; i < blocked; i++) {
+		waiting.push_back(blockOn(never.getFuture()));
+	}
+
+	ActorLineageSampler::instance().stop();
+	wait(runEventLoopBenchmark(params, "ActorLineageSampler/off", count, [n = count]() { return switchLineages(n); }));
+	ActorLineageSampler::instance().start();
+	wait(runEventLoopBenchmark(params, "ActorLineageSampler/on", count, [n = count]() { return switchLineages(n); }));
+	if (!wasRunning) {
+		ActorLineageSampler::instance().stop();
+	}
+	return Void();
+}
+#endif
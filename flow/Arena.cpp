@@ -22,6 +22,7 @@
 
 #include "flow/UnitTest.h"
 #include "flow/ScopeExit.h"
+#include "flow/SecureMemory.h"
 
 #include "flow/config.h"
 
@@ -105,6 +106,33 @@ void makeNoAccess(void*, size_t) {}
 void makeDefined(void*, size_t) {}
 void makeUndefined(void*, size_t) {}
 #endif
+
+// Blocks holding secrets come from the secure memory pool, whatever their size
+template <int Size>
+ArenaBlock* allocateFastBlock(IsSecureMem isSecure) {
+	return static_cast<ArenaBlock*>(isSecure ? allocateSecure(Size) : FastAllocator<Size>::allocate());
+}
+template <int Size>
+void releaseFastBlock(ArenaBlock* b) {
+	if (b->isSecure()) {
+		makeDefined(b, Size);
+		freeSecure(b, Size);
+	} else {
+		FastAllocator<Size>::release(b);
+	}
+}
+ArenaBlock* allocateBigBlock(int size, IsSecureMem isSecure) {
+	return reinterpret_cast<ArenaBlock*>(isSecure ? static_cast<uint8_t*>(allocateSecure(size))
+	                                              : allocateAndMaybeKeepalive(size));
+}
+void releaseBigBlock(ArenaBlock* b, int size) {
+	if (b->isSecure()) {
+		makeDefined(b, size);
+		freeSecure(b, size);
+	} else {
+		freeOrMaybeKeepalive(b);
+	}
+}
 } // namespace
 
 Arena::Arena() : impl(nullptr) {}
@@ -239,15 +267,6 @@ size_t ArenaBlock::estimatedTotalSize() const {
 	return totalSizeEstimate;
 }
 
-void ArenaBlock::wipeUsed() {
-	int dataOffset = isTiny() ? TINY_HEADER : sizeof(ArenaBlock);
-	void* dataBegin = (char*)getData() + dataOffset;
-	int dataSize = used() - dataOffset;
-	makeDefined(dataBegin, dataSize);
-	::memset(dataBegin, 0, dataSize);
-	makeNoAccess(dataBegin, dataSize);
-}
-
 // just for debugging:
 void ArenaBlock::getUniqueBlocks(std::set<ArenaBlock*>& a) {
 	a.insert(this);
@@ -330,38 +349,36 @@ void* ArenaBlock::dependOn4kAlignedBuffer(Reference<ArenaBlock>& self, uint32_t
 void* ArenaBlock::allocate(Reference<ArenaBlock>& self, int bytes, IsSecureMem isSecure) {
 	ArenaBlock* b = self.getPtr();
 	allowAccess(b);
-	if (!self || self->unused() < bytes) {
+	// Secrets only go into blocks from the secure memory pool, though other allocations may share those blocks
+	if (!self || self->unused() < bytes || (isSecure && !self->isSecure())) {
 		auto* tmp = b;
-		b = create(bytes, self);
+		b = create(bytes, self, isSecure);
 		disallowAccess(tmp);
 	}
 
 	void* result = (char*)b->getData() + b->addUsed(bytes);
-	if (isSecure)
-		b->secure = 1;
 	disallowAccess(b);
 	makeUndefined(result, bytes);
 	return result;
 }
 
 // Return an appropriately-sized ArenaBlock to store the given data
-ArenaBlock* ArenaBlock::create(int dataSize, Reference<ArenaBlock>& next) {
+ArenaBlock* ArenaBlock::create(int dataSize, Reference<ArenaBlock>& next, IsSecureMem isSecure) {
 	ArenaBlock* b;
-	// all blocks are initialized with no-wipe by default. allocate() sets it, if needed.
 	if (dataSize <= SMALL - TINY_HEADER && !next) {
 		static_assert(sizeof(ArenaBlock) <= 32); // Need to allocate at least sizeof(ArenaBlock) for an ArenaBlock*. See
 		                                         // https://github.com/apple/foundationdb/issues/6753
 		if (dataSize <= 32 - TINY_HEADER) {
-			b = (ArenaBlock*)FastAllocator<32>::allocate();
+			b = allocateFastBlock<32>(isSecure);
 			b->tinySize = 32;
 			INSTRUMENT_ALLOCATE("Arena32");
 		} else {
-			b = (ArenaBlock*)FastAllocator<64>::allocate();
+			b = allocateFastBlock<64>(isSecure);
 			b->tinySize = 64;
 			INSTRUMENT_ALLOCATE("Arena64");
 		}
 		b->tinyUsed = TINY_HEADER;
-		b->secure = 0;
+		b->secure = isSecure;
 
 	} else {
 		int reqSize = dataSize + sizeof(ArenaBlock);
@@ -378,48 +395,48 @@ ArenaBlock* ArenaBlock::create(int dataSize, Reference<ArenaBlock>& next) {
 
 		if (reqSize < LARGE) {
 			if (reqSize <= 128) {
-				b = (ArenaBlock*)FastAllocator<128>::allocate();
+				b = allocateFastBlock<128>(isSecure);
 				b->bigSize = 128;
 				INSTRUMENT_ALLOCATE("Arena128");
 			} else if (reqSize <= 256) {
-				b = (ArenaBlock*)FastAllocator<256>::allocate();
+				b = allocateFastBlock<256>(isSecure);
 				b->bigSize = 256;
 				INSTRUMENT_ALLOCATE("Arena256");
 			} else if (reqSize <= 512) {
-				b = (ArenaBlock*)allocateAndMaybeKeepalive(512);
+				b = allocateBigBlock(512, isSecure);
 				b->bigSize = 512;
 				INSTRUMENT_ALLOCATE("Arena512");
 			} else if (reqSize <= 1024) {
-				b = (ArenaBlock*)allocateAndMaybeKeepalive(1024);
+				b = allocateBigBlock(1024, isSecure);
 				b->bigSize = 1024;
 				INSTRUMENT_ALLOCATE("Arena1024");
 			} else if (reqSize <= 2048) {
-				b = (ArenaBlock*)allocateAndMaybeKeepalive(2048);
+				b = allocateBigBlock(2048, isSecure);
 				b->bigSize = 2048;
 				INSTRUMENT_ALLOCATE("Arena2048");
 			} else if (reqSize <= 4096) {
-				b = (ArenaBlock*)allocateAndMaybeKeepalive(4096);
+				b = allocateBigBlock(4096, isSecure);
 				b->bigSize = 4096;
 				INSTRUMENT_ALLOCATE("Arena4096");
 			} else {
-				b = (ArenaBlock*)allocateAndMaybeKeepalive(8192);
+				b = allocateBigBlock(8192, isSecure);
 				b->bigSize = 8192;
 				INSTRUMENT_ALLOCATE("Arena8192");
 			}
 			b->totalSizeEstimate = b->bigSize;
 			b->tinySize = b->tinyUsed = NOT_TINY;
 			b->bigUsed = sizeof(ArenaBlock);
-			b->secure = 0;
+			b->secure = isSecure;
 		} else {
 #ifdef ALLOC_INSTRUMENTATION
 			allocInstr["ArenaHugeKB"].alloc((reqSize + 1023) >> 10);
 #endif
-			b = (ArenaBlock*)allocateAndMaybeKeepalive(reqSize);
+			b = allocateBigBlock(reqSize, isSecure);
 			b->tinySize = b->tinyUsed = NOT_TINY;
 			b->bigSize = reqSize;
 			b->totalSizeEstimate = b->bigSize;
 			b->bigUsed = sizeof(ArenaBlock);
-			b->secure = 0;
+			b->secure = isSecure;
 
 #if !DEBUG_DETERMINISM
 			if (FLOW_KNOBS && g_allocation_tracing_disabled == 0 &&
@@ -429,7 +446,7 @@ ArenaBlock* ArenaBlock::create(int dataSize, Reference<ArenaBlock>& next) {
 				--g_allocation_tracing_disabled;
 			}
 #endif
-			g_hugeArenaMemory.fetch_add(reqSize);
+			g_hugeArenaMemory += reqSize;
 
 			// If the new block has less free space than the old block, make the old block depend on it
 			if (next && !next->isTiny() && next->unused() >= reqSize - dataSize) {
@@ -487,45 +504,43 @@ void ArenaBlock::destroy() {
 }
 
 void ArenaBlock::destroyLeaf() {
-	if (secure) {
-		wipeUsed();
-	}
+	// Secure blocks are wiped in full by freeSecure()
 	if (isTiny()) {
 		if (tinySize <= 32) {
-			FastAllocator<32>::release(this);
+			releaseFastBlock<32>(this);
 			INSTRUMENT_RELEASE("Arena32");
 		} else {
-			FastAllocator<64>::release(this);
+			releaseFastBlock<64>(this);
 			INSTRUMENT_RELEASE("Arena64");
 		}
 	} else {
 		if (bigSize <= 128) {
-			FastAllocator<128>::release(this);
+			releaseFastBlock<128>(this);
 			INSTRUMENT_RELEASE("Arena128");
 		} else if (bigSize <= 256) {
-			FastAllocator<256>::release(this);
+			releaseFastBlock<256>(this);
 			INSTRUMENT_RELEASE("Arena256");
 		} else if (bigSize <= 512) {
-			freeOrMaybeKeepalive(this);
+			releaseBigBlock(this, bigSize);
 			INSTRUMENT_RELEASE("Arena512");
 		} else if (bigSize <= 1024) {
-			freeOrMaybeKeepalive(this);
+			releaseBigBlock(this, bigSize);
 			INSTRUMENT_RELEASE("Arena1024");
 		} else if (bigSize <= 2048) {
-			freeOrMaybeKeepalive(this);
+			releaseBigBlock(this, bigSize);
 			INSTRUMENT_RELEASE("Arena2048");
 		} else if (bigSize <= 4096) {
-			freeOrMaybeKeepalive(this);
+			releaseBigBlock(this, bigSize);
 			INSTRUMENT_RELEASE("Arena4096");
 		} else if (bigSize <= 8192) {
-			freeOrMaybeKeepalive(this);
+			releaseBigBlock(this, bigSize);
 			INSTRUMENT_RELEASE("Arena8192");
 		} else {
 #ifdef ALLOC_INSTRUMENTATION
 			allocInstr["ArenaHugeKB"].dealloc((bigSize + 1023) >> 10);
 #endif
-			g_hugeArenaMemory.fetch_sub(bigSize);
-			freeOrMaybeKeepalive(this);
+			g_hugeArenaMemory -= bigSize;
+			releaseBigBlock(this, bigSize);
 		}
 	}
 }
@@ -21,19 +21,81 @@
 #include "fmt/format.h"
 #include "flow/Arena.h"
 #include "flow/DeterministicRandom.h"
+#include "flow/UnitTest.h"
 
 #include <cstring>
 
+uint64_t Xoshiro256::splitmix64(uint64_t& x) {
+	uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+Xoshiro256::Xoshiro256(uint64_t seed) {
+	for (auto& word : s) {
+		word = splitmix64(seed);
+	}
+}
+
+namespace {
+
+// Four xoshiro256** streams stepped in lockstep. Each state word of the four streams is kept in one array, so that the
+// compiler can hold it in a single vector register and generate four values per step.
+struct Xoshiro256x4 {
+	alignas(32) uint64_t s0[4], s1[4], s2[4], s3[4];
+
+	explicit Xoshiro256x4(const uint64_t seeds[4]) {
+		for (int lane = 0; lane < 4; lane++) {
+			uint64_t x = seeds[lane];
+			s0[lane] = Xoshiro256::splitmix64(x);
+			s1[lane] = Xoshiro256::splitmix64(x);
+			s2[lane] = Xoshiro256::splitmix64(x);
+			s3[lane] = Xoshiro256::splitmix64(x);
+		}
+	}
+
+	void next(uint64_t out[4]) {
+		for (int lane = 0; lane < 4; lane++) {
+			out[lane] = Xoshiro256::rotl(s1[lane] * 5, 7) * 9;
+			uint64_t t = s1[lane] << 17;
+			s2[lane] ^= s0[lane];
+			s3[lane] ^= s1[lane];
+			s1[lane] ^= s2[lane];
+			s0[lane] ^= s3[lane];
+			s2[lane] ^= t;
+			s3[lane] = Xoshiro256::rotl(s3[lane], 45);
+		}
+	}
+};
+
+// Fills of at least this many bytes use Xoshiro256x4, which costs four values of the main stream to seed
+constexpr int BULK_FILL_MIN_BYTES = 128;
+
+} // namespace
+
+uint64_t DeterministicRandom::generate() {
+	if (engine == RandomEngine::Xoshiro256) {
+		return xoshiro();
+	}
+	return (uint64_t((*mt)()) << 32) ^ (*mt)();
+}
+
 uint64_t DeterministicRandom::gen64() {
 	uint64_t curr = next;
-	next = (uint64_t(random()) << 32) ^ random();
+	next = generate();
 	if (TRACE_SAMPLE())
 		TraceEvent(SevSample, "Random").log();
 	return curr;
 }
 
-DeterministicRandom::DeterministicRandom(uint32_t seed, bool useRandLog)
-  : random((unsigned long)seed), next((uint64_t(random()) << 32) ^ random()), useRandLog(useRandLog) {}
+DeterministicRandom::DeterministicRandom(uint32_t seed, bool useRandLog, RandomEngine engine)
+  : engine(engine), xoshiro(seed), useRandLog(useRandLog) {
+	if (engine == RandomEngine::MT19937) {
+		mt.emplace((unsigned long)seed);
+	}
+	next = generate();
+}
 
 double DeterministicRandom::random01() {
 	double d = gen64() / double(uint64_t(-1));
@@ -94,7 +156,7 @@ uint32_t DeterministicRandom::randomSkewedUInt32(uint32_t min, uint32_t maxPlusO
 	ASSERT_LT(min, maxPlusOne);
 	std::uniform_real_distribution<double> distribution(std::log(std::max<double>(min, 1.0 / M_E)),
 	                                                    std::log(maxPlusOne));
-	double exponent = distribution(random);
+	double exponent = engine == RandomEngine::Xoshiro256 ? distribution(xoshiro) : distribution(*mt);
 	uint32_t value = static_cast<uint32_t>(std::pow(M_E, exponent));
 	return std::max(std::min(value, maxPlusOne - 1), min);
 }
@@ -119,16 +181,54 @@ char DeterministicRandom::randomAlphaNumeric() {
 std::string DeterministicRandom::randomAlphaNumeric(int length) {
 	std::string s;
 	s.reserve(length);
-	for (int i = 0; i < length; i++)
-		s += randomAlphaNumeric();
+	if (engine == RandomEngine::MT19937) {
+		for (int i = 0; i < length; i++)
+			s += randomAlphaNumeric();
+		return s;
+	}
+
+	// Up to ten characters from each value, six bits at a time, skipping the two values past the alphabet
+	static const char alphanum[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+	while ((int)s.size() < length) {
+		uint64_t bits = gen64();
+		for (int i = 0; i < 10 && (int)s.size() < length; i++, bits >>= 6) {
+			if ((bits & 63) < 62) {
+				s += alphanum[bits & 63];
+			}
+		}
+	}
+	if (randLog && useRandLog)
+		fmt::print(randLog, "Rstr {}\n", s);
 	return s;
 }
 
+void DeterministicRandom::randomBytesBulk(uint8_t* buf, int length) {
+	uint64_t seeds[4];
+	for (auto& seed : seeds) {
+		seed = gen64();
+	}
+	Xoshiro256x4 streams(seeds);
+	uint64_t block[4];
+	int i = 0;
+	for (; i + (int)sizeof(block) <= length; i += sizeof(block)) {
+		streams.next(block);
+		memcpy(buf + i, block, sizeof(block));
+	}
+	if (i < length) {
+		streams.next(block);
+		memcpy(buf + i, block, length - i);
+	}
+}
+
 void DeterministicRandom::randomBytes(uint8_t* buf, int length) {
-	constexpr const int unitLen = sizeof(decltype(gen64()));
-	for (int i = 0; i < length; i += unitLen) {
-		auto val = gen64();
-		memcpy(buf + i, &val, std::min(unitLen, length - i));
+	if (engine == RandomEngine::Xoshiro256 && length >= BULK_FILL_MIN_BYTES) {
+		randomBytesBulk(buf, length);
+	} else {
+		constexpr const int unitLen = sizeof(decltype(gen64()));
+		for (int i = 0; i < length; i += unitLen) {
+			auto val = gen64();
+			memcpy(buf + i, &val, std::min(unitLen, length - i));
+		}
 	}
 	if (randLog && useRandLog) {
 		constexpr const int cutOff = 32;
@@ -151,3 +251,59 @@ void DeterministicRandom::addref() {
 void DeterministicRandom::delref() {
 	ReferenceCounted<DeterministicRandom>::delref();
 }
+
+TEST_CASE("/flow/DeterministicRandom/engines") {
+	for (auto engine : { RandomEngine::MT19937, RandomEngine::Xoshiro256 }) {
+		DeterministicRandom a(42, false, engine), b(42, false, engine), c(43, false, engine);
+		ASSERT(a.peek() == b.peek() && a.peek() != c.peek());
+
+		// Every entry point, including the bulk ones, is reproducible for a seed
+		for (int length : { 7, 100, 128, 1000 }) {
+			std::vector<uint8_t> bytesA(length), bytesB(length);
+			a.randomBytes(bytesA.data(), length);
+			b.randomBytes(bytesB.data(), length);
+			ASSERT(bytesA == bytesB);
+			ASSERT(a.randomAlphaNumeric(length) == b.randomAlphaNumeric(length));
+			ASSERT(a.randomSkewedUInt32(1, 1000) == b.randomSkewedUInt32(1, 1000));
+			ASSERT(a.randomUniqueID() == b.randomUniqueID());
+		}
+
+		std::string s = a.randomAlphaNumeric(1000);
+		ASSERT(s.size() == 1000 && std::all_of(s.begin(), s.end(), [](char ch) { return isalnum(ch); }));
+
+		// Every byte value should turn up in a large fill
+		std::vector<uint8_t> bytes(1 << 16);
+		a.randomBytes(bytes.data(), bytes.size());
+		std::vector<int> counts(256);
+		for (uint8_t byte : bytes) {
+			counts[byte]++;
+		}
+		ASSERT(*std::min_element(counts.begin(), counts.end()) > 128);
+	}
+	return Void();
+}
+
+TEST_CASE("noSim/performance/flow/DeterministicRandom") {
+	for (auto engine : { RandomEngine::MT19937, RandomEngine::Xoshiro256 }) {
+		DeterministicRandom random(1, false, engine);
+		const char* name = engine == RandomEngine::MT19937 ? "mt19937" : "xoshiro256**";
+
+		const int count = 10000000;
+		uint64_t sum = 0;
+		runBenchmark(params, format("DeterministicRandom/%s/randomUInt64", name), count, [&]() {
+			for (int i = 0; i < count; i++) {
+				sum += random.randomUInt64();
+			}
+		});
+		ASSERT(sum != 0);
+
+		// One op per byte
+		std::vector<uint8_t> buf(1 << 20);
+		runBenchmark(params, format("DeterministicRandom/%s/randomBytes", name), 256 * buf.size(), [&]() {
+			for (int i = 0; i < 256; i++) {
+				random.randomBytes(buf.data(), buf.size());
+			}
+		});
+	}
+	return Void();
+}
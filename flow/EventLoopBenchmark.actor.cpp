@@ -0,0 +1,320 @@
+/*
+ * EventLoopBenchmark.actor.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Micro-benchmarks for the run loop primitives which dominate the cost of flow programs. They run on the real Net2
+// network, so they are all noSim, and their results are recorded like runBenchmark()'s so they can be compared
+// against a baseline.
+
+#include <thread>
+
+#include "flow/ActorCollection.h"
+#include "flow/ThreadHelper.actor.h"
+#include "flow/UnitTest.h"
+#include "flow/flow.h"
+#include "flow/actorcompiler.h" // This must be the last #include.
+
+// Times each run of |body| as runBenchmark() does, but waits for the future it returns
+ACTOR Future<Void> runEventLoopBenchmark(UnitTestParameters params,
+                                         std::string name,
+                                         int64_t opsPerRun,
+                                         std::function<Future<Void>()> body) {
+	state BenchmarkResult result = prepareBenchmark(params, name, opsPerRun);
+	state int i = 0;
+	state double start = 0;
+	state int64_t allocations = 0;
+
+	for (i = 0; i < result.warmupRuns; i++) {
+		wait(body());
+	}
+	allocations = fastAllocatorAllocations();
+	for (i = 0; i < result.repetitions; i++) {
+		start = timer_monotonic();
+		wait(body());
+		result.runSeconds.push_back(timer_monotonic() - start);
+	}
+	if (allocations >= 0) {
+		result.allocationsPerOp =
+		    double(fastAllocatorAllocations() - allocations) / (double(opsPerRun) * result.repetitions);
+	}
+	recordBenchmark(params, result);
+	return Void();
+}
+
+namespace {
+
+ACTOR Future<Void> delayLoop(int count) {
+	state int i = 0;
+	for (i = 0; i < count; i++) {
+		wait(delay(0));
+	}
+	return Void();
+}
+
+ACTOR Future<Void> yieldLoop(int count) {
+	state int i = 0;
+	for (i = 0; i < count; i++) {
+		wait(yield());
+	}
+	return Void();
+}
+
+ACTOR Future<Void> waitFor(Future<Void> f) {
+	wait(f);
+	return Void();
+}
+
+ACTOR Future<Void> sendToWake(int count) {
+	state int i = 0;
+	for (i = 0; i < count; i++) {
+		Promise<Void> p;
+		Future<Void> woken = waitFor(p.getFuture());
+		p.send(Void());
+		ASSERT(woken.isReady());
+	}
+	return Void();
+}
+
+ACTOR Future<Void> consume(FutureStream<int> stream, int count) {
+	state int64_t sum = 0;
+	state int i = 0;
+	for (i = 0; i < count; i++) {
+		int v = waitNext(stream);
+		sum += v;
+	}
+	ASSERT(sum == int64_t(count) * (count - 1) / 2);
+	return Void();
+}
+
+ACTOR Future<Void> streamThroughput(int count) {
+	state PromiseStream<int> stream;
+	state Future<Void> consumer = consume(stream.getFuture(), count);
+	state int i = 0;
+	for (i = 0; i < count; i++) {
+		stream.send(i);
+		// Let the consumer fall behind and catch up in batches, as a busy server would
+		if (i % 1000 == 999) {
+			wait(delay(0));
+		}
+	}
+	wait(consumer);
+	return Void();
+}
+
+// A thread which makes |count| onMainThread() calls one after another, then signals |done| on the network thread
+struct OnMainThreadCaller {
+	int count;
+	Promise<Void>* done;
+
+	void operator()() {
+		for (int i = 0; i < count; i++) {
+			onMainThread([]() -> Future<Void> { return Void(); }).blockUntilReady();
+		}
+		Promise<Void>* done = this->done;
+		onMainThreadVoid([done]() { done->send(Void()); });
+	}
+};
+
+ACTOR Future<Void> onMainThreadRoundTrips(int count) {
+	state Promise<Void> done;
+	state std::thread caller = std::thread{ OnMainThreadCaller{ count, &done } };
+	wait(done.getFuture());
+	caller.join();
+	return Void();
+}
+
+ACTOR Future<Void> actorCollectionAdd(int count) {
+	state ActorCollection actors;
+	state std::vector<Promise<Void>> promises;
+	state int i = 0;
+	promises.resize(count);
+	for (i = 0; i < count; i++) {
+		actors.add(promises[i].getFuture());
+	}
+	for (i = 0; i < count; i++) {
+		promises[i].send(Void());
+	}
+	wait(delay(0));
+	return Void();
+}
+
+ACTOR Future<Void> fanIn(FutureStream<int> a,
+                         FutureStream<int> b,
+                         FutureStream<int> c,
+                         FutureStream<int> d,
+                         int count) {
+	state int received = 0;
+	loop {
+		choose {
+			when(int v = waitNext(a)) {}
+			when(int v = waitNext(b)) {}
+			when(int v = waitNext(c)) {}
+			when(int v = waitNext(d)) {}
+		}
+		if (++received == count) {
+			return Void();
+		}
+	}
+}
+
+ACTOR Future<Void> chooseFanIn(int count) {
+	state std::vector<PromiseStream<int>> streams;
+	state Future<Void> receiver;
+	state int i = 0;
+	streams.resize(4);
+	receiver =
+	    fanIn(streams[0].getFuture(), streams[1].getFuture(), streams[2].getFuture(), streams[3].getFuture(), count);
+	for (i = 0; i < count; i++) {
+		streams[i % streams.size()].send(i);
+	}
+	wait(receiver);
+	return Void();
+}
+
+// An ordinary function which reports failure the usual way outside of actors, by throwing
+int throwingStep(int i) {
+	if (i % 2) {
+		throw future_version();
+	}
+	return i;
+}
+
+// Expected errors caught by a C++ exception handler, from a helper which throws
+ACTOR Future<Void> errorsByThrowing(int count) {
+	state int failures = 0;
+	state int i = 0;
+	for (i = 0; i < count; i++) {
+		try {
+			throwingStep(i);
+		} catch (Error& e) {
+			failures++;
+		}
+	}
+	ASSERT(failures == count / 2);
+	return Void();
+}
+
+// Expected errors from a wait() which the actor compiler routes to the catch block without throwing
+ACTOR Future<Void> errorsByCatch(int count) {
+	state int failures = 0;
+	state int i = 0;
+	for (i = 0; i < count; i++) {
+		try {
+			Promise<int> p;
+			Future<int> f = p.getFuture();
+			if (i % 2) {
+				p.sendError(future_version());
+			} else {
+				p.send(i);
+			}
+			int v = wait(f);
+			(void)v;
+		} catch (Error& e) {
+			failures++;
+		}
+	}
+	ASSERT(failures == count / 2);
+	return Void();
+}
+
+// Expected errors from waitErrorOr(), which needs no catch block at all
+ACTOR Future<Void> errorsByErrorOr(int count) {
+	state int failures = 0;
+	state int i = 0;
+	for (i = 0; i < count; i++) {
+		Promise<int> p;
+		Future<int> f = p.getFuture();
+		if (i % 2) {
+			p.sendError(future_version());
+		} else {
+			p.send(i);
+		}
+		ErrorOr<int> v = waitErrorOr(f);
+		failures += v.isError();
+	}
+	ASSERT(failures == count / 2);
+	return Void();
+}
+
+} // namespace
+
+TEST_CASE("noSim/performance/flow/EventLoop/delay0") {
+	int count = params.getInt("count").orDefault(100000);
+	wait(runEventLoopBenchmark(params, "EventLoop/delay0", count, [count]() { return delayLoop(count); }));
+	return Void();
+}
+
+TEST_CASE("noSim/performance/flow/EventLoop/yield") {
+	int count = params.getInt("count").orDefault(1000000);
+	wait(runEventLoopBenchmark(params, "EventLoop/yield", count, [count]() { return yieldLoop(count); }));
+	return Void();
+}
+
+TEST_CASE("noSim/performance/flow/EventLoop/sendToWake") {
+	int count = params.getInt("count").orDefault(1000000);
+	wait(runEventLoopBenchmark(params, "EventLoop/sendToWake", count, [count]() { return sendToWake(count); }));
+	return Void();
+}
+
+TEST_CASE("noSim/performance/flow/EventLoop/PromiseStream") {
+	int count = params.getInt("count").orDefault(1000000);
+	wait(runEventLoopBenchmark(
+	    params, "EventLoop/PromiseStream", count, [count]() { return streamThroughput(count); }));
+	return Void();
+}
+
+TEST_CASE("noSim/performance/flow/EventLoop/onMainThread") {
+	int count = params.getInt("count").orDefault(20000);
+	wait(runEventLoopBenchmark(
+	    params, "EventLoop/onMainThread", count, [count]() { return onMainThreadRoundTrips(count); }));
+	return Void();
+}
+
+TEST_CASE("noSim/performance/flow/EventLoop/ActorCollection") {
+	int count = params.getInt("count").orDefault(100000);
+	wait(runEventLoopBenchmark(
+	    params, "EventLoop/ActorCollection", count, [count]() { return actorCollectionAdd(count); }));
+	return Void();
+}
+
+TEST_CASE("noSim/performance/flow/EventLoop/chooseFanIn") {
+	int count = params.getInt("count").orDefault(1000000);
+	wait(runEventLoopBenchmark(params, "EventLoop/chooseFanIn", count, [count]() { return chooseFanIn(count); }));
+	return Void();
+}
+
+TEST_CASE("noSim/performance/flow/EventLoop/errorsByThrowing") {
+	int count = params.getInt("count").orDefault(100000);
+	wait(runEventLoopBenchmark(
+	    params, "EventLoop/errorsByThrowing", count, [count]() { return errorsByThrowing(count); }));
+	return Void();
+}
+
+TEST_CASE("noSim/performance/flow/EventLoop/errorsByCatch") {
+	int count = params.getInt("count").orDefault(1000000);
+	wait(runEventLoopBenchmark(params, "EventLoop/errorsByCatch", count, [count]() { return errorsByCatch(count); }));
+	return Void();
+}
+
+TEST_CASE("noSim/performance/flow/EventLoop/errorsByErrorOr") {
+	int count = params.getInt("count").orDefault(1000000);
+	wait(runEventLoopBenchmark(
+	    params, "EventLoop/errorsByErrorOr", count, [count]() { return errorsByErrorOr(count); }));
+	return Void();
+}
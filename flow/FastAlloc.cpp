@@ -112,7 +112,7 @@ bool valgrindPrecise() {
 template <int Size>
 void* FastAllocator<Size>::freelist = nullptr;
 
-std::atomic<int64_t> g_hugeArenaMemory(0);
+StripedCounter g_hugeArenaMemory;
 
 double hugeArenaLastLogged = 0;
 std::map<std::string, std::pair<int, int64_t>> hugeArenaTraces;
@@ -150,6 +150,18 @@ thread_local bool memSample_entered = false;
 thread_local bool inRecordAllocation = false;
 #endif
 
+#ifdef FLOW_COUNT_ALLOCATIONS
+static thread_local int64_t fastAllocations = 0;
+#endif
+
+int64_t fastAllocatorAllocations() {
+#ifdef FLOW_COUNT_ALLOCATIONS
+	return fastAllocations;
+#else
+	return -1;
+#endif
+}
+
 void recordAllocation(void* ptr, size_t size) {
 #ifdef ALLOC_INSTRUMENTATION_STDOUT
 	if (inRecordAllocation)
@@ -370,6 +382,9 @@ std::vector<std::pair<const uint8_t*, int>> const& getWipedAreaSet() {
 
 template <int Size>
 void* FastAllocator<Size>::allocate() {
+#ifdef FLOW_COUNT_ALLOCATIONS
+	++fastAllocations;
+#endif
 	if (keepalive_allocator::isActive()) [[unlikely]]
 		return keepalive_allocator::allocate(Size);
 
@@ -0,0 +1,241 @@
+/*
+ * IRateControl.actor.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flow/IRateControl.h"
+#include "flow/UnitTest.h"
+#include "flow/actorcompiler.h" // This must be the last #include.
+
+namespace {
+
+// The shortest interval a node's timer waits, so that rounding in timeUntilGrantable() cannot make it spin
+constexpr double MIN_WAKE_INTERVAL = 0.001;
+
+} // namespace
+
+HierarchicalSpeedLimit::HierarchicalSpeedLimit(double rate,
+                                               double ceil,
+                                               double burst,
+                                               Reference<HierarchicalSpeedLimit> parent)
+  : parent(parent), rate(rate), ceil(ceil), burst(burst), cburst(burst * ceil / rate), tokens(burst), ctokens(cburst),
+    lastRefill(now()), statsStart(now()) {
+	ASSERT(rate > 0 && ceil >= rate && burst > 0);
+}
+
+HierarchicalSpeedLimit::~HierarchicalSpeedLimit() {
+	killWaiters(broken_promise());
+}
+
+void HierarchicalSpeedLimit::refill() {
+	double t = now();
+	double elapsed = t - lastRefill;
+	if (elapsed > 0) {
+		tokens = std::min(burst, tokens + elapsed * rate);
+		ctokens = std::min(cburst, ctokens + elapsed * ceil);
+		lastRefill = t;
+	}
+	if (parent) {
+		parent->refill();
+	}
+}
+
+bool HierarchicalSpeedLimit::canGrant(double n) const {
+	if (ctokens < std::min(n, cburst)) {
+		return false;
+	}
+	return tokens >= std::min(n, burst) || (parent && parent->waiters.empty() && parent->canGrant(n));
+}
+
+void HierarchicalSpeedLimit::charge(double n) {
+	tokens -= n;
+	ctokens -= n;
+	stats.unitsGranted += n;
+	if (parent) {
+		parent->charge(n);
+	}
+}
+
+double HierarchicalSpeedLimit::timeUntilGrantable(double n) const {
+	double ceilWait = std::max(0.0, (std::min(n, cburst) - ctokens) / ceil);
+	double ownWait = std::max(0.0, (std::min(n, burst) - tokens) / rate);
+	double borrowWait = std::numeric_limits<double>::infinity();
+	if (parent) {
+		// The parent's first waiter has to be granted before this node can borrow
+		borrowWait = parent->timeUntilGrantable(parent->waiters.empty() ? n : parent->waiters.front().n + n);
+	}
+	return std::max(ceilWait, std::min(ownWait, borrowWait));
+}
+
+void HierarchicalSpeedLimit::recordGrant(double waitSeconds) {
+	++stats.grants;
+	if (waitSeconds > 0) {
+		++stats.grantsDelayed;
+		stats.totalWaitSeconds += waitSeconds;
+	}
+}
+
+void HierarchicalSpeedLimit::grantWaiters() {
+	refill();
+	while (!waiters.empty() && canGrant(waiters.front().n)) {
+		Waiter w = std::move(waiters.front());
+		waiters.pop_front();
+		charge(w.n);
+		recordGrant(now() - w.queuedTime);
+		w.promise.send(Void());
+	}
+}
+
+ACTOR Future<Void> HierarchicalSpeedLimit::dispatch(HierarchicalSpeedLimit* self) {
+	loop {
+		self->grantWaiters();
+		if (self->waiters.empty()) {
+			return Void();
+		}
+		wait(delay(std::max(MIN_WAKE_INTERVAL, self->timeUntilGrantable(self->waiters.front().n))));
+	}
+}
+
+Future<Void> HierarchicalSpeedLimit::getAllowance(unsigned int n) {
+	refill();
+	if (waiters.empty() && canGrant(n)) {
+		charge(n);
+		recordGrant(0);
+		return Void();
+	}
+	waiters.push_back(Waiter{ n, now(), Promise<Void>() });
+	Future<Void> granted = waiters.back().promise.getFuture();
+	if (!dispatcher.isValid() || dispatcher.isReady()) {
+		dispatcher = dispatch(this);
+	}
+	return granted;
+}
+
+void HierarchicalSpeedLimit::returnUnused(int n) {
+	if (n <= 0) {
+		return;
+	}
+	refill();
+	for (HierarchicalSpeedLimit* node = this; node != nullptr; node = node->parent.getPtr()) {
+		node->tokens = std::min(node->burst, node->tokens + n);
+		node->ctokens = std::min(node->cburst, node->ctokens + n);
+		node->stats.unitsGranted -= std::min<int64_t>(n, node->stats.unitsGranted);
+	}
+}
+
+void HierarchicalSpeedLimit::wakeWaiters() {
+	Deque<Waiter> woken;
+	std::swap(woken, waiters);
+	while (!woken.empty()) {
+		recordGrant(now() - woken.front().queuedTime);
+		woken.front().promise.send(Void());
+		woken.pop_front();
+	}
+}
+
+void HierarchicalSpeedLimit::killWaiters(const Error& e) {
+	Deque<Waiter> killed;
+	std::swap(killed, waiters);
+	while (!killed.empty()) {
+		killed.front().promise.sendError(e);
+		killed.pop_front();
+	}
+}
+
+HierarchicalSpeedLimit::Stats HierarchicalSpeedLimit::getStats() const {
+	Stats s = stats;
+	s.queueLength = waiters.size();
+	double elapsed = now() - statsStart;
+	if (elapsed > 0) {
+		s.utilization = s.unitsGranted / (elapsed * rate);
+		s.ceilUtilization = s.unitsGranted / (elapsed * ceil);
+	}
+	return s;
+}
+
+void HierarchicalSpeedLimit::resetStats() {
+	stats = Stats();
+	statsStart = now();
+}
+
+TEST_CASE("/flow/HierarchicalSpeedLimit/borrow") {
+	state Reference<HierarchicalSpeedLimit> root =
+	    makeReference<HierarchicalSpeedLimit>(1000, 100, Reference<HierarchicalSpeedLimit>());
+	state Reference<HierarchicalSpeedLimit> a = makeReference<HierarchicalSpeedLimit>(10, 1000, 10, root);
+	state Reference<HierarchicalSpeedLimit> b = makeReference<HierarchicalSpeedLimit>(10, 1000, 10, root);
+
+	// a may use its own bucket and then borrow from the root, and what it borrows is no longer available to b.
+	ASSERT(a->getAllowance(10).isReady());
+	ASSERT(a->getAllowance(80).isReady());
+	ASSERT(a->getStats().unitsGranted == 90);
+	ASSERT(root->getStats().unitsGranted == 90);
+	ASSERT(b->getAllowance(10).isReady());
+	ASSERT(root->getStats().unitsGranted == 100);
+	state Future<Void> blocked = b->getAllowance(10);
+	ASSERT(!blocked.isReady());
+	ASSERT(b->getStats().queueLength == 1);
+	ASSERT(root->getStats().unitsGranted == 100);
+
+	// Returned units go back up the hierarchy and the waiter is granted when its node's timer fires.
+	a->returnUnused(50);
+	wait(blocked);
+	ASSERT(b->getStats().grantsDelayed == 1);
+	ASSERT(root->getStats().unitsGranted == 60);
+
+	return Void();
+}
+
+TEST_CASE("/flow/HierarchicalSpeedLimit/parentWaiters") {
+	state Reference<HierarchicalSpeedLimit> root =
+	    makeReference<HierarchicalSpeedLimit>(1000, 100, Reference<HierarchicalSpeedLimit>());
+	state Reference<HierarchicalSpeedLimit> child = makeReference<HierarchicalSpeedLimit>(10, 1000, 10, root);
+
+	// Once the root has a waiter, the child is limited to its own bucket until that waiter is granted.
+	ASSERT(root->getAllowance(60).isReady());
+	state Future<Void> rootWaiter = root->getAllowance(50);
+	ASSERT(!rootWaiter.isReady());
+	ASSERT(child->getAllowance(10).isReady());
+	state Future<Void> borrow = child->getAllowance(30);
+	ASSERT(!borrow.isReady());
+	ASSERT(root->getStats().unitsGranted == 70);
+
+	wait(borrow);
+	ASSERT(rootWaiter.isReady());
+	ASSERT(root->getStats().unitsGranted == 150);
+
+	return Void();
+}
+
+TEST_CASE("/flow/HierarchicalSpeedLimit/fifo") {
+	state Reference<HierarchicalSpeedLimit> node =
+	    makeReference<HierarchicalSpeedLimit>(1000, 10, Reference<HierarchicalSpeedLimit>());
+	ASSERT(node->getAllowance(10).isReady());
+
+	// Waiters are granted in order even when a later one could be granted earlier.
+	state Future<Void> large = node->getAllowance(10);
+	state Future<Void> small = node->getAllowance(1);
+	ASSERT(!large.isReady() && !small.isReady());
+	wait(small);
+	ASSERT(large.isReady());
+
+	state Future<Void> killed = node->getAllowance(1000);
+	node->killWaiters(operation_cancelled());
+	ASSERT(killed.isError() && killed.getError().code() == error_code_operation_cancelled);
+
+	return Void();
+}
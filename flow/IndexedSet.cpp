@@ -241,13 +241,15 @@ struct IndexedSetHarness {
 	const_result upper_bound(K const& k) const { return s.upper_bound(k); }
 	result upper_bound(K const& k) { return s.upper_bound(k); }
 	void erase(K const& k) { s.erase(k); }
+	void clear() { s.clear(); }
 };
 
+// Each operation of treeBenchmark() on |keyCount| (default 1e6) random keys, in an IndexedSet and a std::map
 TEST_CASE("performance/map/StringRef/IndexedSet") {
 	Arena arena;
 
 	IndexedSetHarness<StringRef> is;
-	treeBenchmark(is, [&arena]() { return randomStr(arena); });
+	treeBenchmark(params, "map/StringRef/IndexedSet", is, [&arena]() { return randomStr(arena); });
 
 	return Void();
 }
@@ -256,70 +258,65 @@ TEST_CASE("performance/map/StringRef/StdMap") {
 	Arena arena;
 
 	MapHarness<StringRef> is;
-	treeBenchmark(is, [&arena]() { return randomStr(arena); });
+	treeBenchmark(params, "map/StringRef/StdMap", is, [&arena]() { return randomStr(arena); });
 
 	return Void();
 }
 
 TEST_CASE("performance/map/int/IndexedSet") {
 	IndexedSetHarness<int> is;
-	treeBenchmark(is, &randomInt);
+	treeBenchmark(params, "map/int/IndexedSet", is, &randomInt);
 
 	return Void();
 }
 
 TEST_CASE("performance/map/int/StdMap") {
 	MapHarness<int> is;
-	treeBenchmark(is, &randomInt);
+	treeBenchmark(params, "map/int/StdMap", is, &randomInt);
 
 	return Void();
 }
 
+// Inserts, finds and erases of |count| (default 1e6) random integers, in an IndexedSet with and without a metric
 TEST_CASE("performance/flow/IndexedSet/integers") {
 	std::mt19937_64 urng(deterministicRandom()->randomUInt32());
+	int count = params.getInt("count").orDefault(1000000);
 
 	std::vector<int> x;
-	x.reserve(1000000);
-	for (int i = 0; i < 1000000; i++)
+	x.reserve(count);
+	for (int i = 0; i < count; i++)
 		x.push_back(deterministicRandom()->randomInt(0, 10000000));
 
 	IndexedSet<int, int> is;
-	double start = timer();
-	for (int i = 0; i < x.size(); i++) {
-		int t = x[i];
-		is.insert(std::move(t), 3);
-	}
-	double end = timer();
-	double kps = x.size() / 1000.0 / (end - start);
-	printf("%0.1f Kinsert/sec\n", kps);
-
-	start = timer();
-	for (int i = 0; i < x.size(); i++)
-		ASSERT(is.find(x[i]) != is.end());
-	end = timer();
-	kps = x.size() / 1000.0 / (end - start);
-	printf("%0.1f Kfind/sec\n", kps);
-
-	{
-		// std::set<int> ss;
-		IndexedSet<int, NoMetric> ss;
-		double start = timer();
+	auto insertAll = [&]() {
 		for (int i = 0; i < x.size(); i++) {
 			int t = x[i];
-			ss.insert(t, NoMetric());
+			is.insert(std::move(t), 3);
 		}
-		double end = timer();
-		printf("%0.1f Kinsert/sec (set)\n", x.size() / 1000.0 / (end - start));
-
-		start = timer();
+	};
+	runBenchmark(params, "IndexedSet/integers/insert", x.size(), insertAll, [&]() { is.clear(); });
+	insertAll();
+	runBenchmark(params, "IndexedSet/integers/find", x.size(), [&]() {
 		for (int i = 0; i < x.size(); i++)
-			ASSERT(ss.find(x[i]) != ss.end());
-		end = timer();
-		printf("%0.1f Kfind/sec\n", x.size() / 1000.0 / (end - start));
-	}
+			ASSERT(is.find(x[i]) != is.end());
+	});
 
-	for (int i = 0; i < x.size(); i++)
-		ASSERT(is.find(x[i]) != is.end());
+	{
+		IndexedSet<int, NoMetric> ss;
+		auto insertAllNoMetric = [&]() {
+			for (int i = 0; i < x.size(); i++) {
+				int t = x[i];
+				ss.insert(t, NoMetric());
+			}
+		};
+		runBenchmark(
+		    params, "IndexedSet/integers/insertNoMetric", x.size(), insertAllNoMetric, [&]() { ss.clear(); });
+		insertAllNoMetric();
+		runBenchmark(params, "IndexedSet/integers/findNoMetric", x.size(), [&]() {
+			for (int i = 0; i < x.size(); i++)
+				ASSERT(ss.find(x[i]) != ss.end());
+		});
+	}
 
 	ASSERT(is.find(-6) == is.end());
 
@@ -334,50 +331,49 @@ TEST_CASE("performance/flow/IndexedSet/integers") {
 	is.testonly_assertBalanced();
 
 	std::shuffle(x.begin(), x.end(), urng);
-	start = timer();
-	for (int i = 0; i < x.size(); i++) {
-		is.erase(x[i]);
-	}
-	end = timer();
-	is.testonly_assertBalanced();
-
-	printf("%0.1f Kerase/sec\n", x.size() / 1000.0 / (end - start));
-	is.testonly_assertBalanced();
-	for (int i = 0; i < x.size() / 2; i++) {
-		ASSERT(is.find(x[i]) == is.end());
-	}
+	runBenchmark(
+	    params,
+	    "IndexedSet/integers/erase",
+	    x.size(),
+	    [&]() {
+		    for (int i = 0; i < x.size(); i++) {
+			    is.erase(x[i]);
+		    }
+	    },
+	    [&]() {
+		    is.testonly_assertBalanced();
+		    ASSERT(is.begin() == is.end());
+		    insertAll();
+	    });
 
 	return Void();
 }
 
+// Finds of one string key, in a Map and a std::map, |count| (default 1e6) times per run
 TEST_CASE("performance/flow/IndexedSet/strings") {
-	constexpr size_t count = 1000000;
+	int count = params.getInt("count").orDefault(1000000);
 	Map<std::string, int> myMap;
 	std::map<std::string, int> aMap;
-	double start, end;
-	int tt = 0;
 
 	std::string const hello{ "Hello" };
 	myMap[hello] = 1;
 	aMap["Hello"] = 1;
 
-	start = timer();
-
-	for (size_t i = 0; i < count; i++) {
-		tt += myMap.find(hello)->value;
-	}
-	end = timer();
-
-	ASSERT(tt == count);
-
-	printf("%0.1f Map.KfindStr/sec\n", count / 1000.0 / (end - start));
+	runBenchmark(params, "IndexedSet/strings/Map/find", count, [&]() {
+		int tt = 0;
+		for (int i = 0; i < count; i++) {
+			tt += myMap.find(hello)->value;
+		}
+		ASSERT(tt == count);
+	});
 
-	start = timer();
-	for (size_t i = 0; i < count; i++) {
-		aMap.find(hello);
-	}
-	end = timer();
-	printf("%0.1f std::map.KfindStr/sec\n", count / 1000.0 / (end - start));
+	runBenchmark(params, "IndexedSet/strings/std::map/find", count, [&]() {
+		int tt = 0;
+		for (int i = 0; i < count; i++) {
+			tt += aMap.find(hello)->second;
+		}
+		ASSERT(tt == count);
+	});
 
 	return Void();
 }
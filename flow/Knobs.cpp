@@ -49,6 +49,11 @@ void FlowKnobs::initialize(Randomize randomize, IsSimulated isSimulated) {
 	init( HOSTNAME_RECONNECT_INIT_INTERVAL,                    .05 );
 	init( HOSTNAME_RECONNECT_MAX_INTERVAL,                     1.0 );
 	init( ENABLE_COORDINATOR_DNS_CACHE,                      false ); if( randomize && BUGGIFY ) ENABLE_COORDINATOR_DNS_CACHE = true;
+	init( DNS_CACHE_TTL,                                     300.0 ); if( randomize && BUGGIFY ) DNS_CACHE_TTL = deterministicRandom()->random01() * 10;
+	init( DNS_CACHE_NEGATIVE_TTL,                              1.0 ); if( randomize && BUGGIFY ) DNS_CACHE_NEGATIVE_TTL = 0.0;
+	init( DNS_CACHE_REFRESH_FRACTION,                         0.75 ); // Cache hits after this fraction of the TTL trigger a background re-resolution
+	init( DNS_RESOLVER_THREADS,                                  2 ); // 0 -> resolve through the asio internal resolver thread
+	init( DNS_RESOLVER_THREAD_STACKSIZE,                128 * 1024 );
 	init( CACHE_REFRESH_INTERVAL_WHEN_ALL_ALTERNATIVES_FAILED, 1.0 );
 
 	init( DELAY_JITTER_OFFSET,                                 0.9 );
@@ -71,10 +76,22 @@ void FlowKnobs::initialize(Randomize randomize, IsSimulated isSimulated) {
 	init( SATURATION_PROFILING_MAX_LOG_INTERVAL,               5.0 );
 	init( SATURATION_PROFILING_LOG_BACKOFF,                    2.0 );
 
+	init( ACTOR_LINEAGE_SAMPLING_INTERVAL,                    0.01 ); // 0 leaves the sampler off
+	init( ACTOR_LINEAGE_SAMPLER_MAX_STACKS,                   1000 ); // Further distinct stacks are counted as [other]
+	init( ACTOR_LINEAGE_TRACE_INTERVAL,                       10.0 );
+	init( ACTOR_LINEAGE_TRACE_MAX_STACKS,                       20 );
+
+	init( SERIALIZATION_STATS_ENABLED,                       false ); // Counts serialization by message type, logged with the process metrics
+	init( SERIALIZATION_STATS_TRACE_MAX_TYPES,                  10 );
+
 	init( FAST_ALLOC_LOGGING_BYTES,                           10e6 );
 	init( FAST_ALLOC_ALLOW_GUARD_PAGES,                      false );
 	init( HUGE_ARENA_LOGGING_BYTES,                          100e6 );
 	init( HUGE_ARENA_LOGGING_INTERVAL,                         5.0 );
+	init( SCRATCH_ARENA_CHUNK_BYTES,                         65536 );
+	init( SCRATCH_ARENA_MAX_RETAINED_BYTES,                  16<<20 ); // Per thread; reset() frees chunks beyond this
+	init( SECURE_MEMORY_POOL_BYTES,                           1<<20 ); // Per slab, locked into RAM as the pool grows
+	init( SECURE_MEMORY_MAPPING_CACHE_BYTES,                  4<<20 ); // Freed large secure allocations kept for reuse
 
 	init( MEMORY_USAGE_CHECK_INTERVAL,                         1.0 );
 
@@ -95,6 +112,8 @@ void FlowKnobs::initialize(Randomize randomize, IsSimulated isSimulated) {
 	init( STATSD_UDP_EMISSION_PORT,                           8125 );
 	init( OTEL_UDP_EMISSION_ADDR,                       "127.0.0.1");
 	init( OTEL_UDP_EMISSION_PORT,                             8903 );
+	init( UDP_BATCH_ENABLE_GSO,                               true ); // IUDPSocket::sendBatch hands equal-sized datagrams to the kernel as one segmented send
+	init( UDP_BATCH_ENABLE_GRO,                              false ); // IUDPSocket::receiveBatch asks the kernel to coalesce datagrams; also affects receive() on that socket
 	init( METRICS_EMIT_DDSKETCH,                             false ); // Determines if DDSketch buckets will get emitted
 
 	//connectionMonitor
@@ -131,6 +150,8 @@ void FlowKnobs::initialize(Randomize randomize, IsSimulated isSimulated) {
 	init( TLS_HANDSHAKE_THREAD_STACKSIZE,                64 * 1024 );
 	init( TLS_MALLOC_ARENA_MAX,                                  6 );
 	init( TLS_HANDSHAKE_LIMIT,                                1000 );
+	init( PACKET_COALESCE_DELAY_US,                              0 ); // 0 disables holding back small writes
+	init( PACKET_COALESCE_BYTES,                              1500 );
 
 	init( NETWORK_TEST_CLIENT_COUNT,                            30 );
 	init( NETWORK_TEST_REPLY_SIZE,                           600e3 );
@@ -145,6 +166,8 @@ void FlowKnobs::initialize(Randomize randomize, IsSimulated isSimulated) {
 	init( PUBLIC_KEY_FILE_REFRESH_INTERVAL_SECONDS,            300 );
 	init( AUDIT_TIME_WINDOW,                                   5.0 );
 	init( TOKEN_CACHE_SIZE,                                   2000 );
+	init( SIGNATURE_VERIFY_OFFLOAD_THRESHOLD,                   16 );
+	init( SIGNATURE_VERIFY_CHUNK_SIZE,                          16 );
 	init( WIPE_SENSITIVE_DATA_FROM_PACKET_BUFFER,             true );
 
 	//AsyncFileCached
@@ -211,6 +234,12 @@ void FlowKnobs::initialize(Randomize randomize, IsSimulated isSimulated) {
 	init( CERT_FILE_MAX_SIZE,                      5 * 1024 * 1024 );
 	init( READY_QUEUE_RESERVED_SIZE,                          8192 );
 	init( TASKS_PER_REACTOR_CHECK,                             100 );
+	init( LISTENER_ACCEPT_BATCH,                                16 ); if( randomize && BUGGIFY ) LISTENER_ACCEPT_BATCH = 1;
+	init( LISTENER_ACCEPT_PER_IP_RATE,                         0.0 ); // A value of 0 disables per source limiting
+	init( LISTENER_ACCEPT_PER_IP_BURST,                       20.0 );
+	init( LISTENER_ACCEPT_TRACKED_IPS,                       10000 );
+	init( LISTENER_OVERLOAD_RUN_LOOP_LAG,                      0.5 ); // A value of 0 disables pausing
+	init( LISTENER_OVERLOAD_PAUSE,                            0.01 );
 
 	//Network
 	init( PACKET_LIMIT,                                  100LL<<20 );
@@ -235,6 +264,12 @@ void FlowKnobs::initialize(Randomize randomize, IsSimulated isSimulated) {
 	init( MAX_RUNLOOP_SLEEP_DELAY,                               0 );
 	init( SIM_CONNECT_ERROR_MODE, deterministicRandom()->randomInt(0,3) );
 
+	//SimulatedNetwork
+	init( SIMULATED_NETWORK_LATENCY,                        100e-6 );
+	init( SIMULATED_NETWORK_BANDWIDTH,                      1.25e9 ); // Bytes per second per link, i.e. 10Gbps
+	init( SIMULATED_NETWORK_TASK_CPU_SECONDS,                 5e-6 );
+	init( SIMULATED_NETWORK_CONNECTION_BUFFER_BYTES,         4<<20 ); // Written but undelivered bytes before write() returns 0
+
 	//Tracefiles
 	init( ZERO_LENGTH_FILE_PAD,                                  1 );
 	init( TRACE_FLUSH_INTERVAL,                               0.25 );
@@ -390,165 +425,223 @@ static bool safe_stob(std::string const& str) {
 // name. If any errors are encountered, it throws an
 // invalid_option_value exception.
 ParsedKnobValue Knobs::parseKnobValue(std::string const& knob, std::string const& value) const {
+	KnobId id = getKnobId(knob);
+	if (id == INVALID_KNOB_ID) {
+		return NoKnobFound{};
+	}
 	try {
-		if (double_knobs.count(knob)) {
+		switch (knobs[id].type) {
+		case KnobType::DOUBLE:
 			return safe_stod(value);
-		} else if (bool_knobs.count(knob)) {
+		case KnobType::BOOL:
 			return safe_stob(value);
-		} else if (int64_knobs.count(knob)) {
+		case KnobType::INT64:
 			return safe_stoi64(value);
-		} else if (int_knobs.count(knob)) {
+		case KnobType::INT:
 			return safe_stoi(value);
-		} else if (string_knobs.count(knob)) {
+		case KnobType::STRING:
 			return value;
 		}
-		return NoKnobFound{};
+		UNREACHABLE();
 	} catch (...) {
 		throw invalid_option_value();
 	}
 }
 
-bool Knobs::setKnob(std::string const& knob, int value) {
-	if (!int_knobs.count(knob)) {
-		return false;
+KnobId Knobs::getKnobId(std::string const& name) const {
+	auto it = knobIds.find(name);
+	return it == knobIds.end() ? INVALID_KNOB_ID : it->second;
+}
+
+void Knobs::publish(KnobId id) {
+	uint64_t bits = 0;
+	void const* value = knobValue(id);
+	switch (knobs[id].type) {
+	case KnobType::DOUBLE:
+		memcpy(&bits, value, sizeof(double));
+		break;
+	case KnobType::INT64:
+		memcpy(&bits, value, sizeof(int64_t));
+		break;
+	case KnobType::INT:
+		memcpy(&bits, value, sizeof(int));
+		break;
+	case KnobType::BOOL:
+		memcpy(&bits, value, sizeof(bool));
+		break;
+	case KnobType::STRING:
+		return;
 	}
-	*int_knobs[knob].value = value;
-	explicitlySetKnobs.insert(toLower(knob));
-	return true;
+	published[id].store(bits, std::memory_order_release);
 }
 
-bool Knobs::setKnob(std::string const& knob, int64_t value) {
-	if (!int64_knobs.count(knob)) {
+template <class T>
+bool Knobs::setKnobValue(KnobId id, T const& value) {
+	if (id < 0 || id >= knobCount() || knobs[id].type != knobTypeOf<T>()) {
 		return false;
 	}
-	*int64_knobs[knob].value = value;
-	explicitlySetKnobs.insert(toLower(knob));
+	*static_cast<T*>(knobValue(id)) = value;
+	knobs[id].explicitlySet = true;
+	publish(id);
 	return true;
 }
 
+bool Knobs::setKnob(std::string const& knob, int value) {
+	return setKnobValue(getKnobId(knob), value);
+}
+
+bool Knobs::setKnob(std::string const& knob, int64_t value) {
+	return setKnobValue(getKnobId(knob), value);
+}
+
 bool Knobs::setKnob(std::string const& knob, bool value) {
-	if (!bool_knobs.count(knob)) {
-		return false;
-	}
-	*bool_knobs[knob].value = value;
-	explicitlySetKnobs.insert(toLower(knob));
-	return true;
+	return setKnobValue(getKnobId(knob), value);
 }
 
 bool Knobs::setKnob(std::string const& knob, double value) {
-	if (!double_knobs.count(knob)) {
-		return false;
-	}
-	*double_knobs[knob].value = value;
-	explicitlySetKnobs.insert(toLower(knob));
-	return true;
+	return setKnobValue(getKnobId(knob), value);
 }
 
 bool Knobs::setKnob(std::string const& knob, std::string const& value) {
-	if (!string_knobs.count(knob)) {
-		return false;
-	}
-	*string_knobs[knob].value = value;
-	explicitlySetKnobs.insert(toLower(knob));
-	return true;
+	return setKnobValue(getKnobId(knob), value);
 }
 
-ParsedKnobValue Knobs::getKnob(const std::string& name) const {
-	if (double_knobs.count(name) > 0) {
-		return ParsedKnobValue{ *double_knobs.at(name).value };
-	}
-	if (int64_knobs.count(name) > 0) {
-		return ParsedKnobValue{ *int64_knobs.at(name).value };
-	}
-	if (int_knobs.count(name) > 0) {
-		return ParsedKnobValue{ *int_knobs.at(name).value };
+bool Knobs::setKnob(KnobId id, ParsedKnobValue const& value) {
+	return std::visit(
+	    [this, id](auto const& v) {
+		    if constexpr (std::is_same_v<std::decay_t<decltype(v)>, NoKnobFound>) {
+			    return false;
+		    } else {
+			    return setKnobValue(id, v);
+		    }
+	    },
+	    value);
+}
+
+int Knobs::setKnobs(std::vector<std::pair<KnobId, ParsedKnobValue>> const& changes) {
+	int changed = 0;
+	for (auto const& [id, value] : changes) {
+		changed += setKnob(id, value);
 	}
-	if (string_knobs.count(name) > 0) {
-		return ParsedKnobValue{ *string_knobs.at(name).value };
+	return changed;
+}
+
+ParsedKnobValue Knobs::getKnob(KnobId id) const {
+	if (id < 0 || id >= knobCount()) {
+		return ParsedKnobValue{ NoKnobFound() };
 	}
-	if (bool_knobs.count(name) > 0) {
-		return ParsedKnobValue{ *bool_knobs.at(name).value };
+	void const* value = knobValue(id);
+	switch (knobs[id].type) {
+	case KnobType::DOUBLE:
+		return ParsedKnobValue{ *static_cast<double const*>(value) };
+	case KnobType::INT64:
+		return ParsedKnobValue{ *static_cast<int64_t const*>(value) };
+	case KnobType::INT:
+		return ParsedKnobValue{ *static_cast<int const*>(value) };
+	case KnobType::STRING:
+		return ParsedKnobValue{ *static_cast<std::string const*>(value) };
+	case KnobType::BOOL:
+		return ParsedKnobValue{ *static_cast<bool const*>(value) };
 	}
+	UNREACHABLE();
+}
 
-	return ParsedKnobValue{ NoKnobFound() };
+ParsedKnobValue Knobs::getKnob(const std::string& name) const {
+	return getKnob(getKnobId(name));
 }
 
 bool Knobs::isAtomic(std::string const& knob) const {
-	if (double_knobs.count(knob)) {
-		return double_knobs.find(knob)->second.atomic == Atomic::YES;
-	} else if (int64_knobs.count(knob)) {
-		return int64_knobs.find(knob)->second.atomic == Atomic::YES;
-	} else if (int_knobs.count(knob)) {
-		return int_knobs.find(knob)->second.atomic == Atomic::YES;
-	} else if (string_knobs.count(knob)) {
-		return string_knobs.find(knob)->second.atomic == Atomic::YES;
-	} else if (bool_knobs.count(knob)) {
-		return bool_knobs.find(knob)->second.atomic == Atomic::YES;
+	KnobId id = getKnobId(knob);
+	return id != INVALID_KNOB_ID && knobs[id].atomic == Atomic::YES;
+}
+
+Knobs::Knobs(Knobs const& other) : objectSize(other.objectSize) {
+	*this = other;
+}
+
+Knobs& Knobs::operator=(Knobs const& other) {
+	if (this == &other) {
+		return *this;
+	}
+	// The registry holds offsets, which only describe objects of the same class
+	ASSERT(objectSize == other.objectSize);
+	knobs = other.knobs;
+	knobIds = other.knobIds;
+	// Existing atomics are stored to rather than replaced, as another thread may be reading them
+	for (size_t i = 0; i < other.published.size(); ++i) {
+		uint64_t bits = other.published[i].load(std::memory_order_acquire);
+		if (i < published.size()) {
+			published[i].store(bits, std::memory_order_release);
+		} else {
+			published.emplace_back(bits);
+		}
 	}
-	return false;
+	published.resize(other.published.size());
+	return *this;
 }
 
-void Knobs::initKnob(double& knob, double value, std::string const& name, Atomic atomic) {
-	if (!explicitlySetKnobs.count(toLower(name))) {
-		knob = value;
-		double_knobs[toLower(name)] = KnobValue<double>{ &knob, atomic };
+// Knobs keep the id they were given the first time they were initialized, so reinitializing only overwrites values
+// and does not rebuild the registry.
+template <class T>
+void Knobs::registerKnob(T& knob, T const& value, std::string const& name, Atomic atomic) {
+	// Knobs held anywhere but in this object's own fields would not be copied along with it
+	ptrdiff_t offset = reinterpret_cast<char const*>(&knob) - reinterpret_cast<char const*>(this);
+	ASSERT(offset >= 0 && offset + sizeof(T) <= objectSize);
+	std::string lowerName = toLower(name);
+	auto [it, inserted] = knobIds.try_emplace(lowerName, knobs.size());
+	if (inserted) {
+		knobs.push_back(KnobInfo{ lowerName, knobTypeOf<T>(), atomic, size_t(offset), false });
+		published.emplace_back(0);
+	} else if (knobs[it->second].explicitlySet) {
+		return;
 	}
+	KnobInfo& info = knobs[it->second];
+	ASSERT(info.type == knobTypeOf<T>());
+	ASSERT(info.offset == size_t(offset));
+	knob = value;
+	info.atomic = atomic;
+	publish(it->second);
+}
+
+void Knobs::initKnob(double& knob, double value, std::string const& name, Atomic atomic) {
+	registerKnob(knob, value, name, atomic);
 }
 
 void Knobs::initKnob(int64_t& knob, int64_t value, std::string const& name, Atomic atomic) {
-	if (!explicitlySetKnobs.count(toLower(name))) {
-		knob = value;
-		int64_knobs[toLower(name)] = KnobValue<int64_t>{ &knob, atomic };
-	}
+	registerKnob(knob, value, name, atomic);
 }
 
 void Knobs::initKnob(int& knob, int value, std::string const& name, Atomic atomic) {
-	if (!explicitlySetKnobs.count(toLower(name))) {
-		knob = value;
-		int_knobs[toLower(name)] = KnobValue<int>{ &knob, atomic };
-	}
+	registerKnob(knob, value, name, atomic);
 }
 
 void Knobs::initKnob(std::string& knob, const std::string& value, const std::string& name, Atomic atomic) {
-	if (!explicitlySetKnobs.count(toLower(name))) {
-		knob = value;
-		string_knobs[toLower(name)] = KnobValue<std::string>{ &knob, atomic };
-	}
+	registerKnob(knob, value, name, atomic);
 }
 
 void Knobs::initKnob(bool& knob, bool value, std::string const& name, Atomic atomic) {
-	if (!explicitlySetKnobs.count(toLower(name))) {
-		knob = value;
-		bool_knobs[toLower(name)] = KnobValue<bool>{ &knob, atomic };
+	registerKnob(knob, value, name, atomic);
+}
+
+void Knobs::clearExplicitlySet() {
+	for (auto& info : knobs) {
+		info.explicitlySet = false;
 	}
 }
 
 void Knobs::trace() const {
-	for (auto& k : double_knobs)
-		TraceEvent("Knob")
-		    .detail("Name", k.first.c_str())
-		    .detail("Value", *k.second.value)
-		    .detail("Atomic", k.second.atomic);
-	for (auto& k : int_knobs)
-		TraceEvent("Knob")
-		    .detail("Name", k.first.c_str())
-		    .detail("Value", *k.second.value)
-		    .detail("Atomic", k.second.atomic);
-	for (auto& k : int64_knobs)
-		TraceEvent("Knob")
-		    .detail("Name", k.first.c_str())
-		    .detail("Value", *k.second.value)
-		    .detail("Atomic", k.second.atomic);
-	for (auto& k : string_knobs)
-		TraceEvent("Knob")
-		    .detail("Name", k.first.c_str())
-		    .detail("Value", *k.second.value)
-		    .detail("Atomic", k.second.atomic);
-	for (auto& k : bool_knobs)
-		TraceEvent("Knob")
-		    .detail("Name", k.first.c_str())
-		    .detail("Value", *k.second.value)
-		    .detail("Atomic", k.second.atomic);
+	for (KnobId id = 0; id < knobCount(); ++id) {
+		TraceEvent event("Knob");
+		event.detail("Name", knobs[id].name.c_str());
+		std::visit(
+		    [&event](auto const& v) {
+			    if constexpr (!std::is_same_v<std::decay_t<decltype(v)>, NoKnobFound>) {
+				    event.detail("Value", v);
+			    }
+		    },
+		    getKnob(id));
+		event.detail("Atomic", knobs[id].atomic);
+	}
 }
 
 TEST_CASE("/flow/Knobs/ParseKnobValue") {
@@ -570,3 +663,110 @@ TEST_CASE("/flow/Knobs/ParseKnobValue") {
 
 	return Void();
 }
+
+TEST_CASE("/flow/Knobs/Ids") {
+	FlowKnobs knobs(Randomize::False, IsSimulated::False);
+	KnobId id = knobs.getKnobId("max_outstanding");
+	ASSERT(id != INVALID_KNOB_ID && knobs.getKnobName(id) == "max_outstanding");
+	ASSERT(knobs.getKnobType(id) == KnobType::INT);
+	ASSERT(knobs.getKnobId("no_such_knob") == INVALID_KNOB_ID);
+
+	// Batched changes skip mismatched types and are visible through the published copy
+	KnobId delayId = knobs.getKnobId("min_coalesce_delay");
+	std::vector<std::pair<KnobId, ParsedKnobValue>> changes = { { id, 7 }, { delayId, 0.5 }, { delayId, 1 } };
+	ASSERT_EQ(knobs.setKnobs(changes), 2);
+	ASSERT_EQ(knobs.MAX_OUTSTANDING, 7);
+	ASSERT_EQ(knobs.getPublishedKnob<int>(id), 7);
+	ASSERT_EQ(knobs.getPublishedKnob<double>(delayId), 0.5);
+	ASSERT(std::get<int>(knobs.getKnob("max_outstanding")) == 7);
+
+	// Explicitly set knobs survive reinitialization until reset(), and ids are stable across both
+	int count = knobs.knobCount();
+	knobs.initialize(Randomize::False, IsSimulated::False);
+	ASSERT_EQ(knobs.MAX_OUTSTANDING, 7);
+	knobs.reset(Randomize::False, IsSimulated::False);
+	ASSERT_EQ(knobs.knobCount(), count);
+	ASSERT_EQ(knobs.getKnobId("max_outstanding"), id);
+	ASSERT(knobs.getPublishedKnob<int>(id) == knobs.MAX_OUTSTANDING);
+
+	// A copy is changed independently of the original
+	FlowKnobs copy = knobs;
+	ASSERT(copy.setKnob("max_outstanding", 9));
+	ASSERT_EQ(copy.MAX_OUTSTANDING, 9);
+	ASSERT_EQ(copy.getPublishedKnob<int>(id), 9);
+	ASSERT(knobs.MAX_OUTSTANDING != 9 && knobs.getPublishedKnob<int>(id) != 9);
+	knobs = copy;
+	ASSERT_EQ(knobs.MAX_OUTSTANDING, 9);
+	ASSERT(knobs.setKnob("max_outstanding", 10));
+	ASSERT_EQ(copy.MAX_OUTSTANDING, 9);
+
+	return Void();
+}
+
+namespace {
+
+struct KnobsTestGroup {
+	int64_t GROUPED;
+	std::string LABEL;
+};
+
+// Knobs of every type, some in a field of a field, with other fields in between
+class KnobsTestKnobs : public KnobsImpl<KnobsTestKnobs> {
+public:
+	int UNREGISTERED = 0;
+	double RATE;
+	KnobsTestGroup group;
+	bool ENABLED;
+	int COUNT;
+
+	KnobsTestKnobs() { initialize(); }
+	void initialize() {
+		initKnob(RATE, 0.5, "rate");
+		initKnob(group.GROUPED, int64_t(1) << 40, "grouped");
+		initKnob(group.LABEL, "label", "label", Atomic::NO);
+		initKnob(ENABLED, false, "enabled");
+		initKnob(COUNT, 3, "count");
+	}
+};
+
+} // namespace
+
+TEST_CASE("/flow/Knobs/CopyDerived") {
+	KnobsTestKnobs original;
+	ASSERT(original.setKnob("count", 4));
+	KnobsTestKnobs copy = original;
+	ASSERT_EQ(copy.COUNT, 4);
+	ASSERT_EQ(copy.getPublishedKnob<int>(copy.getKnobId("count")), 4);
+
+	// Every knob of the copy is its own
+	ASSERT(copy.setKnob("rate", 2.5));
+	ASSERT(copy.setKnob("grouped", int64_t(7)));
+	ASSERT(copy.setKnob("label", std::string("copied")));
+	ASSERT(copy.setKnob("enabled", true));
+	ASSERT(copy.setKnob("count", 5));
+	ASSERT(copy.RATE == 2.5 && copy.group.GROUPED == 7 && copy.group.LABEL == "copied" && copy.ENABLED &&
+	       copy.COUNT == 5);
+	ASSERT(std::get<std::string>(copy.getKnob("label")) == "copied");
+	ASSERT_EQ(copy.getPublishedKnob<int64_t>(copy.getKnobId("grouped")), 7);
+	ASSERT(original.RATE == 0.5 && original.group.GROUPED == int64_t(1) << 40 && original.group.LABEL == "label" &&
+	       !original.ENABLED && original.COUNT == 4);
+	ASSERT(std::get<std::string>(original.getKnob("label")) == "label");
+	ASSERT_EQ(original.getPublishedKnob<int64_t>(original.getKnobId("grouped")), int64_t(1) << 40);
+	ASSERT_EQ(original.getPublishedKnob<int>(original.getKnobId("count")), 4);
+
+	// And the same after assignment, through either object
+	original = copy;
+	ASSERT(original.setKnob("label", std::string("assigned")));
+	ASSERT(original.group.LABEL == "assigned" && copy.group.LABEL == "copied");
+	ASSERT(copy.setKnob("count", 6));
+	ASSERT(original.COUNT == 5 && copy.COUNT == 6);
+	ASSERT_EQ(original.getPublishedKnob<int>(original.getKnobId("count")), 5);
+	ASSERT_EQ(original.UNREGISTERED, 0);
+
+	// Explicitly set knobs carry over to the copy, which reset() clears independently
+	copy.reset();
+	ASSERT(copy.COUNT == 3 && copy.group.LABEL == "label");
+	ASSERT(original.COUNT == 5 && original.group.LABEL == "assigned");
+
+	return Void();
+}
@@ -0,0 +1,515 @@
+/*
+ * MemOps.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flow/MemOps.h"
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+#include "flow/Error.h"
+#include "flow/IRandom.h"
+#include "flow/UnitTest.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FLOW_MEMOPS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+using detail::MemcmpFn;
+using detail::MemcpyFn;
+
+struct MemOpsKernels {
+	MemcpyFn copy;
+	MemcpyFn copyNonTemporal;
+	MemcmpFn compare;
+};
+
+void* libcMemcpy(void* dst, const void* src, size_t n) {
+	return memcpy(dst, src, n);
+}
+
+int libcMemcmp(const void* a, const void* b, size_t n) {
+	return memcmp(a, b, n);
+}
+
+#ifdef FLOW_MEMOPS_X86
+
+// Copies fewer than 16 bytes with at most two overlapping loads and stores of each width
+inline void copyUnder16(uint8_t* d, const uint8_t* s, size_t n) {
+	if (n >= 8) {
+		uint64_t head, tail;
+		memcpy(&head, s, 8);
+		memcpy(&tail, s + n - 8, 8);
+		memcpy(d, &head, 8);
+		memcpy(d + n - 8, &tail, 8);
+	} else if (n >= 4) {
+		uint32_t head, tail;
+		memcpy(&head, s, 4);
+		memcpy(&tail, s + n - 4, 4);
+		memcpy(d, &head, 4);
+		memcpy(d + n - 4, &tail, 4);
+	} else if (n > 0) {
+		uint8_t first = s[0], middle = s[n / 2], last = s[n - 1];
+		d[0] = first;
+		d[n / 2] = middle;
+		d[n - 1] = last;
+	}
+}
+
+void* copySSE2(void* dst, const void* src, size_t n) {
+	uint8_t* d = (uint8_t*)dst;
+	const uint8_t* s = (const uint8_t*)src;
+	if (n < 16) {
+		copyUnder16(d, s, n);
+		return dst;
+	}
+
+	// The last 16 bytes are stored at the end, overlapping whatever the loop leaves over
+	__m128i tail = _mm_loadu_si128((const __m128i*)(s + n - 16));
+	uint8_t* tailDst = d + n - 16;
+	for (; n > 64; n -= 64, s += 64, d += 64) {
+		__m128i a = _mm_loadu_si128((const __m128i*)s);
+		__m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+		__m128i c = _mm_loadu_si128((const __m128i*)(s + 32));
+		__m128i e = _mm_loadu_si128((const __m128i*)(s + 48));
+		_mm_storeu_si128((__m128i*)d, a);
+		_mm_storeu_si128((__m128i*)(d + 16), b);
+		_mm_storeu_si128((__m128i*)(d + 32), c);
+		_mm_storeu_si128((__m128i*)(d + 48), e);
+	}
+	for (; n > 16; n -= 16, s += 16, d += 16) {
+		_mm_storeu_si128((__m128i*)d, _mm_loadu_si128((const __m128i*)s));
+	}
+	_mm_storeu_si128((__m128i*)tailDst, tail);
+	return dst;
+}
+
+void* copyNonTemporalSSE2(void* dst, const void* src, size_t n) {
+	uint8_t* d = (uint8_t*)dst;
+	const uint8_t* s = (const uint8_t*)src;
+	if (n < 128) {
+		return copySSE2(dst, src, n);
+	}
+
+	size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+	copyUnder16(d, s, head);
+	d += head;
+	s += head;
+	n -= head;
+	for (; n >= 64; n -= 64, s += 64, d += 64) {
+		__m128i a = _mm_loadu_si128((const __m128i*)s);
+		__m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+		__m128i c = _mm_loadu_si128((const __m128i*)(s + 32));
+		__m128i e = _mm_loadu_si128((const __m128i*)(s + 48));
+		_mm_stream_si128((__m128i*)d, a);
+		_mm_stream_si128((__m128i*)(d + 16), b);
+		_mm_stream_si128((__m128i*)(d + 32), c);
+		_mm_stream_si128((__m128i*)(d + 48), e);
+	}
+	_mm_sfence();
+	copySSE2(d, s, n);
+	return dst;
+}
+
+int compareSSE2(const void* a, const void* b, size_t n) {
+	const uint8_t* pa = (const uint8_t*)a;
+	const uint8_t* pb = (const uint8_t*)b;
+	if (n < 16) {
+		return memcmp(a, b, n);
+	}
+
+	size_t i = 0;
+	for (;; i += 16) {
+		// The final block overlaps bytes already known to be equal, so its first difference is the first overall
+		if (i + 16 > n) {
+			if (i == n) {
+				return 0;
+			}
+			i = n - 16;
+		}
+		unsigned diff = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(pa + i)),
+		                                                 _mm_loadu_si128((const __m128i*)(pb + i)))) ^
+		                0xffff;
+		if (diff) {
+			size_t k = i + __builtin_ctz(diff);
+			return (int)pa[k] - (int)pb[k];
+		}
+		if (i + 16 == n) {
+			return 0;
+		}
+	}
+}
+
+__attribute__((target("avx2"))) void* copyAVX2(void* dst, const void* src, size_t n) {
+	uint8_t* d = (uint8_t*)dst;
+	const uint8_t* s = (const uint8_t*)src;
+	if (n <= 32) {
+		if (n < 16) {
+			copyUnder16(d, s, n);
+		} else {
+			__m128i head = _mm_loadu_si128((const __m128i*)s);
+			__m128i tail = _mm_loadu_si128((const __m128i*)(s + n - 16));
+			_mm_storeu_si128((__m128i*)d, head);
+			_mm_storeu_si128((__m128i*)(d + n - 16), tail);
+		}
+		return dst;
+	}
+
+	__m256i tail = _mm256_loadu_si256((const __m256i*)(s + n - 32));
+	uint8_t* tailDst = d + n - 32;
+	for (; n > 128; n -= 128, s += 128, d += 128) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)s);
+		__m256i b = _mm256_loadu_si256((const __m256i*)(s + 32));
+		__m256i c = _mm256_loadu_si256((const __m256i*)(s + 64));
+		__m256i e = _mm256_loadu_si256((const __m256i*)(s + 96));
+		_mm256_storeu_si256((__m256i*)d, a);
+		_mm256_storeu_si256((__m256i*)(d + 32), b);
+		_mm256_storeu_si256((__m256i*)(d + 64), c);
+		_mm256_storeu_si256((__m256i*)(d + 96), e);
+	}
+	for (; n > 32; n -= 32, s += 32, d += 32) {
+		_mm256_storeu_si256((__m256i*)d, _mm256_loadu_si256((const __m256i*)s));
+	}
+	_mm256_storeu_si256((__m256i*)tailDst, tail);
+	return dst;
+}
+
+__attribute__((target("avx2"))) void* copyNonTemporalAVX2(void* dst, const void* src, size_t n) {
+	uint8_t* d = (uint8_t*)dst;
+	const uint8_t* s = (const uint8_t*)src;
+	if (n < 256) {
+		return copyAVX2(dst, src, n);
+	}
+
+	size_t head = (32 - ((uintptr_t)d & 31)) & 31;
+	copyAVX2(d, s, head);
+	d += head;
+	s += head;
+	n -= head;
+	for (; n >= 128; n -= 128, s += 128, d += 128) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)s);
+		__m256i b = _mm256_loadu_si256((const __m256i*)(s + 32));
+		__m256i c = _mm256_loadu_si256((const __m256i*)(s + 64));
+		__m256i e = _mm256_loadu_si256((const __m256i*)(s + 96));
+		_mm256_stream_si256((__m256i*)d, a);
+		_mm256_stream_si256((__m256i*)(d + 32), b);
+		_mm256_stream_si256((__m256i*)(d + 64), c);
+		_mm256_stream_si256((__m256i*)(d + 96), e);
+	}
+	_mm_sfence();
+	copyAVX2(d, s, n);
+	return dst;
+}
+
+__attribute__((target("avx2"))) int compareAVX2(const void* a, const void* b, size_t n) {
+	const uint8_t* pa = (const uint8_t*)a;
+	const uint8_t* pb = (const uint8_t*)b;
+	if (n < 32) {
+		return compareSSE2(a, b, n);
+	}
+
+	size_t i = 0;
+	for (;; i += 32) {
+		if (i + 32 > n) {
+			if (i == n) {
+				return 0;
+			}
+			i = n - 32;
+		}
+		uint32_t diff = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+		    _mm256_loadu_si256((const __m256i*)(pa + i)), _mm256_loadu_si256((const __m256i*)(pb + i))));
+		if (diff) {
+			size_t k = i + __builtin_ctz(diff);
+			return (int)pa[k] - (int)pb[k];
+		}
+		if (i + 32 == n) {
+			return 0;
+		}
+	}
+}
+
+__attribute__((target("avx512f"))) void* copyAVX512(void* dst, const void* src, size_t n) {
+	uint8_t* d = (uint8_t*)dst;
+	const uint8_t* s = (const uint8_t*)src;
+	if (n <= 64) {
+		return copyAVX2(dst, src, n);
+	}
+
+	__m512i tail = _mm512_loadu_si512((const void*)(s + n - 64));
+	uint8_t* tailDst = d + n - 64;
+	for (; n > 256; n -= 256, s += 256, d += 256) {
+		__m512i a = _mm512_loadu_si512((const void*)s);
+		__m512i b = _mm512_loadu_si512((const void*)(s + 64));
+		__m512i c = _mm512_loadu_si512((const void*)(s + 128));
+		__m512i e = _mm512_loadu_si512((const void*)(s + 192));
+		_mm512_storeu_si512((void*)d, a);
+		_mm512_storeu_si512((void*)(d + 64), b);
+		_mm512_storeu_si512((void*)(d + 128), c);
+		_mm512_storeu_si512((void*)(d + 192), e);
+	}
+	for (; n > 64; n -= 64, s += 64, d += 64) {
+		_mm512_storeu_si512((void*)d, _mm512_loadu_si512((const void*)s));
+	}
+	_mm512_storeu_si512((void*)tailDst, tail);
+	return dst;
+}
+
+__attribute__((target("avx512f"))) void* copyNonTemporalAVX512(void* dst, const void* src, size_t n) {
+	uint8_t* d = (uint8_t*)dst;
+	const uint8_t* s = (const uint8_t*)src;
+	if (n < 512) {
+		return copyAVX512(dst, src, n);
+	}
+
+	size_t head = (64 - ((uintptr_t)d & 63)) & 63;
+	copyAVX2(d, s, head);
+	d += head;
+	s += head;
+	n -= head;
+	for (; n >= 256; n -= 256, s += 256, d += 256) {
+		__m512i a = _mm512_loadu_si512((const void*)s);
+		__m512i b = _mm512_loadu_si512((const void*)(s + 64));
+		__m512i c = _mm512_loadu_si512((const void*)(s + 128));
+		__m512i e = _mm512_loadu_si512((const void*)(s + 192));
+		_mm512_stream_si512((__m512i*)d, a);
+		_mm512_stream_si512((__m512i*)(d + 64), b);
+		_mm512_stream_si512((__m512i*)(d + 128), c);
+		_mm512_stream_si512((__m512i*)(d + 192), e);
+	}
+	_mm_sfence();
+	copyAVX512(d, s, n);
+	return dst;
+}
+
+bool cpuSupports(MemOpsVariant variant) {
+	__builtin_cpu_init();
+	switch (variant) {
+	case MemOpsVariant::Libc:
+	case MemOpsVariant::SSE2:
+		return true;
+	case MemOpsVariant::AVX2:
+		return __builtin_cpu_supports("avx2");
+	case MemOpsVariant::AVX512:
+		return __builtin_cpu_supports("avx512f");
+	}
+	return false;
+}
+
+#else
+
+bool cpuSupports(MemOpsVariant variant) {
+	return variant == MemOpsVariant::Libc;
+}
+
+#endif // FLOW_MEMOPS_X86
+
+MemOpsKernels kernelsFor(MemOpsVariant variant) {
+	switch (variant) {
+#ifdef FLOW_MEMOPS_X86
+	case MemOpsVariant::SSE2:
+		return { &copySSE2, &copyNonTemporalSSE2, &compareSSE2 };
+	case MemOpsVariant::AVX2:
+		return { &copyAVX2, &copyNonTemporalAVX2, &compareAVX2 };
+	case MemOpsVariant::AVX512:
+		// Byte compares need AVX512BW, which is not implied by AVX512F
+		return { &copyAVX512, &copyNonTemporalAVX512, &compareAVX2 };
+#endif
+	default:
+		return { &libcMemcpy, &libcMemcpy, &libcMemcmp };
+	}
+}
+
+size_t lastLevelCacheBytes() {
+#if defined(__linux__) && defined(_SC_LEVEL3_CACHE_SIZE)
+	long bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+	if (bytes <= 0) {
+		bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	}
+	if (bytes > 0) {
+		return bytes;
+	}
+#endif
+	return 8 << 20;
+}
+
+// 0 until the threshold is first needed, and SIZE_MAX when non-temporal copies are disabled
+std::atomic<size_t> nonTemporalThreshold{ 0 };
+
+size_t currentNonTemporalThreshold() {
+	size_t threshold = nonTemporalThreshold.load(std::memory_order_relaxed);
+	if (threshold == 0) {
+		// A copy this large would push out half of the cache, which is more than the copied data is likely to be
+		// worth keeping there
+		size_t computed = lastLevelCacheBytes() / 2;
+		nonTemporalThreshold.compare_exchange_strong(threshold, computed, std::memory_order_relaxed);
+		threshold = nonTemporalThreshold.load(std::memory_order_relaxed);
+	}
+	return threshold;
+}
+
+// Threads which race to select store the same values, and any of them is safe to call in the meantime
+std::atomic<MemOpsVariant> selectedVariant{ MemOpsVariant::Libc };
+std::atomic<MemcpyFn> selectedCopy{ &libcMemcpy };
+std::atomic<MemcpyFn> selectedCopyNonTemporal{ &libcMemcpy };
+
+void* copyWithSelected(void* dst, const void* src, size_t n) {
+	if (n >= nonTemporalThreshold.load(std::memory_order_relaxed)) {
+		return selectedCopyNonTemporal.load(std::memory_order_relaxed)(dst, src, n);
+	}
+	return selectedCopy.load(std::memory_order_relaxed)(dst, src, n);
+}
+
+void selectMemOps() {
+	MemOpsVariant best = supportedMemOpsVariants().back();
+	MemOpsKernels kernels = kernelsFor(best);
+	currentNonTemporalThreshold();
+	selectedCopy.store(kernels.copy, std::memory_order_relaxed);
+	selectedCopyNonTemporal.store(kernels.copyNonTemporal, std::memory_order_relaxed);
+	selectedVariant.store(best, std::memory_order_relaxed);
+	detail::flowMemcmpImpl.store(kernels.compare, std::memory_order_relaxed);
+	detail::flowMemcpyImpl.store(&copyWithSelected, std::memory_order_release);
+}
+
+void* resolveMemcpy(void* dst, const void* src, size_t n) {
+	selectMemOps();
+	return flowMemcpy(dst, src, n);
+}
+
+int resolveMemcmp(const void* a, const void* b, size_t n) {
+	selectMemOps();
+	return flowMemcmp(a, b, n);
+}
+
+} // namespace
+
+namespace detail {
+std::atomic<MemcpyFn> flowMemcpyImpl{ &resolveMemcpy };
+std::atomic<MemcmpFn> flowMemcmpImpl{ &resolveMemcmp };
+} // namespace detail
+
+const char* memOpsVariantName(MemOpsVariant variant) {
+	switch (variant) {
+	case MemOpsVariant::Libc:
+		return "libc";
+	case MemOpsVariant::SSE2:
+		return "sse2";
+	case MemOpsVariant::AVX2:
+		return "avx2";
+	case MemOpsVariant::AVX512:
+		return "avx512";
+	}
+	return "unknown";
+}
+
+std::vector<MemOpsVariant> supportedMemOpsVariants() {
+	std::vector<MemOpsVariant> variants;
+	for (auto v : { MemOpsVariant::Libc, MemOpsVariant::SSE2, MemOpsVariant::AVX2, MemOpsVariant::AVX512 }) {
+		if (cpuSupports(v)) {
+			variants.push_back(v);
+		}
+	}
+	return variants;
+}
+
+MemOpsVariant selectedMemOpsVariant() {
+	if (detail::flowMemcpyImpl.load(std::memory_order_acquire) == &resolveMemcpy) {
+		selectMemOps();
+	}
+	return selectedVariant.load(std::memory_order_relaxed);
+}
+
+void* flowMemcpyWith(MemOpsVariant variant, void* dst, const void* src, size_t n) {
+	ASSERT(cpuSupports(variant));
+	MemOpsKernels kernels = kernelsFor(variant);
+	if (n >= currentNonTemporalThreshold()) {
+		return kernels.copyNonTemporal(dst, src, n);
+	}
+	return kernels.copy(dst, src, n);
+}
+
+int flowMemcmpWith(MemOpsVariant variant, const void* a, const void* b, size_t n) {
+	ASSERT(cpuSupports(variant));
+	return kernelsFor(variant).compare(a, b, n);
+}
+
+size_t flowMemcpyNonTemporalThreshold() {
+	size_t threshold = currentNonTemporalThreshold();
+	return threshold == std::numeric_limits<size_t>::max() ? 0 : threshold;
+}
+
+void setFlowMemcpyNonTemporalThreshold(size_t bytes) {
+	nonTemporalThreshold.store(bytes ? bytes : std::numeric_limits<size_t>::max(), std::memory_order_relaxed);
+}
+
+static int sign(int x) {
+	return (x > 0) - (x < 0);
+}
+
+TEST_CASE("/flow/MemOps/variants") {
+	size_t savedThreshold = flowMemcpyNonTemporalThreshold();
+	// Small enough that the larger sizes below go through the non-temporal kernels
+	setFlowMemcpyNonTemporalThreshold(1024);
+
+	std::vector<uint8_t> src(20000), dst(src.size() + 64);
+	for (auto& b : src) {
+		b = deterministicRandom()->randomUInt32();
+	}
+	std::vector<size_t> sizes;
+	for (size_t n = 0; n <= 300; ++n) {
+		sizes.push_back(n);
+	}
+	for (size_t n : { 511, 512, 513, 1023, 1024, 1025, 4096, 4099, 12345, 19000 }) {
+		sizes.push_back(n);
+	}
+
+	for (auto variant : supportedMemOpsVariants()) {
+		for (size_t n : sizes) {
+			for (size_t offset : { 0, 1, 7, 33 }) {
+				std::fill(dst.begin(), dst.end(), 0);
+				ASSERT(flowMemcpyWith(variant, dst.data() + offset, src.data() + 3, n) == dst.data() + offset);
+				ASSERT(memcmp(dst.data() + offset, src.data() + 3, n) == 0);
+				for (size_t i = 0; i < offset; ++i) {
+					ASSERT(dst[i] == 0);
+				}
+				for (size_t i = offset + n; i < dst.size(); ++i) {
+					ASSERT(dst[i] == 0);
+				}
+
+				ASSERT(flowMemcmpWith(variant, dst.data() + offset, src.data() + 3, n) == 0);
+				if (n > 0) {
+					size_t at = deterministicRandom()->randomInt(0, n);
+					dst[offset + at] ^= 1 << deterministicRandom()->randomInt(0, 8);
+					ASSERT(sign(flowMemcmpWith(variant, dst.data() + offset, src.data() + 3, n)) ==
+					       sign(memcmp(dst.data() + offset, src.data() + 3, n)));
+				}
+			}
+		}
+	}
+
+	setFlowMemcpyNonTemporalThreshold(savedThreshold);
+	return Void();
+}
@@ -0,0 +1,196 @@
+/*
+ * MetricSample.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <map>
+
+#include "flow/flow.h"
+#include "flow/IndexedSet.h"
+#include "flow/MetricSample.h"
+#include "flow/UnitTest.h"
+
+namespace {
+
+int64_t exactEstimate(std::map<int, int64_t> const& exact, int begin, int end) {
+	int64_t sum = 0;
+	for (auto it = exact.lower_bound(begin); it != exact.end() && it->first < end; ++it) {
+		sum += it->second;
+	}
+	return sum;
+}
+
+} // namespace
+
+TEST_CASE("/flow/MetricSample/MetricSketch/exact") {
+	// Until it has more keys than its capacity, a sketch keeps every key
+	MetricSketch<int> sketch(1000);
+	for (int i = 0; i < 500; i++) {
+		sketch.add(i, i);
+		sketch.add(i, 1);
+	}
+	ASSERT_EQ(sketch.size(), 500);
+	ASSERT_EQ(sketch.getMetric(10), 11);
+	ASSERT_EQ(sketch.getEstimate(10, 20), 155);
+	ASSERT_EQ(sketch.getEstimate(20, 10), 0);
+	ASSERT_EQ(sketch.splitEstimate(10, 20, 30), 12);
+	ASSERT_EQ(sketch.splitEstimate(10, 20, 1000), 19);
+	return Void();
+}
+
+TEST_CASE("/flow/MetricSample/MetricSketch/bounded") {
+	int const capacity = 256;
+	MetricSketch<int> sketch(capacity);
+	MetricSketch<int> other(capacity);
+	std::map<int, int64_t> exact;
+	for (int i = 0; i < 100000; i++) {
+		int key = deterministicRandom()->randomInt(0, 1000000);
+		int64_t weight = deterministicRandom()->randomInt(1, 1000);
+		(i % 2 ? sketch : other).add(key, weight);
+		exact[key] += weight;
+	}
+	sketch.merge(other);
+	ASSERT_LE(sketch.size(), capacity + 1);
+
+	int64_t const total = sketch.getTotal();
+	ASSERT_EQ(total, exactEstimate(exact, 0, 1000000));
+	int64_t const tolerance = 10 * total / capacity;
+	for (int i = 0; i < 100; i++) {
+		int begin = deterministicRandom()->randomInt(0, 1000000);
+		int end = deterministicRandom()->randomInt(begin, 1000001);
+		ASSERT_LE(std::abs(sketch.getEstimate(begin, end) - exactEstimate(exact, begin, end)), tolerance);
+	}
+	int split = sketch.splitEstimate(0, 1000000, total / 2);
+	ASSERT_LE(std::abs(exactEstimate(exact, 0, split) - total / 2), tolerance);
+	return Void();
+}
+
+// Removals cancel what their keys added, wherever compaction moved it, so the error of estimates follows the live total
+// however much has been added and removed in all
+TEST_CASE("/flow/MetricSample/MetricSketch/churn") {
+	int const capacity = 256;
+	MetricSketch<int> sketch(capacity);
+	std::map<int, int64_t> exact;
+	std::vector<std::pair<int, int64_t>> live;
+	auto add = [&]() {
+		int key = deterministicRandom()->randomInt(0, 1000000);
+		int64_t weight = deterministicRandom()->randomInt(1, 1000);
+		sketch.add(key, weight);
+		exact[key] += weight;
+		live.emplace_back(key, weight);
+	};
+	auto remove = [&]() {
+		int i = deterministicRandom()->randomInt(0, live.size());
+		auto [key, weight] = live[i];
+		live[i] = live.back();
+		live.pop_back();
+		sketch.add(key, -weight);
+		if (!(exact[key] -= weight)) {
+			exact.erase(key);
+		}
+	};
+	auto check = [&]() {
+		ASSERT_LE(sketch.size(), capacity + 1);
+		int64_t const total = sketch.getTotal();
+		ASSERT_EQ(total, exactEstimate(exact, 0, 1000000));
+		int64_t const tolerance = 20 * total / capacity;
+		for (int i = 0; i < 100; i++) {
+			int begin = deterministicRandom()->randomInt(0, 1000000);
+			int end = deterministicRandom()->randomInt(begin, 1000001);
+			ASSERT_LE(std::abs(sketch.getEstimate(begin, end) - exactEstimate(exact, begin, end)), tolerance);
+		}
+	};
+
+	// About forty times the live total is added and removed, then most of what is left is removed
+	for (int i = 0; i < 5000; i++) {
+		add();
+	}
+	for (int i = 0; i < 200000; i++) {
+		remove();
+		add();
+	}
+	check();
+	while (live.size() > 500) {
+		remove();
+	}
+	check();
+	while (!live.empty()) {
+		remove();
+	}
+	ASSERT_EQ(sketch.getTotal(), 0);
+	ASSERT_EQ(sketch.getEstimate(0, 1000000), 0);
+	ASSERT_EQ(sketch.size(), 0);
+	return Void();
+}
+
+TEST_CASE("/flow/MetricSample/SketchMetricSample") {
+	SketchMetricSample<int> sample(1, 100);
+	for (int i = 0; i < 10; i++) {
+		sample.add(i, 10);
+	}
+	sample.add(3, -10);
+	ASSERT_EQ(sample.getMetric(3), 0);
+	ASSERT_EQ(sample.getEstimate(0, 10), 90);
+	ASSERT_EQ(sample.splitEstimate(0, 10, 30), 4);
+
+	SketchMetricSample<int> other(1, 100);
+	other.add(20, 5);
+	sample.merge(other);
+	ASSERT_EQ(sample.getEstimate(0, 100), 95);
+
+	// Removing keys which were compacted leaves no weight behind
+	SketchMetricSample<int> compacted(1, 100);
+	for (int i = 0; i < 1000; i++) {
+		compacted.add(i, 10);
+	}
+	for (int i = 0; i < 1000; i++) {
+		if (i != 500) {
+			compacted.add(i, -10);
+		}
+	}
+	ASSERT_EQ(compacted.getEstimate(0, 1000), 10);
+	ASSERT_EQ(compacted.getEstimate(0, 400), 0);
+	ASSERT_EQ(compacted.getEstimate(600, 1000), 0);
+
+	// Metrics below metricUnitsPerSample are sampled, and the estimate stays close to their total
+	SketchMetricSample<int> sampled(100, 100);
+	int64_t total = 0;
+	for (int i = 0; i < 10000; i++) {
+		int64_t metric = sampled.add(i, 10);
+		ASSERT(metric == 0 || metric == 100);
+		total += metric;
+	}
+	ASSERT_EQ(sampled.getEstimate(0, 10000), total);
+	ASSERT_LE(std::abs(total - 100000), 20000);
+	ASSERT_EQ(sampled.add(0, 250), 250);
+	return Void();
+}
+
+TEST_CASE("/flow/MetricSample/TransientSketchMetricSample") {
+	TransientSketchMetricSample<int> sample(1, 100, 1.0);
+	double const t = now();
+	ASSERT_EQ(sample.addAndExpire(1, 10, t - 2), 10);
+	ASSERT_EQ(sample.addAndExpire(2, 20, t + 1000), 20);
+	ASSERT_EQ(sample.addAndExpire(3, 30, t - 1), 30);
+	ASSERT_EQ(sample.getEstimate(0, 10), 60);
+	sample.poll();
+	ASSERT_EQ(sample.getEstimate(0, 10), 20);
+	ASSERT_EQ(sample.getMetric(2), 20);
+	ASSERT_EQ(sample.splitEstimate(0, 10, 5), 2);
+	return Void();
+}
@@ -25,6 +25,7 @@
 #include "flow/Platform.h"
 #include "flow/Trace.h"
 #include <algorithm>
+#include <list>
 #include <memory>
 #ifndef BOOST_SYSTEM_NO_LIB
 #define BOOST_SYSTEM_NO_LIB
@@ -45,6 +46,7 @@
 
 #include "flow/IAsyncFile.h"
 #include "flow/ActorCollection.h"
+#include "flow/ActorLineageSampler.h"
 #include "flow/TaskQueue.h"
 #include "flow/ThreadHelper.actor.h"
 #include "flow/ChaosMetrics.h"
@@ -59,6 +61,8 @@
 #include "flow/Util.h"
 #include "flow/UnitTest.h"
 #include "flow/ScopeExit.h"
+#include "flow/ScratchArena.h"
+#include "flow/SerializationStats.h"
 #include "flow/IUDPSocket.h"
 #include "flow/IConnection.h"
 
@@ -69,6 +73,16 @@
 #ifdef WIN32
 #include <mmsystem.h>
 #endif
+#ifdef __linux__
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
 #include "flow/actorcompiler.h" // This must be the last #include.
 
 // Defined to track the stack limit
@@ -164,6 +178,7 @@ public:
 	std::vector<NetworkAddress> resolveTCPEndpointBlockingWithDNSCache(const std::string& host,
 	                                                                   const std::string& service) override;
 	Reference<IListener> listen(NetworkAddress localAddr) override;
+	void initDNSResolver();
 
 	// INetwork interface
 	double now() const override { return currentTime; };
@@ -227,6 +242,10 @@ public:
 	Reference<IThreadPool> sslHandshakerPool;
 	int sslHandshakerThreadsStarted;
 	int sslPoolHandshakesInProgress;
+	Reference<IThreadPool> dnsResolverPool;
+	int dnsResolverThreadsStarted;
+	// Lookups which are currently running, keyed by host:service, so that concurrent resolutions share one lookup
+	std::map<std::string, Future<std::vector<NetworkAddress>>> dnsResolutionsInFlight;
 	TLSConfig tlsConfig;
 	Reference<TLSPolicy> activeTlsPolicy;
 	Future<Void> backgroundCertRefresh;
@@ -257,6 +276,10 @@ public:
 
 	NetworkMetrics::PriorityStats* lastPriorityStats;
 
+	// How long the run loop has recently spent between polls of the reactor, as seen by listeners deciding whether to
+	// accept more connections
+	double runLoopLag = 0;
+
 	struct PromiseTask final : public FastAllocated<PromiseTask> {
 		Promise<Void> promise;
 		PromiseTask() {}
@@ -284,6 +307,9 @@ public:
 
 	Future<Void> timeOffsetLogger;
 	Future<Void> logTimeOffset();
+#ifdef ENABLE_SAMPLING
+	Future<Void> actorLineageSampler;
+#endif
 
 	Int64MetricHandle bytesReceived;
 	Int64MetricHandle udpBytesReceived;
@@ -669,6 +695,15 @@ public:
 		return res;
 	}
 
+	Future<int> sendBatch(VectorRef<UDPDatagram> datagrams) override {
+		return doSendBatch(Reference<UDPSocket>::addRef(this), datagrams);
+	}
+
+	Future<Standalone<VectorRef<UDPDatagram>>> receiveBatch(int maxDatagrams, int maxDatagramSize) override {
+		ASSERT(maxDatagrams > 0 && maxDatagramSize > 0 && maxDatagramSize <= MAX_PACKET_SIZE);
+		return doReceiveBatch(Reference<UDPSocket>::addRef(this), maxDatagrams, maxDatagramSize);
+	}
+
     void set_multicast_group(NetworkAddress const& laddr, NetworkAddress const& maddr) override {
         boost::system::error_code ec;
         socket.set_option(boost::asio::ip::udp::socket::reuse_address(true), ec);
@@ -716,7 +751,300 @@ public:
 
 private:
 	UDPSocket(boost::asio::io_service& io_service, Optional<NetworkAddress> toAddress, bool isV6)
-	  : id(nondeterministicRandom()->randomUniqueID()), socket(io_service, isV6 ? udp::v6() : udp::v4()) {}
+	  : id(nondeterministicRandom()->randomUniqueID()), toAddress(toAddress),
+	    socket(io_service, isV6 ? udp::v6() : udp::v4()) {}
+
+	// The largest payload a single GSO send may carry, and the most segments the kernel accepts in one send
+	constexpr static int MAX_GSO_PAYLOAD = 65507;
+	constexpr static int MAX_GSO_SEGMENTS = 64;
+	// The most datagrams the kernel coalesces into one GRO message (UDP_GRO_CNT_MAX)
+	constexpr static int MAX_GRO_SEGMENTS = 64;
+	// The most messages passed to one sendmmsg()/recvmmsg() call (UIO_MAXIOV)
+	constexpr static int MAX_MESSAGES_PER_CALL = 1024;
+
+#ifdef __linux__
+	bool gsoEnabled = FLOW_KNOBS->UDP_BATCH_ENABLE_GSO;
+	bool groEnabled = false;
+	bool groChecked = false;
+
+	// Scratch space for sendmmsg()/recvmmsg(). A batch never spans a wait, so one set per socket is enough.
+	constexpr static int CONTROL_SLOT_SIZE = CMSG_SPACE(sizeof(uint16_t));
+	std::vector<mmsghdr> messages;
+	std::vector<iovec> iovecs;
+	std::vector<udp::endpoint> endpoints;
+	std::vector<char> control;
+	std::vector<int> messageEnds;
+
+	void reserveScratch(int messageCount, int iovecCount) {
+		if (messages.size() < messageCount) {
+			messages.resize(messageCount);
+			endpoints.resize(messageCount);
+			control.resize(messageCount * CONTROL_SLOT_SIZE);
+			messageEnds.resize(messageCount);
+		}
+		if (iovecs.size() < iovecCount) {
+			iovecs.resize(iovecCount);
+		}
+	}
+
+	// GRO changes what receive() and receiveFrom() return as well, so it is only turned on by the first
+	// receiveBatch() on a socket and only when UDP_BATCH_ENABLE_GRO is set.
+	void enableGRO() {
+		if (groChecked) {
+			return;
+		}
+		groChecked = true;
+		if (FLOW_KNOBS->UDP_BATCH_ENABLE_GRO) {
+			int on = 1;
+			groEnabled = setsockopt(socket.native_handle(), SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+		}
+	}
+#endif
+
+	// Splits the receive buffer for receiveBatch() into slots, each receiving one message. Without GRO a slot holds one
+	// datagram. With GRO a slot holds up to MAX_GRO_SEGMENTS coalesced datagrams of maxDatagramSize bytes, and there
+	// are only as many slots as it takes to hold maxDatagrams of them, so the buffer is no larger than without GRO.
+	// Datagrams which the kernel did not coalesce then take a whole slot each.
+	void receiveSlots(int maxDatagrams, int maxDatagramSize, int* slotSize, int* slots) {
+		*slotSize = maxDatagramSize;
+		*slots = maxDatagrams;
+#ifdef __linux__
+		enableGRO();
+		// Without a datagram to fit, there is nothing to coalesce
+		if (groEnabled && maxDatagrams > 0 && maxDatagramSize > 0 && maxDatagramSize <= MAX_PACKET_SIZE) {
+			int segments = std::min<int>(
+			    { maxDatagrams, MAX_GRO_SEGMENTS, static_cast<int>(MAX_PACKET_SIZE / maxDatagramSize) });
+			*slotSize = std::min<int>(segments * maxDatagramSize, MAX_PACKET_SIZE);
+			*slots = (maxDatagrams + segments - 1) / segments;
+		}
+#endif
+	}
+
+	Future<Void> onReadable() {
+		BindPromise p("N2_UDPReadError", id);
+		auto f = p.getFuture();
+		socket.async_wait(udp::socket::wait_read, std::move(p));
+		return f;
+	}
+
+	Future<Void> onWritable() {
+		BindPromise p("N2_UDPWriteError", id);
+		auto f = p.getFuture();
+		socket.async_wait(udp::socket::wait_write, std::move(p));
+		return f;
+	}
+
+	static bool wouldBlock(int err) { return err == EAGAIN || err == EWOULDBLOCK || err == EINTR || err == ENOBUFS; }
+
+	// Receives into buffer, which holds |slots| slots of slotSize bytes each. Returns false if nothing was available.
+	bool tryReceiveBatch(Standalone<VectorRef<UDPDatagram>>& result, uint8_t* buffer, int slotSize, int slots) {
+		++g_net2->countUDPReads;
+#ifdef __linux__
+		int count = std::min(slots, MAX_MESSAGES_PER_CALL);
+		reserveScratch(count, count);
+		for (int i = 0; i < count; ++i) {
+			iovecs[i].iov_base = buffer + (size_t)i * slotSize;
+			iovecs[i].iov_len = slotSize;
+			msghdr& hdr = messages[i].msg_hdr;
+			memset(&messages[i], 0, sizeof(mmsghdr));
+			hdr.msg_name = endpoints[i].data();
+			hdr.msg_namelen = endpoints[i].capacity();
+			hdr.msg_iov = &iovecs[i];
+			hdr.msg_iovlen = 1;
+			if (groEnabled) {
+				hdr.msg_control = &control[i * CONTROL_SLOT_SIZE];
+				hdr.msg_controllen = CONTROL_SLOT_SIZE;
+			}
+		}
+		int received = ::recvmmsg(socket.native_handle(), messages.data(), count, MSG_DONTWAIT, nullptr);
+		if (received < 0) {
+			if (wouldBlock(errno)) {
+				++g_net2->countWouldBlock;
+				return false;
+			}
+			onReadError(boost::system::error_code(errno, boost::system::system_category()));
+			throw connection_failed();
+		}
+		for (int i = 0; i < received; ++i) {
+			endpoints[i].resize(messages[i].msg_hdr.msg_namelen);
+			NetworkAddress sender(toIPAddress(endpoints[i].address()), endpoints[i].port());
+			const uint8_t* data = (const uint8_t*)iovecs[i].iov_base;
+			int length = messages[i].msg_len;
+			int segmentSize = length;
+			if (groEnabled) {
+				for (cmsghdr* cmsg = CMSG_FIRSTHDR(&messages[i].msg_hdr); cmsg != nullptr;
+				     cmsg = CMSG_NXTHDR(&messages[i].msg_hdr, cmsg)) {
+					if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+						uint16_t gsoSize;
+						memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof(gsoSize));
+						segmentSize = gsoSize;
+					}
+				}
+			}
+			int offset = 0;
+			do {
+				int segmentLength = std::min(segmentSize, length - offset);
+				result.push_back(result.arena(), UDPDatagram{ StringRef(data + offset, segmentLength), sender });
+				offset += segmentLength;
+			} while (offset < length);
+			g_net2->udpBytesReceived += length;
+		}
+		return received > 0;
+#else
+		int received = 0;
+		while (received < slots) {
+			udp::endpoint endpoint;
+			boost::system::error_code ec;
+			uint8_t* slot = buffer + (size_t)received * slotSize;
+			size_t length = socket.receive_from(
+			    boost::asio::mutable_buffer(slot, slotSize), endpoint, udp::socket::message_flags(), ec);
+			if (ec == boost::asio::error::would_block || ec == boost::asio::error::try_again) {
+				break;
+			}
+			if (ec) {
+				onReadError(ec);
+				throw connection_failed();
+			}
+			NetworkAddress sender(toIPAddress(endpoint.address()), endpoint.port());
+			result.push_back(result.arena(), UDPDatagram{ StringRef(slot, length), sender });
+			g_net2->udpBytesReceived += length;
+			++received;
+		}
+		if (received == 0) {
+			++g_net2->countWouldBlock;
+		}
+		return received > 0;
+#endif
+	}
+
+	// Returns the number of datagrams sent, or 0 if the socket buffer is full.
+	int trySendBatch(VectorRef<UDPDatagram> const& datagrams) {
+		++g_net2->countUDPWrites;
+#ifdef __linux__
+		int count = std::min(datagrams.size(), MAX_MESSAGES_PER_CALL);
+		reserveScratch(count, count);
+		bool usedGSO = false;
+		int messageCount = 0;
+		for (int i = 0; i < count; ++messageCount) {
+			// With GSO, a run of datagrams to the same peer which all have the size of the first one, except
+			// possibly a shorter last one, is handed to the kernel as one message and split by the kernel or NIC.
+			int run = 1;
+			int segmentSize = datagrams[i].data.size();
+			if (gsoEnabled && segmentSize > 0) {
+				int total = segmentSize;
+				while (i + run < count && run < MAX_GSO_SEGMENTS) {
+					const UDPDatagram& next = datagrams[i + run];
+					if ((!toAddress.present() && next.peer != datagrams[i].peer) || next.data.size() == 0 ||
+					    next.data.size() > segmentSize || total + next.data.size() > MAX_GSO_PAYLOAD) {
+						break;
+					}
+					total += next.data.size();
+					++run;
+					if (next.data.size() < segmentSize) {
+						break;
+					}
+				}
+			}
+
+			msghdr& hdr = messages[messageCount].msg_hdr;
+			memset(&messages[messageCount], 0, sizeof(mmsghdr));
+			for (int j = 0; j < run; ++j) {
+				iovecs[i + j].iov_base = const_cast<uint8_t*>(datagrams[i + j].data.begin());
+				iovecs[i + j].iov_len = datagrams[i + j].data.size();
+			}
+			hdr.msg_iov = &iovecs[i];
+			hdr.msg_iovlen = run;
+			if (!toAddress.present()) {
+				endpoints[messageCount] = udpEndpoint(datagrams[i].peer);
+				hdr.msg_name = endpoints[messageCount].data();
+				hdr.msg_namelen = endpoints[messageCount].size();
+			}
+			if (run > 1) {
+				usedGSO = true;
+				hdr.msg_control = &control[messageCount * CONTROL_SLOT_SIZE];
+				hdr.msg_controllen = CONTROL_SLOT_SIZE;
+				cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+				cmsg->cmsg_level = SOL_UDP;
+				cmsg->cmsg_type = UDP_SEGMENT;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+				uint16_t gsoSize = segmentSize;
+				memcpy(CMSG_DATA(cmsg), &gsoSize, sizeof(gsoSize));
+			}
+			i += run;
+			messageEnds[messageCount] = i;
+		}
+
+		int sent = ::sendmmsg(socket.native_handle(), messages.data(), messageCount, MSG_DONTWAIT);
+		if (sent < 0) {
+			int err = errno;
+			if (wouldBlock(err)) {
+				++g_net2->countWouldBlock;
+				return 0;
+			}
+			if (usedGSO && (err == EIO || err == EINVAL || err == EOPNOTSUPP)) {
+				// The kernel or the egress device cannot segment (e.g. no checksum offload), so stop using GSO
+				TraceEvent(SevWarn, "N2_UDPGSODisabled", id).detail("ErrorCode", err);
+				gsoEnabled = false;
+				return trySendBatch(datagrams);
+			}
+			onWriteError(boost::system::error_code(err, boost::system::system_category()));
+			throw connection_failed();
+		}
+		return sent == 0 ? 0 : messageEnds[sent - 1];
+#else
+		int sent = 0;
+		for (; sent < datagrams.size(); ++sent) {
+			boost::system::error_code ec;
+			boost::asio::const_buffer buffer(datagrams[sent].data.begin(), datagrams[sent].data.size());
+			if (toAddress.present()) {
+				socket.send(buffer, udp::socket::message_flags(), ec);
+			} else {
+				socket.send_to(buffer, udpEndpoint(datagrams[sent].peer), udp::socket::message_flags(), ec);
+			}
+			if (ec == boost::asio::error::would_block || ec == boost::asio::error::try_again ||
+			    ec == boost::asio::error::no_buffer_space) {
+				break;
+			}
+			if (ec) {
+				onWriteError(ec);
+				throw connection_failed();
+			}
+		}
+		if (sent == 0) {
+			++g_net2->countWouldBlock;
+		}
+		return sent;
+#endif
+	}
+
+	ACTOR static Future<int> doSendBatch(Reference<UDPSocket> self, VectorRef<UDPDatagram> datagrams) {
+		if (datagrams.empty()) {
+			return 0;
+		}
+		loop {
+			int sent = self->trySendBatch(datagrams);
+			if (sent > 0) {
+				return sent;
+			}
+			wait(self->onWritable());
+		}
+	}
+
+	ACTOR static Future<Standalone<VectorRef<UDPDatagram>>> doReceiveBatch(Reference<UDPSocket> self,
+	                                                                      int maxDatagrams,
+	                                                                      int maxDatagramSize) {
+		state Standalone<VectorRef<UDPDatagram>> result;
+		state int slotSize;
+		state int slots;
+		self->receiveSlots(maxDatagrams, maxDatagramSize, &slotSize, &slots);
+		state uint8_t* buffer = new (result.arena()) uint8_t[(size_t)slotSize * slots];
+		loop {
+			if (self->tryReceiveBatch(result, buffer, slotSize, slots)) {
+				return result;
+			}
+			wait(self->onReadable());
+		}
+	}
 
 	void closeSocket() {
 		boost::system::error_code error;
@@ -749,10 +1077,121 @@ private:
 	}
 };
 
+static NetworkAddress peerNetworkAddress(const tcp::endpoint& peer_endpoint, bool isTLS) {
+	auto peer_address = peer_endpoint.address().is_v6() ? IPAddress(peer_endpoint.address().to_v6().to_bytes())
+	                                                    : IPAddress(peer_endpoint.address().to_v4().to_ulong());
+	return NetworkAddress(peer_address, peer_endpoint.port(), false, isTLS);
+}
+
+// Decides which accepted connections a listener hands out. Each source IP has a token bucket of
+// LISTENER_ACCEPT_PER_IP_RATE connections per second, and accepting pauses while the run loop lags by more than
+// LISTENER_OVERLOAD_RUN_LOOP_LAG, so that a connection flood cannot take the network thread away from existing peers.
+class AcceptAdmission : NonCopyable {
+public:
+	ListenerMetrics metrics;
+
+	// Returns false, and counts the rejection, if peer has used up its accept rate
+	bool admit(const NetworkAddress& peer) {
+		double rate = FLOW_KNOBS->LISTENER_ACCEPT_PER_IP_RATE;
+		if (rate <= 0) {
+			++metrics.accepted;
+			return true;
+		}
+
+		double t = now();
+		double burst = FLOW_KNOBS->LISTENER_ACCEPT_PER_IP_BURST;
+		Bucket& bucket = sourceBucket(peer.ip, t, burst);
+		bucket.tokens = std::min(burst, bucket.tokens + (t - bucket.lastRefill) * rate);
+		bucket.lastRefill = t;
+		if (bucket.tokens < 1) {
+			++metrics.rejected;
+			TraceEvent(SevWarnAlways, "N2_AcceptRateExceeded").suppressFor(1.0).detail("PeerAddr", peer);
+			return false;
+		}
+		bucket.tokens -= 1;
+		++metrics.accepted;
+		return true;
+	}
+
+	bool overloaded() const {
+		return FLOW_KNOBS->LISTENER_OVERLOAD_RUN_LOOP_LAG > 0 &&
+		       N2::g_net2->runLoopLag > FLOW_KNOBS->LISTENER_OVERLOAD_RUN_LOOP_LAG;
+	}
+
+	ACTOR static Future<Void> waitUntilNotOverloaded(AcceptAdmission* self) {
+		loop {
+			if (!self->overloaded()) {
+				return Void();
+			}
+			++self->metrics.overloadPauses;
+			TraceEvent(SevWarn, "N2_AcceptPaused").suppressFor(1.0).detail("RunLoopLag", N2::g_net2->runLoopLag);
+			wait(delay(FLOW_KNOBS->LISTENER_OVERLOAD_PAUSE));
+		}
+	}
+
+private:
+	struct Bucket {
+		IPAddress ip;
+		double tokens;
+		double lastRefill;
+	};
+	// Most recently seen first
+	std::list<Bucket> recentSources;
+	std::unordered_map<IPAddress, std::list<Bucket>::iterator> sources;
+
+	// Returns the bucket of ip, moved to the front of recentSources. A new source gets a full bucket, and once
+	// LISTENER_ACCEPT_TRACKED_IPS sources are tracked, the least recently seen one is forgotten to make room.
+	Bucket& sourceBucket(const IPAddress& ip, double t, double burst) {
+		auto it = sources.find(ip);
+		if (it != sources.end()) {
+			recentSources.splice(recentSources.begin(), recentSources, it->second);
+			return recentSources.front();
+		}
+		while (!recentSources.empty() && sources.size() >= std::max(1, FLOW_KNOBS->LISTENER_ACCEPT_TRACKED_IPS)) {
+			sources.erase(recentSources.back().ip);
+			recentSources.pop_back();
+		}
+		recentSources.push_front(Bucket{ ip, burst, t });
+		sources.emplace(ip, recentSources.begin());
+		return recentSources.front();
+	}
+};
+
+// Takes up to LISTENER_ACCEPT_BATCH - 1 connections which are already waiting on acceptor without blocking, and appends
+// the admitted ones to pending
+template <class ConnectionType>
+void acceptWaiting(boost::asio::io_context& io_service,
+                   tcp::acceptor& acceptor,
+                   std::function<Reference<ConnectionType>()> const& makeConnection,
+                   bool isTLS,
+                   AcceptAdmission& admission,
+                   Deque<Reference<ConnectionType>>& pending) {
+	for (int i = 1; i < FLOW_KNOBS->LISTENER_ACCEPT_BATCH; ++i) {
+		Reference<ConnectionType> conn = makeConnection();
+		tcp::acceptor::endpoint_type peer_endpoint;
+		boost::system::error_code ec;
+		acceptor.accept(conn->getSocket(), peer_endpoint, ec);
+		if (ec) {
+			// would_block means the backlog is empty; anything else is left for the next async_accept to report
+			conn->close();
+			break;
+		}
+		NetworkAddress peer = peerNetworkAddress(peer_endpoint, isTLS);
+		if (!admission.admit(peer)) {
+			conn->close();
+			continue;
+		}
+		conn->accept(peer);
+		pending.push_back(conn);
+	}
+}
+
 class Listener final : public IListener, ReferenceCounted<Listener> {
 	boost::asio::io_context& io_service;
 	NetworkAddress listenAddress;
 	tcp::acceptor acceptor;
+	AcceptAdmission admission;
+	Deque<Reference<Connection>> pending;
 
 public:
 	Listener(boost::asio::io_context& io_service, NetworkAddress listenAddress)
@@ -765,6 +1204,7 @@ public:
 			        std::to_string(acceptor.local_endpoint().port())));
 		}
 		platform::setCloseOnExec(acceptor.native_handle());
+		acceptor.non_blocking(true);
 	}
 
 	void addref() override { ReferenceCounted<Listener>::addref(); }
@@ -775,23 +1215,52 @@ public:
 
 	NetworkAddress getListenAddress() const override { return listenAddress; }
 
+	ListenerMetrics getMetrics() const override {
+		ListenerMetrics m = admission.metrics;
+		m.pending = pending.size();
+		return m;
+	}
+
 private:
 	ACTOR static Future<Reference<IConnection>> doAccept(Listener* self) {
-		state Reference<Connection> conn(new Connection(self->io_service));
+		state Reference<Connection> conn;
 		state tcp::acceptor::endpoint_type peer_endpoint;
-		try {
-			BindPromise p("N2_AcceptError", UID());
-			auto f = p.getFuture();
-			self->acceptor.async_accept(conn->getSocket(), peer_endpoint, std::move(p));
-			wait(f);
-			auto peer_address = peer_endpoint.address().is_v6() ? IPAddress(peer_endpoint.address().to_v6().to_bytes())
-			                                                    : IPAddress(peer_endpoint.address().to_v4().to_ulong());
-			conn->accept(NetworkAddress(peer_address, peer_endpoint.port()));
-
-			return conn;
-		} catch (...) {
-			conn->close();
-			throw;
+		loop {
+			if (!self->pending.empty()) {
+				conn = self->pending.front();
+				self->pending.pop_front();
+				return conn;
+			}
+
+			if (self->admission.overloaded()) {
+				wait(AcceptAdmission::waitUntilNotOverloaded(&self->admission));
+			}
+
+			conn = Reference<Connection>(new Connection(self->io_service));
+			try {
+				BindPromise p("N2_AcceptError", UID());
+				auto f = p.getFuture();
+				self->acceptor.async_accept(conn->getSocket(), peer_endpoint, std::move(p));
+				wait(f);
+			} catch (...) {
+				conn->close();
+				throw;
+			}
+
+			NetworkAddress peer = peerNetworkAddress(peer_endpoint, false);
+			if (self->admission.admit(peer)) {
+				conn->accept(peer);
+				self->pending.push_back(conn);
+			} else {
+				conn->close();
+			}
+			acceptWaiting<Connection>(
+			    self->io_service,
+			    self->acceptor,
+			    [self = self]() { return Reference<Connection>(new Connection(self->io_service)); },
+			    false,
+			    self->admission,
+			    self->pending);
 		}
 	}
 };
@@ -1191,6 +1660,8 @@ class SSLListener final : public IListener, ReferenceCounted<SSLListener> {
 	NetworkAddress listenAddress;
 	tcp::acceptor acceptor;
 	AsyncVar<Reference<ReferencedObject<boost::asio::ssl::context>>>* contextVar;
+	AcceptAdmission admission;
+	Deque<Reference<SSLConnection>> pending;
 
 public:
 	SSLListener(boost::asio::io_context& io_service,
@@ -1209,6 +1680,7 @@ public:
 			                                                .append(listenAddress.isTLS() ? ":tls" : ""));
 		}
 		platform::setCloseOnExec(acceptor.native_handle());
+		acceptor.non_blocking(true);
 	}
 
 	void addref() override { ReferenceCounted<SSLListener>::addref(); }
@@ -1219,24 +1691,55 @@ public:
 
 	NetworkAddress getListenAddress() const override { return listenAddress; }
 
+	ListenerMetrics getMetrics() const override {
+		ListenerMetrics m = admission.metrics;
+		m.pending = pending.size();
+		return m;
+	}
+
 private:
+	// Rejected connections are closed before their handshake is queued, so a flood from one source costs no TLS work
 	ACTOR static Future<Reference<IConnection>> doAccept(SSLListener* self) {
-		state Reference<SSLConnection> conn(new SSLConnection(self->io_service, self->contextVar->get()));
+		state Reference<SSLConnection> conn;
 		state tcp::acceptor::endpoint_type peer_endpoint;
-		try {
-			BindPromise p("N2_AcceptError", UID());
-			auto f = p.getFuture();
-			self->acceptor.async_accept(conn->getSocket(), peer_endpoint, std::move(p));
-			wait(f);
-			auto peer_address = peer_endpoint.address().is_v6() ? IPAddress(peer_endpoint.address().to_v6().to_bytes())
-			                                                    : IPAddress(peer_endpoint.address().to_v4().to_ulong());
+		loop {
+			if (!self->pending.empty()) {
+				conn = self->pending.front();
+				self->pending.pop_front();
+				return conn;
+			}
 
-			conn->accept(NetworkAddress(peer_address, peer_endpoint.port(), false, true));
+			if (self->admission.overloaded()) {
+				wait(AcceptAdmission::waitUntilNotOverloaded(&self->admission));
+			}
 
-			return conn;
-		} catch (...) {
-			conn->close();
-			throw;
+			conn = Reference<SSLConnection>(new SSLConnection(self->io_service, self->contextVar->get()));
+			try {
+				BindPromise p("N2_AcceptError", UID());
+				auto f = p.getFuture();
+				self->acceptor.async_accept(conn->getSocket(), peer_endpoint, std::move(p));
+				wait(f);
+			} catch (...) {
+				conn->close();
+				throw;
+			}
+
+			NetworkAddress peer = peerNetworkAddress(peer_endpoint, true);
+			if (self->admission.admit(peer)) {
+				conn->accept(peer);
+				self->pending.push_back(conn);
+			} else {
+				conn->close();
+			}
+			acceptWaiting<SSLConnection>(
+			    self->io_service,
+			    self->acceptor,
+			    [self = self]() {
+				    return Reference<SSLConnection>(new SSLConnection(self->io_service, self->contextVar->get()));
+			    },
+			    true,
+			    self->admission,
+			    self->pending);
 		}
 	}
 };
@@ -1247,7 +1750,7 @@ Net2::Net2(const TLSConfig& tlsConfig, bool useThreadPool, bool useMetrics)
   : globals(enumGlobal::COUNT), useThreadPool(useThreadPool), reactor(this),
     sslContextVar({ ReferencedObject<boost::asio::ssl::context>::from(
         boost::asio::ssl::context(boost::asio::ssl::context::tls)) }),
-    sslHandshakerThreadsStarted(0), sslPoolHandshakesInProgress(0), tlsConfig(tlsConfig),
+    sslHandshakerThreadsStarted(0), sslPoolHandshakesInProgress(0), dnsResolverThreadsStarted(0), tlsConfig(tlsConfig),
     tlsInitializedState(ETLSInitState::NONE), network(this), tscBegin(0), tscEnd(0), taskBegin(0),
     currentTaskID(TaskPriority::DefaultYield), stopped(false), started(false), numYields(0),
     lastPriorityStats(nullptr) {
@@ -1261,6 +1764,9 @@ Net2::Net2(const TLSConfig& tlsConfig, bool useThreadPool, bool useMetrics)
 	if (FLOW_KNOBS->ENABLE_CHAOS_FEATURES) {
 		setGlobal(INetwork::enChaosMetrics, (flowGlobalType)&chaosMetrics);
 	}
+	if (FLOW_KNOBS->SERIALIZATION_STATS_ENABLED) {
+		SerializationStats::setEnabled(true);
+	}
 	setGlobal(INetwork::enMetrics, (flowGlobalType)&metrics);
 	setGlobal(INetwork::enNetworkConnections, (flowGlobalType)network);
 	setGlobal(INetwork::enASIOService, (flowGlobalType)&reactor.ios);
@@ -1438,6 +1944,7 @@ void Net2::run() {
 	thread_network = this;
 
 	unsigned int tasksSinceReact = 0;
+	ScratchArena& scratchArena = ScratchArena::local();
 
 #ifdef WIN32
 	if (timeBeginPeriod(1) != TIMERR_NOERROR)
@@ -1445,6 +1952,9 @@ void Net2::run() {
 #endif
 
 	timeOffsetLogger = logTimeOffset();
+#ifdef ENABLE_SAMPLING
+	actorLineageSampler = runActorLineageSampler();
+#endif
 	const char* flow_profiler_enabled = getenv("FLOW_PROFILER_ENABLED");
 	if (flow_profiler_enabled != nullptr && *flow_profiler_enabled != '\0') {
 		// The empty string check is to allow running `FLOW_PROFILER_ENABLED= ./fdbserver` to force disabling flow
@@ -1538,6 +2048,8 @@ void Net2::run() {
 			} catch (...) {
 				TraceEvent(SevError, "TaskError").error(unknown_error());
 			}
+			// Scratch memory never outlives the task which allocated it
+			scratchArena.reset();
 
 			if (currentTaskID < minTaskID) {
 				trackAtPriority(currentTaskID, taskBegin);
@@ -1617,6 +2129,8 @@ void Net2::run() {
 		}
 #endif
 		nnow = timer_monotonic();
+		// Halves every iteration, so a single slow task is forgotten quickly once the loop is responsive again
+		runLoopLag = std::max(nnow - now, runLoopLag * 0.5);
 
 		if ((nnow - now) > FLOW_KNOBS->SLOW_LOOP_CUTOFF &&
 		    nondeterministicRandom()->random01() < (nnow - now) * FLOW_KNOBS->SLOW_LOOP_SAMPLING_RATE)
@@ -1628,6 +2142,16 @@ void Net2::run() {
 		fn();
 	}
 
+#ifdef ENABLE_SAMPLING
+	// Joins the sampler thread, which reads this network's lineage set
+	actorLineageSampler = Future<Void>();
+#endif
+
+	// Joins the resolver threads, waiting for any lookup they are blocked in
+	if (dnsResolverPool) {
+		dnsResolverPool->stop();
+	}
+
 #ifdef WIN32
 	timeEndPeriod(1);
 #endif
@@ -1818,90 +2342,171 @@ Future<Reference<IUDPSocket>> Net2::createUDPSocket(bool isV6) {
 	return UDPSocket::connect(&reactor.ios, Optional<NetworkAddress>(), isV6);
 }
 
+// Converts resolver results to NetworkAddresses. IPv6 loopback might not be supported, so such addresses are dropped
+// when skipV6Loopback is set.
+template <class ResolverIterator>
+static std::vector<NetworkAddress> toNetworkAddresses(ResolverIterator iter, bool skipV6Loopback) {
+	std::vector<NetworkAddress> addrs;
+	ResolverIterator end;
+	while (iter != end) {
+		auto endpoint = iter->endpoint();
+		auto addr = endpoint.address();
+		if (addr.is_v6()) {
+			if (!skipV6Loopback || !addr.is_loopback()) {
+				addrs.emplace_back(IPAddress(addr.to_v6().to_bytes()), endpoint.port());
+			}
+		} else {
+			addrs.emplace_back(addr.to_v4().to_ulong(), endpoint.port());
+		}
+		++iter;
+	}
+	return addrs;
+}
+
+// Runs the blocking getaddrinfo() on a dedicated thread, so that a slow DNS server delays only the lookups it serves
+// instead of every lookup queued behind it on asio's single internal resolver thread.
+struct DNSResolverThread final : IThreadPoolReceiver {
+	DNSResolverThread() : resolver(ios) {}
+	void init() override {}
+
+	struct Resolve final : TypedAction<DNSResolverThread, Resolve> {
+		Resolve(std::string host, std::string service) : host(std::move(host)), service(std::move(service)) {}
+		double getTimeEstimate() const override { return 0.01; }
+
+		ThreadReturnPromise<std::vector<NetworkAddress>> result;
+		std::string host;
+		std::string service;
+	};
+
+	void action(Resolve& r) {
+		boost::system::error_code ec;
+		auto results = resolver.resolve(r.host, r.service, ec);
+		if (ec) {
+			r.result.sendError(lookup_failed());
+			return;
+		}
+		std::vector<NetworkAddress> addrs = toNetworkAddresses(results, true);
+		if (addrs.empty()) {
+			r.result.sendError(lookup_failed());
+		} else {
+			r.result.send(addrs);
+		}
+	}
+
+	boost::asio::io_service ios;
+	tcp::resolver resolver;
+};
+
+void Net2::initDNSResolver() {
+	if (dnsResolverThreadsStarted > 0) {
+		return;
+	}
+	dnsResolverPool = createGenericThreadPool(FLOW_KNOBS->DNS_RESOLVER_THREAD_STACKSIZE);
+	for (int i = 0; i < FLOW_KNOBS->DNS_RESOLVER_THREADS; ++i) {
+		++dnsResolverThreadsStarted;
+		dnsResolverPool->addThread(new DNSResolverThread(), "fdb-dns-resolve");
+	}
+}
+
 ACTOR static Future<std::vector<NetworkAddress>> resolveTCPEndpoint_impl(Net2* self,
                                                                          std::string host,
                                                                          std::string service) {
 	state tcp::resolver tcpResolver(self->reactor.ios);
-	Promise<std::vector<NetworkAddress>> promise;
-	state Future<std::vector<NetworkAddress>> result = promise.getFuture();
-
-	tcpResolver.async_resolve(
-	    host, service, [promise](const boost::system::error_code& ec, tcp::resolver::iterator iter) {
-		    if (ec) {
-			    promise.sendError(lookup_failed());
-			    return;
-		    }
-
-		    std::vector<NetworkAddress> addrs;
-
-		    tcp::resolver::iterator end;
-		    while (iter != end) {
-			    auto endpoint = iter->endpoint();
-			    auto addr = endpoint.address();
-			    if (addr.is_v6()) {
-				    // IPV6 loopback might not be supported, only return IPV6 address
-				    if (!addr.is_loopback()) {
-					    addrs.emplace_back(IPAddress(addr.to_v6().to_bytes()), endpoint.port());
-				    }
-			    } else {
-				    addrs.emplace_back(addr.to_v4().to_ulong(), endpoint.port());
+	state Future<std::vector<NetworkAddress>> result;
+	state std::vector<NetworkAddress> ret;
+
+	if (FLOW_KNOBS->DNS_RESOLVER_THREADS > 0) {
+		self->initDNSResolver();
+		auto resolve = new DNSResolverThread::Resolve(host, service);
+		result = resolve->result.getFuture();
+		self->dnsResolverPool->post(resolve);
+	} else {
+		Promise<std::vector<NetworkAddress>> promise;
+		result = promise.getFuture();
+
+		tcpResolver.async_resolve(
+		    host, service, [promise](const boost::system::error_code& ec, tcp::resolver::iterator iter) {
+			    if (ec) {
+				    promise.sendError(lookup_failed());
+				    return;
 			    }
-			    ++iter;
-		    }
 
-		    if (addrs.empty()) {
-			    promise.sendError(lookup_failed());
-		    } else {
-			    promise.send(addrs);
-		    }
-	    });
+			    std::vector<NetworkAddress> addrs = toNetworkAddresses(iter, true);
+			    if (addrs.empty()) {
+				    promise.sendError(lookup_failed());
+			    } else {
+				    promise.send(addrs);
+			    }
+		    });
+	}
 
 	try {
-		wait(ready(result));
+		wait(store(ret, result));
 	} catch (Error& e) {
-		if (e.code() == error_code_lookup_failed) {
-			self->dnsCache.remove(host, service);
+		// A failed re-resolution leaves an unexpired entry in place, so a DNS outage does not evict working addresses
+		if (self->dnsCache.find(host, service).present()) {
+			self->dnsCache.refreshFailed(host, service, FLOW_KNOBS->DNS_CACHE_NEGATIVE_TTL);
+		} else if (e.code() == error_code_lookup_failed) {
+			self->dnsCache.addNegative(host, service, FLOW_KNOBS->DNS_CACHE_NEGATIVE_TTL);
 		}
 		throw e;
 	}
 	tcpResolver.cancel();
-	std::vector<NetworkAddress> ret = result.get();
-	self->dnsCache.add(host, service, ret);
+	self->dnsCache.add(host, service, ret, FLOW_KNOBS->DNS_CACHE_TTL, FLOW_KNOBS->DNS_CACHE_REFRESH_FRACTION);
 
 	return ret;
 }
 
+ACTOR static void resolveTCPEndpointShared(Net2* self,
+                                           std::string host,
+                                           std::string service,
+                                           Promise<std::vector<NetworkAddress>> result) {
+	state std::string key = host + ":" + service;
+	try {
+		std::vector<NetworkAddress> addrs = wait(resolveTCPEndpoint_impl(self, host, service));
+		self->dnsResolutionsInFlight.erase(key);
+		result.send(addrs);
+	} catch (Error& e) {
+		self->dnsResolutionsInFlight.erase(key);
+		result.sendError(e);
+	}
+}
+
 Future<std::vector<NetworkAddress>> Net2::resolveTCPEndpoint(const std::string& host, const std::string& service) {
-	return resolveTCPEndpoint_impl(this, host, service);
+	std::string key = host + ":" + service;
+	auto it = dnsResolutionsInFlight.find(key);
+	if (it != dnsResolutionsInFlight.end()) {
+		return it->second;
+	}
+	Promise<std::vector<NetworkAddress>> result;
+	Future<std::vector<NetworkAddress>> resolved = result.getFuture();
+	dnsResolutionsInFlight[key] = resolved;
+	resolveTCPEndpointShared(this, host, service, result);
+	return resolved;
 }
 
 Future<std::vector<NetworkAddress>> Net2::resolveTCPEndpointWithDNSCache(const std::string& host,
                                                                          const std::string& service) {
 	if (FLOW_KNOBS->ENABLE_COORDINATOR_DNS_CACHE) {
+		if (dnsCache.findNegative(host, service)) {
+			return lookup_failed();
+		}
 		Optional<std::vector<NetworkAddress>> cache = dnsCache.find(host, service);
 		if (cache.present()) {
+			if (dnsCache.needsRefresh(host, service)) {
+				// Re-resolve entries which are still in use before they expire. The lookup updates the cache.
+				resolveTCPEndpoint(host, service);
+			}
 			return cache.get();
 		}
 	}
-	return resolveTCPEndpoint_impl(this, host, service);
+	return resolveTCPEndpoint(host, service);
 }
 
 std::vector<NetworkAddress> Net2::resolveTCPEndpointBlocking(const std::string& host, const std::string& service) {
 	tcp::resolver tcpResolver(reactor.ios);
 	try {
-		auto iter = tcpResolver.resolve(host, service);
-		decltype(iter) end;
-		std::vector<NetworkAddress> addrs;
-		while (iter != end) {
-			auto endpoint = iter->endpoint();
-			auto addr = endpoint.address();
-			if (addr.is_v6()) {
-				addrs.emplace_back(IPAddress(addr.to_v6().to_bytes()), endpoint.port());
-			} else {
-				addrs.emplace_back(addr.to_v4().to_ulong(), endpoint.port());
-			}
-			++iter;
-		}
+		std::vector<NetworkAddress> addrs = toNetworkAddresses(tcpResolver.resolve(host, service), false);
 		if (addrs.empty()) {
 			throw lookup_failed();
 		}
@@ -1915,6 +2520,9 @@ std::vector<NetworkAddress> Net2::resolveTCPEndpointBlocking(const std::string&
 std::vector<NetworkAddress> Net2::resolveTCPEndpointBlockingWithDNSCache(const std::string& host,
                                                                          const std::string& service) {
 	if (FLOW_KNOBS->ENABLE_COORDINATOR_DNS_CACHE) {
+		if (dnsCache.findNegative(host, service)) {
+			throw lookup_failed();
+		}
 		Optional<std::vector<NetworkAddress>> cache = dnsCache.find(host, service);
 		if (cache.present()) {
 			return cache.get();
@@ -2252,6 +2860,107 @@ TEST_CASE("noSim/flow/Net2/onMainThreadFIFO") {
 	return Void();
 }
 
+TEST_CASE("noSim/flow/Net2/UDPSocket/batch") {
+	state Reference<IUDPSocket> receiver = wait(INetworkConnections::net()->createUDPSocket(false));
+	receiver->bind(NetworkAddress::parse("127.0.0.1:0"));
+	state Reference<IUDPSocket> sender = wait(INetworkConnections::net()->createUDPSocket(false));
+	sender->bind(NetworkAddress::parse("127.0.0.1:0"));
+
+	// Runs of equal sizes exercise GSO, the odd sizes break the runs up
+	state Standalone<VectorRef<UDPDatagram>> sent;
+	for (int i = 0; i < 100; ++i) {
+		int size = i % 10 == 9 ? i : 100;
+		uint8_t* data = new (sent.arena()) uint8_t[size];
+		memset(data, i, size);
+		sent.push_back(sent.arena(), UDPDatagram{ StringRef(data, size), receiver->localAddress() });
+	}
+	state int sentCount = 0;
+	while (sentCount < sent.size()) {
+		int n = wait(sender->sendBatch(VectorRef<UDPDatagram>(sent.begin() + sentCount, sent.size() - sentCount)));
+		ASSERT(n > 0);
+		sentCount += n;
+	}
+
+	state int receivedCount = 0;
+	while (receivedCount < sent.size()) {
+		Standalone<VectorRef<UDPDatagram>> received = wait(timeoutError(receiver->receiveBatch(16, 1024), 5.0));
+		ASSERT(received.size() > 0);
+		for (const auto& datagram : received) {
+			ASSERT(datagram.data == sent[receivedCount].data);
+			ASSERT(datagram.peer.ip == sender->localAddress().ip && datagram.peer.port == sender->localAddress().port);
+			++receivedCount;
+		}
+	}
+	return Void();
+}
+
+ACTOR static Future<Void> udpBenchmarkReceiver(Reference<IUDPSocket> socket, int batchSize, int64_t* received) {
+	state std::vector<uint8_t> buffer(IUDPSocket::MAX_PACKET_SIZE);
+	loop {
+		if (batchSize > 0) {
+			Standalone<VectorRef<UDPDatagram>> datagrams = wait(socket->receiveBatch(batchSize, 2048));
+			*received += datagrams.size();
+		} else {
+			wait(success(socket->receive(buffer.data(), buffer.data() + buffer.size())));
+			++*received;
+		}
+	}
+}
+
+ACTOR static Future<Void> udpBenchmarkSender(Reference<IUDPSocket> socket,
+                                             NetworkAddress peer,
+                                             int64_t count,
+                                             int batchSize,
+                                             int datagramSize) {
+	state std::string payload(datagramSize, 'x');
+	state Standalone<VectorRef<UDPDatagram>> batch;
+	state int64_t sent = 0;
+	for (int i = 0; i < std::max(batchSize, 1); ++i) {
+		batch.push_back(batch.arena(), UDPDatagram{ StringRef(payload), peer });
+	}
+	while (sent < count) {
+		if (batchSize > 0) {
+			int n = wait(socket->sendBatch(batch));
+			sent += n;
+		} else {
+			const uint8_t* begin = (const uint8_t*)payload.data();
+			wait(success(socket->sendTo(begin, begin + payload.size(), peer)));
+			++sent;
+		}
+	}
+	return Void();
+}
+
+// Measures loopback UDP packets per second with one datagram per system call (batch size 0) and with batches. The
+// receiver only runs while the sender waits, so the received count shows how many datagrams the kernel dropped.
+ACTOR static Future<Void> udpBatchBenchmark(int batchSize) {
+	state int64_t count = 1000000;
+	state int64_t received = 0;
+	state Reference<IUDPSocket> receiver = wait(INetworkConnections::net()->createUDPSocket(false));
+	receiver->bind(NetworkAddress::parse("127.0.0.1:0"));
+	state Reference<IUDPSocket> sender = wait(INetworkConnections::net()->createUDPSocket(false));
+	state Future<Void> receiving = udpBenchmarkReceiver(receiver, batchSize, &received);
+	state double start = timer();
+	wait(udpBenchmarkSender(sender, receiver->localAddress(), count, batchSize, 64));
+	state double elapsed = timer() - start;
+	wait(delay(0.1));
+	receiving.cancel();
+	printf("UDP batch size %d: %0.1f Kpackets/s sent, %0.1f Kpackets/s received (%lld of %lld)\n",
+	       batchSize,
+	       count / 1000.0 / elapsed,
+	       received / 1000.0 / elapsed,
+	       (long long)received,
+	       (long long)count);
+	return Void();
+}
+
+TEST_CASE("noSim/performance/flow/Net2/UDPSocket/batch") {
+	wait(udpBatchBenchmark(0));
+	wait(udpBatchBenchmark(8));
+	wait(udpBatchBenchmark(64));
+	return Void();
+}
+
 void net2_test(){
 	/*
 	g_network = newNet2();  // for promise serialization below
@@ -2311,3 +3020,31 @@ void net2_test(){
 	printf("  Used: %lld\n", FastAllocator<4096>::getTotalMemory());
 	*/
 };
+
+TEST_CASE("noSim/flow/Net2/Listener/batch") {
+	state Reference<IListener> listener = INetworkConnections::net()->listen(NetworkAddress::parse("127.0.0.1:0"));
+	state std::vector<Future<Reference<IConnection>>> clients;
+	state int i = 0;
+	for (i = 0; i < 10; ++i) {
+		clients.push_back(INetworkConnections::net()->connect(listener->getListenAddress()));
+	}
+	wait(waitForAll(clients));
+
+	// Connections already waiting are taken in one batch and handed out by later accept() calls
+	state std::vector<Reference<IConnection>> accepted;
+	for (i = 0; i < clients.size(); ++i) {
+		Reference<IConnection> conn = wait(timeoutError(listener->accept(), 5.0));
+		ASSERT(conn->getPeerAddress().ip == IPAddress(0x7f000001));
+		accepted.push_back(conn);
+	}
+	ListenerMetrics metrics = listener->getMetrics();
+	ASSERT(metrics.accepted == clients.size() && metrics.pending == 0 && metrics.rejected == 0);
+
+	for (auto& conn : accepted) {
+		conn->close();
+	}
+	for (auto& client : clients) {
+		client.get()->close();
+	}
+	return Void();
+}
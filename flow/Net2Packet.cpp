@@ -19,6 +19,8 @@
  */
 
 #include "flow/Net2Packet.h"
+#include "flow/Knobs.h"
+#include "flow/UnitTest.h"
 
 void PacketWriter::init(PacketBuffer* buf, ReliablePacket* reliable) {
 	this->buffer = buf;
@@ -44,7 +46,7 @@ PacketBuffer* PacketWriter::finish() {
 void PacketWriter::serializeBytesAcrossBoundary(const void* data, int bytes) {
 	while (true) {
 		int b = std::min(bytes, buffer->bytes_unwritten());
-		memcpy(buffer->data() + buffer->bytes_written, data, b);
+		flowMemcpy(buffer->data() + buffer->bytes_written, data, b);
 		buffer->bytes_written += b;
 		bytes -= b;
 		if (!bytes)
@@ -139,10 +141,133 @@ void ReliablePacket::remove() {
 	}
 }
 
+UnsentPacketQueue::UnsentPacketQueue() {
+	lanes[(int)SendLane::Control].sendQueueLatencyHistogram =
+	    Histogram::getHistogram("UnsentPacketQueue"_sr, "QueueWaitControl"_sr, Histogram::Unit::milliseconds);
+	lanes[(int)SendLane::Default].sendQueueLatencyHistogram =
+	    Histogram::getHistogram("UnsentPacketQueue"_sr, "QueueWait"_sr, Histogram::Unit::milliseconds);
+	lanes[(int)SendLane::Bulk].sendQueueLatencyHistogram =
+	    Histogram::getHistogram("UnsentPacketQueue"_sr, "QueueWaitBulk"_sr, Histogram::Unit::milliseconds);
+}
+
+void UnsentPacketQueue::setWriteBuffer(PacketBuffer* pb, SendLane lane) {
+	Lane& l = lanes[(int)lane];
+	ASSERT(l.last);
+
+	// What was written since the previous call starts in the old last buffer and may continue into new ones
+	int64_t written = 0;
+	int alreadyWritten = l.lastWritten;
+	for (PacketBuffer* b = l.last; b; b = b->nextPacketBuffer()) {
+		written += b->bytes_written - alreadyWritten;
+		alreadyWritten = 0;
+		if (b == pb)
+			break;
+	}
+
+	l.last = pb;
+	l.lastWritten = pb->bytes_written;
+	if (written > 0) {
+		// Only getCoalesceDelay() needs the time, so it is not read while coalescing is off
+		if (l.packetBytes.empty() && FLOW_KNOBS->PACKET_COALESCE_DELAY_US > 0)
+			l.oldestUnsentTime = now();
+		l.packetBytes.push_back(written);
+		l.unsentBytes += written;
+	}
+	selectLane();
+}
+
+void UnsentPacketQueue::prependWriteBuffer(PacketBuffer* first, PacketBuffer* last) {
+	Lane& l = lanes[(int)SendLane::Control];
+	int64_t bytes = 0;
+	for (PacketBuffer* b = first;; b = b->nextPacketBuffer()) {
+		bytes += b->bytes_written - b->bytes_sent;
+		if (b == last)
+			break;
+	}
+
+	last->next = l.first;
+	l.first = first;
+	if (!l.last) {
+		l.last = last;
+		l.lastWritten = last->bytes_written;
+	}
+	if (bytes > 0) {
+		// What is left of a partially sent packet now starts a group of its own
+		if (l.frontBytesSent) {
+			l.packetBytes.front() -= l.frontBytesSent;
+			l.frontBytesSent = 0;
+		}
+		if (l.packetBytes.empty() && FLOW_KNOBS->PACKET_COALESCE_DELAY_US > 0)
+			l.oldestUnsentTime = now();
+		Deque<int64_t> packetBytes;
+		packetBytes.push_back(bytes);
+		while (!l.packetBytes.empty()) {
+			packetBytes.push_back(l.packetBytes.front());
+			l.packetBytes.pop_front();
+		}
+		l.packetBytes = std::move(packetBytes);
+		l.unsentBytes += bytes;
+	}
+	activeLane = (int)SendLane::Control;
+}
+
+void UnsentPacketQueue::selectLane() {
+	if (lanes[activeLane].frontBytesSent > 0)
+		return;
+	for (int i = 0; i < LANE_COUNT; ++i) {
+		if (!lanes[i].packetBytes.empty()) {
+			activeLane = i;
+			return;
+		}
+	}
+}
+
+int UnsentPacketQueue::getSendLimit() const {
+	const Lane& l = lanes[activeLane];
+	for (int i = 0; i < activeLane; ++i) {
+		if (!lanes[i].packetBytes.empty() && !l.packetBytes.empty()) {
+			return std::min<int64_t>(l.packetBytes.front() - l.frontBytesSent, std::numeric_limits<int>::max());
+		}
+	}
+	return std::numeric_limits<int>::max();
+}
+
+double UnsentPacketQueue::getCoalesceDelay() const {
+	if (FLOW_KNOBS->PACKET_COALESCE_DELAY_US <= 0 || !lanes[(int)SendLane::Control].packetBytes.empty())
+		return 0;
+
+	int64_t unsentBytes = 0;
+	double oldestUnsentTime = std::numeric_limits<double>::max();
+	for (const auto& lane : lanes) {
+		if (!lane.packetBytes.empty()) {
+			unsentBytes += lane.unsentBytes;
+			oldestUnsentTime = std::min(oldestUnsentTime, lane.oldestUnsentTime);
+		}
+	}
+	if (unsentBytes == 0 || unsentBytes >= FLOW_KNOBS->PACKET_COALESCE_BYTES)
+		return 0;
+	return std::max(0.0, oldestUnsentTime + FLOW_KNOBS->PACKET_COALESCE_DELAY_US / 1e6 - now());
+}
+
 void UnsentPacketQueue::sent(int bytes) {
+	Lane& l = lanes[activeLane];
+
+	l.unsentBytes -= bytes;
+	int64_t remaining = bytes;
+	while (remaining && !l.packetBytes.empty()) {
+		int64_t left = l.packetBytes.front() - l.frontBytesSent;
+		if (remaining < left) {
+			l.frontBytesSent += remaining;
+			break;
+		}
+		remaining -= left;
+		l.packetBytes.pop_front();
+		l.frontBytesSent = 0;
+	}
+
 	while (bytes) {
-		ASSERT(unsent_first);
-		PacketBuffer* b = unsent_first;
+		ASSERT(l.first);
+		PacketBuffer* b = l.first;
 
 		if (b->bytes_sent + bytes <= b->bytes_written &&
 		    (b->bytes_sent + bytes != b->bytes_written || (!b->next && b->bytes_unwritten()))) {
@@ -156,21 +281,29 @@ void UnsentPacketQueue::sent(int bytes) {
 		b->bytes_sent = b->bytes_written;
 		ASSERT(b->bytes_written <= b->size());
 		double queue_time = now() - b->enqueue_time;
-		sendQueueLatencyHistogram->sampleSeconds(queue_time);
-		unsent_first = b->nextPacketBuffer();
-		if (!unsent_first)
-			unsent_last = nullptr;
+		l.sendQueueLatencyHistogram->sampleSeconds(queue_time);
+		l.first = b->nextPacketBuffer();
+		if (!l.first)
+			l.last = nullptr;
 		b->delref();
 	}
+
+	selectLane();
 }
 
 void UnsentPacketQueue::discardAll() {
-	while (unsent_first) {
-		auto n = unsent_first->nextPacketBuffer();
-		unsent_first->delref();
-		unsent_first = n;
+	for (auto& l : lanes) {
+		while (l.first) {
+			auto n = l.first->nextPacketBuffer();
+			l.first->delref();
+			l.first = n;
+		}
+		l.last = 0;
+		l.packetBytes.clear();
+		l.frontBytesSent = 0;
+		l.unsentBytes = 0;
 	}
-	unsent_last = 0;
+	activeLane = (int)SendLane::Default;
 }
 
 PacketBuffer* ReliablePacketList::compact(PacketBuffer* into, PacketBuffer* end) {
@@ -217,3 +350,47 @@ void ReliablePacketList::discardAll() {
 	while (reliable.next != &reliable)
 		reliable.next->remove();
 }
+
+static void writeTestPacket(UnsentPacketQueue& queue, SendLane lane, uint8_t fill, int size) {
+	std::vector<uint8_t> data(size, fill);
+	PacketWriter writer(queue.getWriteBuffer(0, lane), nullptr, AssumeVersion(g_network->protocolVersion()));
+	writer.serializeBytes(data.data(), data.size());
+	queue.setWriteBuffer(writer.finish(), lane);
+}
+
+static uint8_t nextUnsentByte(UnsentPacketQueue const& queue) {
+	PacketBuffer* b = queue.getUnsent();
+	return b->data()[b->bytes_sent];
+}
+
+TEST_CASE("/flow/UnsentPacketQueue/lanes") {
+	UnsentPacketQueue queue;
+	writeTestPacket(queue, SendLane::Bulk, 'a', 30000);
+	writeTestPacket(queue, SendLane::Bulk, 'b', 30000);
+	ASSERT(nextUnsentByte(queue) == 'a');
+	ASSERT(queue.getSendLimit() == std::numeric_limits<int>::max());
+	queue.sent(1000);
+
+	// A control packet waits for the bulk packet in flight, and then goes ahead of the next one.
+	writeTestPacket(queue, SendLane::Control, 'c', 100);
+	ASSERT(nextUnsentByte(queue) == 'a');
+	ASSERT(queue.getSendLimit() == 29000);
+	queue.sent(29000);
+	ASSERT(nextUnsentByte(queue) == 'c');
+	ASSERT(queue.getSendLimit() == std::numeric_limits<int>::max());
+	queue.sent(100);
+	ASSERT(nextUnsentByte(queue) == 'b');
+	queue.sent(30000);
+	ASSERT(queue.empty());
+
+	// Packets in the default lane keep their order.
+	writeTestPacket(queue, SendLane::Default, 'd', 10);
+	writeTestPacket(queue, SendLane::Default, 'e', 10);
+	ASSERT(nextUnsentByte(queue) == 'd');
+	queue.sent(15);
+	ASSERT(nextUnsentByte(queue) == 'e');
+	queue.sent(5);
+	ASSERT(queue.empty());
+
+	return Void();
+}
@@ -0,0 +1,486 @@
+/*
+ * NetBench.actor.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// netbench: a loopback benchmark for the connection send and receive paths. It listens on local ports and connects
+// clients to them in the same process, then drives request/reply or streaming traffic through UnsentPacketQueue and
+// ReliablePacketList the way a transport would, optionally over TLS with certificates generated by MkCert.
+
+#include <cinttypes>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fmt/format.h>
+
+#include "flow/ActorCollection.h"
+#include "flow/Arena.h"
+#include "flow/IConnection.h"
+#include "flow/MkCert.h"
+#include "flow/Net2Packet.h"
+#include "flow/Platform.h"
+#include "flow/TLSConfig.actor.h"
+#include "flow/flow.h"
+#include "flow/network.h"
+#include "SimpleOpt/SimpleOpt.h"
+#include "flow/actorcompiler.h" // This must be the last #include.
+
+enum ENetBenchOpt : int {
+	OPT_HELP,
+	OPT_LISTENERS,
+	OPT_CONNECTIONS,
+	OPT_MESSAGE_SIZE,
+	OPT_PATTERN,
+	OPT_PIPELINE,
+	OPT_TLS,
+	OPT_RELIABLE,
+	OPT_WARMUP,
+	OPT_DURATION,
+	OPT_JSON,
+};
+
+CSimpleOpt::SOption gOptions[] = { { OPT_HELP, "--help", SO_NONE },
+	                               { OPT_HELP, "-h", SO_NONE },
+	                               { OPT_LISTENERS, "--listeners", SO_REQ_SEP },
+	                               { OPT_CONNECTIONS, "--connections", SO_REQ_SEP },
+	                               { OPT_MESSAGE_SIZE, "--message-size", SO_REQ_SEP },
+	                               { OPT_PATTERN, "--pattern", SO_REQ_SEP },
+	                               { OPT_PIPELINE, "--pipeline", SO_REQ_SEP },
+	                               { OPT_TLS, "--tls", SO_NONE },
+	                               { OPT_RELIABLE, "--reliable", SO_NONE },
+	                               { OPT_WARMUP, "--warmup", SO_REQ_SEP },
+	                               { OPT_DURATION, "--duration", SO_REQ_SEP },
+	                               { OPT_JSON, "--json", SO_NONE },
+	                               SO_END_OF_OPTIONS };
+
+void printUsage(std::string_view binary) {
+	fmt::print(stdout,
+	           "netbench: FDB loopback network benchmark\n\n"
+	           "Usage: {} [OPTIONS...]\n\n"
+	           "  --listeners N          Local listeners to connect to (default: 1)\n"
+	           "  --connections N        Client connections, spread over the listeners (default: 4)\n"
+	           "  --message-size BYTES   Payload of each message (default: 1024)\n"
+	           "  --pattern PATTERN      request-reply or stream (default: request-reply)\n"
+	           "  --pipeline N           Outstanding requests per connection for request-reply (default: 1)\n"
+	           "  --tls                  Connect over TLS with a generated certificate chain\n"
+	           "  --reliable             Track sent messages in a ReliablePacketList until they are acknowledged\n"
+	           "  --warmup SECONDS       Traffic before measuring starts (default: 1)\n"
+	           "  --duration SECONDS     Measured time (default: 10)\n"
+	           "  --json                 Print the results as a JSON object\n",
+	           binary);
+}
+
+enum class Pattern { RequestReply, Stream };
+
+struct NetBenchOptions {
+	int listeners = 1;
+	int connections = 4;
+	int messageBytes = 1024;
+	Pattern pattern = Pattern::RequestReply;
+	int pipeline = 1;
+	bool tls = false;
+	bool reliable = false;
+	double warmup = 1;
+	double duration = 10;
+	bool json = false;
+};
+
+// A uniform sample of the latencies seen, bounded so that long runs do not grow without limit
+struct LatencySample {
+	static constexpr int CAPACITY = 1 << 20;
+	std::vector<double> samples;
+	int64_t seen = 0;
+
+	void add(double latency) {
+		if (samples.size() < CAPACITY) {
+			samples.push_back(latency);
+		} else {
+			int64_t i = deterministicRandom()->randomInt64(0, seen + 1);
+			if (i < CAPACITY) {
+				samples[i] = latency;
+			}
+		}
+		++seen;
+	}
+
+	// Precondition: samples is sorted
+	double percentile(double p) const {
+		return samples.empty() ? 0 : samples[std::min<size_t>(samples.size() - 1, p * samples.size())];
+	}
+};
+
+struct NetBenchStats {
+	bool measuring = false;
+	int64_t messages = 0;
+	int64_t bytes = 0;
+	LatencySample latency;
+
+	void record(int messageBytes, double sentTime) {
+		if (measuring) {
+			++messages;
+			bytes += messageBytes;
+			latency.add(timer_monotonic() - sentTime);
+		}
+	}
+};
+
+// One end of a benchmark connection. Each message is a 4 byte length, the timer_monotonic() time it was first sent
+// and the payload; replies echo the time of their request, so both patterns measure latency with one clock.
+struct BenchPeer : NonCopyable, ReferenceCounted<BenchPeer> {
+	Reference<IConnection> conn;
+	bool reliable;
+	std::vector<uint8_t> payload;
+	UnsentPacketQueue unsent;
+	ReliablePacketList reliablePackets;
+	Deque<ReliablePacket*> unacknowledged;
+	AsyncTrigger dataToSend;
+	AsyncTrigger drained;
+	Future<Void> writer;
+
+	BenchPeer(Reference<IConnection> conn, int messageBytes, bool reliable)
+	  : conn(conn), reliable(reliable), payload(messageBytes, 'x') {}
+
+	~BenchPeer() {
+		writer.cancel();
+		reliablePackets.discardAll();
+		conn->close();
+	}
+
+	int messageBytes() const { return sizeof(uint32_t) + sizeof(double) + payload.size(); }
+
+	void send(double sentTime) {
+		ReliablePacket* rp = reliable ? new ReliablePacket : nullptr;
+		PacketWriter wr(unsent.getWriteBuffer(), rp, AssumeVersion(g_network->protocolVersion()));
+		SplitBuffer packetLen;
+		uint32_t len = 0;
+		wr.writeAhead(sizeof(len), &packetLen);
+		wr.serializeBinaryItem(sentTime);
+		wr.serializeBytes(payload.data(), payload.size());
+		unsent.setWriteBuffer(wr.finish());
+		len = wr.size() - sizeof(len);
+		packetLen.write(&len, sizeof(len));
+		if (rp) {
+			reliablePackets.insert(rp);
+			unacknowledged.push_back(rp);
+		}
+		dataToSend.trigger();
+	}
+
+	// Drops the oldest unacknowledged message, as a transport does once it no longer needs to resend it
+	void acknowledge() {
+		if (!unacknowledged.empty()) {
+			unacknowledged.front()->remove();
+			unacknowledged.pop_front();
+		}
+	}
+};
+
+ACTOR Future<Void> connectionWriter(BenchPeer* self) {
+	loop {
+		if (self->unsent.empty()) {
+			self->drained.trigger();
+			wait(self->dataToSend.onTrigger());
+		}
+		wait(yield(TaskPriority::WriteSocket));
+		if (self->unsent.getCoalesceDelay() > 0) {
+			wait(delay(self->unsent.getCoalesceDelay(), TaskPriority::WriteSocket));
+		}
+		loop {
+			int sent = self->conn->write(self->unsent.getUnsent(), self->unsent.getSendLimit());
+			if (sent) {
+				self->unsent.sent(sent);
+				break;
+			}
+			wait(self->conn->onWritable());
+		}
+	}
+}
+
+// Reads messages until the connection fails. Servers echo requests or count streamed messages; clients count replies
+// and send the next request.
+ACTOR Future<Void> connectionReader(Reference<BenchPeer> self,
+                                    NetBenchStats* stats,
+                                    Pattern pattern,
+                                    bool isServer) {
+	state std::vector<uint8_t> buffer(64 << 10);
+	state size_t begin = 0;
+	state size_t end = 0;
+	loop {
+		if (end == buffer.size()) {
+			if (begin > 0) {
+				memmove(buffer.data(), buffer.data() + begin, end - begin);
+				end -= begin;
+				begin = 0;
+			} else {
+				buffer.resize(buffer.size() * 2);
+			}
+		}
+		int n = self->conn->read(buffer.data() + end, buffer.data() + buffer.size());
+		end += n;
+		if (n == 0) {
+			wait(self->conn->onReadable());
+			wait(delay(0, TaskPriority::ReadSocket));
+			continue;
+		}
+
+		while (end - begin >= sizeof(uint32_t) + sizeof(double)) {
+			uint32_t len;
+			memcpy(&len, buffer.data() + begin, sizeof(len));
+			if (end - begin < sizeof(len) + len) {
+				break;
+			}
+			double sentTime;
+			memcpy(&sentTime, buffer.data() + begin + sizeof(len), sizeof(sentTime));
+			begin += sizeof(len) + len;
+
+			if (isServer && pattern == Pattern::RequestReply) {
+				self->send(sentTime);
+			} else {
+				stats->record(sizeof(len) + len, sentTime);
+				if (!isServer) {
+					self->acknowledge();
+					self->send(timer_monotonic());
+				}
+			}
+		}
+		if (begin == end) {
+			begin = end = 0;
+		}
+	}
+}
+
+// Keeps a stream connection's send queue full, sending in batches of about 64KB
+ACTOR Future<Void> streamSender(Reference<BenchPeer> self) {
+	state int batch = std::max(1, (64 << 10) / self->messageBytes());
+	state int i = 0;
+	loop {
+		for (i = 0; i < batch; i++) {
+			self->send(timer_monotonic());
+		}
+		wait(self->drained.onTrigger());
+		// Everything queued so far has been handed to the connection
+		while (!self->unacknowledged.empty()) {
+			self->acknowledge();
+		}
+	}
+}
+
+Reference<BenchPeer> makePeer(Reference<IConnection> conn, NetBenchOptions const& options, bool isServer) {
+	// Replies are not tracked as reliable; nothing acknowledges them
+	auto peer = makeReference<BenchPeer>(conn, options.messageBytes, options.reliable && !isServer);
+	peer->writer = connectionWriter(peer.getPtr());
+	return peer;
+}
+
+ACTOR Future<Void> serveConnection(Reference<IConnection> conn, NetBenchOptions options, NetBenchStats* stats) {
+	wait(conn->acceptHandshake());
+	wait(connectionReader(makePeer(conn, options, true), stats, options.pattern, true));
+	return Void();
+}
+
+ACTOR Future<Void> acceptConnections(Reference<IListener> listener,
+                                     NetBenchOptions options,
+                                     NetBenchStats* stats,
+                                     ActorCollection* connections) {
+	loop {
+		Reference<IConnection> conn = wait(listener->accept());
+		connections->add(serveConnection(conn, options, stats));
+	}
+}
+
+ACTOR Future<Void> runClient(NetworkAddress address, NetBenchOptions options, NetBenchStats* stats) {
+	state Reference<IConnection> conn = wait(INetworkConnections::net()->connect(address));
+	wait(conn->connectHandshake());
+	state Reference<BenchPeer> peer = makePeer(conn, options, false);
+	if (options.pattern == Pattern::Stream) {
+		wait(streamSender(peer));
+	} else {
+		for (int i = 0; i < options.pipeline; i++) {
+			peer->send(timer_monotonic());
+		}
+		wait(connectionReader(peer, stats, options.pattern, false));
+	}
+	return Void();
+}
+
+void report(NetBenchOptions const& options, NetBenchStats& stats, double elapsed, double cpuSeconds) {
+	std::sort(stats.latency.samples.begin(), stats.latency.samples.end());
+	double messagesPerSecond = stats.messages / elapsed;
+	double megabytesPerSecond = stats.bytes / elapsed / 1e6;
+	double p50 = stats.latency.percentile(0.5) * 1e6;
+	double p99 = stats.latency.percentile(0.99) * 1e6;
+	double p999 = stats.latency.percentile(0.999) * 1e6;
+	// Both ends of every connection are in this process, so this is the CPU cost of sending and receiving a byte
+	double cpuNsPerByte = stats.bytes ? cpuSeconds * 1e9 / stats.bytes : 0;
+	const char* pattern = options.pattern == Pattern::Stream ? "stream" : "request-reply";
+	if (options.json) {
+		fmt::print("{{\"pattern\":\"{}\",\"listeners\":{},\"connections\":{},\"messageSize\":{},\"pipeline\":{},"
+		           "\"tls\":{},\"reliable\":{},\"seconds\":{:.3f},\"messages\":{},\"messagesPerSecond\":{:.0f},"
+		           "\"megabytesPerSecond\":{:.2f},\"p50LatencyUs\":{:.1f},\"p99LatencyUs\":{:.1f},"
+		           "\"p999LatencyUs\":{:.1f},\"cpuNsPerByte\":{:.3f}}}\n",
+		           pattern,
+		           options.listeners,
+		           options.connections,
+		           options.messageBytes,
+		           options.pipeline,
+		           options.tls,
+		           options.reliable,
+		           elapsed,
+		           stats.messages,
+		           messagesPerSecond,
+		           megabytesPerSecond,
+		           p50,
+		           p99,
+		           p999,
+		           cpuNsPerByte);
+	} else {
+		fmt::print("{} over {} connection(s) to {} listener(s), {} byte messages{}{}\n",
+		           pattern,
+		           options.connections,
+		           options.listeners,
+		           options.messageBytes,
+		           options.tls ? ", TLS" : "",
+		           options.reliable ? ", reliable" : "");
+		fmt::print("  {:.0f} messages/s, {:.2f} MB/s\n", messagesPerSecond, megabytesPerSecond);
+		fmt::print("  latency p50 {:.1f}us, p99 {:.1f}us, p99.9 {:.1f}us\n", p50, p99, p999);
+		fmt::print("  {:.3f} CPU ns/byte\n", cpuNsPerByte);
+	}
+}
+
+ACTOR Future<Void> runNetBench(NetBenchOptions options, int* exitCode) {
+	state NetBenchStats stats;
+	state ActorCollection connections;
+	state std::vector<Reference<IListener>> listeners;
+	state double start = 0;
+	state double cpuStart = 0;
+	state int i = 0;
+	try {
+		for (i = 0; i < options.listeners; i++) {
+			NetworkAddress address = NetworkAddress::parse(options.tls ? "127.0.0.1:0:tls" : "127.0.0.1:0");
+			listeners.push_back(INetworkConnections::net()->listen(address));
+			connections.add(acceptConnections(listeners.back(), options, &stats, &connections));
+		}
+		for (i = 0; i < options.connections; i++) {
+			connections.add(runClient(listeners[i % listeners.size()]->getListenAddress(), options, &stats));
+		}
+
+		wait(delay(options.warmup) || connections.getResult());
+		stats.measuring = true;
+		start = timer_monotonic();
+		cpuStart = getProcessorTimeProcess();
+		wait(delay(options.duration) || connections.getResult());
+		stats.measuring = false;
+		report(options, stats, timer_monotonic() - start, getProcessorTimeProcess() - cpuStart);
+		*exitCode = FDB_EXIT_SUCCESS;
+	} catch (Error& e) {
+		fmt::print(stderr, "error: {}\n", e.name());
+		*exitCode = FDB_EXIT_ERROR;
+	}
+	g_network->stop();
+	return Void();
+}
+
+// Generates a certificate chain which this process presents both as a server and as a client
+TLSConfig makeTLSConfig() {
+	Arena arena;
+	auto chain = mkcert::makeCertChain(arena, 3, mkcert::ESide::Server);
+	auto ca = chain.back().certPem;
+	auto key = chain[0].privateKeyPem;
+	chain.pop_back();
+	auto certs = mkcert::concatCertChain(arena, chain);
+	TLSConfig config;
+	config.setCertificateBytes(certs.toString());
+	config.setKeyBytes(key.toString());
+	config.setCABytes(ca.toString());
+	return config;
+}
+
+int main(int argc, char** argv) {
+	NetBenchOptions options;
+	auto args = CSimpleOpt(argc, argv, gOptions, SO_O_EXACT);
+	while (args.Next()) {
+		if (args.LastError() != SO_SUCCESS) {
+			fmt::print(stderr, "ERROR: invalid option '{}'\n", args.OptionText());
+			printUsage(argv[0]);
+			return FDB_EXIT_ERROR;
+		}
+		try {
+			switch (args.OptionId()) {
+			case OPT_HELP:
+				printUsage(argv[0]);
+				return FDB_EXIT_SUCCESS;
+			case OPT_LISTENERS:
+				options.listeners = std::max(1, std::stoi(args.OptionArg()));
+				break;
+			case OPT_CONNECTIONS:
+				options.connections = std::max(1, std::stoi(args.OptionArg()));
+				break;
+			case OPT_MESSAGE_SIZE:
+				options.messageBytes = std::max(0, std::stoi(args.OptionArg()));
+				break;
+			case OPT_PATTERN:
+				if (std::string_view(args.OptionArg()) == "stream") {
+					options.pattern = Pattern::Stream;
+				} else if (std::string_view(args.OptionArg()) == "request-reply") {
+					options.pattern = Pattern::RequestReply;
+				} else {
+					fmt::print(stderr, "ERROR: unknown pattern '{}'\n", args.OptionArg());
+					return FDB_EXIT_ERROR;
+				}
+				break;
+			case OPT_PIPELINE:
+				options.pipeline = std::max(1, std::stoi(args.OptionArg()));
+				break;
+			case OPT_TLS:
+				options.tls = true;
+				break;
+			case OPT_RELIABLE:
+				options.reliable = true;
+				break;
+			case OPT_WARMUP:
+				options.warmup = std::max(0.0, std::stod(args.OptionArg()));
+				break;
+			case OPT_DURATION:
+				options.duration = std::max(0.1, std::stod(args.OptionArg()));
+				break;
+			case OPT_JSON:
+				options.json = true;
+				break;
+			}
+		} catch (std::exception const& e) {
+			fmt::print(stderr, "ERROR: invalid argument to option '{}'\n", args.OptionText());
+			return FDB_EXIT_ERROR;
+		}
+	}
+
+	try {
+		platformInit();
+		Error::init();
+		g_network = newNet2(options.tls ? makeTLSConfig() : TLSConfig(), false, false);
+		int exitCode = FDB_EXIT_ERROR;
+		Future<Void> done = runNetBench(options, &exitCode);
+		g_network->run();
+		return exitCode;
+	} catch (const Error& e) {
+		fmt::print(stderr, "error: {}\n", e.name());
+		return FDB_EXIT_MAIN_ERROR;
+	} catch (const std::exception& e) {
+		fmt::print(stderr, "exception: {}\n", e.what());
+		return FDB_EXIT_MAIN_EXCEPTION;
+	}
+}
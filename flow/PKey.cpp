@@ -20,11 +20,17 @@
 
 #include "flow/AutoCPointer.h"
 #include "flow/Error.h"
+#include "flow/IThreadPool.h"
+#include "flow/Knobs.h"
+#include "flow/MkCert.h"
 #include "flow/PKey.h"
+#include "flow/UnitTest.h"
+#include "flow/genericactors.actor.h"
 #include <openssl/bio.h>
 #include <openssl/err.h>
 #include <openssl/evp.h>
 #include <openssl/pem.h>
+#include <openssl/sha.h>
 #include <openssl/x509.h>
 #include <openssl/objects.h>
 #include <openssl/opensslv.h>
@@ -118,21 +124,35 @@ StringRef doWritePublicKeyDer(Arena& arena, EVP_PKEY* key) {
 	return StringRef(buf, len);
 }
 
-bool doVerifyStringSignature(StringRef data, StringRef signature, const EVP_MD& digest, EVP_PKEY* key) {
-	auto mdctx = AutoCPointer(::EVP_MD_CTX_create(), &::EVP_MD_CTX_free);
-	if (!mdctx) {
-		traceAndThrowDsa("PKeyVerifyInitFail");
-	}
-	if (1 != ::EVP_DigestVerifyInit(mdctx, nullptr, &digest, nullptr, key)) {
+// Digest contexts kept for the life of the thread, so that verifying a signature does not allocate one. The template
+// context holds an EVP_DigestVerifyInit() which is copied into the working context for each signature of a batch.
+struct VerifyContexts {
+	AutoCPointer<EVP_MD_CTX, void> init = AutoCPointer(::EVP_MD_CTX_new(), &::EVP_MD_CTX_free);
+	AutoCPointer<EVP_MD_CTX, void> work = AutoCPointer(::EVP_MD_CTX_new(), &::EVP_MD_CTX_free);
+};
+
+VerifyContexts& threadVerifyContexts() {
+	thread_local VerifyContexts contexts;
+	if (!contexts.init || !contexts.work) {
 		traceAndThrowDsa("PKeyVerifyInitFail");
 	}
+	return contexts;
+}
+
+bool verifyFinal(EVP_MD_CTX* mdctx, StringRef data, StringRef signature) {
 	if (1 != ::EVP_DigestVerifyUpdate(mdctx, data.begin(), data.size())) {
 		traceAndThrowDsa("PKeyVerifyUpdateFail");
 	}
-	if (1 != ::EVP_DigestVerifyFinal(mdctx, signature.begin(), signature.size())) {
-		return false;
+	return 1 == ::EVP_DigestVerifyFinal(mdctx, signature.begin(), signature.size());
+}
+
+bool doVerifyStringSignature(StringRef data, StringRef signature, const EVP_MD& digest, EVP_PKEY* key) {
+	auto& contexts = threadVerifyContexts();
+	if (1 != ::EVP_MD_CTX_reset(contexts.work) ||
+	    1 != ::EVP_DigestVerifyInit(contexts.work, nullptr, &digest, nullptr, key)) {
+		traceAndThrowDsa("PKeyVerifyInitFail");
 	}
-	return true;
+	return verifyFinal(contexts.work, data, signature);
 }
 
 PublicKey::PublicKey(PemEncoded, StringRef pem) {
@@ -292,3 +312,242 @@ PublicKey PrivateKey::toPublic() const {
 	auto arena = Arena();
 	return PublicKey(DerEncoded{}, writePublicKeyDer(arena));
 }
+
+std::vector<bool> verifySignatures(std::vector<SignatureCheck> const& checks) {
+	std::vector<bool> result(checks.size());
+	auto& contexts = threadVerifyContexts();
+	EVP_PKEY* initKey = nullptr;
+	const EVP_MD* initDigest = nullptr;
+	for (int i = 0; i < checks.size(); i++) {
+		auto const& check = checks[i];
+		auto key = check.key.nativeHandle();
+		ASSERT(key && check.digest);
+		if (key != initKey || check.digest != initDigest) {
+			initKey = nullptr;
+			if (1 != ::EVP_MD_CTX_reset(contexts.init) ||
+			    1 != ::EVP_DigestVerifyInit(contexts.init, nullptr, check.digest, nullptr, key)) {
+				traceAndThrowDsa("PKeyVerifyInitFail");
+			}
+			initKey = key;
+			initDigest = check.digest;
+		}
+		if (1 != ::EVP_MD_CTX_copy_ex(contexts.work, contexts.init)) {
+			traceAndThrowDsa("PKeyVerifyInitFail");
+		}
+		result[i] = verifyFinal(contexts.work, check.data, check.signature);
+	}
+	return result;
+}
+
+namespace {
+
+struct SignatureVerifier final : IThreadPoolReceiver {
+	void init() override {}
+
+	struct Verify final : TypedAction<SignatureVerifier, Verify> {
+		std::vector<SignatureCheck> checks;
+		Arena arena;
+		ThreadReturnPromise<std::vector<bool>> result;
+
+		Verify(std::vector<SignatureCheck> checks, Arena arena) : checks(std::move(checks)), arena(arena) {}
+		double getTimeEstimate() const override { return 0; }
+	};
+
+	void action(Verify& v) {
+		try {
+			v.result.send(verifySignatures(v.checks));
+		} catch (Error& e) {
+			v.result.sendError(e);
+		}
+	}
+};
+
+} // namespace
+
+Reference<IThreadPool> createSignatureVerifierPool(int threads) {
+	ASSERT_GT(threads, 0);
+	auto pool = createGenericThreadPool();
+	for (int i = 0; i < threads; i++) {
+		pool->addThread(new SignatureVerifier, "fdb-sigverify");
+	}
+	return pool;
+}
+
+Future<std::vector<bool>> verifySignaturesAsync(Reference<IThreadPool> pool,
+                                                std::vector<SignatureCheck> checks,
+                                                Arena arena) {
+	if (checks.size() < FLOW_KNOBS->SIGNATURE_VERIFY_OFFLOAD_THRESHOLD) {
+		return verifySignatures(checks);
+	}
+	int const chunkSize = std::max(1, FLOW_KNOBS->SIGNATURE_VERIFY_CHUNK_SIZE);
+	std::vector<Future<std::vector<bool>>> chunks;
+	for (int begin = 0; begin < checks.size(); begin += chunkSize) {
+		int const end = std::min<int>(begin + chunkSize, checks.size());
+		auto action = new SignatureVerifier::Verify(
+		    std::vector<SignatureCheck>(checks.begin() + begin, checks.begin() + end), arena);
+		chunks.push_back(action->result.getFuture());
+		pool->post(action);
+	}
+	return map(getAll(chunks), [](std::vector<std::vector<bool>> const& results) {
+		std::vector<bool> result;
+		for (auto const& r : results) {
+			result.insert(result.end(), r.begin(), r.end());
+		}
+		return result;
+	});
+}
+
+VerifiedTokenCache::VerifiedTokenCache(int capacity) : capacity_(capacity) {
+	ASSERT_GT(capacity, 0);
+}
+
+std::string VerifiedTokenCache::cacheKey(StringRef keyId, StringRef token) {
+	// The hash has a fixed length, so it comes first and the key ID is the rest of the string
+	uint8_t hash[EVP_MAX_MD_SIZE];
+	unsigned int hashLen = 0;
+	if (1 != ::EVP_Digest(token.begin(), token.size(), hash, &hashLen, ::EVP_sha256(), nullptr)) {
+		traceAndThrowDsa("TokenCacheHashError");
+	}
+	std::string key(reinterpret_cast<const char*>(hash), hashLen);
+	key.append(reinterpret_cast<const char*>(keyId.begin()), keyId.size());
+	return key;
+}
+
+bool VerifiedTokenCache::contains(StringRef keyId, StringRef token, double now) {
+	auto it = index.find(cacheKey(keyId, token));
+	if (it == index.end()) {
+		return false;
+	}
+	if (it->second->expiresAt <= now) {
+		lru.erase(it->second);
+		index.erase(it);
+		return false;
+	}
+	lru.splice(lru.begin(), lru, it->second);
+	return true;
+}
+
+void VerifiedTokenCache::insert(StringRef keyId, StringRef token, double expiresAt) {
+	auto key = cacheKey(keyId, token);
+	auto it = index.find(key);
+	if (it != index.end()) {
+		it->second->expiresAt = expiresAt;
+		lru.splice(lru.begin(), lru, it->second);
+		return;
+	}
+	if (index.size() >= capacity_) {
+		index.erase(lru.back().key);
+		lru.pop_back();
+	}
+	lru.push_front(Entry{ key, expiresAt });
+	index.emplace(std::move(key), lru.begin());
+}
+
+void VerifiedTokenCache::eraseKey(StringRef keyId) {
+	for (auto it = lru.begin(); it != lru.end();) {
+		if (StringRef(it->key).substr(SHA256_DIGEST_LENGTH) == keyId) {
+			index.erase(it->key);
+			it = lru.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+TEST_CASE("/flow/PKey/verifySignatures") {
+	auto ec = mkcert::makeEcP256();
+	auto other = mkcert::makeEcP256();
+	Arena arena;
+	std::vector<SignatureCheck> checks;
+	std::vector<bool> expected;
+	for (int i = 0; i < 20; i++) {
+		auto data = StringRef(arena, std::to_string(i));
+		auto const& signer = i % 3 == 2 ? other : ec;
+		auto signature = signer.sign(arena, data, *::EVP_sha256());
+		// Runs of the same key, and signatures which do not match their key or data
+		checks.push_back(SignatureCheck{ ec.toPublic(), i % 5 == 4 ? "wrong"_sr : data, signature, ::EVP_sha256() });
+		expected.push_back(i % 3 != 2 && i % 5 != 4);
+		ASSERT(ec.verify(checks.back().data, signature, *::EVP_sha256()) == expected.back());
+	}
+	ASSERT(verifySignatures(checks) == expected);
+	return Void();
+}
+
+TEST_CASE("/flow/PKey/verifySignaturesAsync") {
+	auto ec = mkcert::makeEcP256();
+	auto other = mkcert::makeEcP256();
+	// Enough checks to be offloaded, in several chunks of which the last is partial
+	int const chunkSize = std::max(1, FLOW_KNOBS->SIGNATURE_VERIFY_CHUNK_SIZE);
+	int const count = std::max(FLOW_KNOBS->SIGNATURE_VERIFY_OFFLOAD_THRESHOLD, 3 * chunkSize) + chunkSize / 2 + 1;
+	Arena arena;
+	std::vector<SignatureCheck> checks;
+	std::vector<bool> expected;
+	for (int i = 0; i < count; i++) {
+		auto data = StringRef(arena, std::to_string(i));
+		// Runs of each key, and failures, which straddle the chunk boundaries
+		auto const& key = (i / 7) % 2 ? other : ec;
+		bool valid = i % 3 != 1;
+		auto signature = (valid ? key : (&key == &ec ? other : ec)).sign(arena, data, *::EVP_sha256());
+		checks.push_back(SignatureCheck{ key.toPublic(), data, signature, ::EVP_sha256() });
+		expected.push_back(valid);
+	}
+	auto pool = createSignatureVerifierPool(3);
+	return map(verifySignaturesAsync(pool, checks, arena), [pool, expected](std::vector<bool> const& result) {
+		ASSERT_EQ(result.size(), expected.size());
+		for (int i = 0; i < expected.size(); i++) {
+			// Each result is that of the check at the same index
+			ASSERT(result[i] == expected[i]);
+		}
+		return Void();
+	});
+}
+
+TEST_CASE("/flow/PKey/VerifiedTokenCache") {
+	VerifiedTokenCache cache(2);
+	cache.insert("key1"_sr, "a"_sr, 10);
+	cache.insert("key1"_sr, "b"_sr, 10);
+	ASSERT(cache.contains("key1"_sr, "a"_sr, 5));
+	ASSERT(!cache.contains("key2"_sr, "a"_sr, 5));
+	// b is now the least recently used
+	cache.insert("key2"_sr, "c"_sr, 20);
+	ASSERT_EQ(cache.size(), 2);
+	ASSERT(!cache.contains("key1"_sr, "b"_sr, 5));
+	ASSERT(cache.contains("key1"_sr, "a"_sr, 5));
+	// Expired tokens are dropped when they are looked up
+	ASSERT(!cache.contains("key1"_sr, "a"_sr, 10));
+	ASSERT_EQ(cache.size(), 1);
+	cache.insert("key1"_sr, "a"_sr, 30);
+	cache.eraseKey("key1"_sr);
+	ASSERT(!cache.contains("key1"_sr, "a"_sr, 5));
+	ASSERT(cache.contains("key2"_sr, "c"_sr, 5));
+	return Void();
+}
+
+namespace {
+
+void benchmarkVerify(UnitTestParameters const& params, std::string const& name, PrivateKey const& key, int count) {
+	Arena arena;
+	std::vector<SignatureCheck> checks;
+	auto publicKey = key.toPublic();
+	for (int i = 0; i < count; i++) {
+		auto data = StringRef(arena, deterministicRandom()->randomAlphaNumeric(200));
+		checks.push_back(SignatureCheck{ publicKey, data, key.sign(arena, data, *::EVP_sha256()), ::EVP_sha256() });
+	}
+	runBenchmark(params, "PKey/verify/" + name, count, [&checks]() {
+		for (auto const& check : checks) {
+			ASSERT(check.key.verify(check.data, check.signature, *check.digest));
+		}
+	});
+	runBenchmark(params, "PKey/verifySignatures/" + name, count, [&checks]() {
+		auto result = verifySignatures(checks);
+		ASSERT(std::all_of(result.begin(), result.end(), [](bool ok) { return ok; }));
+	});
+}
+
+} // namespace
+
+TEST_CASE("noSim/performance/flow/PKey/verify") {
+	benchmarkVerify(params, "EcP256", mkcert::makeEcP256(), params.getInt("count").orDefault(1000));
+	benchmarkVerify(params, "Rsa4096", mkcert::makeRsa4096Bit(), params.getInt("count").orDefault(1000));
+	return Void();
+}
@@ -2252,6 +2252,69 @@ void setAffinity(int proc) {
 #endif
 }
 
+std::vector<int> getAffinity() {
+	std::vector<int> procs;
+#if defined(_WIN32)
+	DWORD_PTR processMask, systemMask;
+	// Threads start with the affinity of their process, and Windows cannot report a thread's own
+	if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+		for (int proc = 0; proc < sizeof(processMask) * 8; proc++) {
+			if (processMask & (DWORD_PTR(1) << proc)) {
+				procs.push_back(proc);
+			}
+		}
+	}
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(cpu_set_t), &set) == 0) {
+		for (int proc = 0; proc < CPU_SETSIZE; proc++) {
+			if (CPU_ISSET(proc, &set)) {
+				procs.push_back(proc);
+			}
+		}
+	}
+#elif defined(__FreeBSD__)
+	cpuset_t set;
+	CPU_ZERO(&set);
+	if (cpuset_getaffinity(CPU_LEVEL_WHICH, CPU_WHICH_PID, -1, sizeof(set), &set) == 0) {
+		for (int proc = 0; proc < CPU_SETSIZE; proc++) {
+			if (CPU_ISSET(proc, &set)) {
+				procs.push_back(proc);
+			}
+		}
+	}
+#endif
+	return procs;
+}
+
+void setAffinity(std::vector<int> const& procs) {
+	if (procs.empty()) {
+		return;
+	}
+#if defined(_WIN32)
+	DWORD_PTR mask = 0;
+	for (int proc : procs) {
+		mask |= DWORD_PTR(1) << proc;
+	}
+	SetThreadAffinityMask(GetCurrentThread(), mask);
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int proc : procs) {
+		CPU_SET(proc, &set);
+	}
+	sched_setaffinity(0, sizeof(cpu_set_t), &set);
+#elif defined(__FreeBSD__)
+	cpuset_t set;
+	CPU_ZERO(&set);
+	for (int proc : procs) {
+		CPU_SET(proc, &set);
+	}
+	cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_PID, -1, sizeof(set), &set);
+#endif
+}
+
 namespace platform {
 
 int getRandomSeed() {
@@ -22,120 +22,120 @@
 #include "flow/UnitTest.h"
 
 #include <unordered_map>
+#include <variant>
 #include <vector>
 
 namespace {
 
+using ProcessEvents::EventId;
+
 struct EventImpl {
-	using Id = intptr_t;
-	std::vector<StringRef> names;
-	ProcessEvents::Callback callback;
+	std::vector<EventId> ids;
+	std::variant<ProcessEvents::Callback, ProcessEvents::PayloadCallback> callback;
 
-	EventImpl(std::vector<StringRef> names, ProcessEvents::Callback callback)
-	  : names(std::move(names)), callback(std::move(callback)) {
+	template <class C>
+	EventImpl(std::vector<EventId> ids, C callback) : ids(std::move(ids)), callback(std::move(callback)) {
 		addEvent();
 	}
-	Id id() const { return reinterpret_cast<intptr_t>(this); }
 	void addEvent();
 	void removeEvent();
 };
 
+// Subscribers are kept in a vector per interned id. Dispatch walks that vector by index, without copying it or
+// taking any lock. Subscribers added during a dispatch are appended inactive and removed ones are cleared in place, so
+// that the current dispatch neither calls a subscriber added by a callback nor one which has been destroyed; both are
+// settled once the outermost dispatch returns.
 struct ProcessEventsImpl {
-	struct Triggering {
-		unsigned& value;
-		ProcessEventsImpl& processEvents;
-		explicit Triggering(unsigned& value, ProcessEventsImpl& processEvents)
-		  : value(value), processEvents(processEvents) {
-			++value;
-		}
-		~Triggering() {
-			if (--value == 0) {
-				// merge modifications back into the event map
-				for (auto const& p : processEvents.toRemove) {
-					for (auto const& n : p.second) {
-						processEvents.events[n].erase(p.first);
-					}
-				}
-				processEvents.toRemove.clear();
-				for (auto const& p : processEvents.toInsert) {
-					processEvents.events[p.first].insert(p.second.begin(), p.second.end());
-				}
-				processEvents.toInsert.clear();
-			}
-		}
+	struct Subscriber {
+		EventImpl* event; // nullptr once removed
+		bool active;
 	};
-	using EventMap = std::unordered_map<StringRef, std::unordered_map<EventImpl::Id, EventImpl*>>;
+
+	Arena arena;
+	std::unordered_map<StringRef, EventId> ids;
+	std::vector<StringRef> names;
+	std::vector<std::vector<Subscriber>> subscribers;
 	unsigned triggering = 0;
-	EventMap events;
-	std::map<EventImpl::Id, std::vector<StringRef>> toRemove;
-	EventMap toInsert;
-
-	void trigger(StringRef name, std::any const& data, Error const& e) {
-		Triggering _(triggering, *this);
-		auto iter = events.find(name);
-		// strictly speaking this isn't a bug, but having callbacks that aren't caught
-		// by anyone could mean that something was misspelled. Therefore, the safe thing
-		// to do is to abort.
-		if (iter == events.end()) {
-			return;
+	// Ids whose subscriber lists changed during a dispatch
+	std::vector<EventId> dirty;
+
+	EventId intern(StringRef name) {
+		auto it = ids.find(name);
+		if (it != ids.end()) {
+			return it->second;
 		}
-		std::unordered_map<EventImpl::Id, EventImpl*>& callbacks = iter->second;
-		// after we collected all unique callbacks we can call each
-		for (auto const& c : callbacks) {
+		EventId id = names.size();
+		names.push_back(StringRef(arena, name));
+		subscribers.emplace_back();
+		ids.emplace(names.back(), id);
+		return id;
+	}
+
+	Optional<EventId> find(StringRef name) const {
+		auto it = ids.find(name);
+		return it == ids.end() ? Optional<EventId>() : it->second;
+	}
+
+	void settle() {
+		for (EventId id : dirty) {
+			auto& list = subscribers[id];
+			list.erase(std::remove_if(list.begin(), list.end(), [](Subscriber const& s) { return !s.event; }),
+			           list.end());
+			for (auto& s : list) {
+				s.active = true;
+			}
+		}
+		dirty.clear();
+	}
+
+	void trigger(EventId id, ProcessEvents::Payload const& payload, Error const& e) {
+		++triggering;
+		// Built on first use for callbacks which take a std::any
+		Optional<std::any> any;
+		size_t count = subscribers[id].size();
+		for (size_t i = 0; i < count; ++i) {
+			Subscriber s = subscribers[id][i];
+			if (!s.event || !s.active) {
+				continue;
+			}
 			try {
-				// it's possible that the callback has been removed in
-				// which case attempting to call it will be undefined
-				// behavior.
-				if (toRemove.count(c.first) == 0) {
-					c.second->callback(name, data, e);
+				if (auto callback = std::get_if<ProcessEvents::PayloadCallback>(&s.event->callback)) {
+					(*callback)(id, payload, e);
+				} else {
+					if (!any.present()) {
+						any = payload.toAny();
+					}
+					std::get<ProcessEvents::Callback>(s.event->callback)(names[id], any.get(), e);
 				}
 			} catch (...) {
 				// callbacks are not allowed to throw
 				UNSTOPPABLE_ASSERT(false);
 			}
 		}
+		if (--triggering == 0) {
+			settle();
+		}
 	}
 
-	void add(StringRef const& name, EventImpl* event) {
-		EventMap& m = triggering ? toInsert : events;
-		m[name].emplace(event->id(), event);
-	}
-
-	void add(std::vector<StringRef> const& names, EventImpl* event) {
-		for (auto const& name : names) {
-			add(name, event);
+	void add(EventImpl* event) {
+		for (EventId id : event->ids) {
+			subscribers[id].push_back(Subscriber{ event, triggering == 0 });
+			if (triggering) {
+				dirty.push_back(id);
+			}
 		}
 	}
 
-	void remove(std::vector<StringRef> names, EventImpl::Id id) {
-		if (triggering) {
-			// it's possible that the event hasn't been added yet
-			bool inInsertMap = false;
-			for (auto const& name : names) {
-				auto it = toInsert.find(name);
-				if (it == toInsert.end()) {
-					// either all are in the insert map or none
-					ASSERT(!inInsertMap);
-					break;
-				}
-				auto it2 = it->second.find(id);
-				if (it2 == it->second.end()) {
-					// either all are in the insert map or none
-					ASSERT(!inInsertMap);
-					break;
-				}
-				inInsertMap = true;
-				it->second.erase(it2);
-				if (it->second.empty()) {
-					toInsert.erase(it);
-				}
-			}
-			if (!inInsertMap) {
-				toRemove.emplace(id, std::move(names));
-			}
-		} else {
-			for (auto const& name : names) {
-				events[name].erase(id);
+	void remove(EventImpl* event) {
+		for (EventId id : event->ids) {
+			auto& list = subscribers[id];
+			auto it = std::find_if(list.begin(), list.end(), [event](Subscriber const& s) { return s.event == event; });
+			ASSERT(it != list.end());
+			if (triggering) {
+				it->event = nullptr;
+				dirty.push_back(id);
+			} else {
+				list.erase(it);
 			}
 		}
 	}
@@ -143,31 +143,65 @@ struct ProcessEventsImpl {
 
 ProcessEventsImpl processEventsImpl;
 
+std::vector<EventId> internAll(std::vector<StringRef> const& names) {
+	std::vector<EventId> ids;
+	for (auto const& name : names) {
+		ids.push_back(processEventsImpl.intern(name));
+	}
+	return ids;
+}
+
 void EventImpl::addEvent() {
-	processEventsImpl.add(names, this);
+	processEventsImpl.add(this);
 }
 
 void EventImpl::removeEvent() {
-	processEventsImpl.remove(names, this->id());
+	processEventsImpl.remove(this);
 }
 
 } // namespace
 
 namespace ProcessEvents {
 
+EventId eventId(StringRef name) {
+	return processEventsImpl.intern(name);
+}
+
+Optional<EventId> findEventId(StringRef name) {
+	return processEventsImpl.find(name);
+}
+
+StringRef eventName(EventId id) {
+	return processEventsImpl.names[id];
+}
+
 void trigger(StringRef name, std::any const& data, Error const& e) {
-	processEventsImpl.trigger(name, data, e);
+	// Names nobody has subscribed to are not interned, so that triggering arbitrary names does not grow the table
+	Optional<EventId> id = processEventsImpl.find(name);
+	if (id.present()) {
+		processEventsImpl.trigger(id.get(), Payload(data), e);
+	}
+}
+
+void trigger(EventId id, Payload const& payload, Error const& e) {
+	processEventsImpl.trigger(id, payload, e);
 }
 
 void uncancellableEvent(StringRef name, Callback callback) {
-	new EventImpl({ name }, std::move(callback));
+	new EventImpl(internAll({ name }), std::move(callback));
 }
 
 Event::Event(StringRef name, Callback callback) {
-	impl = new EventImpl({ std::move(name) }, std::move(callback));
+	impl = new EventImpl(internAll({ name }), std::move(callback));
 }
 Event::Event(std::vector<StringRef> names, Callback callback) {
-	impl = new EventImpl(std::move(names), std::move(callback));
+	impl = new EventImpl(internAll(names), std::move(callback));
+}
+Event::Event(EventId id, PayloadCallback callback) {
+	impl = new EventImpl(std::vector<EventId>{ id }, std::move(callback));
+}
+Event::Event(std::vector<EventId> ids, PayloadCallback callback) {
+	impl = new EventImpl(std::move(ids), std::move(callback));
 }
 Event::~Event() {
 	auto ptr = reinterpret_cast<EventImpl*>(impl);
@@ -266,4 +300,38 @@ TEST_CASE("/flow/ProcessEvents") {
 	return Void();
 }
 
-} // namespace ProcessEvents
\ No newline at end of file
+TEST_CASE("/flow/ProcessEvents/typed") {
+	EventId id = eventId("typed"_sr);
+	ASSERT_EQ(eventId("typed"_sr), id);
+	ASSERT(findEventId("typed"_sr).present() && eventName(id) == "typed"_sr);
+	ASSERT(!findEventId("neverInterned"_sr).present());
+
+	{
+		// Typed payloads reach typed subscribers by reference, and subscribers by name through a std::any
+		std::string payload = "payload";
+		int typedHits = 0, namedHits = 0;
+		Event typed(id, [&](EventId eid, Payload const& p, Error const& e) {
+			ASSERT_EQ(eid, id);
+			ASSERT(p.get<std::string>() == &payload);
+			ASSERT(p.get<int>() == nullptr);
+			++typedHits;
+		});
+		Event named("typed"_sr, [&](StringRef n, std::any const& data, Error const& e) {
+			ASSERT_EQ(std::any_cast<std::string>(data), payload);
+			++namedHits;
+		});
+		trigger(id, payload, success());
+		ASSERT_EQ(typedHits, 1);
+		ASSERT_EQ(namedHits, 1);
+	}
+
+	// The string based trigger wraps its std::any for typed subscribers
+	int typedInts = 0;
+	Event ints(id, [&](EventId, Payload const& p, Error const&) { typedInts += p.get<int>() ? *p.get<int>() : 0; });
+	trigger("typed"_sr, std::any(), success());
+	trigger("typed"_sr, 3, success());
+	ASSERT_EQ(typedInts, 3);
+	return Void();
+}
+
+} // namespace ProcessEvents
@@ -21,6 +21,7 @@
 #pragma once
 #include "flow/Trace.h"
 #include <cstdint>
+#include <type_traits>
 
 // This version impacts both communications and the deserialization of certain database and IKeyValueStore keys.
 constexpr uint64_t defaultProtocolVersionValue = @FDB_PV_DEFAULT_VERSION@;
@@ -36,16 +37,102 @@ constexpr uint64_t minCompatibleProtocolVersionValue = @FDB_PV_MIN_COMPATIBLE_VE
 // Used only for testing upgrades to the future version
 constexpr uint64_t futureProtocolVersionValue = @FDB_PV_FUTURE_VERSION@;
 
+// Every protocol version feature. Each entry becomes a nested type and has##x() test on ProtocolVersion, and a dense
+// ProtocolFeature index into the bitset kept by ProtocolFeatures.
+#define FDB_PROTOCOL_VERSION_FEATURES(X) \
+	X(@FDB_PV_WATCHES@, Watches) \
+	X(@FDB_PV_MOVABLE_COORDINATED_STATE@, MovableCoordinatedState) \
+	X(@FDB_PV_PROCESS_ID@, ProcessID) \
+	X(@FDB_PV_OPEN_DATABASE@, OpenDatabase) \
+	X(@FDB_PV_LOCALITY@, Locality) \
+	X(@FDB_PV_MULTIGENERATION_TLOG@, MultiGenerationTLog) \
+	X(@FDB_PV_SHARED_MUTATIONS@, SharedMutations) \
+	X(@FDB_PV_INEXPENSIVE_MULTIVERSION_CLIENT@, InexpensiveMultiVersionClient) \
+	X(@FDB_PV_TAG_LOCALITY@, TagLocality) \
+	X(@FDB_PV_FEARLESS@, Fearless) \
+	X(@FDB_PV_ENDPOINT_ADDR_LIST@, EndpointAddrList) \
+	X(@FDB_PV_IPV6@, IPv6) \
+	X(@FDB_PV_TLOG_VERSION@, TLogVersion) \
+	X(@FDB_PV_PSEUDO_LOCALITIES@, PseudoLocalities) \
+	X(@FDB_PV_SHARDED_TXS_TAGS@, ShardedTxsTags) \
+	X(@FDB_PV_TLOG_QUEUE_ENTRY_REF@, TLogQueueEntryRef) \
+	X(@FDB_PV_GENERATION_REG_VAL@, GenerationRegVal) \
+	X(@FDB_PV_MOVABLE_COORDINATED_STATE_V2@, MovableCoordinatedStateV2) \
+	X(@FDB_PV_KEY_SERVER_VALUE@, KeyServerValue) \
+	X(@FDB_PV_LOGS_VALUE@, LogsValue) \
+	X(@FDB_PV_SERVER_TAG_VALUE@, ServerTagValue) \
+	X(@FDB_PV_TAG_LOCALITY_LIST_VALUE@, TagLocalityListValue) \
+	X(@FDB_PV_DATACENTER_REPLICAS_VALUE@, DatacenterReplicasValue) \
+	X(@FDB_PV_PROCESS_CLASS_VALUE@, ProcessClassValue) \
+	X(@FDB_PV_WORKER_LIST_VALUE@, WorkerListValue) \
+	X(@FDB_PV_BACKUP_START_VALUE@, BackupStartValue) \
+	X(@FDB_PV_LOG_RANGE_ENCODE_VALUE@, LogRangeEncodeValue) \
+	X(@FDB_PV_HEALTHY_ZONE_VALUE@, HealthyZoneValue) \
+	X(@FDB_PV_DR_BACKUP_RANGES@, DRBackupRanges) \
+	X(@FDB_PV_REGION_CONFIGURATION@, RegionConfiguration) \
+	X(@FDB_PV_REPLICATION_POLICY@, ReplicationPolicy) \
+	X(@FDB_PV_BACKUP_MUTATIONS@, BackupMutations) \
+	X(@FDB_PV_CLUSTER_CONTROLLER_PRIORITY_INFO@, ClusterControllerPriorityInfo) \
+	X(@FDB_PV_PROCESS_ID_FILE@, ProcessIDFile) \
+	X(@FDB_PV_CLOSE_UNUSED_CONNECTION@, CloseUnusedConnection) \
+	X(@FDB_PV_DB_CORE_STATE@, DBCoreState) \
+	X(@FDB_PV_TAG_THROTTLE_VALUE@, TagThrottleValue) \
+	X(@FDB_PV_STORAGE_CACHE_VALUE@, StorageCacheValue) \
+	X(@FDB_PV_RESTORE_STATUS_VALUE@, RestoreStatusValue) \
+	X(@FDB_PV_RESTORE_REQUEST_VALUE@, RestoreRequestValue) \
+	X(@FDB_PV_RESTORE_REQUEST_DONE_VERSION_VALUE@, RestoreRequestDoneVersionValue) \
+	X(@FDB_PV_RESTORE_REQUEST_TRIGGER_VALUE@, RestoreRequestTriggerValue) \
+	X(@FDB_PV_RESTORE_WORKER_INTERFACE_VALUE@, RestoreWorkerInterfaceValue) \
+	X(@FDB_PV_BACKUP_PROGRESS_VALUE@, BackupProgressValue) \
+	X(@FDB_PV_KEY_SERVER_VALUE_V2@, KeyServerValueV2) \
+	X(@FDB_PV_UNIFIED_TLOG_SPILLING@, UnifiedTLogSpilling) \
+	X(@FDB_PV_BACKUP_WORKER@, BackupWorker) \
+	X(@FDB_PV_REPORT_CONFLICTING_KEYS@, ReportConflictingKeys) \
+	X(@FDB_PV_SMALL_ENDPOINTS@, SmallEndpoints) \
+	X(@FDB_PV_CACHE_ROLE@, CacheRole) \
+	X(@FDB_PV_STABLE_INTERFACES@, StableInterfaces) \
+	X(@FDB_PV_SERVER_LIST_VALUE@, ServerListValue) \
+	X(@FDB_PV_TAG_THROTTLE_VALUE_REASON@, TagThrottleValueReason) \
+	X(@FDB_PV_SPAN_CONTEXT@, SpanContext) \
+	X(@FDB_PV_TSS@, TSS) \
+	X(@FDB_PV_CHANGE_FEED@, ChangeFeed) \
+	X(@FDB_PV_BLOB_GRANULE@, BlobGranule) \
+	X(@FDB_PV_NETWORK_ADDRESS_HOSTNAME_FLAG@, NetworkAddressHostnameFlag) \
+	X(@FDB_PV_STORAGE_METADATA@, StorageMetadata) \
+	X(@FDB_PV_PERPETUAL_WIGGLE_METADATA@, PerpetualWiggleMetadata) \
+	X(@FDB_PV_STORAGE_INTERFACE_READINESS@, StorageInterfaceReadiness) \
+	X(@FDB_PV_RESOLVER_PRIVATE_MUTATIONS@, ResolverPrivateMutations) \
+	X(@FDB_PV_OTEL_SPAN_CONTEXT@, OTELSpanContext) \
+	X(@FDB_PV_SW_VERSION_TRACKING@, SWVersionTracking) \
+	X(@FDB_PV_ENCRYPTION_AT_REST@, EncryptionAtRest) \
+	X(@FDB_PV_SHARD_ENCODE_LOCATION_METADATA@, ShardEncodeLocationMetaData) \
+	X(@FDB_PV_TENANTS@, Tenants) \
+	X(@FDB_PV_BLOB_GRANULE_FILE@, BlobGranuleFile) \
+	X(@FDB_ENCRYPTED_SNAPSHOT_BACKUP_FILE@, EncryptedSnapshotBackupFile) \
+	X(@FDB_PV_CLUSTER_ID_SPECIAL_KEY@, ClusterIdSpecialKey) \
+	X(@FDB_PV_BLOB_GRANULE_FILE_LOGICAL_SIZE@, BlobGranuleFileLogicalSize) \
+	X(@FDB_PV_BLOB_RANGE_CHANGE_LOG@, BlobRangeChangeLog) \
+	X(@FDB_PV_GC_TXN_GENERATIONS@, GcTxnGenerations)
+
+#define PROTOCOL_FEATURE_ENUMERATOR(v, x) x,
+enum class ProtocolFeature : int { FDB_PROTOCOL_VERSION_FEATURES(PROTOCOL_FEATURE_ENUMERATOR) Count };
+#undef PROTOCOL_FEATURE_ENUMERATOR
+
+constexpr int protocolFeatureCount = static_cast<int>(ProtocolFeature::Count);
+
 // The first check second expression version doesn't need to change because it's just for earlier protocol versions.
 #define PROTOCOL_VERSION_FEATURE(v, x)                                                                                 \
 	static_assert((v & @FDB_PV_LSB_MASK@) == 0 || v < 0x0FDB00B071000000LL, "Unexpected feature protocol version");             \
 	static_assert(v <= defaultProtocolVersionValue, "Feature protocol version too large");                             \
 	struct x {                                                                                                         \
 		static constexpr uint64_t protocolVersion = v;                                                                 \
+		static constexpr ProtocolFeature feature = ProtocolFeature::x;                                                 \
 	};                                                                                                                 \
 	constexpr bool has##x() const { return this->version() >= x ::protocolVersion; }                                   \
 	static constexpr ProtocolVersion with##x() { return ProtocolVersion(x ::protocolVersion); }
 
+class ProtocolFeatures;
+
 // ProtocolVersion wraps a uint64_t to make it type safe. It will know about the current versions.
 // The default constructor will initialize the version to 0 (which is an invalid
 // version). ProtocolVersion objects should never be compared to version numbers
@@ -104,81 +191,87 @@ public: // introduced features
 	// We stopped using the dev version consistently in the past.
 	// To ensure binaries work across patch releases (e.g., 6.2.0 to 6.2.22), we require that the protocol version be
 	// the same for each of them.
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_WATCHES@, Watches);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_MOVABLE_COORDINATED_STATE@, MovableCoordinatedState);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_PROCESS_ID@, ProcessID);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_OPEN_DATABASE@, OpenDatabase);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_LOCALITY@, Locality);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_MULTIGENERATION_TLOG@, MultiGenerationTLog);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_SHARED_MUTATIONS@, SharedMutations);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_INEXPENSIVE_MULTIVERSION_CLIENT@, InexpensiveMultiVersionClient);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_TAG_LOCALITY@, TagLocality);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_FEARLESS@, Fearless);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_ENDPOINT_ADDR_LIST@, EndpointAddrList);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_IPV6@, IPv6);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_TLOG_VERSION@, TLogVersion);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_PSEUDO_LOCALITIES@, PseudoLocalities);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_SHARDED_TXS_TAGS@, ShardedTxsTags);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_TLOG_QUEUE_ENTRY_REF@, TLogQueueEntryRef);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_GENERATION_REG_VAL@, GenerationRegVal);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_MOVABLE_COORDINATED_STATE_V2@, MovableCoordinatedStateV2);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_KEY_SERVER_VALUE@, KeyServerValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_LOGS_VALUE@, LogsValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_SERVER_TAG_VALUE@, ServerTagValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_TAG_LOCALITY_LIST_VALUE@, TagLocalityListValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_DATACENTER_REPLICAS_VALUE@, DatacenterReplicasValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_PROCESS_CLASS_VALUE@, ProcessClassValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_WORKER_LIST_VALUE@, WorkerListValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_BACKUP_START_VALUE@, BackupStartValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_LOG_RANGE_ENCODE_VALUE@, LogRangeEncodeValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_HEALTHY_ZONE_VALUE@, HealthyZoneValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_DR_BACKUP_RANGES@, DRBackupRanges);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_REGION_CONFIGURATION@, RegionConfiguration);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_REPLICATION_POLICY@, ReplicationPolicy);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_BACKUP_MUTATIONS@, BackupMutations);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_CLUSTER_CONTROLLER_PRIORITY_INFO@, ClusterControllerPriorityInfo);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_PROCESS_ID_FILE@, ProcessIDFile);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_CLOSE_UNUSED_CONNECTION@, CloseUnusedConnection);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_DB_CORE_STATE@, DBCoreState);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_TAG_THROTTLE_VALUE@, TagThrottleValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_STORAGE_CACHE_VALUE@, StorageCacheValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_RESTORE_STATUS_VALUE@, RestoreStatusValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_RESTORE_REQUEST_VALUE@, RestoreRequestValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_RESTORE_REQUEST_DONE_VERSION_VALUE@, RestoreRequestDoneVersionValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_RESTORE_REQUEST_TRIGGER_VALUE@, RestoreRequestTriggerValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_RESTORE_WORKER_INTERFACE_VALUE@, RestoreWorkerInterfaceValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_BACKUP_PROGRESS_VALUE@, BackupProgressValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_KEY_SERVER_VALUE_V2@, KeyServerValueV2);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_UNIFIED_TLOG_SPILLING@, UnifiedTLogSpilling);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_BACKUP_WORKER@, BackupWorker);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_REPORT_CONFLICTING_KEYS@, ReportConflictingKeys);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_SMALL_ENDPOINTS@, SmallEndpoints);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_CACHE_ROLE@, CacheRole);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_STABLE_INTERFACES@, StableInterfaces);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_SERVER_LIST_VALUE@, ServerListValue);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_TAG_THROTTLE_VALUE_REASON@, TagThrottleValueReason);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_SPAN_CONTEXT@, SpanContext);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_TSS@, TSS);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_CHANGE_FEED@, ChangeFeed);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_BLOB_GRANULE@, BlobGranule);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_NETWORK_ADDRESS_HOSTNAME_FLAG@, NetworkAddressHostnameFlag);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_STORAGE_METADATA@, StorageMetadata);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_PERPETUAL_WIGGLE_METADATA@, PerpetualWiggleMetadata);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_STORAGE_INTERFACE_READINESS@, StorageInterfaceReadiness);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_RESOLVER_PRIVATE_MUTATIONS@, ResolverPrivateMutations);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_OTEL_SPAN_CONTEXT@, OTELSpanContext);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_SW_VERSION_TRACKING@, SWVersionTracking);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_ENCRYPTION_AT_REST@, EncryptionAtRest);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_SHARD_ENCODE_LOCATION_METADATA@, ShardEncodeLocationMetaData);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_TENANTS@, Tenants);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_BLOB_GRANULE_FILE@, BlobGranuleFile);
-	PROTOCOL_VERSION_FEATURE(@FDB_ENCRYPTED_SNAPSHOT_BACKUP_FILE@, EncryptedSnapshotBackupFile);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_CLUSTER_ID_SPECIAL_KEY@, ClusterIdSpecialKey);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_BLOB_GRANULE_FILE_LOGICAL_SIZE@, BlobGranuleFileLogicalSize);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_BLOB_RANGE_CHANGE_LOG@, BlobRangeChangeLog);
-	PROTOCOL_VERSION_FEATURE(@FDB_PV_GC_TXN_GENERATIONS@, GcTxnGenerations);
+	FDB_PROTOCOL_VERSION_FEATURES(PROTOCOL_VERSION_FEATURE)
+
+	constexpr ProtocolFeatures features() const;
 };
 
+// The features of one protocol version as a bitset. Archives and connections compute it once when their protocol
+// version is set, so that serializers testing a feature per field do a bit test instead of a version comparison.
+class ProtocolFeatures {
+	static constexpr int wordCount = (protocolFeatureCount + 63) / 64;
+#define PROTOCOL_FEATURE_VERSION(v, x) v,
+	static constexpr uint64_t featureVersions[] = { FDB_PROTOCOL_VERSION_FEATURES(PROTOCOL_FEATURE_VERSION) };
+#undef PROTOCOL_FEATURE_VERSION
+
+	uint64_t words[wordCount] = {};
+
+public:
+	constexpr ProtocolFeatures() = default;
+	constexpr explicit ProtocolFeatures(ProtocolVersion version) {
+		for (int i = 0; i < protocolFeatureCount; ++i) {
+			if (version.version() >= featureVersions[i]) {
+				words[i / 64] |= uint64_t(1) << (i % 64);
+			}
+		}
+	}
+
+	constexpr bool has(ProtocolFeature feature) const {
+		int i = static_cast<int>(feature);
+		return (words[i / 64] >> (i % 64)) & 1;
+	}
+	// Feature is one of the types nested in ProtocolVersion, e.g. has<ProtocolVersion::Tenants>()
+	template <class Feature>
+	constexpr bool has() const {
+		return has(Feature::feature);
+	}
+
+#define PROTOCOL_FEATURES_HAS(v, x)                                                                                    \
+	constexpr bool has##x() const { return has(ProtocolFeature::x); }
+	FDB_PROTOCOL_VERSION_FEATURES(PROTOCOL_FEATURES_HAS)
+#undef PROTOCOL_FEATURES_HAS
+
+	constexpr bool operator==(const ProtocolFeatures& other) const {
+		for (int i = 0; i < wordCount; ++i) {
+			if (words[i] != other.words[i]) {
+				return false;
+			}
+		}
+		return true;
+	}
+	constexpr bool operator!=(const ProtocolFeatures& other) const { return !(*this == other); }
+};
+
+constexpr ProtocolFeatures ProtocolVersion::features() const {
+	return ProtocolFeatures(*this);
+}
+
+// A protocol version known at compile time. Archives which only ever use one version can expose its features as a
+// static constexpr member, and archiveHasFeature() then folds each test into a constant.
+template <uint64_t Version>
+struct StaticProtocolVersion {
+	static constexpr ProtocolVersion version = ProtocolVersion(Version);
+	static constexpr ProtocolFeatures features = ProtocolFeatures(version);
+};
+
+// Tests a protocol version feature of an archive, e.g. archiveHasFeature<ProtocolVersion::Tenants>(ar). Archives
+// whose version is fixed at compile time declare `using StaticVersion = StaticProtocolVersion<V>` and the test is a
+// constant. Any other archive compares its protocolVersion(), which is a single comparison and needs no state in the
+// archive.
+template <class Ar, class = void>
+struct ArchiveStaticVersion : std::false_type {};
+template <class Ar>
+struct ArchiveStaticVersion<Ar, std::void_t<typename Ar::StaticVersion>> : std::true_type {};
+
+template <class Feature, class Ar>
+constexpr bool archiveHasFeature(const Ar& ar) {
+	if constexpr (ArchiveStaticVersion<Ar>::value) {
+		return Ar::StaticVersion::features.template has<Feature>();
+	} else {
+		return ar.protocolVersion().version() >= Feature::protocolVersion;
+	}
+}
+
 template <>
 struct Traceable<ProtocolVersion> : std::true_type {
 	static std::string toString(const ProtocolVersion& protocolVersion) {
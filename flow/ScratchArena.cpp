@@ -0,0 +1,206 @@
+/*
+ * ScratchArena.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flow/ScratchArena.h"
+
+#include <limits>
+#include <map>
+#include <vector>
+
+#include "flow/FastAlloc.h"
+#include "flow/Knobs.h"
+#include "flow/Platform.h"
+#include "flow/UnitTest.h"
+
+ScratchArena::~ScratchArena() {
+	while (chunks) {
+		Chunk* next = chunks->next;
+		freeFast4kAligned(chunks->size, chunks);
+		chunks = next;
+	}
+}
+
+size_t ScratchArena::retainLimit() {
+	return FLOW_KNOBS->SCRATCH_ARENA_MAX_RETAINED_BYTES;
+}
+
+void* ScratchArena::allocateSlow(size_t size, size_t alignment) {
+	// Chunks are 4k aligned, so offsets within a chunk are aligned as the addresses are
+	ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0 && alignment <= 4096);
+	size_t needed = ((sizeof(Chunk) + alignment - 1) & ~(alignment - 1)) + size;
+
+	// The tail of the current chunk stays in use until the next rewind
+	Chunk* next = current ? current->next : chunks;
+	if (current) {
+		bytesInUse_ += current->size - used;
+	}
+
+	if (!next || next->size < needed) {
+		// Grow geometrically, so a thread settles on a few chunks however much scratch memory it needs
+		size_t chunkSize = std::max<size_t>({ needed, size_t(FLOW_KNOBS->SCRATCH_ARENA_CHUNK_BYTES), capacity_ });
+		chunkSize = (chunkSize + 4095) & ~size_t(4095);
+		if (chunkSize > size_t(std::numeric_limits<int>::max())) {
+			platform::outOfMemory();
+		}
+		Chunk* chunk = static_cast<Chunk*>(allocateFast4kAligned(chunkSize));
+		chunk->size = chunkSize;
+		chunk->next = next;
+		if (current) {
+			current->next = chunk;
+		} else {
+			chunks = chunk;
+		}
+		capacity_ += chunkSize;
+		next = chunk;
+	}
+
+	current = next;
+	used = sizeof(Chunk);
+	return allocate(size, alignment);
+}
+
+void ScratchArena::releaseExcessChunks() {
+	size_t retained = 0;
+	Chunk** link = &chunks;
+	while (*link && retained + (*link)->size <= retainLimit()) {
+		retained += (*link)->size;
+		link = &(*link)->next;
+	}
+	Chunk* chunk = *link;
+	*link = nullptr;
+	while (chunk) {
+		Chunk* next = chunk->next;
+		capacity_ -= chunk->size;
+		freeFast4kAligned(chunk->size, chunk);
+		chunk = next;
+	}
+	current = chunks;
+	used = chunks ? sizeof(Chunk) : 0;
+}
+
+TEST_CASE("/flow/ScratchArena/rewind") {
+	ScratchArena arena;
+	ScratchArena::Mark empty = arena.mark();
+
+	int* a = arena.allocate<int>(10);
+	ASSERT(reinterpret_cast<uintptr_t>(a) % alignof(int) == 0);
+	for (int i = 0; i < 10; i++) {
+		a[i] = i;
+	}
+	ScratchArena::Mark afterA = arena.mark();
+	size_t inUse = arena.bytesInUse();
+	ASSERT(inUse >= 10 * sizeof(int));
+
+	// Allocations bigger than a chunk, which force new chunks, are still rewound in O(1)
+	size_t big = FLOW_KNOBS->SCRATCH_ARENA_CHUNK_BYTES * 3;
+	for (int i = 0; i < 3; i++) {
+		uint8_t* b = arena.allocate<uint8_t>(big);
+		memset(b, 0xab, big);
+	}
+	size_t capacity = arena.capacity();
+	ASSERT(arena.bytesInUse() >= inUse + 3 * big);
+	ASSERT(arena.highWaterMark() == arena.bytesInUse());
+
+	arena.rewind(afterA);
+	ASSERT_EQ(arena.bytesInUse(), inUse);
+	for (int i = 0; i < 10; i++) {
+		ASSERT_EQ(a[i], i);
+	}
+	// The same allocations again reuse the chunks
+	for (int i = 0; i < 3; i++) {
+		uint8_t* b = arena.allocate<uint8_t>(big);
+		memset(b, 0xcd, big);
+	}
+	ASSERT_EQ(arena.capacity(), capacity);
+
+	arena.rewind(empty);
+	ASSERT_EQ(arena.bytesInUse(), size_t(0));
+	ASSERT(arena.highWaterMark() >= inUse + 3 * big);
+	arena.resetHighWaterMark();
+	ASSERT_EQ(arena.highWaterMark(), size_t(0));
+
+	double* d = arena.allocate<double>(1);
+	ASSERT(reinterpret_cast<uintptr_t>(d) % alignof(double) == 0);
+	void* page = arena.allocate(100, 4096);
+	ASSERT(reinterpret_cast<uintptr_t>(page) % 4096 == 0);
+
+	arena.reset();
+	ASSERT_EQ(arena.bytesInUse(), size_t(0));
+	ASSERT(arena.capacity() <= size_t(FLOW_KNOBS->SCRATCH_ARENA_MAX_RETAINED_BYTES));
+	return Void();
+}
+
+TEST_CASE("/flow/ScratchArena/resetAfterRewind") {
+	// Grown past what it retains inside a scope, as ScratchScope marks and rewinds it, and empty again when reset
+	ScratchArena arena;
+	size_t const retained = FLOW_KNOBS->SCRATCH_ARENA_MAX_RETAINED_BYTES;
+	ScratchArena::Mark scope = arena.mark();
+	for (size_t grown = 0; grown <= retained; grown += FLOW_KNOBS->SCRATCH_ARENA_CHUNK_BYTES) {
+		[[maybe_unused]] uint8_t* b = arena.allocate<uint8_t>(FLOW_KNOBS->SCRATCH_ARENA_CHUNK_BYTES);
+	}
+	arena.rewind(scope);
+	ASSERT_EQ(arena.bytesInUse(), size_t(0));
+	ASSERT(arena.capacity() > retained);
+
+	arena.reset();
+	ASSERT(arena.capacity() <= retained);
+	ASSERT_EQ(arena.bytesInUse(), size_t(0));
+	// What is left is still used
+	size_t capacity = arena.capacity();
+	[[maybe_unused]] uint8_t* b = arena.allocate<uint8_t>(100);
+	ASSERT_EQ(arena.capacity(), capacity);
+	return Void();
+}
+
+TEST_CASE("/flow/ScratchArena/containers") {
+	ScratchArena& arena = ScratchArena::local();
+	size_t before = arena.bytesInUse();
+	{
+		ScratchScope outer;
+		std::vector<int, ScratchAllocator<int>> v;
+		for (int i = 0; i < 1000; i++) {
+			v.push_back(i);
+		}
+		std::map<int, int, std::less<int>, ScratchAllocator<std::pair<const int, int>>> m;
+		for (int i = 0; i < 100; i++) {
+			m[i] = i * i;
+		}
+		size_t afterContainers = arena.bytesInUse();
+		ASSERT(afterContainers > before);
+
+		{
+			ScratchScope inner;
+			VectorRef<int> ref = scratchVectorRef<int>(50);
+			ASSERT_EQ(ref.size(), 50);
+			for (int i = 0; i < ref.size(); i++) {
+				ASSERT_EQ(ref[i], 0);
+				ref[i] = i;
+			}
+		}
+		ASSERT_EQ(arena.bytesInUse(), afterContainers);
+
+		for (int i = 0; i < 1000; i++) {
+			ASSERT_EQ(v[i], i);
+		}
+		ASSERT_EQ(m[99], 99 * 99);
+	}
+	ASSERT_EQ(arena.bytesInUse(), before);
+	return Void();
+}
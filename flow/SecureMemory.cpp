@@ -0,0 +1,424 @@
+/*
+ * SecureMemory.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flow/SecureMemory.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#include "flow/FastAlloc.h"
+#include "flow/Knobs.h"
+#include "flow/Platform.h"
+#include "flow/Trace.h"
+#include "flow/UnitTest.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Size classes are powers of two from 32 bytes up to secureMemoryMaxPooledSize
+constexpr int minSizeClassBits = 5;
+constexpr int sizeClassCount = 9;
+static_assert(size_t(1) << (minSizeClassBits + sizeClassCount - 1) == secureMemoryMaxPooledSize);
+
+int sizeClass(size_t size) {
+	int c = 0;
+	while ((size_t(1) << (minSizeClassBits + c)) < size) {
+		c++;
+	}
+	return c;
+}
+
+size_t sizeClassBytes(int c) {
+	return size_t(1) << (minSizeClassBits + c);
+}
+
+size_t pageSize() {
+#ifdef _WIN32
+	static size_t size = []() {
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return size_t(info.dwPageSize);
+	}();
+#else
+	static size_t size = sysconf(_SC_PAGESIZE);
+#endif
+	return size;
+}
+
+size_t roundUpToPage(size_t bytes) {
+	return (bytes + pageSize() - 1) / pageSize() * pageSize();
+}
+
+struct Mapping {
+	void* memory;
+	bool locked;
+	bool excludedFromDumps;
+};
+
+// Maps |bytes|, a multiple of the page size, locked into RAM and excluded from core dumps as far as possible
+Mapping mapSecure(size_t bytes) {
+	Mapping m{ nullptr, false, false };
+#ifdef _WIN32
+	m.memory = VirtualAlloc(nullptr, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (m.memory == nullptr) {
+		platform::outOfMemory();
+	}
+	m.locked = VirtualLock(m.memory, bytes);
+	// Minidumps only include the memory they are asked to
+	m.excludedFromDumps = true;
+#else
+	m.memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (m.memory == MAP_FAILED) {
+		platform::outOfMemory();
+	}
+	m.locked = mlock(m.memory, bytes) == 0;
+#if defined(MADV_DONTDUMP)
+	m.excludedFromDumps = madvise(m.memory, bytes, MADV_DONTDUMP) == 0;
+#elif defined(MADV_NOCORE)
+	m.excludedFromDumps = madvise(m.memory, bytes, MADV_NOCORE) == 0;
+#endif
+#endif
+	return m;
+}
+
+void unmapSecure(void* memory, size_t bytes, bool locked) {
+#ifdef _WIN32
+	if (locked) {
+		VirtualUnlock(memory, bytes);
+	}
+	VirtualFree(memory, 0, MEM_RELEASE);
+#else
+	if (locked) {
+		munlock(memory, bytes);
+	}
+	munmap(memory, bytes);
+#endif
+}
+
+// Small allocations are carved out of slabs of SECURE_MEMORY_POOL_BYTES, mapped one at a time as the pool needs them,
+// and freed ones go onto per size class free lists. A size class whose list is empty splits a free block of a larger
+// class before the pool carves more of its slab, so memory freed by one size can serve others. Large allocations get
+// mappings of their own, and freed ones are kept for reuse, up to SECURE_MEMORY_MAPPING_CACHE_BYTES in all, so that
+// repeated large secrets do not map and lock memory every time.
+class SecureMemoryPool {
+public:
+	void* allocate(size_t size) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (size <= secureMemoryMaxPooledSize && slabBytes() > 0) {
+			int c = sizeClass(size);
+			void* result = takeFree(c);
+			if (!result) {
+				result = carve(c);
+			}
+			stats.pooledBytesInUse += sizeClassBytes(c);
+			return result;
+		}
+
+		size_t bytes = roundUpToPage(size);
+		// Reuse a cached mapping which is big enough, but not so big as to waste most of it
+		auto cached = cachedMappings.lower_bound(bytes);
+		void* memory;
+		if (cached != cachedMappings.end() && cached->first <= 2 * bytes) {
+			bytes = cached->first;
+			memory = cached->second;
+			cachedMappings.erase(cached);
+			stats.cachedBytes -= bytes;
+		} else {
+			lock.unlock();
+			Mapping m = mapSecure(bytes);
+			memory = m.memory;
+			lock.lock();
+			recordMapping(m);
+		}
+		mappingBytes[memory] = bytes;
+		stats.unpooledBytesInUse += bytes;
+		return memory;
+	}
+
+	void free(void* ptr, size_t size) {
+		bool pooled = size <= secureMemoryMaxPooledSize && slabBytes() > 0;
+		// A mapping only ever held |size| bytes of this caller's data; the rest was wiped when it was last freed
+		secureWipe(ptr, pooled ? sizeClassBytes(sizeClass(size)) : size);
+		std::unique_lock<std::mutex> lock(mutex);
+		if (pooled) {
+			int c = sizeClass(size);
+			pushFree(c, ptr);
+			stats.pooledBytesInUse -= sizeClassBytes(c);
+			return;
+		}
+
+		auto mapping = mappingBytes.find(ptr);
+		ASSERT(mapping != mappingBytes.end());
+		size_t bytes = mapping->second;
+		mappingBytes.erase(mapping);
+		stats.unpooledBytesInUse -= bytes;
+		if (stats.cachedBytes + bytes <= mappingCacheBytes()) {
+			cachedMappings.emplace(bytes, ptr);
+			stats.cachedBytes += bytes;
+			return;
+		}
+		lock.unlock();
+		// munlock fails harmlessly on memory which was not locked
+		unmapSecure(ptr, bytes, true);
+	}
+
+	SecureMemoryStats getStats() {
+		std::unique_lock<std::mutex> lock(mutex);
+		return stats;
+	}
+
+private:
+	struct FreeNode {
+		FreeNode* next;
+	};
+
+	static size_t slabBytes() {
+		static size_t bytes = []() {
+			int64_t knob = FLOW_KNOBS ? FLOW_KNOBS->SECURE_MEMORY_POOL_BYTES : 1 << 20;
+			return knob > 0 ? roundUpToPage(std::max<size_t>(knob, secureMemoryMaxPooledSize)) : 0;
+		}();
+		return bytes;
+	}
+
+	static size_t mappingCacheBytes() {
+		return FLOW_KNOBS ? std::max<int64_t>(0, FLOW_KNOBS->SECURE_MEMORY_MAPPING_CACHE_BYTES) : 4 << 20;
+	}
+
+	void pushFree(int c, void* p) {
+		FreeNode* node = static_cast<FreeNode*>(p);
+		node->next = freeLists[c];
+		freeLists[c] = node;
+	}
+
+	// Takes a free block of class |c|, splitting one of the smallest larger class which has any if need be
+	void* takeFree(int c) {
+		int d = c;
+		while (d < sizeClassCount && !freeLists[d]) {
+			d++;
+		}
+		if (d == sizeClassCount) {
+			return nullptr;
+		}
+		FreeNode* node = freeLists[d];
+		freeLists[d] = node->next;
+		node->next = nullptr;
+		// Keep the first half and free the second, down to class |c|
+		for (; d > c; d--) {
+			pushFree(d - 1, reinterpret_cast<uint8_t*>(node) + sizeClassBytes(d - 1));
+		}
+		return node;
+	}
+
+	// Carves a block of class |c| from the current slab, mapping a new one when it is used up
+	void* carve(int c) {
+		size_t bytes = sizeClassBytes(c);
+		if (!slab || slabUsed + bytes > slabBytes()) {
+			// Hand the rest of the old slab out to the free lists; blocks stay aligned to their size within it
+			while (slab && slabUsed < slabBytes()) {
+				int fit = sizeClassCount - 1;
+				while (sizeClassBytes(fit) > slabBytes() - slabUsed || slabUsed % sizeClassBytes(fit)) {
+					fit--;
+				}
+				pushFree(fit, slab + slabUsed);
+				slabUsed += sizeClassBytes(fit);
+			}
+			Mapping m = mapSecure(slabBytes());
+			recordMapping(m);
+			slab = static_cast<uint8_t*>(m.memory);
+			slabUsed = 0;
+			stats.poolBytes += slabBytes();
+		}
+		void* result = slab + slabUsed;
+		slabUsed += bytes;
+		return result;
+	}
+
+	void recordMapping(const Mapping& m) {
+		if (!m.locked) {
+			stats.lockFailures++;
+		}
+		if (!m.excludedFromDumps) {
+			stats.dumpExclusionFailures++;
+		}
+		if ((!m.locked || !m.excludedFromDumps) && !warned) {
+			warned = true;
+			// Tracing allocates from ordinary arenas, so it cannot come back here
+			TraceEvent(SevWarnAlways, "SecureMemoryNotProtected")
+			    .detail("Locked", m.locked)
+			    .detail("ExcludedFromCoreDumps", m.excludedFromDumps);
+		}
+	}
+
+	std::mutex mutex;
+	uint8_t* slab = nullptr;
+	size_t slabUsed = 0;
+	std::array<FreeNode*, sizeClassCount> freeLists{};
+	// The size of each large allocation's mapping, which can be bigger than was asked for when it is reused
+	std::unordered_map<void*, size_t> mappingBytes;
+	std::multimap<size_t, void*> cachedMappings;
+	SecureMemoryStats stats;
+	bool warned = false;
+};
+
+SecureMemoryPool& securePool() {
+	// Never destroyed, since secrets can be freed by static destructors
+	static SecureMemoryPool* pool = new SecureMemoryPool();
+	return *pool;
+}
+
+} // namespace
+
+void secureWipe(void* ptr, size_t size) {
+	// memset is vectorized by the C library; the barrier stops it from being dropped as a dead store
+	::memset(ptr, 0, size);
+#if defined(_MSC_VER)
+	_ReadWriteBarrier();
+#else
+	asm volatile("" : : "r"(ptr) : "memory");
+#endif
+}
+
+void* allocateSecure(size_t size) {
+	// Lets tests check that memory was wiped after it is freed
+	if (keepalive_allocator::isActive()) [[unlikely]] {
+		return keepalive_allocator::allocate(size);
+	}
+	return securePool().allocate(size);
+}
+
+void freeSecure(void* ptr, size_t size) {
+	if (keepalive_allocator::isActive()) [[unlikely]] {
+		secureWipe(ptr, size);
+		keepalive_allocator::invalidate(ptr);
+		return;
+	}
+	securePool().free(ptr, size);
+}
+
+SecureMemoryStats getSecureMemoryStats() {
+	return securePool().getStats();
+}
+
+TEST_CASE("/flow/SecureMemory/allocate") {
+	SecureMemoryStats before = getSecureMemoryStats();
+	std::vector<std::pair<uint8_t*, size_t>> allocations;
+	for (size_t size : { size_t(1), size_t(32), size_t(33), size_t(1000), secureMemoryMaxPooledSize, size_t(100000) }) {
+		uint8_t* p = static_cast<uint8_t*>(allocateSecure(size));
+		ASSERT(reinterpret_cast<uintptr_t>(p) % 16 == 0);
+		::memset(p, 0xaa, size);
+		allocations.emplace_back(p, size);
+	}
+	SecureMemoryStats during = getSecureMemoryStats();
+	ASSERT(during.unpooledBytesInUse >= before.unpooledBytesInUse + 100000);
+	if (during.poolBytes > 0) {
+		ASSERT(during.pooledBytesInUse >= before.pooledBytesInUse + 32 + 32 + 64 + 1024 + secureMemoryMaxPooledSize);
+	}
+
+	// Freed pooled memory is wiped and reused for the same size class
+	uint8_t* pooled = allocations[3].first;
+	freeSecure(pooled, allocations[3].second);
+	if (during.poolBytes > 0) {
+		for (size_t i = sizeof(void*); i < 1024; i++) {
+			ASSERT(pooled[i] == 0);
+		}
+		uint8_t* again = static_cast<uint8_t*>(allocateSecure(1000));
+		ASSERT(again == pooled);
+		allocations[3].first = again;
+	} else {
+		allocations[3].first = static_cast<uint8_t*>(allocateSecure(1000));
+	}
+
+	for (auto const& [p, size] : allocations) {
+		freeSecure(p, size);
+	}
+	SecureMemoryStats after = getSecureMemoryStats();
+	ASSERT_EQ(after.pooledBytesInUse, before.pooledBytesInUse);
+	ASSERT_EQ(after.unpooledBytesInUse, before.unpooledBytesInUse);
+	return Void();
+}
+
+TEST_CASE("/flow/SecureMemory/grow") {
+	// More blocks than the free lists and the current slab can hold in all, so another slab must be mapped, rather than
+	// falling back to a mapping per allocation
+	SecureMemoryStats before = getSecureMemoryStats();
+	size_t count = (before.poolBytes + FLOW_KNOBS->SECURE_MEMORY_POOL_BYTES) / secureMemoryMaxPooledSize + 1;
+	std::vector<void*> large;
+	for (size_t i = 0; i < count; i++) {
+		large.push_back(allocateSecure(secureMemoryMaxPooledSize));
+	}
+	SecureMemoryStats grown = getSecureMemoryStats();
+	if (FLOW_KNOBS->SECURE_MEMORY_POOL_BYTES > 0) {
+		ASSERT(grown.poolBytes > before.poolBytes);
+		ASSERT_EQ(grown.unpooledBytesInUse, before.unpooledBytesInUse);
+	}
+
+	// Freed blocks are split to serve smaller size classes before the pool grows again
+	for (void* p : large) {
+		freeSecure(p, secureMemoryMaxPooledSize);
+	}
+	std::vector<void*> small;
+	for (size_t i = 0; i < 2 * count; i++) {
+		small.push_back(allocateSecure(secureMemoryMaxPooledSize / 2));
+	}
+	ASSERT_EQ(getSecureMemoryStats().poolBytes, grown.poolBytes);
+	for (void* p : small) {
+		freeSecure(p, secureMemoryMaxPooledSize / 2);
+	}
+	return Void();
+}
+
+TEST_CASE("/flow/SecureMemory/mappingCache") {
+	// A freed large allocation is kept mapped and handed out again
+	size_t const size = 3 * secureMemoryMaxPooledSize + 1;
+	void* p = allocateSecure(size);
+	freeSecure(p, size);
+	SecureMemoryStats freed = getSecureMemoryStats();
+	if (FLOW_KNOBS->SECURE_MEMORY_MAPPING_CACHE_BYTES >= 4 * secureMemoryMaxPooledSize) {
+		ASSERT(freed.cachedBytes >= size);
+		p = allocateSecure(size);
+		ASSERT(getSecureMemoryStats().cachedBytes < freed.cachedBytes);
+		freeSecure(p, size);
+	}
+	return Void();
+}
+
+TEST_CASE("/flow/SecureMemory/wipe") {
+	auto keepaliveScope = keepalive_allocator::ActiveScope{};
+	for (size_t size : { size_t(7), size_t(4096), size_t(20000) }) {
+		uint8_t* p = static_cast<uint8_t*>(allocateSecure(size));
+		::memset(p, 0x5c, size);
+		freeSecure(p, size);
+		for (size_t i = 0; i < size; i++) {
+			ASSERT(p[i] == 0);
+		}
+	}
+	return Void();
+}
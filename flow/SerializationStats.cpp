@@ -0,0 +1,296 @@
+/*
+ * SerializationStats.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flow/SerializationStats.h"
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "flow/Knobs.h"
+#include "flow/ObjectSerializer.h"
+#include "flow/Platform.h"
+#include "flow/ThreadPrimitives.h"
+#include "flow/Trace.h"
+#include "flow/UnitTest.h"
+
+std::atomic<bool> SerializationStats::enabledFlag = false;
+
+namespace {
+
+using StatsMap = std::unordered_map<FileIdentifier, SerializationTypeStats>;
+
+void add(StatsMap& to, SerializationTypeStats const& s) {
+	SerializationTypeStats& t = to[s.fileIdentifier];
+	t.fileIdentifier = s.fileIdentifier;
+	t.messagesWritten += s.messagesWritten;
+	t.bytesWritten += s.bytesWritten;
+	t.writeSeconds += s.writeSeconds;
+	t.messagesRead += s.messagesRead;
+	t.bytesRead += s.bytesRead;
+	t.readSeconds += s.readSeconds;
+}
+
+struct ThreadStats;
+
+// Every thread counts into a table of its own, so recording never contends with other threads; the lock is only taken
+// by the thread itself and by readers, which merge all the tables.
+class Registry {
+public:
+	void add(ThreadStats* t) {
+		std::unique_lock<std::mutex> lock(mutex);
+		threads.insert(t);
+	}
+
+	// Keeps the counts of an exiting thread
+	void retire(ThreadStats* t);
+
+	StatsMap merge();
+
+	// Returns what was counted since the previous call
+	StatsMap takeSinceLastTrace() {
+		StatsMap current = merge();
+		std::unique_lock<std::mutex> lock(mutex);
+		StatsMap since = current;
+		for (auto& [id, s] : since) {
+			auto last = lastTraced.find(id);
+			if (last != lastTraced.end()) {
+				s.messagesWritten -= last->second.messagesWritten;
+				s.bytesWritten -= last->second.bytesWritten;
+				s.writeSeconds -= last->second.writeSeconds;
+				s.messagesRead -= last->second.messagesRead;
+				s.bytesRead -= last->second.bytesRead;
+				s.readSeconds -= last->second.readSeconds;
+			}
+		}
+		lastTraced = std::move(current);
+		return since;
+	}
+
+private:
+	std::mutex mutex;
+	std::unordered_set<ThreadStats*> threads;
+	StatsMap retired;
+	StatsMap lastTraced;
+};
+
+Registry& registry() {
+	// Never destroyed, since threads can exit during static destruction
+	static Registry* r = new Registry();
+	return *r;
+}
+
+struct ThreadStats {
+	ThreadSpinLock lock;
+	StatsMap stats;
+
+	ThreadStats() { registry().add(this); }
+	~ThreadStats() { registry().retire(this); }
+
+	static ThreadStats& local() {
+		thread_local ThreadStats t;
+		return t;
+	}
+
+	SerializationTypeStats& at(FileIdentifier fileIdentifier) {
+		SerializationTypeStats& s = stats[fileIdentifier];
+		s.fileIdentifier = fileIdentifier;
+		return s;
+	}
+};
+
+void Registry::retire(ThreadStats* t) {
+	std::unique_lock<std::mutex> lock(mutex);
+	threads.erase(t);
+	for (auto const& [id, s] : t->stats) {
+		::add(retired, s);
+	}
+}
+
+StatsMap Registry::merge() {
+	std::unique_lock<std::mutex> lock(mutex);
+	StatsMap result = retired;
+	for (ThreadStats* t : threads) {
+		ThreadSpinLockHolder holder(t->lock);
+		for (auto const& [id, s] : t->stats) {
+			::add(result, s);
+		}
+	}
+	return result;
+}
+
+std::string formatTypes(std::vector<SerializationTypeStats> const& stats) {
+	std::string result;
+	for (auto const& s : stats) {
+		if (!result.empty()) {
+			result += ' ';
+		}
+		result += format("%u:%" PRId64 ":%" PRId64 ":%.6f", s.fileIdentifier, s.messages(), s.bytes(), s.seconds());
+	}
+	return result;
+}
+
+} // namespace
+
+double SerializationStats::start() {
+	return timer_monotonic();
+}
+
+void SerializationStats::recordWrite(FileIdentifier fileIdentifier, size_t bytes, double startTime) {
+	double seconds = timer_monotonic() - startTime;
+	ThreadStats& t = ThreadStats::local();
+	ThreadSpinLockHolder holder(t.lock);
+	SerializationTypeStats& s = t.at(fileIdentifier);
+	s.messagesWritten++;
+	s.bytesWritten += bytes;
+	s.writeSeconds += seconds;
+}
+
+void SerializationStats::recordRead(FileIdentifier fileIdentifier, size_t bytes, double startTime) {
+	double seconds = timer_monotonic() - startTime;
+	ThreadStats& t = ThreadStats::local();
+	ThreadSpinLockHolder holder(t.lock);
+	SerializationTypeStats& s = t.at(fileIdentifier);
+	s.messagesRead++;
+	s.bytesRead += bytes;
+	s.readSeconds += seconds;
+}
+
+std::vector<SerializationTypeStats> SerializationStats::get() {
+	std::vector<SerializationTypeStats> result;
+	for (auto const& [id, s] : registry().merge()) {
+		result.push_back(s);
+	}
+	return result;
+}
+
+SerializationTypeStats SerializationStats::get(FileIdentifier fileIdentifier) {
+	StatsMap stats = registry().merge();
+	auto s = stats.find(fileIdentifier);
+	if (s == stats.end()) {
+		SerializationTypeStats none;
+		none.fileIdentifier = fileIdentifier;
+		return none;
+	}
+	return s->second;
+}
+
+std::vector<SerializationTypeStats> SerializationStats::top(std::vector<SerializationTypeStats> stats,
+                                                            int count,
+                                                            bool bySeconds) {
+	auto more = [bySeconds](SerializationTypeStats const& a, SerializationTypeStats const& b) {
+		if (bySeconds ? a.seconds() != b.seconds() : a.bytes() != b.bytes()) {
+			return bySeconds ? a.seconds() > b.seconds() : a.bytes() > b.bytes();
+		}
+		return a.fileIdentifier < b.fileIdentifier;
+	};
+	count = std::min<int>(count, stats.size());
+	std::partial_sort(stats.begin(), stats.begin() + count, stats.end(), more);
+	stats.resize(count);
+	return stats;
+}
+
+void SerializationStats::trace() {
+	std::vector<SerializationTypeStats> stats;
+	SerializationTypeStats total;
+	for (auto const& [id, s] : registry().takeSinceLastTrace()) {
+		if (s.messages() > 0) {
+			stats.push_back(s);
+			total.messagesWritten += s.messagesWritten;
+			total.bytesWritten += s.bytesWritten;
+			total.writeSeconds += s.writeSeconds;
+			total.messagesRead += s.messagesRead;
+			total.bytesRead += s.bytesRead;
+			total.readSeconds += s.readSeconds;
+		}
+	}
+	int maxTypes = FLOW_KNOBS->SERIALIZATION_STATS_TRACE_MAX_TYPES;
+	TraceEvent("SerializationMetrics")
+	    .detail("Types", stats.size())
+	    .detail("MessagesWritten", total.messagesWritten)
+	    .detail("BytesWritten", total.bytesWritten)
+	    .detail("WriteSeconds", total.writeSeconds)
+	    .detail("MessagesRead", total.messagesRead)
+	    .detail("BytesRead", total.bytesRead)
+	    .detail("ReadSeconds", total.readSeconds)
+	    .detail("TopBytes", formatTypes(top(stats, maxTypes, false)))
+	    .detail("TopSeconds", formatTypes(top(stats, maxTypes, true)));
+}
+
+namespace {
+
+struct SerializationStatsTestMessage {
+	constexpr static FileIdentifier file_identifier = 15330275;
+	std::string payload;
+
+	template <class Ar>
+	void serialize(Ar& ar) {
+		serializer(ar, payload);
+	}
+};
+
+} // namespace
+
+TEST_CASE("/flow/SerializationStats/accounting") {
+	bool wasEnabled = SerializationStats::enabled();
+	FileIdentifier id = SerializationStatsTestMessage::file_identifier;
+	SerializationTypeStats before = SerializationStats::get(id);
+
+	SerializationStats::setEnabled(false);
+	SerializationStatsTestMessage message;
+	message.payload = std::string(100, 'x');
+	ObjectWriter::toValue(message, Unversioned());
+	ASSERT_EQ(SerializationStats::get(id).messages(), before.messages());
+
+	SerializationStats::setEnabled(true);
+	int64_t bytes = 0;
+	for (int i = 0; i < 3; i++) {
+		message.payload = std::string(100 * (i + 1), 'x');
+		Standalone<StringRef> value = ObjectWriter::toValue(message, IncludeVersion());
+		bytes += value.size();
+		ASSERT(ObjectReader::fromStringRef<SerializationStatsTestMessage>(value, IncludeVersion()).payload ==
+		       message.payload);
+	}
+	Standalone<StringRef> value = ObjectWriter::toValue(message, Unversioned());
+	SerializationStatsTestMessage read;
+	ArenaObjectReader reader(value.arena(), value, Unversioned());
+	reader.deserialize(read);
+	ASSERT(read.payload == message.payload);
+	// Readers given only a pointer count messages but not bytes
+	ObjectReader(value.begin(), Unversioned()).deserialize(read);
+	SerializationStats::setEnabled(wasEnabled);
+
+	SerializationTypeStats after = SerializationStats::get(id);
+	ASSERT_EQ(after.messagesWritten - before.messagesWritten, 4);
+	ASSERT_EQ(after.bytesWritten - before.bytesWritten, bytes + value.size());
+	ASSERT_EQ(after.messagesRead - before.messagesRead, 5);
+	ASSERT_EQ(after.bytesRead - before.bytesRead, bytes + value.size());
+	ASSERT(after.writeSeconds >= before.writeSeconds && after.readSeconds >= before.readSeconds);
+
+	auto byBytes = SerializationStats::top(SerializationStats::get(), 1000, false);
+	ASSERT(std::find_if(byBytes.begin(), byBytes.end(), [id](SerializationTypeStats const& s) {
+		       return s.fileIdentifier == id;
+	       }) != byBytes.end());
+	for (int i = 1; i < byBytes.size(); i++) {
+		ASSERT(byBytes[i - 1].bytes() >= byBytes[i].bytes());
+	}
+	return Void();
+}
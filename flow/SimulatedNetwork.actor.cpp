@@ -0,0 +1,603 @@
+/*
+ * SimulatedNetwork.actor.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flow/SimulatedNetwork.h"
+
+#include <cmath>
+#include <deque>
+
+#include "flow/IUDPSocket.h"
+#include "flow/Knobs.h"
+#include "flow/Platform.h"
+#include "flow/ScopeExit.h"
+#include "flow/ScratchArena.h"
+#include "flow/UnitTest.h"
+#include "flow/genericactors.actor.h"
+#include "flow/serialize.h"
+#include "flow/actorcompiler.h" // This must be the last #include.
+
+// One end of a connection. Each end belongs to the process which created or accepted it, and bytes written to it are
+// delivered to the other end by tasks on the other end's process.
+class SimulatedNetwork::Connection final : public IConnection, public ReferenceCounted<Connection> {
+public:
+	Connection(SimulatedNetwork* net, Process* process, NetworkAddress localAddress, NetworkAddress peerAddress)
+	  : net(net), process(process), localAddress(localAddress), peerAddress(peerAddress),
+	    debugID(deterministicRandom()->randomUniqueID()) {}
+
+	void addref() override { ReferenceCounted<Connection>::addref(); }
+	void delref() override { ReferenceCounted<Connection>::delref(); }
+
+	void close() override {
+		if (closed) {
+			return;
+		}
+		closed = true;
+		if (peer) {
+			// The peer sees the close after everything written before it
+			Reference<Connection> to = peer;
+			double arrival = net->transmit(localAddress.ip, peerAddress.ip, 0);
+			net->post(to->process, arrival, TaskPriority::ReadSocket, [to]() {
+				to->peerClosed = true;
+				to->peer.clear();
+				to->readable.trigger();
+				to->writable.trigger();
+			});
+			peer.clear();
+		}
+		readable.trigger();
+		writable.trigger();
+	}
+
+	Future<Void> acceptHandshake() override { return Void(); }
+	Future<Void> connectHandshake() override { return Void(); }
+
+	Future<Void> onWritable() override {
+		if (closed || peerClosed || bytesInFlight < FLOW_KNOBS->SIMULATED_NETWORK_CONNECTION_BUFFER_BYTES) {
+			return Void();
+		}
+		return writable.onTrigger();
+	}
+
+	Future<Void> onReadable() override {
+		if (closed || peerClosed || !received.empty()) {
+			return Void();
+		}
+		return readable.onTrigger();
+	}
+
+	int read(uint8_t* begin, uint8_t* end) override {
+		if (closed) {
+			throw connection_failed();
+		}
+		int n = 0;
+		while (begin < end && !received.empty()) {
+			StringRef front = received.front().substr(receivedOffset);
+			int len = std::min<int>(front.size(), end - begin);
+			memcpy(begin, front.begin(), len);
+			begin += len;
+			n += len;
+			receivedOffset += len;
+			if (receivedOffset == received.front().size()) {
+				received.pop_front();
+				receivedOffset = 0;
+			}
+		}
+		if (n == 0 && peerClosed) {
+			throw connection_failed();
+		}
+		return n;
+	}
+
+	int write(SendBuffer const* buffer, int limit) override {
+		if (closed || peerClosed) {
+			throw connection_failed();
+		}
+		int64_t space = FLOW_KNOBS->SIMULATED_NETWORK_CONNECTION_BUFFER_BYTES - bytesInFlight;
+		int total = 0;
+		for (SendBuffer const* p = buffer; p && total < limit; p = p->next) {
+			total += std::min(p->bytes_unsent(), limit - total);
+		}
+		total = std::min<int64_t>(total, space);
+		if (total <= 0) {
+			return 0;
+		}
+
+		Standalone<StringRef> bytes = makeString(total);
+		uint8_t* out = mutateString(bytes);
+		int copied = 0;
+		for (SendBuffer const* p = buffer; copied < total; p = p->next) {
+			int len = std::min(p->bytes_unsent(), total - copied);
+			memcpy(out + copied, p->data() + p->bytes_sent, len);
+			copied += len;
+		}
+
+		bytesInFlight += total;
+		Reference<Connection> from = Reference<Connection>::addRef(this);
+		Reference<Connection> to = peer;
+		double arrival = net->transmit(localAddress.ip, peerAddress.ip, total);
+		net->post(to->process, arrival, TaskPriority::ReadSocket, [from, to, bytes]() {
+			from->bytesInFlight -= bytes.size();
+			from->writable.trigger();
+			if (!to->closed) {
+				to->received.push_back(bytes);
+				to->readable.trigger();
+			}
+		});
+		return total;
+	}
+
+	NetworkAddress getPeerAddress() const override { return peerAddress; }
+	bool hasTrustedPeer() const override { return true; }
+	UID getDebugID() const override { return debugID; }
+	boost::asio::ip::tcp::socket& getSocket() override { throw unsupported_operation(); }
+
+	SimulatedNetwork* net;
+	Process* process;
+	NetworkAddress localAddress;
+	NetworkAddress peerAddress;
+	UID debugID;
+	// Cleared on close, which breaks the reference cycle between the two ends
+	Reference<Connection> peer;
+	bool closed = false;
+	bool peerClosed = false;
+
+	std::deque<Standalone<StringRef>> received;
+	int receivedOffset = 0;
+	int64_t bytesInFlight = 0; // written but not yet delivered
+	AsyncTrigger readable;
+	AsyncTrigger writable;
+};
+
+class SimulatedNetwork::Listener final : public IListener, public ReferenceCounted<Listener> {
+public:
+	Listener(SimulatedNetwork* net, Process* process, NetworkAddress address)
+	  : net(net), process(process), address(address) {
+		net->listeners[{ address.ip, address.port }] = this;
+	}
+	~Listener() { net->listeners.erase({ address.ip, address.port }); }
+
+	void addref() override { ReferenceCounted<Listener>::addref(); }
+	void delref() override { ReferenceCounted<Listener>::delref(); }
+
+	Future<Reference<IConnection>> accept() override { return doAccept(this); }
+	NetworkAddress getListenAddress() const override { return address; }
+	ListenerMetrics getMetrics() const override { return metrics; }
+
+	SimulatedNetwork* net;
+	Process* process;
+	NetworkAddress address;
+	PromiseStream<Reference<IConnection>> incoming;
+	ListenerMetrics metrics;
+
+private:
+	ACTOR static Future<Reference<IConnection>> doAccept(Listener* self) {
+		Reference<IConnection> conn = waitNext(self->incoming.getFuture());
+		self->metrics.pending--;
+		return conn;
+	}
+};
+
+SimulatedNetwork::SimulatedNetwork()
+  : timerOffset(::timer()),
+    defaultLink{ FLOW_KNOBS->SIMULATED_NETWORK_LATENCY, FLOW_KNOBS->SIMULATED_NETWORK_BANDWIDTH },
+    globals(enumGlobal::COUNT), mainThread(std::this_thread::get_id()) {
+	processes.emplace_back(
+	    std::make_unique<Process>("", NetworkAddress(), FLOW_KNOBS->SIMULATED_NETWORK_TASK_CPU_SECONDS));
+	currentProcess = processes.back().get();
+
+	setGlobal(INetwork::enNetworkConnections, (flowGlobalType)(INetworkConnections*)this);
+	setGlobal(INetwork::enNetworkAddressFunc, (flowGlobalType)&SimulatedNetwork::currentProcessAddress);
+	setGlobal(INetwork::enNetworkAddressesFunc, (flowGlobalType)&SimulatedNetwork::currentProcessAddresses);
+}
+
+SimulatedNetwork::~SimulatedNetwork() {
+	// Waiters on tasks which never ran see broken_promise
+	while (!tasks.empty()) {
+		delete tasks.top().action;
+		tasks.pop();
+	}
+}
+
+SimulatedNetwork::Process* SimulatedNetwork::newProcess(std::string const& name,
+                                                        NetworkAddress address,
+                                                        Optional<double> taskCpuSeconds) {
+	processes.emplace_back(std::make_unique<Process>(
+	    name, address, taskCpuSeconds.orDefault(FLOW_KNOBS->SIMULATED_NETWORK_TASK_CPU_SECONDS)));
+	return processes.back().get();
+}
+
+Future<Void> SimulatedNetwork::onProcess(Process* process, TaskPriority taskID) {
+	if (taskID == TaskPriority::DefaultYield) {
+		taskID = currentTaskID;
+	}
+	return schedule(process, taskTime(), taskID);
+}
+
+void SimulatedNetwork::post(Process* process, double time, TaskPriority taskID, std::function<void()> action) {
+	tasks.push(Task{ time, taskID, ++tasksIssued, time, process, new std::function<void()>(std::move(action)) });
+}
+
+Future<Void> SimulatedNetwork::schedule(Process* process, double time, TaskPriority taskID) {
+	Promise<Void> promise;
+	Future<Void> f = promise.getFuture();
+	post(process, time, taskID, [promise]() mutable { promise.send(Void()); });
+	return f;
+}
+
+SimulatedNetwork::Link& SimulatedNetwork::getLink(IPAddress const& from, IPAddress const& to) {
+	return links[{ from, to }];
+}
+
+double SimulatedNetwork::transmit(IPAddress const& from, IPAddress const& to, int64_t bytes) {
+	Link& link = getLink(from, to);
+	LinkModel model = link.model.orDefault(defaultLink);
+	double written = taskTime();
+	double start = std::max(written, link.busyUntil);
+	double seconds = model.bandwidth > 0 ? bytes / model.bandwidth : 0;
+	link.busyUntil = start + seconds;
+	// Later bytes never overtake earlier ones, even if the link's latency was lowered in between
+	link.lastArrival = std::max(link.busyUntil + model.latency, link.lastArrival);
+
+	link.stats.bytes += bytes;
+	link.stats.writes++;
+	link.stats.busySeconds += seconds;
+	link.stats.maxQueueingSeconds = std::max(link.stats.maxQueueingSeconds, start - written);
+	return link.lastArrival;
+}
+
+SimulatedNetwork::LinkStats SimulatedNetwork::getLinkStats(IPAddress const& from, IPAddress const& to) const {
+	auto it = links.find({ from, to });
+	return it == links.end() ? LinkStats() : it->second.stats;
+}
+
+NetworkAddress SimulatedNetwork::currentProcessAddress() {
+	return static_cast<SimulatedNetwork*>(g_network)->currentProcess->address;
+}
+
+NetworkAddressList SimulatedNetwork::currentProcessAddresses() {
+	NetworkAddressList addresses;
+	addresses.address = currentProcessAddress();
+	return addresses;
+}
+
+Future<Void> SimulatedNetwork::delay(double seconds, TaskPriority taskID) {
+	// Intervals that overflow an int64_t in microseconds are treated as infinite, as by Net2
+	if (seconds >= 4e12) {
+		return Never();
+	}
+	return schedule(currentProcess, taskTime() + std::max(seconds, 0.0), taskID);
+}
+
+Future<Void> SimulatedNetwork::orderedDelay(double seconds, TaskPriority taskID) {
+	// Tasks with the same time and priority already run in the order they were scheduled
+	return delay(seconds, taskID);
+}
+
+bool SimulatedNetwork::check_yield(TaskPriority taskID) {
+	if (taskID == TaskPriority::DefaultYield) {
+		taskID = currentTaskID;
+	}
+	return !tasks.empty() && tasks.top().time <= now() && tasks.top().taskID > taskID;
+}
+
+Future<Void> SimulatedNetwork::yield(TaskPriority taskID) {
+	if (taskID == TaskPriority::DefaultYield) {
+		taskID = currentTaskID;
+	}
+	if (check_yield(taskID)) {
+		return delay(0, taskID);
+	}
+	setCurrentTask(taskID);
+	return Void();
+}
+
+void SimulatedNetwork::stop() {
+	stopped = true;
+}
+
+void SimulatedNetwork::onMainThread(Promise<Void>&& signal, TaskPriority taskID) {
+	// Tasks are not thread safe; without threads the main thread is the only one
+	ASSERT(isOnMainThread());
+	post(currentProcess, taskTime(), taskID, [signal = std::move(signal)]() mutable { signal.send(Void()); });
+}
+
+THREAD_HANDLE SimulatedNetwork::startThread(THREAD_FUNC_RETURN (*func)(void*),
+                                            void* arg,
+                                            int stackSize,
+                                            const char* name) {
+	// Work on other threads would take no virtual time and make runs nondeterministic
+	throw unsupported_operation();
+}
+
+void SimulatedNetwork::run() {
+	ASSERT(isOnMainThread());
+	ScratchArena& scratchArena = ScratchArena::local();
+	Process* idle = processes.front().get();
+	while (!stopped && !tasks.empty()) {
+		Task task = tasks.top();
+		tasks.pop();
+
+		// A task which became ready while its process's CPU was busy waits for it, in priority order with the others
+		// waiting then
+		if (task.process->cpuBusyUntil > task.time) {
+			task.time = task.process->cpuBusyUntil;
+			task.sequence = ++tasksIssued;
+			tasks.push(task);
+			continue;
+		}
+
+		currentTime = std::max(currentTime, task.time);
+		currentProcess = task.process;
+		currentTaskID = task.taskID;
+		currentTaskCpuSeconds = task.process->taskCpuSeconds;
+
+		double queueing = currentTime - task.readyTime;
+		task.process->queueingSeconds += queueing;
+		task.process->maxQueueingSeconds = std::max(task.process->maxQueueingSeconds, queueing);
+
+		try {
+			(*task.action)();
+		} catch (Error& e) {
+			TraceEvent(SevError, "TaskError").error(e);
+		} catch (...) {
+			TraceEvent(SevError, "TaskError").error(unknown_error());
+		}
+		delete task.action;
+		scratchArena.reset();
+
+		task.process->cpuBusyUntil = currentTime + currentTaskCpuSeconds;
+		task.process->cpuSeconds += currentTaskCpuSeconds;
+		task.process->tasks++;
+		tasksRun++;
+		currentProcess = idle;
+		currentTaskCpuSeconds = 0;
+	}
+
+	for (auto& fn : stopCallbacks) {
+		fn();
+	}
+}
+
+void SimulatedNetwork::getDiskBytes(std::string const& directory, int64_t& free, int64_t& total) {
+	::getDiskBytes(directory, free, total);
+}
+
+Future<Reference<IConnection>> SimulatedNetwork::connect(NetworkAddress toAddr,
+                                                         boost::asio::ip::tcp::socket* existingSocket) {
+	Promise<Reference<IConnection>> reply;
+	Future<Reference<IConnection>> result = reply.getFuture();
+	Process* client = currentProcess;
+	NetworkAddress localAddress(client->address.ip, nextEphemeralPort++, true, false);
+	if (nextEphemeralPort == 0) {
+		nextEphemeralPort = 40000;
+	}
+
+	// Setting up a connection takes a round trip
+	double there = transmit(localAddress.ip, toAddr.ip, 0);
+	auto it = listeners.find({ toAddr.ip, toAddr.port });
+	if (it == listeners.end()) {
+		double back = there + getLink(toAddr.ip, localAddress.ip).model.orDefault(defaultLink).latency;
+		post(client, back, TaskPriority::DefaultDelay, [reply]() mutable { reply.sendError(connection_failed()); });
+		return result;
+	}
+
+	Process* server = it->second->process;
+	post(server, there, TaskPriority::AcceptSocket, [this, reply, client, server, localAddress, toAddr]() mutable {
+		auto it = listeners.find({ toAddr.ip, toAddr.port });
+		double back = transmit(toAddr.ip, localAddress.ip, 0);
+		if (it == listeners.end()) {
+			post(client, back, TaskPriority::DefaultDelay, [reply]() mutable {
+				reply.sendError(connection_failed());
+			});
+			return;
+		}
+		Reference<Connection> accepted(new Connection(this, server, toAddr, localAddress));
+		Reference<Connection> connected(new Connection(this, client, localAddress, toAddr));
+		accepted->peer = connected;
+		connected->peer = accepted;
+		it->second->metrics.accepted++;
+		it->second->metrics.pending++;
+		it->second->incoming.send(accepted);
+		post(client, back, TaskPriority::DefaultDelay, [reply, connected]() mutable {
+			reply.send(connected);
+		});
+	});
+	return result;
+}
+
+Future<Reference<IUDPSocket>> SimulatedNetwork::createUDPSocket(NetworkAddress toAddr) {
+	return unsupported_operation();
+}
+
+Future<Reference<IUDPSocket>> SimulatedNetwork::createUDPSocket(bool isV6) {
+	return unsupported_operation();
+}
+
+Future<std::vector<NetworkAddress>> SimulatedNetwork::resolveTCPEndpoint(const std::string& host,
+                                                                        const std::string& service) {
+	Optional<std::vector<NetworkAddress>> addresses = mockDNS.find(host, service);
+	if (!addresses.present()) {
+		return lookup_failed();
+	}
+	return addresses.get();
+}
+
+std::vector<NetworkAddress> SimulatedNetwork::resolveTCPEndpointBlocking(const std::string& host,
+                                                                        const std::string& service) {
+	Optional<std::vector<NetworkAddress>> addresses = mockDNS.find(host, service);
+	if (!addresses.present()) {
+		throw lookup_failed();
+	}
+	return addresses.get();
+}
+
+Reference<IListener> SimulatedNetwork::listen(NetworkAddress localAddr) {
+	if (listeners.count({ localAddr.ip, localAddr.port })) {
+		throw address_in_use();
+	}
+	return makeReference<Listener>(this, currentProcess, localAddr);
+}
+
+namespace {
+
+struct TestSendBuffer : SendBuffer {
+	TestSendBuffer(uint8_t* data, int size) {
+		_data = data;
+		next = nullptr;
+		bytes_written = size;
+		bytes_sent = 0;
+	}
+};
+
+// Runs a simulation with g_network pointing at it
+template <class F>
+void runSimulation(SimulatedNetwork& sim, F&& start) {
+	INetwork* network = g_network;
+	g_network = &sim;
+	ScopeExit restore([network]() { g_network = network; });
+	start();
+	sim.run();
+}
+
+ACTOR Future<Void> writeAll(Reference<IConnection> conn, std::vector<uint8_t>* data) {
+	state int sent = 0;
+	while (sent < data->size()) {
+		TestSendBuffer buffer(data->data() + sent, data->size() - sent);
+		int n = conn->write(&buffer);
+		sent += n;
+		if (n == 0) {
+			wait(conn->onWritable());
+		}
+	}
+	return Void();
+}
+
+ACTOR Future<Void> readExactly(Reference<IConnection> conn, std::vector<uint8_t>* data) {
+	state int received = 0;
+	while (received < data->size()) {
+		int n = conn->read(data->data() + received, data->data() + data->size());
+		received += n;
+		if (n == 0) {
+			wait(conn->onReadable());
+		}
+	}
+	return Void();
+}
+
+ACTOR Future<Void> echoServer(SimulatedNetwork* sim, SimulatedNetwork::Process* process, int size) {
+	wait(sim->onProcess(process));
+	state Reference<IListener> listener = sim->listen(process->address);
+	state Reference<IConnection> conn = wait(listener->accept());
+	state std::vector<uint8_t> data(size);
+	wait(readExactly(conn, &data));
+	wait(writeAll(conn, &data));
+	return Void();
+}
+
+// Returns the virtual time taken to connect and for |size| bytes to be echoed
+ACTOR Future<double> echoClient(SimulatedNetwork* sim,
+                                SimulatedNetwork::Process* process,
+                                NetworkAddress to,
+                                int size) {
+	wait(sim->onProcess(process));
+	state double start = now();
+	state Reference<IConnection> conn = wait(sim->connect(to));
+	state std::vector<uint8_t> data(size, 'x');
+	wait(writeAll(conn, &data));
+	std::fill(data.begin(), data.end(), 0);
+	wait(readExactly(conn, &data));
+	ASSERT(std::all_of(data.begin(), data.end(), [](uint8_t c) { return c == 'x'; }));
+	conn->close();
+	return now() - start;
+}
+
+ACTOR Future<Void> busyLoop(SimulatedNetwork* sim, SimulatedNetwork::Process* process, int count) {
+	wait(sim->onProcess(process));
+	state int i = 0;
+	for (i = 0; i < count; i++) {
+		wait(delay(0));
+	}
+	return Void();
+}
+
+} // namespace
+
+TEST_CASE("/flow/SimulatedNetwork/links") {
+	SimulatedNetwork sim;
+	sim.setDefaultLink({ 0.001, 1e6 });
+	SimulatedNetwork::Process* server =
+	    sim.newProcess("server", NetworkAddress::parse("10.0.0.1:4500"), 0.0);
+	SimulatedNetwork::Process* client = sim.newProcess("client", NetworkAddress::parse("10.0.0.2:4500"), 0.0);
+	Future<Void> served;
+	Future<double> elapsed;
+	runSimulation(sim, [&]() {
+		served = echoServer(&sim, server, 10000);
+		elapsed = echoClient(&sim, client, server->address, 10000);
+	});
+	ASSERT(served.isReady() && !served.isError());
+	// A round trip to connect, then 10ms to transmit and 1ms of latency each way
+	ASSERT(std::abs(elapsed.get() - 0.024) < 1e-9);
+	SimulatedNetwork::LinkStats stats = sim.getLinkStats(client->address.ip, server->address.ip);
+	ASSERT_EQ(stats.bytes, 10000);
+	ASSERT(std::abs(stats.busySeconds - 0.01) < 1e-9);
+
+	// Nothing listens on the client's address
+	Future<Reference<IConnection>> refused;
+	runSimulation(sim, [&]() { refused = sim.connect(client->address); });
+	ASSERT(refused.isError() && refused.getError().code() == error_code_connection_failed);
+	return Void();
+}
+
+TEST_CASE("/flow/SimulatedNetwork/cpu") {
+	state double firstEnd = 0;
+	state int64_t firstTasks = 0;
+	state int run = 0;
+	for (run = 0; run < 2; run++) {
+		SimulatedNetwork sim;
+		SimulatedNetwork::Process* busy = sim.newProcess("busy", NetworkAddress::parse("10.0.0.1:4500"), 0.001);
+		SimulatedNetwork::Process* idle = sim.newProcess("idle", NetworkAddress::parse("10.0.0.2:4500"), 0.001);
+		std::vector<Future<Void>> loops;
+		runSimulation(sim, [&]() {
+			for (int i = 0; i < 10; i++) {
+				loops.push_back(busyLoop(&sim, busy, 10));
+			}
+			loops.push_back(busyLoop(&sim, idle, 10));
+		});
+		for (auto& f : loops) {
+			ASSERT(f.isReady() && !f.isError());
+		}
+		// 110 tasks on one CPU, queueing behind each other, take 110ms; the idle process is never held up
+		ASSERT_EQ(busy->tasks, 110);
+		ASSERT(std::abs(busy->cpuSeconds - 0.11) < 1e-9);
+		ASSERT(busy->queueingSeconds > 0);
+		ASSERT_EQ(idle->queueingSeconds, 0.0);
+		ASSERT(std::abs(sim.now() - 0.109) < 1e-9);
+
+		// Identical runs take identical virtual time
+		if (run == 0) {
+			firstEnd = sim.now();
+			firstTasks = sim.getTasksRun();
+		} else {
+			ASSERT_EQ(sim.now(), firstEnd);
+			ASSERT_EQ(sim.getTasksRun(), firstTasks);
+		}
+	}
+	return Void();
+}
@@ -65,20 +65,20 @@ void StreamCipherKey::cleanup() noexcept {
 }
 
 void StreamCipherKey::initializeKey(uint8_t* data, int len) {
-	memset(arr.get(), 0, keySize);
+	memset(arr, 0, keySize);
 	int copyLen = std::min(keySize, len);
-	memcpy(arr.get(), data, copyLen);
+	memcpy(arr, data, copyLen);
 }
 
 StreamCipherKey::StreamCipherKey(int size)
-  : id(deterministicRandom()->randomUniqueID()), arr(std::make_unique<uint8_t[]>(size)), keySize(size) {
-	memset(arr.get(), 0, keySize);
+  : id(deterministicRandom()->randomUniqueID()), arr(static_cast<uint8_t*>(allocateSecure(size))), keySize(size) {
+	memset(arr, 0, keySize);
 	cipherKeys[id] = this;
 }
 
 StreamCipherKey::~StreamCipherKey() {
-	reset();
 	cipherKeys.erase(this->id);
+	freeSecure(arr, keySize);
 }
 
 StreamCipher::StreamCipher(int keySize)
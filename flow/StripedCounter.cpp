@@ -0,0 +1,148 @@
+/*
+ * StripedCounter.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flow/StripedCounter.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "flow/UnitTest.h"
+
+static_assert(sizeof(StripedCounters<4, 4>) == 4 * MAX_CACHE_LINE_SIZE);
+static_assert(alignof(StripedCounter) == MAX_CACHE_LINE_SIZE);
+
+namespace {
+
+// Threads which are started once and then run a body together as often as asked, so that benchmarks do not time
+// thread creation
+class ThreadGroup {
+public:
+	explicit ThreadGroup(int threads) {
+		for (int t = 0; t < threads; t++) {
+			running.emplace_back([this]() { work(); });
+		}
+	}
+
+	~ThreadGroup() {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		started.notify_all();
+		for (auto& t : running) {
+			t.join();
+		}
+	}
+
+	// Runs |body| on every thread at once, and returns once all of them are done
+	void run(std::function<void()> const& body) {
+		std::unique_lock<std::mutex> lock(mutex);
+		current = &body;
+		remaining = running.size();
+		round++;
+		started.notify_all();
+		finished.wait(lock, [this]() { return remaining == 0; });
+	}
+
+private:
+	void work() {
+		uint64_t done = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			started.wait(lock, [&]() { return stopping || round != done; });
+			if (stopping) {
+				return;
+			}
+			done = round;
+			std::function<void()> const* body = current;
+			lock.unlock();
+			(*body)();
+			lock.lock();
+			if (--remaining == 0) {
+				finished.notify_one();
+			}
+		}
+	}
+
+	std::mutex mutex;
+	std::condition_variable started, finished;
+	std::function<void()> const* current = nullptr;
+	uint64_t round = 0;
+	size_t remaining = 0;
+	bool stopping = false;
+	std::vector<std::thread> running;
+};
+
+} // namespace
+
+TEST_CASE("noSim/flow/StripedCounter") {
+	StripedCounters<3, 4> counters;
+	StripedCounter counter;
+	// More threads than stripes, so that some share one
+	ThreadGroup(6).run([&]() {
+		for (int i = 0; i < 10000; i++) {
+			counters.add(0, 1);
+			counters.add(2, -3);
+			++counter;
+			counter += 2;
+			counter -= 1;
+		}
+	});
+	ASSERT_EQ(counters.get(0), 60000);
+	ASSERT_EQ(counters.get(1), 0);
+	ASSERT_EQ(counters.get(2), -180000);
+	ASSERT_EQ(counter.get(), 120000);
+	return Void();
+}
+
+// Increments of one counter from 1 up to |maxThreads| (default 64) threads, as an atomic and striped. Each thread makes
+// |increments| (default 1e6) increments per run.
+TEST_CASE("noSim/performance/flow/StripedCounter") {
+	int maxThreads = params.getInt("maxThreads").orDefault(64);
+	int increments = params.getInt("increments").orDefault(1000000);
+
+	for (int threads = 1; threads <= maxThreads; threads *= 2) {
+		int64_t ops = int64_t(threads) * increments;
+		ThreadGroup group(threads);
+
+		std::atomic<int64_t> atomic{ 0 };
+		runBenchmark(params, format("StripedCounter/atomic/threads=%d", threads), ops, [&]() {
+			group.run([&]() {
+				for (int i = 0; i < increments; i++) {
+					atomic.fetch_add(1, std::memory_order_relaxed);
+				}
+			});
+		});
+
+		StripedCounter striped;
+		runBenchmark(params, format("StripedCounter/striped/threads=%d", threads), ops, [&]() {
+			group.run([&]() {
+				for (int i = 0; i < increments; i++) {
+					++striped;
+				}
+			});
+		});
+		ASSERT_EQ(striped.get(), atomic.load());
+	}
+	return Void();
+}
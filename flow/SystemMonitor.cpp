@@ -23,6 +23,7 @@
 #include "flow/flow.h"
 #include "flow/Histogram.h"
 #include "flow/Platform.h"
+#include "flow/SerializationStats.h"
 #include "flow/TDMetric.actor.h"
 #include "flow/SystemMonitor.h"
 
@@ -197,7 +198,7 @@ SystemStatistics customSystemMonitor(std::string const& eventName, StatisticsSta
 			    .DETAILALLOCATORMEMUSAGE(4096)
 			    .DETAILALLOCATORMEMUSAGE(8192)
 			    .DETAILALLOCATORMEMUSAGE(16384)
-			    .detail("HugeArenaMemory", g_hugeArenaMemory.load())
+			    .detail("HugeArenaMemory", g_hugeArenaMemory.get())
 			    .detail("DCID", machineState.dcId)
 			    .detail("ZoneID", machineState.zoneId)
 			    .detail("MachineID", machineState.machineId);
@@ -237,6 +238,10 @@ SystemStatistics customSystemMonitor(std::string const& eventName, StatisticsSta
 				    .detail("Utilization", format("%f%%", (total_memory - unused_memory) * 100.0 / total_memory));
 			}
 
+			if (SerializationStats::enabled()) {
+				SerializationStats::trace();
+			}
+
 			TraceEvent n("NetworkMetrics");
 			n.detail("Elapsed", currentStats.elapsed)
 			    .detail("CantSleep", netData.countCantSleep - statState->networkState.countCantSleep)
@@ -75,3 +75,109 @@ TEST_CASE("/flow/safeThreadFutureToFuture/Cancel") {
 	thread.join();
 	return Void();
 }
+
+TEST_CASE("/flow/ThreadFuture/then") {
+	// std::thread is not working in simulation at present, disable this in simulation
+	if (g_network->isSimulated())
+		return Void();
+	ThreadSingleAssignmentVar<int>* tsav = new ThreadSingleAssignmentVar<int>;
+	state ThreadFuture<int> f(tsav);
+
+	// Continuations attached before and after the source is set both run, and an Error thrown by one is forwarded.
+	ThreadFuture<int> doubled = f.then([](ErrorOr<int> v) { return v.get() * 2; });
+	ThreadFuture<int> failed = f.then([](ErrorOr<int> v) -> int { throw io_error(); });
+	tsav->addref();
+	std::thread([tsav]() {
+		tsav->send(21);
+		tsav->delref();
+	}).join();
+	ASSERT(doubled.isReady() && doubled.get() == 42);
+	ASSERT(failed.isError() && failed.getError().code() == error_code_io_error);
+	ThreadFuture<std::string> late = f.then([](ErrorOr<int> v) { return std::to_string(v.get()); });
+	ASSERT(late.isReady() && late.get() == "21");
+
+	// Errors reach the continuation rather than being thrown past it
+	ThreadFuture<int> errorCode = ThreadFuture<int>(operation_failed()).then([](ErrorOr<int> v) {
+		return v.isError() ? v.getError().code() : 0;
+	});
+	ASSERT(errorCode.get() == error_code_operation_failed);
+
+	// Continuations do not keep their source alive, so dropping a source which was never set ends them
+	ThreadFuture<int> unset(new ThreadSingleAssignmentVar<int>);
+	ThreadFuture<int> first = unset.then([](ErrorOr<int> v) { return 1; });
+	ThreadFuture<int> second = unset.then([](ErrorOr<int> v) { return 2; });
+	ASSERT(!first.isReady() && !second.isReady());
+	unset = ThreadFuture<int>();
+	ASSERT(first.isError() && first.getError().code() == error_code_broken_promise);
+	ASSERT(second.isError() && second.getError().code() == error_code_broken_promise);
+
+	// The setter may hold the only reference to a source with several continuations
+	ThreadSingleAssignmentVar<int>* setterOnly = new ThreadSingleAssignmentVar<int>;
+	setterOnly->addref();
+	ThreadFuture<int> third = ThreadFuture<int>(setterOnly).then([](ErrorOr<int> v) { return v.get(); });
+	setterOnly->addref();
+	ThreadFuture<int> fourth = ThreadFuture<int>(setterOnly).then([](ErrorOr<int> v) { return v.get() + 1; });
+	setterOnly->send(7);
+	setterOnly->delref();
+	ASSERT(third.get() == 7 && fourth.get() == 8);
+
+	state ThreadFuture<Void> onMain = f.then(
+	    [](ErrorOr<int> v) {
+		    ASSERT(g_network->isOnMainThread());
+		    return Void();
+	    },
+	    ContinuationExecutor::MainThread);
+	wait(safeThreadFutureToFuture(onMain));
+	return Void();
+}
+
+// Measures futures set on one thread and consumed on another, both by blocking and through Inline continuations
+TEST_CASE("noSim/performance/flow/ThreadFuture/crossThread") {
+	constexpr int count = 200000;
+	std::vector<ThreadSingleAssignmentVar<int>*> savs;
+	std::vector<ThreadFuture<int>> futures;
+	for (int i = 0; i < count; ++i) {
+		savs.push_back(new ThreadSingleAssignmentVar<int>);
+		futures.emplace_back(savs.back());
+		savs.back()->addref();
+	}
+	auto produce = [&savs]() {
+		for (int i = 0; i < savs.size(); ++i) {
+			savs[i]->send(i);
+			savs[i]->delref();
+		}
+	};
+
+	double start = timer_monotonic();
+	std::thread producer(produce);
+	int64_t sum = 0;
+	for (auto& f : futures) {
+		f.blockUntilReady();
+		sum += f.get();
+	}
+	producer.join();
+	double blocking = timer_monotonic() - start;
+	ASSERT(sum == int64_t(count) * (count - 1) / 2);
+
+	savs.clear();
+	futures.clear();
+	std::atomic<int64_t> continuationSum = 0;
+	std::vector<ThreadFuture<Void>> continued;
+	for (int i = 0; i < count; ++i) {
+		savs.push_back(new ThreadSingleAssignmentVar<int>);
+		savs.back()->addref();
+		continued.push_back(ThreadFuture<int>(savs.back()).then([&continuationSum](ErrorOr<int> v) {
+			continuationSum.fetch_add(v.get(), std::memory_order_relaxed);
+			return Void();
+		}));
+	}
+	start = timer_monotonic();
+	std::thread(produce).join();
+	double inlined = timer_monotonic() - start;
+	ASSERT(continuationSum.load() == sum);
+
+	printf("ThreadFuture cross-thread: blockUntilReady %.0f futures/sec, then() %.0f futures/sec\n",
+	       count / blocking,
+	       count / inlined);
+	return Void();
+}
@@ -20,6 +20,7 @@
 
 #include "flow/ThreadPrimitives.h"
 #include "flow/Trace.h"
+#include "flow/UnitTest.h"
 #include <stdint.h>
 #include <iostream>
 #include <errno.h>
@@ -32,12 +33,176 @@
 #undef max
 #endif
 
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 extern std::string format(const char* form, ...);
 
+#if defined(__linux__)
+namespace {
+
+void futexWait(std::atomic<int32_t>* addr, int32_t expected) {
+	syscall(SYS_futex, reinterpret_cast<int32_t*>(addr), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+void futexWake(std::atomic<int32_t>* addr, int32_t count) {
+	syscall(SYS_futex, reinterpret_cast<int32_t*>(addr), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+// Spinning only helps when the thread being waited for can run at the same time
+bool spinningHelps() {
+	static const bool multicore = std::thread::hardware_concurrency() > 1;
+	return multicore;
+}
+
+// Differs between live threads, and is never 0
+uintptr_t currentThreadTag() {
+	static thread_local char tag;
+	return reinterpret_cast<uintptr_t>(&tag);
+}
+
+void increment(std::atomic<uint64_t>& counter) {
+	counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+LockContentionStats toStats(const std::atomic<uint64_t>& acquisitions,
+                            const std::atomic<uint64_t>& contended,
+                            const std::atomic<uint64_t>& spun,
+                            const std::atomic<uint64_t>& parked) {
+	LockContentionStats stats;
+	stats.acquisitions = acquisitions.load(std::memory_order_relaxed);
+	stats.contended = contended.load(std::memory_order_relaxed);
+	stats.spun = spun.load(std::memory_order_relaxed);
+	stats.parked = parked.load(std::memory_order_relaxed);
+	return stats;
+}
+
+} // namespace
+
+Event::Event() {}
+
+Event::~Event() {}
+
+bool Event::tryConsume() {
+	// Sequentially consistent with the increment of waiters in block(), so that set() either sees the waiter or the
+	// waiter sees the count
+	int32_t c = count.load(std::memory_order_seq_cst);
+	while (c > 0) {
+		if (count.compare_exchange_weak(c, c - 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Event::set() {
+	count.fetch_add(1, std::memory_order_seq_cst);
+	if (waiters.load(std::memory_order_seq_cst) > 0) {
+		futexWake(&count, 1);
+	}
+}
+
+void Event::block() {
+	acquisitions.fetch_add(1, std::memory_order_relaxed);
+	if (tryConsume()) {
+		return;
+	}
+	contended.fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t start = timestampCounter();
+	uint64_t budget = spinningHelps() ? spin.budget() : 0;
+	while (timestampCounter() - start < budget) {
+		spinPause();
+		if (tryConsume()) {
+			spun.fetch_add(1, std::memory_order_relaxed);
+			spin.record(timestampCounter() - start);
+			return;
+		}
+	}
+
+	parked.fetch_add(1, std::memory_order_relaxed);
+	waiters.fetch_add(1, std::memory_order_seq_cst);
+	while (!tryConsume()) {
+		futexWait(&count, 0);
+	}
+	waiters.fetch_sub(1, std::memory_order_relaxed);
+	spin.record(timestampCounter() - start);
+}
+
+LockContentionStats Event::getContentionStats() const {
+	return toStats(acquisitions, contended, spun, parked);
+}
+
+Mutex::Mutex() {}
+
+Mutex::~Mutex() {}
+
+void Mutex::enter() {
+	uintptr_t self = currentThreadTag();
+	if (owner.load(std::memory_order_relaxed) == self) {
+		++recursion;
+		return;
+	}
+
+	bool wasContended = false, wasParked = false;
+	int32_t c = 0;
+	if (!state.compare_exchange_strong(c, 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+		wasContended = true;
+		bool acquired = false;
+		uint64_t start = timestampCounter();
+		uint64_t budget = spinningHelps() ? spin.budget() : 0;
+		while (!acquired && timestampCounter() - start < budget) {
+			spinPause();
+			c = 0;
+			acquired = state.load(std::memory_order_relaxed) == 0 &&
+			           state.compare_exchange_weak(c, 1, std::memory_order_acquire, std::memory_order_relaxed);
+		}
+		if (!acquired) {
+			// Mark the lock as contended, so that leave() wakes a parked thread, and park until it is released
+			wasParked = true;
+			c = state.exchange(2, std::memory_order_acquire);
+			while (c != 0) {
+				futexWait(&state, 2);
+				c = state.exchange(2, std::memory_order_acquire);
+			}
+		}
+	}
+
+	owner.store(self, std::memory_order_relaxed);
+	recursion = 1;
+	acquiredAt = timestampCounter();
+	increment(acquisitions);
+	if (wasContended) {
+		increment(contended);
+		increment(wasParked ? parked : spun);
+	}
+}
+
+void Mutex::leave() {
+	if (--recursion > 0) {
+		return;
+	}
+	spin.record(timestampCounter() - acquiredAt);
+	owner.store(0, std::memory_order_relaxed);
+	if (state.fetch_sub(1, std::memory_order_release) != 1) {
+		state.store(0, std::memory_order_release);
+		futexWake(&state, 1);
+	}
+}
+
+LockContentionStats Mutex::getContentionStats() const {
+	return toStats(acquisitions, contended, spun, parked);
+}
+
+#else
+
 Event::Event() {
 #ifdef _WIN32
 	ev = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-#elif defined(__linux__) || defined(__FreeBSD__)
+#elif defined(__FreeBSD__)
 	int result = sem_init(&sem, 0, 0);
 	if (result)
 		criticalError(FDB_EXIT_INIT_SEMAPHORE,
@@ -58,7 +223,7 @@ Event::Event() {
 Event::~Event() {
 #ifdef _WIN32
 	CloseHandle(ev);
-#elif defined(__linux__) || defined(__FreeBSD__)
+#elif defined(__FreeBSD__)
 	sem_destroy(&sem);
 #elif defined(__APPLE__)
 	semaphore_destroy(self, sem);
@@ -70,7 +235,7 @@ Event::~Event() {
 void Event::set() {
 #ifdef _WIN32
 	SetEvent(ev);
-#elif defined(__linux__) || defined(__FreeBSD__)
+#elif defined(__FreeBSD__)
 	sem_post(&sem);
 #elif defined(__APPLE__)
 	semaphore_signal(sem);
@@ -82,7 +247,7 @@ void Event::set() {
 void Event::block() {
 #ifdef _WIN32
 	WaitForSingleObject(ev, INFINITE);
-#elif defined(__linux__) || defined(__FreeBSD__)
+#elif defined(__FreeBSD__)
 	int ret;
 	do {
 		ret = sem_wait(&sem);
@@ -112,3 +277,61 @@ void Mutex::enter() {
 void Mutex::leave() {
 	LeaveCriticalSection((CRITICAL_SECTION*)impl);
 }
+
+LockContentionStats Event::getContentionStats() const {
+	return LockContentionStats();
+}
+
+LockContentionStats Mutex::getContentionStats() const {
+	return LockContentionStats();
+}
+
+#endif // defined(__linux__)
+
+TEST_CASE("noSim/flow/ThreadPrimitives/Mutex") {
+	Mutex mutex;
+	int64_t total = 0;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&]() {
+			for (int i = 0; i < 100000; i++) {
+				MutexHolder holder(mutex);
+				// Mutex is re-entrant
+				MutexHolder again(mutex);
+				++total;
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+	ASSERT(total == 400000);
+	LockContentionStats stats = mutex.getContentionStats();
+	ASSERT(stats.acquisitions == 0 || stats.acquisitions == 400000);
+	ASSERT(stats.contended == stats.spun + stats.parked);
+	return Void();
+}
+
+TEST_CASE("noSim/flow/ThreadPrimitives/Event") {
+	// Ping-pong between two threads, followed by sets which accumulate before anyone blocks
+	Event ping, pong;
+	std::thread other([&]() {
+		for (int i = 0; i < 10000; i++) {
+			ping.block();
+			pong.set();
+		}
+	});
+	for (int i = 0; i < 10000; i++) {
+		ping.set();
+		pong.block();
+	}
+	other.join();
+
+	ping.set();
+	ping.set();
+	ping.block();
+	ping.block();
+	LockContentionStats stats = pong.getContentionStats();
+	ASSERT(stats.contended == stats.spun + stats.parked);
+	return Void();
+}
@@ -20,6 +20,8 @@
 
 #include "flow/UnitTest.h"
 
+#include "flow/ScopeExit.h"
+
 UnitTestCollection g_unittests = { nullptr };
 
 UnitTest::UnitTest(const char* name, const char* file, int line, TestFunction func)
@@ -71,3 +73,328 @@ std::string UnitTestParameters::getDataDir() const {
 void UnitTestParameters::setDataDir(std::string const& dataDir) {
 	this->dataDir = dataDir;
 }
+
+namespace {
+
+std::vector<BenchmarkResult> g_benchmarkResults;
+int g_benchmarkRegressions = 0;
+// Output files which this process has already truncated
+std::set<std::string> g_benchmarkOutputs;
+// Baselines by file, each by benchmark name
+std::map<std::string, std::map<std::string, BenchmarkResult>> g_benchmarkBaselines;
+
+double median(std::vector<double> values) {
+	if (values.empty()) {
+		return 0;
+	}
+	auto mid = values.begin() + values.size() / 2;
+	std::nth_element(values.begin(), mid, values.end());
+	if (values.size() % 2) {
+		return *mid;
+	}
+	return (*mid + *std::max_element(values.begin(), mid)) / 2;
+}
+
+std::string readSysFile(std::string const& path) {
+	std::string contents;
+	if (FILE* f = fopen(path.c_str(), "r")) {
+		char buf[64];
+		if (fgets(buf, sizeof(buf), f)) {
+			contents = buf;
+			while (!contents.empty() && isspace(contents.back())) {
+				contents.pop_back();
+			}
+		}
+		fclose(f);
+	}
+	return contents;
+}
+
+std::string jsonString(std::string const& s) {
+	std::string quoted = "\"";
+	for (char c : s) {
+		if (c == '"' || c == '\\') {
+			quoted += '\\';
+			quoted += c;
+		} else if ((unsigned char)c < 0x20) {
+			quoted += format("\\u%04x", (unsigned char)c);
+		} else {
+			quoted += c;
+		}
+	}
+	return quoted + '"';
+}
+
+// Returns the text of "key":value in a line written by BenchmarkResult::toJSON(), with strings unquoted and unescaped
+Optional<std::string> jsonField(std::string const& line, std::string const& key) {
+	// Strings are escaped, so the pattern cannot match inside one
+	std::string pattern = jsonString(key) + ":";
+	size_t start = line.find(pattern);
+	if (start == std::string::npos) {
+		return {};
+	}
+	start += pattern.size();
+	if (start < line.size() && line[start] == '"') {
+		std::string value;
+		for (size_t i = start + 1; i < line.size(); i++) {
+			if (line[i] == '"') {
+				return value;
+			}
+			if (line[i] != '\\') {
+				value += line[i];
+			} else if (i + 1 < line.size() && line[i + 1] == 'u' && i + 5 < line.size()) {
+				value += (char)strtol(line.substr(i + 2, 4).c_str(), nullptr, 16);
+				i += 5;
+			} else if (i + 1 < line.size()) {
+				value += line[++i];
+			}
+		}
+		return {};
+	}
+	size_t end = line.find_first_of(",}", start);
+	return end == std::string::npos ? Optional<std::string>() : line.substr(start, end - start);
+}
+
+std::map<std::string, BenchmarkResult> const& benchmarkBaseline(std::string const& file) {
+	auto it = g_benchmarkBaselines.find(file);
+	if (it != g_benchmarkBaselines.end()) {
+		return it->second;
+	}
+	std::map<std::string, BenchmarkResult>& baseline = g_benchmarkBaselines[file];
+	FILE* f = fopen(file.c_str(), "r");
+	if (!f) {
+		fprintf(stderr, "Could not read benchmark baseline %s\n", file.c_str());
+		throw file_not_found();
+	}
+	char buf[4096];
+	while (fgets(buf, sizeof(buf), f)) {
+		auto result = BenchmarkResult::fromJSON(buf);
+		if (result.present()) {
+			baseline[result.get().name] = result.get();
+		}
+	}
+	fclose(f);
+	return baseline;
+}
+
+void writeBenchmarkOutput(std::string const& file, BenchmarkResult const& result) {
+	bool truncate = g_benchmarkOutputs.insert(file).second;
+	FILE* f = fopen(file.c_str(), truncate ? "w" : "a");
+	if (!f) {
+		fprintf(stderr, "Could not write benchmark results to %s\n", file.c_str());
+		throw io_error();
+	}
+	fprintf(f, "%s\n", result.toJSON().c_str());
+	fclose(f);
+}
+
+} // namespace
+
+void BenchmarkResult::summarize() {
+	medianSeconds = median(runSeconds);
+	std::vector<double> deviations;
+	for (double s : runSeconds) {
+		deviations.push_back(fabs(s - medianSeconds));
+	}
+	madSeconds = median(deviations);
+}
+
+bool BenchmarkResult::regressedFrom(BenchmarkResult const& baseline, double threshold) const {
+	double slowdown = nsPerOp() - baseline.nsPerOp();
+	double noise = opsPerRun > 0 ? 3 * madSeconds * 1e9 / opsPerRun : 0;
+	return slowdown > threshold * baseline.nsPerOp() && slowdown > noise;
+}
+
+std::string BenchmarkResult::toJSON() const {
+	std::string runs;
+	for (double s : runSeconds) {
+		runs += format("%s%.9g", runs.empty() ? "" : ",", s);
+	}
+	return format("{\"name\":%s,\"opsPerRun\":%" PRId64 ",\"warmupRuns\":%d,\"repetitions\":%d,\"cpu\":%d,"
+	              "\"cpuMHz\":%.0f,\"cpuGovernor\":%s,\"medianSeconds\":%.9g,\"madSeconds\":%.9g,"
+	              "\"nsPerOp\":%.6g,\"allocationsPerOp\":%.4g,\"runSeconds\":[%s]}",
+	              jsonString(name).c_str(),
+	              opsPerRun,
+	              warmupRuns,
+	              (int)runSeconds.size(),
+	              cpu,
+	              cpuMHz,
+	              jsonString(cpuGovernor).c_str(),
+	              medianSeconds,
+	              madSeconds,
+	              nsPerOp(),
+	              allocationsPerOp,
+	              runs.c_str());
+}
+
+Optional<BenchmarkResult> BenchmarkResult::fromJSON(std::string const& line) {
+	auto name = jsonField(line, "name");
+	auto ops = jsonField(line, "opsPerRun");
+	auto medianSeconds = jsonField(line, "medianSeconds");
+	auto madSeconds = jsonField(line, "madSeconds");
+	if (!name.present() || !ops.present() || !medianSeconds.present() || !madSeconds.present()) {
+		return {};
+	}
+	BenchmarkResult result;
+	result.name = name.get();
+	result.opsPerRun = atoll(ops.get().c_str());
+	result.medianSeconds = atof(medianSeconds.get().c_str());
+	result.madSeconds = atof(madSeconds.get().c_str());
+	return result;
+}
+
+BenchmarkResult prepareBenchmark(const UnitTestParameters& params, std::string const& name, int64_t opsPerRun) {
+	BenchmarkResult result;
+	result.name = name;
+	result.opsPerRun = opsPerRun;
+	result.warmupRuns = params.getInt("benchmarkWarmup").orDefault(1);
+	result.cpu = params.getInt("benchmarkCpu").orDefault(-1);
+	result.repetitions = std::max<int64_t>(1, params.getInt("benchmarkRepetitions").orDefault(5));
+
+	if (result.cpu >= 0) {
+		result.savedAffinity = getAffinity();
+		setAffinity(result.cpu);
+	}
+#ifdef __linux__
+	std::string cpufreq = format("/sys/devices/system/cpu/cpu%d/cpufreq/", std::max(result.cpu, 0));
+	result.cpuMHz = atof(readSysFile(cpufreq + "scaling_cur_freq").c_str()) / 1000;
+	result.cpuGovernor = readSysFile(cpufreq + "scaling_governor");
+#endif
+	return result;
+}
+
+void recordBenchmark(const UnitTestParameters& params, BenchmarkResult& result) {
+	setAffinity(result.savedAffinity);
+	result.savedAffinity.clear();
+	result.summarize();
+	printf("%s: %.2f ns/op, %s allocations/op, median %.6fs, MAD %.6fs over %d runs%s\n",
+	       result.name.c_str(),
+	       result.nsPerOp(),
+	       result.allocationsPerOp >= 0 ? format("%.2f", result.allocationsPerOp).c_str() : "uncounted",
+	       result.medianSeconds,
+	       result.madSeconds,
+	       (int)result.runSeconds.size(),
+	       result.cpuGovernor.empty() || result.cpuGovernor == "performance" ? "" : " (CPU governor not performance)");
+	g_benchmarkResults.push_back(result);
+
+	auto output = params.get("benchmarkOutput");
+	if (output.present()) {
+		writeBenchmarkOutput(output.get(), result);
+	}
+	auto baselineFile = params.get("benchmarkBaseline");
+	if (!baselineFile.present()) {
+		return;
+	}
+	auto const& baseline = benchmarkBaseline(baselineFile.get());
+	auto it = baseline.find(result.name);
+	double threshold = params.getDouble("benchmarkThreshold").orDefault(0.1);
+	if (it != baseline.end() && result.regressedFrom(it->second, threshold)) {
+		fprintf(stderr,
+		        "Performance regression in %s: %.2f ns/op, baseline %.2f ns/op\n",
+		        result.name.c_str(),
+		        result.nsPerOp(),
+		        it->second.nsPerOp());
+		++g_benchmarkRegressions;
+		throw test_failed();
+	}
+}
+
+BenchmarkResult measureBenchmark(const UnitTestParameters& params,
+                                 std::string const& name,
+                                 int64_t opsPerRun,
+                                 std::function<void()> const& body,
+                                 std::function<void()> const& afterRun) {
+	BenchmarkResult result = prepareBenchmark(params, name, opsPerRun);
+	// Restores the affinity even if the body throws
+	std::vector<int> savedAffinity = std::move(result.savedAffinity);
+	result.savedAffinity.clear();
+	ScopeExit restoreAffinity([&savedAffinity]() { setAffinity(savedAffinity); });
+	for (int i = 0; i < result.warmupRuns; i++) {
+		body();
+		if (afterRun) {
+			afterRun();
+		}
+	}
+	int64_t allocations = 0;
+	for (int i = 0; i < result.repetitions; i++) {
+		int64_t allocationsBefore = fastAllocatorAllocations();
+		double start = timer_monotonic();
+		body();
+		result.runSeconds.push_back(timer_monotonic() - start);
+		allocations += fastAllocatorAllocations() - allocationsBefore;
+		if (afterRun) {
+			afterRun();
+		}
+	}
+	// Without counting both reads are -1
+	if (opsPerRun > 0 && fastAllocatorAllocations() >= 0) {
+		result.allocationsPerOp = double(allocations) / (double(opsPerRun) * result.repetitions);
+	}
+	result.summarize();
+	return result;
+}
+
+BenchmarkResult runBenchmark(const UnitTestParameters& params,
+                             std::string const& name,
+                             int64_t opsPerRun,
+                             std::function<void()> const& body,
+                             std::function<void()> const& afterRun) {
+	BenchmarkResult result = measureBenchmark(params, name, opsPerRun, body, afterRun);
+	recordBenchmark(params, result);
+	return result;
+}
+
+std::vector<BenchmarkResult> const& benchmarkResults() {
+	return g_benchmarkResults;
+}
+
+int finishBenchmarks() {
+	return g_benchmarkRegressions ? FDB_EXIT_PERFORMANCE_REGRESSION : FDB_EXIT_SUCCESS;
+}
+
+TEST_CASE("/flow/UnitTest/benchmark") {
+	UnitTestParameters benchmarkParams;
+	benchmarkParams.set("benchmarkWarmup", (int64_t)2);
+	benchmarkParams.set("benchmarkRepetitions", (int64_t)3);
+	std::vector<int> affinity = getAffinity();
+	if (!affinity.empty()) {
+		benchmarkParams.set("benchmarkCpu", (int64_t)affinity.back());
+	}
+	int calls = 0;
+	int afterRuns = 0;
+	size_t recorded = benchmarkResults().size();
+	BenchmarkResult result = measureBenchmark(
+	    benchmarkParams, "/flow/UnitTest/benchmark", 1, [&calls]() { ++calls; }, [&afterRuns]() { ++afterRuns; });
+	ASSERT_EQ(calls, 5);
+	ASSERT_EQ(afterRuns, 5);
+	ASSERT_EQ(result.runSeconds.size(), 3);
+	ASSERT(getAffinity() == affinity);
+	ASSERT_EQ(benchmarkResults().size(), recorded);
+
+	result.runSeconds = { 1.0, 5.0, 1.2, 0.9, 1.1 };
+	result.summarize();
+	ASSERT_EQ(result.medianSeconds, 1.1);
+	ASSERT(fabs(result.madSeconds - 0.1) < 1e-9);
+
+	result.opsPerRun = 1000;
+	Optional<BenchmarkResult> parsed = BenchmarkResult::fromJSON(result.toJSON());
+	ASSERT(parsed.present() && parsed.get().name == result.name && parsed.get().opsPerRun == 1000);
+	ASSERT_EQ(parsed.get().medianSeconds, result.medianSeconds);
+
+	// Names are escaped so that the output stays one JSON object per line
+	result.name = "quote\" backslash\\ newline\n";
+	ASSERT(result.toJSON().find('\n') == std::string::npos);
+	parsed = BenchmarkResult::fromJSON(result.toJSON());
+	ASSERT(parsed.present() && parsed.get().name == result.name && parsed.get().opsPerRun == 1000);
+
+	// Slower by more than the threshold and the noise is a regression, within either is not
+	BenchmarkResult slower = result;
+	slower.medianSeconds = 1.5;
+	ASSERT(slower.regressedFrom(result, 0.1));
+	ASSERT(!slower.regressedFrom(result, 0.5));
+	slower.madSeconds = 0.2;
+	ASSERT(!slower.regressedFrom(result, 0.1));
+	ASSERT(!result.regressedFrom(slower, 0.1));
+
+	return Void();
+}
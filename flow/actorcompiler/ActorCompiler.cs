@@ -802,8 +802,8 @@ namespace actorcompiler
                                            new string[] { string.Format("{0} && {2}{1}", ch.wait.result.type, ch.wait.result.name, ch.wait.resultIsState?"__":""), loopDepth }
                                        ),
                     Future = string.Format("__when_expr_{0}", this.whenCount + i),
-                    CallbackType = string.Format("{3}< {0}, {1}, {2} >", fullClassName, this.whenCount + i, ch.wait.result.type, ch.wait.isWaitNext ? "ActorSingleCallback" : "ActorCallback"),
-                    CallbackTypeInStateClass = string.Format("{3}< {0}, {1}, {2} >", className, this.whenCount + i, ch.wait.result.type, ch.wait.isWaitNext ? "ActorSingleCallback" : "ActorCallback")
+                    CallbackType = string.Format("{3}< {0}, {1}, {2} >", fullClassName, this.whenCount + i, ch.wait.valueType, ch.wait.isWaitNext ? "ActorSingleCallback" : "ActorCallback"),
+                    CallbackTypeInStateClass = string.Format("{3}< {0}, {1}, {2} >", className, this.whenCount + i, ch.wait.valueType, ch.wait.isWaitNext ? "ActorSingleCallback" : "ActorCallback")
                 })
                 .ToArray();
             this.whenCount += choices.Length;
@@ -870,11 +870,11 @@ namespace actorcompiler
                     returnType = "void",
                     formalParameters = new string[] { 
                         ch.CallbackTypeInStateClass + "*",
-                        ch.Stmt.wait.result.type + " const& value"
+                        ch.Stmt.wait.valueType + " const& value"
                     },
                     endIsUnreachable = true
                 };
-                cbFunc.addOverload(ch.CallbackTypeInStateClass + "*", ch.Stmt.wait.result.type + " && value");
+                cbFunc.addOverload(ch.CallbackTypeInStateClass + "*", ch.Stmt.wait.valueType + " && value");
                 functions.Add(string.Format("{0}#{1}", cbFunc.name, ch.Index), cbFunc);
                 cbFunc.Indent(codeIndent);
                 ProbeEnter(cbFunc, actor.name, ch.Index);
@@ -908,7 +908,15 @@ namespace actorcompiler
                 errFunc.WriteLine("{0};", exitFunc.call());
                 TryCatch(cx.WithTarget(errFunc), cx.catchFErr, cx.tryLoopDepth, () =>
                 {
-                    errFunc.WriteLine("{0};", cx.catchFErr.call("err", "0"));
+                    if (ch.Stmt.wait.isWaitErrorOr)
+                    {
+                        // cancel() comes through here with actor_wait_state set to -1, and unwinds the actor. Every
+                        // error of the future itself, actor_cancelled included, is handed to the body as a value.
+                        errFunc.WriteLine("if ({0}->actor_wait_state < 0) {1};", This, cx.catchFErr.call("err", "0"));
+                        errFunc.WriteLine("else {0};", ch.Body.call(string.Format("{0}(err)", ch.Stmt.wait.result.type), "0"));
+                    }
+                    else
+                        errFunc.WriteLine("{0};", cx.catchFErr.call("err", "0"));
                 }, false);
                 ProbeExit(errFunc, actor.name, ch.Index);
             }
@@ -918,7 +926,7 @@ namespace actorcompiler
             {
                 string getFunc = ch.Stmt.wait.isWaitNext ? "pop" : "get";
                 LineNumber(cx.target, ch.Stmt.wait.FirstSourceLine);
-                cx.target.WriteLine("{2}<{3}> {0} = {1};", ch.Future, ch.Stmt.wait.futureExpression, ch.Stmt.wait.isWaitNext ? "FutureStream" : "StrictFuture", ch.Stmt.wait.result.type);
+                cx.target.WriteLine("{2}<{3}> {0} = {1};", ch.Future, ch.Stmt.wait.futureExpression, ch.Stmt.wait.isWaitNext ? "FutureStream" : "StrictFuture", ch.Stmt.wait.valueType);
 
                 if (firstChoice)
                 {
@@ -931,7 +939,11 @@ namespace actorcompiler
                         cx.target.WriteLine("if ({1}->actor_wait_state < 0) return {0};", cx.catchFErr.call("actor_cancelled()", AdjustLoopDepth(cx.tryLoopDepth)), This);
                 }
 
-                cx.target.WriteLine("if ({0}.isReady()) {{ if ({0}.isError()) return {2}; else return {1}; }};", ch.Future, ch.Body.call(ch.Future + "." + getFunc + "()", "loopDepth"), cx.catchFErr.call(ch.Future + ".getError()", AdjustLoopDepth(cx.tryLoopDepth)));
+                if (ch.Stmt.wait.isWaitErrorOr)
+                    cx.target.WriteLine("if ({0}.isReady()) return {1};", ch.Future,
+                        ch.Body.call(string.Format("{0}.isError() ? {1}({0}.getError()) : {1}({0}.get())", ch.Future, ch.Stmt.wait.result.type), "loopDepth"));
+                else
+                    cx.target.WriteLine("if ({0}.isReady()) {{ if ({0}.isError()) return {2}; else return {1}; }};", ch.Future, ch.Body.call(ch.Future + "." + getFunc + "()", "loopDepth"), cx.catchFErr.call(ch.Future + ".getError()", AdjustLoopDepth(cx.tryLoopDepth)));
             }
             cx.target.WriteLine("{1}->actor_wait_state = {0};", group, This);
             foreach (var ch in choices)
@@ -721,6 +721,8 @@ namespace actorcompiler
                 toks = toks.Consume("state");
             }
             TokenRange initializer;
+            if (toks.First().Value == "waitErrorOr")
+                throw new Error(ws.FirstSourceLine, "The result of waitErrorOr must initialize an ErrorOr<T> declaration.");
             if (toks.First().Value == "wait" || toks.First().Value == "waitNext")
             {
                 initializer = toks.RevSkipWhile(t=>t.Value==";");
@@ -757,6 +759,7 @@ namespace actorcompiler
                         t=> {
                             if (t.Value=="wait") return true;
                             if (t.Value=="waitNext") { ws.isWaitNext = true; return true; }
+                            if (t.Value=="waitErrorOr") { ws.isWaitErrorOr = true; return true; }
                             return false;
                         })
                 .SkipWhile(Whitespace).First().Assert("Expected (", t => t.Value == "(")
@@ -766,6 +769,8 @@ namespace actorcompiler
             }
 
             ws.futureExpression = str(NormalizeWhitespace(waitParams));
+            if (ws.isWaitErrorOr && !(ws.result.type.StartsWith("ErrorOr<") && ws.result.type.EndsWith(">")))
+                throw new Error(ws.FirstSourceLine, "The result of waitErrorOr must initialize an ErrorOr<T> declaration.");
             return ws;
         }
 
@@ -936,7 +941,7 @@ namespace actorcompiler
                 default:
                     if (IllegalKeywords.Contains(toks.First().Value))
                         throw new Error(toks.First().SourceLine, "Statement '{0}' not supported in actors.", toks.First().Value);
-                    if (toks.Any(t => t.Value == "wait" || t.Value == "waitNext"))
+                    if (toks.Any(t => t.Value == "wait" || t.Value == "waitNext" || t.Value == "waitErrorOr"))
                         Add(ParseWaitStatement(toks));
                     else if (toks.First().Value == "state")
                         Add(ParseStateDeclaration(toks));
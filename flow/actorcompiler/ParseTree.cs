@@ -134,6 +134,11 @@ namespace actorcompiler
         public string futureExpression;
         public bool resultIsState;
         public bool isWaitNext;
+        public bool isWaitErrorOr;  // ErrorOr<T> result = waitErrorOr(Future<T>): errors are delivered as values
+        public string valueType    // The type the future resolves to
+        {
+            get { return isWaitErrorOr ? result.type.Substring(8, result.type.Length - 9).Trim() : result.type; }
+        }
         public override string ToString()
         {
             return string.Format("Wait {0} {1} <- {2} ({3})", result.type, result.name, futureExpression, resultIsState ? "state" : "local");
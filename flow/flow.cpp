@@ -81,6 +81,7 @@ void replaceLineage(LineageReference* lineage) {
 using namespace std::literals;
 
 const std::string_view StackLineage::name = "StackLineage"sv;
+const std::string_view OperationLineage::name = "OperationLineage"sv;
 
 #if (defined(__linux__) || defined(__FreeBSD__)) && defined(__AVX__) && !defined(MEMORY_SANITIZER) && !DEBUG_DETERMINISM
 // For benchmarking; need a version of rte_memcpy that doesn't live in the same compilation unit as the test.
@@ -107,9 +108,9 @@ Reference<IRandom> seededDebugRandom;
 uint64_t debug_lastLoadBalanceResultEndpointToken = 0;
 bool noUnseed = false;
 
-void setThreadLocalDeterministicRandomSeed(uint32_t seed) {
-	seededRandom = Reference<IRandom>(new DeterministicRandom(seed, true));
-	seededDebugRandom = Reference<IRandom>(new DeterministicRandom(seed));
+void setThreadLocalDeterministicRandomSeed(uint32_t seed, RandomEngine engine) {
+	seededRandom = Reference<IRandom>(new DeterministicRandom(seed, true, engine));
+	seededDebugRandom = Reference<IRandom>(new DeterministicRandom(seed, false, engine));
 }
 
 Reference<IRandom> debugRandom() {
@@ -126,7 +127,9 @@ Reference<IRandom> deterministicRandom() {
 Reference<IRandom> nondeterministicRandom() {
 	static thread_local Reference<IRandom> random;
 	if (!random) {
-		random = Reference<IRandom>(new DeterministicRandom(platform::getRandomSeed()));
+		// Nothing needs to reproduce this sequence, so it can use the faster engine
+		random = Reference<IRandom>(
+		    new DeterministicRandom(platform::getRandomSeed(), false, RandomEngine::Xoshiro256));
 	}
 	return random;
 }
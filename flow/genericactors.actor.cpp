@@ -202,8 +202,69 @@ static Future<ErrorOr<Void>> badTestFuture(double duration, Error e) {
 	return tag(delay(duration), ErrorOr<Void>(e));
 }
 
+ACTOR Future<int> waitErrorOrWhen(Future<int> a, Future<Void> b) {
+	choose {
+		when(ErrorOr<int> v = waitErrorOr(a)) {
+			return v.isError() ? -v.getError().code() : v.get();
+		}
+		when(wait(b)) {
+			return 0;
+		}
+	}
+}
+
+ACTOR Future<ErrorOr<int>> waitErrorOrHolding(Future<int> f, Promise<Void> waiting) {
+	state ErrorOr<int> v = waitErrorOr(f);
+	waiting.send(Void());
+	return v;
+}
+
 } // namespace
 
+TEST_CASE("/flow/genericactors/waitErrorOr") {
+	// Ready futures take the synchronous path
+	state ErrorOr<int> ready = wait(errorOr(Future<int>(7)));
+	ASSERT(ready.present() && ready.get() == 7);
+	state ErrorOr<int> readyError = wait(errorOr(Future<int>(timed_out())));
+	ASSERT(readyError.isError() && readyError.getError().code() == error_code_timed_out);
+
+	// Futures which become ready later are delivered through the callbacks
+	state Promise<int> value;
+	state Promise<int> error;
+	state Future<ErrorOr<int>> fromValue = errorOr(value.getFuture());
+	state Future<ErrorOr<int>> fromError = errorOr(error.getFuture());
+	value.send(3);
+	error.sendError(operation_failed());
+	ASSERT(fromValue.get().get() == 3);
+	ASSERT(fromError.get().getError().code() == error_code_operation_failed);
+
+	// In a when, an error is taken as that branch's value
+	state Promise<int> a;
+	state Promise<Void> b;
+	state Future<int> chosen = waitErrorOrWhen(a.getFuture(), b.getFuture());
+	a.sendError(io_error());
+	ASSERT_EQ(chosen.get(), -error_code_io_error);
+
+	// Cancellation is still thrown, and does not reach the code after waitErrorOr
+	state Promise<int> never;
+	state Promise<Void> waiting;
+	state Future<ErrorOr<int>> cancelled = waitErrorOrHolding(never.getFuture(), waiting);
+	cancelled.cancel();
+	ASSERT(cancelled.isError() && cancelled.getError().code() == error_code_actor_cancelled);
+	ASSERT(!waiting.isSet());
+
+	// But actor_cancelled from the future itself is a value, as it always was for errorOr()
+	state ErrorOr<int> readyCancelled = wait(errorOr(Future<int>(actor_cancelled())));
+	ASSERT(readyCancelled.isError() && readyCancelled.getError().code() == error_code_actor_cancelled);
+	state Promise<int> cancelledLater;
+	state Promise<Void> waitingLater;
+	state Future<ErrorOr<int>> fromCancelled = waitErrorOrHolding(cancelledLater.getFuture(), waitingLater);
+	cancelledLater.sendError(actor_cancelled());
+	ASSERT(waitingLater.isSet());
+	ASSERT(fromCancelled.get().getError().code() == error_code_actor_cancelled);
+	return Void();
+}
+
 TEST_CASE("/flow/genericactors/AsyncListener") {
 	auto input = makeReference<AsyncVar<DummyState>>();
 	state Future<Void> subscriber1 =
@@ -0,0 +1,84 @@
+/*
+ * ActorLineageSampler.h
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLOW_ACTOR_LINEAGE_SAMPLER_H
+#define FLOW_ACTOR_LINEAGE_SAMPLER_H
+#pragma once
+
+#include "flow/flow.h"
+
+#ifdef ENABLE_SAMPLING
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Samples what the actors of this process are doing, continuously and cheaply enough to leave on in production.
+//
+// Every ACTOR_LINEAGE_SAMPLING_INTERVAL seconds the sampler thread sets startSampling, so that the next lineage switch
+// on the network thread hands it the running actor's lineage, and copies the network's ActorLineageSet for the actors
+// which are blocked. Each lineage is folded into a key of the form "role;operation;priority;root;...;leaf", where the
+// role and operation come from OperationLineage, the actor names from StackLineage, and the priority is "blocked" for
+// actors which were not running. The network thread pays one flag check per lineage switch and one sample per
+// interval; everything else happens on the sampler thread.
+class ActorLineageSampler {
+public:
+	// The process wide sampler used by runActorLineageSampler()
+	static ActorLineageSampler& instance();
+
+	explicit ActorLineageSampler(int maxStacks);
+	~ActorLineageSampler();
+
+	void start();
+	void stop();
+	bool isRunning() const { return thread.joinable(); }
+
+	// Counts one sample of |lineage|. At most maxStacks distinct stacks are kept; samples of any others are counted
+	// against "[other]".
+	void aggregate(const Reference<ActorLineage>& lineage, Optional<TaskPriority> priority);
+
+	// Returns the counts gathered since the previous call, keyed by folded stack, and starts over
+	std::map<std::string, int64_t> takeFoldedStacks();
+
+	// Logs the most frequent stacks gathered since the previous call as ActorLineageSample events
+	void traceFoldedStacks();
+
+	static std::string foldStack(const Reference<ActorLineage>& lineage, Optional<TaskPriority> priority);
+
+private:
+	void run();
+
+	const int maxStacks;
+	std::mutex mutex;
+	std::map<std::string, int64_t> counts;
+
+	std::thread thread;
+	std::mutex stopMutex;
+	std::condition_variable stopped;
+	bool stopping = false;
+};
+
+// Runs the process wide sampler until cancelled, logging what it saw every ACTOR_LINEAGE_TRACE_INTERVAL seconds. Net2
+// runs it for as long as its run loop does, unless ACTOR_LINEAGE_SAMPLING_INTERVAL is 0.
+Future<Void> runActorLineageSampler();
+#endif
+
+#endif
@@ -31,6 +31,7 @@
 #include "flow/Trace.h"
 #include "flow/ObjectSerializerTraits.h"
 #include "flow/FileIdentifier.h"
+#include "flow/MemOps.h"
 #include "flow/Optional.h"
 #include "flow/Traceable.h"
 #include <algorithm>
@@ -174,7 +175,7 @@ struct ArenaBlock : NonCopyable, ThreadSafeReferenceCounted<ArenaBlock> {
 	enum { NOT_TINY = 127, TINY_HEADER = 6 };
 
 	// int32_t referenceCount;	  // 4 bytes (in ThreadSafeReferenceCounted)
-	bool secure : 1; // If this is set, block is zero-ed out after use
+	bool secure : 1; // If this is set, block is from the secure memory pool and zero-ed out after use
 	uint8_t tinySize : 7, tinyUsed; // If these == NOT_TINY, use bigSize, bigUsed instead
 	// if tinySize != NOT_TINY, following variables aren't used
 	uint32_t bigSize, bigUsed; // include block header
@@ -192,7 +193,6 @@ struct ArenaBlock : NonCopyable, ThreadSafeReferenceCounted<ArenaBlock> {
 	const void* getNextData() const;
 	size_t totalSize() const;
 	size_t estimatedTotalSize() const;
-	void wipeUsed();
 	// just for debugging:
 	void getUniqueBlocks(std::set<ArenaBlock*>& a);
 	int addUsed(int bytes);
@@ -202,7 +202,7 @@ struct ArenaBlock : NonCopyable, ThreadSafeReferenceCounted<ArenaBlock> {
 	static void* dependOn4kAlignedBuffer(Reference<ArenaBlock>& self, uint32_t size);
 	static void* allocate(Reference<ArenaBlock>& self, int bytes, IsSecureMem isSecure = IsSecureMem::False);
 	// Return an appropriately-sized ArenaBlock to store the given data
-	static ArenaBlock* create(int dataSize, Reference<ArenaBlock>& next);
+	static ArenaBlock* create(int dataSize, Reference<ArenaBlock>& next, IsSecureMem isSecure = IsSecureMem::False);
 	void destroy();
 	void destroyLeaf();
 	static void* operator new(size_t s) = delete;
@@ -374,18 +374,18 @@ public:
 	StringRef() : data(0), length(0) {}
 	StringRef(Arena& p, const StringRef& toCopy) : data(new(p) uint8_t[toCopy.size()]), length(toCopy.size()) {
 		if (length > 0) {
-			memcpy((void*)data, toCopy.data, length);
+			flowMemcpy((void*)data, toCopy.data, length);
 		}
 	}
 	StringRef(Arena& p, const std::string& toCopy) : length((int)toCopy.size()) {
 		UNSTOPPABLE_ASSERT(toCopy.size() <= std::numeric_limits<int>::max());
 		data = new (p) uint8_t[toCopy.size()];
 		if (length)
-			memcpy((void*)data, &toCopy[0], length);
+			flowMemcpy((void*)data, &toCopy[0], length);
 	}
 	StringRef(Arena& p, const uint8_t* toCopy, int length) : data(new(p) uint8_t[length]), length(length) {
 		if (length > 0) {
-			memcpy((void*)data, toCopy, length);
+			flowMemcpy((void*)data, toCopy, length);
 		}
 	}
 	StringRef(const uint8_t* data, int length) : data(data), length(length) {}
@@ -505,7 +505,7 @@ public:
 	int compare(StringRef const& other) const {
 		auto minSize = static_cast<int>(std::min(size(), other.size()));
 		if (minSize != 0) {
-			int c = memcmp(begin(), other.begin(), minSize);
+			int c = flowMemcmp(begin(), other.begin(), minSize);
 			if (c != 0)
 				return c;
 		}
@@ -516,7 +516,7 @@ public:
 		// pre: prefixLen <= size() && prefixLen <= other.size()
 		size_t minSuffixSize = std::min(size(), other.size()) - prefixLen;
 		if (minSuffixSize != 0) {
-			int c = memcmp(begin() + prefixLen, other.begin() + prefixLen, minSuffixSize);
+			int c = flowMemcmp(begin() + prefixLen, other.begin() + prefixLen, minSuffixSize);
 			if (c != 0)
 				return c;
 		}
@@ -581,7 +581,7 @@ public:
 	// Copies string contents to dst and returns a pointer to the next byte after
 	uint8_t* copyTo(uint8_t* dst) const {
 		if (length > 0) {
-			memcpy(dst, data, length);
+			flowMemcpy(dst, data, length);
 		}
 		return dst + length;
 	}
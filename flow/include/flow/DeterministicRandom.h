@@ -28,18 +28,54 @@
 #include "flow/Trace.h"
 #include "flow/FastRef.h"
 
+#include <limits>
+#include <optional>
 #include <random>
 
+// xoshiro256** by Blackman and Vigna, usable as a UniformRandomBitGenerator. The 256 bit state is expanded from the
+// seed with splitmix64, as its authors recommend.
+class Xoshiro256 {
+public:
+	using result_type = uint64_t;
+
+	explicit Xoshiro256(uint64_t seed);
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	result_type operator()() {
+		uint64_t result = rotl(s[1] * 5, 7) * 9;
+		uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+
+	static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+	static uint64_t splitmix64(uint64_t& x);
+
+private:
+	uint64_t s[4];
+};
+
 class DeterministicRandom final : public IRandom, public ReferenceCounted<DeterministicRandom> {
 private:
-	std::mt19937 random;
+	RandomEngine engine;
+	std::optional<std::mt19937> mt; // Only constructed for RandomEngine::MT19937
+	Xoshiro256 xoshiro;
 	uint64_t next;
 	bool useRandLog;
 
+	uint64_t generate();
 	uint64_t gen64();
+	void randomBytesBulk(uint8_t* buf, int length);
 
 public:
-	DeterministicRandom(uint32_t seed, bool useRandLog = false);
+	DeterministicRandom(uint32_t seed, bool useRandLog = false, RandomEngine engine = RandomEngine::MT19937);
 	double random01() override;
 	int randomInt(int min, int maxPlusOne) override;
 	int64_t randomInt64(int64_t min, int64_t maxPlusOne) override;
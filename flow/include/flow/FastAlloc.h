@@ -42,6 +42,7 @@ bool valgrindPrecise();
 #endif
 
 #include "flow/Hash3.h"
+#include "flow/StripedCounter.h"
 
 #include <assert.h>
 #include <atomic>
@@ -172,10 +173,14 @@ private:
 	static void releaseMagazine(void*);
 };
 
-extern std::atomic<int64_t> g_hugeArenaMemory;
+// Bytes in arena blocks too big for FastAllocator, which any thread can allocate and free
+extern StripedCounter g_hugeArenaMemory;
 void hugeArenaSample(int size);
 void releaseAllThreadMagazines();
 int64_t getTotalUnusedAllocatedMemory();
+// The number of FastAllocator allocations made so far by the calling thread, of any size. They are only counted when
+// built with FLOW_COUNT_ALLOCATIONS, like the other allocation instrumentation; otherwise this returns -1.
+int64_t fastAllocatorAllocations();
 
 // Allow temporary overriding of default allocators used by arena to let memory survive deallocation and test
 // correctness of memory policy (e.g. zeroing out sensitive contents after use)
@@ -22,6 +22,7 @@
 #define FLOW_ICONNECTION_H
 
 #include <cstdint>
+#include <functional>
 #include <limits>
 
 #include <boost/asio/ip/tcp.hpp>
@@ -89,6 +90,13 @@ public:
 // forward declare SendBuffer, declared in serialize.h
 class SendBuffer;
 
+struct ListenerMetrics {
+	int64_t pending = 0; // Accepted from the kernel but not yet returned by accept()
+	int64_t accepted = 0;
+	int64_t rejected = 0; // Closed because their source IP exceeded its accept rate
+	int64_t overloadPauses = 0; // Times accepting paused because the run loop was lagging
+};
+
 class IListener {
 public:
 	virtual void addref() = 0;
@@ -98,27 +106,68 @@ public:
 	virtual Future<Reference<IConnection>> accept() = 0;
 
 	virtual NetworkAddress getListenAddress() const = 0;
+
+	virtual ListenerMetrics getMetrics() const { return ListenerMetrics(); }
 };
 
-// DNSCache is a class maintaining a <hostname, vector<NetworkAddress>> mapping.
+// DNSCache is a class maintaining a <hostname, vector<NetworkAddress>> mapping. Every entry carries an expiration time
+// after which it is no longer returned, and a refresh time after which a hit asks the caller to re-resolve the entry in
+// the background. Failed lookups may be cached as negative entries (no addresses) so that repeated resolutions of a bad
+// hostname do not all go to the resolver.
 class DNSCache {
 public:
+	struct Entry {
+		std::string host;
+		std::string service;
+		std::vector<NetworkAddress> addresses; // Empty for a negative entry
+		double expireTime = std::numeric_limits<double>::infinity();
+		double refreshTime = std::numeric_limits<double>::infinity();
+		bool refreshing = false;
+
+		bool isNegative() const { return addresses.empty(); }
+	};
+
 	DNSCache() = default;
-	explicit DNSCache(const std::map<std::string, std::vector<NetworkAddress>>& dnsCache)
-	  : hostnameToAddresses(dnsCache) {}
+	explicit DNSCache(const std::map<std::string, std::vector<NetworkAddress>>& dnsCache);
 
+	// Returns the addresses of an unexpired positive entry.
 	Optional<std::vector<NetworkAddress>> find(const std::string& host, const std::string& service);
-	void add(const std::string& host, const std::string& service, const std::vector<NetworkAddress>& addresses);
+	// Returns true if host:service failed to resolve recently and the negative entry has not expired yet.
+	bool findNegative(const std::string& host, const std::string& service);
+	// Returns true, at most once per resolution, if host:service has an unexpired positive entry that is past its
+	// refresh time. The caller is expected to re-resolve the entry and add() the result.
+	bool needsRefresh(const std::string& host, const std::string& service);
+	// Ends a refresh started by needsRefresh() which failed. The entry keeps its addresses until it expires, and is
+	// due for refresh again after |retryDelay|.
+	void refreshFailed(const std::string& host, const std::string& service, double retryDelay);
+
+	// ttl <= 0 adds an entry that never expires.
+	void add(const std::string& host,
+	         const std::string& service,
+	         const std::vector<NetworkAddress>& addresses,
+	         double ttl = 0,
+	         double refreshFraction = 1.0);
+	void addNegative(const std::string& host, const std::string& service, double ttl);
 	void remove(const std::string& host, const std::string& service);
 	void clear();
 
-	// Convert hostnameToAddresses to string. The format is:
+	int size() const { return hostnameToEntry.size(); }
+
+	// Replaces now() as the source of time for expiry and refresh, so that tests control it
+	void setClock(std::function<double()> clock) { this->clock = std::move(clock); }
+
+	// Convert the positive entries to string. The format is:
 	// hostname1,host1Address1,host1Address2;hostname2,host2Address1,host2Address2...
 	std::string toString();
 	static DNSCache parseFromString(const std::string& s);
 
 private:
-	std::map<std::string, std::vector<NetworkAddress>> hostnameToAddresses;
+	// Returns the entry for host:service, erasing it first if it has expired.
+	Entry* lookup(const std::string& host, const std::string& service);
+	double currentTime() const;
+
+	std::map<std::string, Entry> hostnameToEntry;
+	std::function<double()> clock;
 };
 
 class IUDPSocket;
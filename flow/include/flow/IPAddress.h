@@ -22,6 +22,8 @@
 #define FLOW_IPADDRESS_H
 
 #include <array>
+#include <functional>
+#include <string_view>
 #include <variant>
 
 #include "flow/Optional.h"
@@ -32,32 +34,57 @@ struct IPAddress {
 	using IPAddressStore = std::array<uint8_t, 16>;
 
 public:
-	// Represents both IPv4 and IPv6 address. For IPv4 addresses,
-	// only the first 32bits are relevant and rest are initialized to 0.
-	IPAddress() : addr(uint32_t(0)) {}
+	// Represents both IPv4 and IPv6 address as 16 bytes in network order, IPv4 addresses in their IPv4-mapped form
+	// (::ffff:a.b.c.d), so that comparing and hashing an address does not depend on its family. An IPv6 address which
+	// is IPv4-mapped is therefore the same address as the IPv4 address it maps.
+	IPAddress() : IPAddress(uint32_t(0)) {}
 	explicit IPAddress(const IPAddressStore& v6addr) : addr(v6addr) {}
-	explicit IPAddress(uint32_t v4addr) : addr(v4addr) {}
+	explicit IPAddress(uint32_t v4addr) : addr(mapV4(v4addr)) {}
 
-	bool isV6() const { return std::holds_alternative<IPAddressStore>(addr); }
+	bool isV6() const { return high() != 0 || (low() >> 32) != 0xffff; }
 	bool isV4() const { return !isV6(); }
-	bool isValid() const;
+	bool isValid() const { return isV6() ? (high() | low()) != 0 : toV4() != 0; }
 
 	// Returns raw v4/v6 representation of address. Caller is responsible
 	// to call these functions safely.
-	uint32_t toV4() const { return std::get<uint32_t>(addr); }
-	const IPAddressStore& toV6() const { return std::get<IPAddressStore>(addr); }
+	uint32_t toV4() const { return uint32_t(low()); }
+	const IPAddressStore& toV6() const { return addr; }
 
 	std::string toString() const;
-	static Optional<IPAddress> parse(std::string const& str);
+	// Parses dotted quad IPv4 and RFC 4291 IPv6 text, without allocating. An IPv6 zone ("%eth0") is accepted and
+	// dropped.
+	static Optional<IPAddress> parse(std::string_view str);
 
-	bool operator==(const IPAddress& addr) const;
-	bool operator!=(const IPAddress& addr) const;
-	bool operator<(const IPAddress& addr) const;
+	bool operator==(const IPAddress& r) const { return high() == r.high() && low() == r.low(); }
+	bool operator!=(const IPAddress& r) const { return !(*this == r); }
+	// IPv4 addresses order before IPv6 ones, then by their bytes
+	bool operator<(const IPAddress& r) const {
+		bool v6 = isV6(), rv6 = r.isV6();
+		if (v6 != rv6) {
+			return rv6;
+		}
+		return high() != r.high() ? high() < r.high() : low() < r.low();
+	}
+
+	// Mixes all 16 bytes and |seed|, which NetworkAddress uses for the port
+	size_t hash(uint64_t seed = 0) const {
+		uint64_t h = (high() ^ seed) * 0x9E3779B97F4A7C15ULL;
+		h = (h ^ (h >> 32) ^ low()) * 0xBF58476D1CE4E5B9ULL;
+		return size_t(h ^ (h >> 31));
+	}
 
 	template <class Ar>
 	void serialize(Ar& ar) {
 		if constexpr (is_fb_function<Ar>) {
-			serializer(ar, addr);
+			// The flatbuffers encoding is still that of the std::variant this type used to hold
+			std::variant<uint32_t, IPAddressStore> v;
+			if (!Ar::isDeserializing) {
+				v = isV6() ? decltype(v)(addr) : decltype(v)(toV4());
+			}
+			serializer(ar, v);
+			if (Ar::isDeserializing) {
+				*this = v.index() ? IPAddress(std::get<IPAddressStore>(v)) : IPAddress(std::get<uint32_t>(v));
+			}
 		} else {
 			if (Ar::isDeserializing) {
 				bool v6;
@@ -69,7 +96,7 @@ public:
 				} else {
 					uint32_t res;
 					serializer(ar, res);
-					addr = res;
+					*this = IPAddress(res);
 				}
 			} else {
 				bool v6 = isV6();
@@ -86,8 +113,35 @@ public:
 	}
 
 private:
-	std::variant<uint32_t, IPAddressStore> addr;
+	IPAddressStore addr;
+
+	static IPAddressStore mapV4(uint32_t v4addr) {
+		IPAddressStore mapped{};
+		mapped[10] = mapped[11] = 0xff;
+		for (int i = 0; i < 4; i++) {
+			mapped[12 + i] = uint8_t(v4addr >> (24 - 8 * i));
+		}
+		return mapped;
+	}
+
+	// The first and last eight bytes as big endian integers, so that they compare as the bytes do
+	uint64_t high() const { return load(0); }
+	uint64_t low() const { return load(8); }
+	uint64_t load(int offset) const {
+		uint64_t v = 0;
+		for (int i = 0; i < 8; i++) {
+			v = (v << 8) | addr[offset + i];
+		}
+		return v;
+	}
+};
+
+namespace std {
+template <>
+struct hash<IPAddress> {
+	size_t operator()(const IPAddress& ip) const { return ip.hash(); }
 };
+} // namespace std
 
 template <>
 struct Traceable<IPAddress> : std::true_type {
@@ -195,8 +195,15 @@ public:
 
 extern FILE* randLog;
 
+// The generators a DeterministicRandom can be built on. The sequence for a given seed depends on the engine, so
+// MT19937 stays the default wherever seeds have to reproduce earlier runs.
+enum class RandomEngine : uint8_t {
+	MT19937,
+	Xoshiro256, // xoshiro256**: much smaller state and faster generation, with a vectorized path for bulk fills
+};
+
 // Sets the seed for the deterministic random number generator on the current thread
-void setThreadLocalDeterministicRandomSeed(uint32_t seed);
+void setThreadLocalDeterministicRandomSeed(uint32_t seed, RandomEngine engine = RandomEngine::MT19937);
 
 // Returns the random number generator that can be seeded. This generator should only
 // be used in contexts where the choice to call it is deterministic.
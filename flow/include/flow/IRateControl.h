@@ -21,6 +21,7 @@
 #pragma once
 
 #include "flow/flow.h"
+#include "flow/Deque.h"
 
 class IRateControl {
 public:
@@ -108,3 +109,89 @@ public:
 	void wakeWaiters() override {}
 	void killWaiters(const Error& e) override {}
 };
+
+// An IRateControl implementation which is one node of a hierarchy of token buckets, e.g. per-file limits inside a
+// per-tenant limit inside a per-process limit.
+//
+// Each node has a bucket refilled at its guaranteed rate holding at most burst units, and a bucket refilled at its
+// ceiling rate holding proportionally more. A request can be granted when the node's ceiling bucket has enough units
+// and either its own bucket does or its parent could grant the request, in which case the units are borrowed from the
+// parent. Granted units are charged to the node and to all of its ancestors, so siblings share whatever their parent
+// has to spare and no subtree ever exceeds the ceiling of its root. Requests larger than burst are granted once a full
+// bucket is available and leave the bucket in debt.
+//
+// Waiters are served in FIFO order per node, and each node runs at most one timer to wake them. A node does not borrow
+// from a parent which has waiters of its own, so that borrowing children cannot starve them.
+class HierarchicalSpeedLimit final : public IRateControl, ReferenceCounted<HierarchicalSpeedLimit> {
+public:
+	struct Stats {
+		// Units charged to this node, including those granted to its descendants
+		int64_t unitsGranted = 0;
+		int64_t grants = 0;
+		int64_t grantsDelayed = 0;
+		double totalWaitSeconds = 0;
+		int queueLength = 0;
+		// Units granted per second since the last resetStats(), as a fraction of the guaranteed and ceiling rates
+		double utilization = 0;
+		double ceilUtilization = 0;
+	};
+
+	HierarchicalSpeedLimit(double rate,
+	                       double ceil,
+	                       double burst,
+	                       Reference<HierarchicalSpeedLimit> parent = Reference<HierarchicalSpeedLimit>());
+	// A node whose rate is also its ceiling, and so never borrows from its parent
+	HierarchicalSpeedLimit(double rate, double burst, Reference<HierarchicalSpeedLimit> parent)
+	  : HierarchicalSpeedLimit(rate, rate, burst, parent) {}
+	~HierarchicalSpeedLimit() override;
+
+	void addref() override { ReferenceCounted<HierarchicalSpeedLimit>::addref(); }
+	void delref() override { ReferenceCounted<HierarchicalSpeedLimit>::delref(); }
+
+	Future<Void> getAllowance(unsigned int n) override;
+	// Returns units to this node and to all of its ancestors.
+	void returnUnused(int n) override;
+	void killWaiters(const Error& e) override;
+	void wakeWaiters() override;
+
+	Reference<HierarchicalSpeedLimit> const& getParent() const { return parent; }
+	Stats getStats() const;
+	void resetStats();
+
+private:
+	struct Waiter {
+		unsigned int n;
+		double queuedTime;
+		Promise<Void> promise;
+	};
+
+	// Brings both buckets of this node and of its ancestors up to date.
+	void refill();
+	bool canGrant(double n) const;
+	void charge(double n);
+	// Returns how long until canGrant(n) may become true if nothing else consumes units.
+	double timeUntilGrantable(double n) const;
+	// Grants queued requests in order until one cannot be granted.
+	void grantWaiters();
+	void recordGrant(double waitSeconds);
+
+	// An ACTOR, defined in IRateControl.actor.cpp
+	static Future<Void> dispatch(HierarchicalSpeedLimit* const& self);
+	template <class>
+	friend class HierarchicalSpeedLimit_DispatchActorState;
+
+	Reference<HierarchicalSpeedLimit> parent;
+	double rate;
+	double ceil;
+	double burst;
+	double cburst;
+	double tokens;
+	double ctokens;
+	double lastRefill;
+
+	Deque<Waiter> waiters;
+	Future<Void> dispatcher;
+
+	Stats stats;
+	double statsStart;
+};
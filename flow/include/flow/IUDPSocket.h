@@ -23,8 +23,15 @@
 
 #include <boost/asio/ip/udp.hpp>
 
+#include "flow/Arena.h"
 #include "flow/network.h"
 
+// One datagram of a batched send or receive. The payload is owned by the arena of the VectorRef holding it.
+struct UDPDatagram {
+	StringRef data;
+	NetworkAddress peer; // The destination of a sent datagram, or the sender of a received one
+};
+
 class IUDPSocket {
 public:
 	//  see https://en.wikipedia.org/wiki/User_Datagram_Protocol - the max size of a UDP packet
@@ -39,6 +46,14 @@ public:
 	virtual Future<int> sendTo(uint8_t const* begin, uint8_t const* end, NetworkAddress const& peer) = 0;
 	virtual Future<int> receive(uint8_t* begin, uint8_t* end) = 0;
 	virtual Future<int> receiveFrom(uint8_t* begin, uint8_t* end, NetworkAddress* sender) = 0;
+	// Sends as many of the datagrams as possible with as few system calls as possible, and returns how many were
+	// sent, which is at least one unless datagrams is empty. On a connected socket the peer of each datagram is
+	// ignored. The datagrams must stay alive until the returned future is ready.
+	virtual Future<int> sendBatch(VectorRef<UDPDatagram> datagrams) = 0;
+	// Receives at least one and at most maxDatagrams datagrams of up to maxDatagramSize bytes each. When UDP GRO is
+	// enabled, datagrams coalesced by the kernel are split again, so the result may hold more than maxDatagrams.
+	virtual Future<Standalone<VectorRef<UDPDatagram>>> receiveBatch(int maxDatagrams,
+	                                                                int maxDatagramSize = MAX_PACKET_SIZE) = 0;
 	virtual void bind(NetworkAddress const& addr) = 0;
 	virtual void set_multicast_group(NetworkAddress const& laddr, NetworkAddress const& maddr) = 0;
 
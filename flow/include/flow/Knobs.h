@@ -25,12 +25,19 @@
 
 #include "flow/Platform.h"
 
+#include <atomic>
+#include <cstring>
+#include <deque>
 #include <map>
 #include <set>
 #include <string>
 #include <stdint.h>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <variant>
 #include <optional>
+#include <vector>
 
 // Helper macros to allow the init macro to be called with an optional third
 // parameter, used to explicit set atomicity of knobs.
@@ -51,29 +58,67 @@ enum class ConfigDBType {
 
 enum class Atomic { YES, NO };
 
+enum class KnobType : uint8_t { DOUBLE, INT64, INT, STRING, BOOL };
+
+template <class T>
+constexpr KnobType knobTypeOf() {
+	if constexpr (std::is_same_v<T, double>) {
+		return KnobType::DOUBLE;
+	} else if constexpr (std::is_same_v<T, int64_t>) {
+		return KnobType::INT64;
+	} else if constexpr (std::is_same_v<T, int>) {
+		return KnobType::INT;
+	} else if constexpr (std::is_same_v<T, bool>) {
+		return KnobType::BOOL;
+	} else {
+		static_assert(std::is_same_v<T, std::string>, "unsupported knob type");
+		return KnobType::STRING;
+	}
+}
+
+// Dense index of a knob, assigned in the order knobs are first initialized. Ids are stable across reset(), so callers
+// which change or read the same knobs repeatedly can resolve the name once with getKnobId().
+using KnobId = int;
+constexpr KnobId INVALID_KNOB_ID = -1;
+
 class Knobs {
 protected:
-	template <class T>
-	struct KnobValue {
-		T* value;
+	struct KnobInfo {
+		std::string name;
+		KnobType type;
 		Atomic atomic;
+		// Of the knob field from the start of this object, so that the registry also describes any copy of it
+		size_t offset;
+		bool explicitlySet;
 	};
 
-	Knobs() = default;
-	Knobs(Knobs const&) = delete;
-	Knobs& operator=(Knobs const&) = delete;
+	// |objectSize| is the size of the most derived knobs class, which every knob must be a field of
+	explicit Knobs(size_t objectSize) : objectSize(objectSize) {}
+	// A copy's published values start as copies of the source's
+	Knobs(Knobs const& other);
+	Knobs& operator=(Knobs const& other);
 	void initKnob(double& knob, double value, std::string const& name, Atomic atomic = Atomic::YES);
 	void initKnob(int64_t& knob, int64_t value, std::string const& name, Atomic atomic = Atomic::YES);
 	void initKnob(int& knob, int value, std::string const& name, Atomic atomic = Atomic::YES);
 	void initKnob(std::string& knob, const std::string& value, const std::string& name, Atomic atomic = Atomic::YES);
 	void initKnob(bool& knob, bool value, std::string const& name, Atomic atomic = Atomic::YES);
+	void clearExplicitlySet();
 
-	std::map<std::string, KnobValue<double>> double_knobs;
-	std::map<std::string, KnobValue<int64_t>> int64_knobs;
-	std::map<std::string, KnobValue<int>> int_knobs;
-	std::map<std::string, KnobValue<std::string>> string_knobs;
-	std::map<std::string, KnobValue<bool>> bool_knobs;
-	std::set<std::string> explicitlySetKnobs;
+	template <class T>
+	void registerKnob(T& knob, T const& value, std::string const& name, Atomic atomic);
+	template <class T>
+	bool setKnobValue(KnobId id, T const& value);
+	void publish(KnobId id);
+	void* knobValue(KnobId id) { return reinterpret_cast<char*>(this) + knobs[id].offset; }
+	void const* knobValue(KnobId id) const { return reinterpret_cast<char const*>(this) + knobs[id].offset; }
+
+	size_t objectSize;
+	// Indexed by KnobId
+	std::vector<KnobInfo> knobs;
+	std::unordered_map<std::string, KnobId> knobIds;
+	// Copies of the numeric knob values which any thread may read; see getPublishedKnob(). A deque so that registering
+	// a knob never moves the atomics already published.
+	std::deque<std::atomic<uint64_t>> published;
 
 public:
 	// Sets an integer value to an integer knob, returns false if the knob does not exist or type mismatch
@@ -94,6 +139,32 @@ public:
 	// Gets the value of knob
 	ParsedKnobValue getKnob(const std::string& name) const;
 
+	// Returns INVALID_KNOB_ID if there is no knob with this name
+	KnobId getKnobId(std::string const& name) const;
+	std::string const& getKnobName(KnobId id) const { return knobs[id].name; }
+	KnobType getKnobType(KnobId id) const { return knobs[id].type; }
+	int knobCount() const { return knobs.size(); }
+
+	// Same as setKnob and getKnob by name, without the name lookup
+	bool setKnob(KnobId id, ParsedKnobValue const& value);
+	ParsedKnobValue getKnob(KnobId id) const;
+
+	// Applies a batch of changes, such as a dynamic knob update from the configuration database, in time proportional
+	// to the number of changes. Returns the number of knobs which were changed; entries naming no knob or with a
+	// mismatched type are skipped.
+	int setKnobs(std::vector<std::pair<KnobId, ParsedKnobValue>> const& changes);
+
+	// Reads the last value set for a numeric knob. Unlike reading the knob field directly, this is safe on any thread
+	// while the network thread changes knobs.
+	template <class T>
+	T getPublishedKnob(KnobId id) const {
+		static_assert(std::is_arithmetic_v<T> && sizeof(T) <= sizeof(uint64_t));
+		uint64_t bits = published[id].load(std::memory_order_acquire);
+		T value;
+		memcpy(&value, &bits, sizeof(T));
+		return value;
+	}
+
 	ParsedKnobValue parseKnobValue(std::string const& name, std::string const& value) const;
 	bool isAtomic(std::string const& knob) const;
 	void trace() const;
@@ -101,10 +172,14 @@ public:
 
 template <class T>
 class KnobsImpl : public Knobs {
+protected:
+	// Knobs is the first base of T, so T's fields lie within sizeof(T) bytes of it
+	KnobsImpl() : Knobs(sizeof(T)) {}
+
 public:
 	template <class... Args>
 	void reset(Args&&... args) {
-		explicitlySetKnobs.clear();
+		clearExplicitlySet();
 		static_cast<T*>(this)->initialize(std::forward<Args>(args)...);
 	}
 };
@@ -118,6 +193,11 @@ public:
 	double HOSTNAME_RECONNECT_INIT_INTERVAL;
 	double HOSTNAME_RECONNECT_MAX_INTERVAL;
 	bool ENABLE_COORDINATOR_DNS_CACHE;
+	double DNS_CACHE_TTL;
+	double DNS_CACHE_NEGATIVE_TTL;
+	double DNS_CACHE_REFRESH_FRACTION;
+	int DNS_RESOLVER_THREADS;
+	int DNS_RESOLVER_THREAD_STACKSIZE;
 	double CACHE_REFRESH_INTERVAL_WHEN_ALL_ALTERNATIVES_FAILED;
 
 	double DELAY_JITTER_OFFSET;
@@ -133,6 +213,10 @@ public:
 	bool FAST_ALLOC_ALLOW_GUARD_PAGES;
 	double HUGE_ARENA_LOGGING_BYTES;
 	double HUGE_ARENA_LOGGING_INTERVAL;
+	int SCRATCH_ARENA_CHUNK_BYTES;
+	int64_t SCRATCH_ARENA_MAX_RETAINED_BYTES;
+	int64_t SECURE_MEMORY_POOL_BYTES;
+	int64_t SECURE_MEMORY_MAPPING_CACHE_BYTES;
 
 	double MEMORY_USAGE_CHECK_INTERVAL;
 
@@ -152,6 +236,8 @@ public:
 	std::string OTEL_UDP_EMISSION_ADDR;
 	int STATSD_UDP_EMISSION_PORT;
 	int OTEL_UDP_EMISSION_PORT;
+	bool UDP_BATCH_ENABLE_GSO;
+	bool UDP_BATCH_ENABLE_GRO;
 	bool METRICS_EMIT_DDSKETCH;
 
 	// run loop profiling
@@ -164,6 +250,16 @@ public:
 	double SATURATION_PROFILING_MAX_LOG_INTERVAL;
 	double SATURATION_PROFILING_LOG_BACKOFF;
 
+	// actor lineage sampling (only with ENABLE_SAMPLING)
+	double ACTOR_LINEAGE_SAMPLING_INTERVAL;
+	int ACTOR_LINEAGE_SAMPLER_MAX_STACKS;
+	double ACTOR_LINEAGE_TRACE_INTERVAL;
+	int ACTOR_LINEAGE_TRACE_MAX_STACKS;
+
+	// SerializationStats
+	bool SERIALIZATION_STATS_ENABLED;
+	int SERIALIZATION_STATS_TRACE_MAX_TYPES;
+
 	// connectionMonitor
 	double CONNECTION_MONITOR_LOOP_TIME;
 	double CONNECTION_MONITOR_TIMEOUT;
@@ -195,6 +291,8 @@ public:
 	int TLS_HANDSHAKE_THREAD_STACKSIZE;
 	int TLS_MALLOC_ARENA_MAX;
 	int TLS_HANDSHAKE_LIMIT;
+	int PACKET_COALESCE_DELAY_US;
+	int PACKET_COALESCE_BYTES;
 
 	int NETWORK_TEST_CLIENT_COUNT;
 	int NETWORK_TEST_REPLY_SIZE;
@@ -209,6 +307,8 @@ public:
 	int PUBLIC_KEY_FILE_REFRESH_INTERVAL_SECONDS;
 	double AUDIT_TIME_WINDOW;
 	int TOKEN_CACHE_SIZE;
+	int SIGNATURE_VERIFY_OFFLOAD_THRESHOLD;
+	int SIGNATURE_VERIFY_CHUNK_SIZE;
 	bool WIPE_SENSITIVE_DATA_FROM_PACKET_BUFFER;
 
 	// AsyncFileCached
@@ -275,6 +375,12 @@ public:
 	int CERT_FILE_MAX_SIZE;
 	int READY_QUEUE_RESERVED_SIZE;
 	int TASKS_PER_REACTOR_CHECK;
+	int LISTENER_ACCEPT_BATCH; // Connections taken from the kernel per completed accept
+	double LISTENER_ACCEPT_PER_IP_RATE;
+	double LISTENER_ACCEPT_PER_IP_BURST;
+	int LISTENER_ACCEPT_TRACKED_IPS;
+	double LISTENER_OVERLOAD_RUN_LOOP_LAG;
+	double LISTENER_OVERLOAD_PAUSE;
 
 	// Network
 	int64_t PACKET_LIMIT;
@@ -300,6 +406,12 @@ public:
 	double MAX_RUNLOOP_SLEEP_DELAY;
 	int SIM_CONNECT_ERROR_MODE;
 	double SIM_SPEEDUP_AFTER_SECONDS;
+
+	// SimulatedNetwork
+	double SIMULATED_NETWORK_LATENCY;
+	double SIMULATED_NETWORK_BANDWIDTH;
+	double SIMULATED_NETWORK_TASK_CPU_SECONDS;
+	int64_t SIMULATED_NETWORK_CONNECTION_BUFFER_BYTES;
 	int MAX_TRACE_LINES;
 
 	// Tracefiles
@@ -0,0 +1,76 @@
+/*
+ * MemOps.h
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLOW_MEMOPS_H
+#define FLOW_MEMOPS_H
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// Copy and compare kernels chosen for the CPU the process is running on, rather than the one it was compiled for.
+// The first call picks the widest variant the CPU supports; copies of at least flowMemcpyNonTemporalThreshold() bytes
+// use non-temporal stores so that they do not evict the rest of the last level cache.
+enum class MemOpsVariant { Libc, SSE2, AVX2, AVX512 };
+
+const char* memOpsVariantName(MemOpsVariant variant);
+// All variants which can run on this CPU, narrowest first
+std::vector<MemOpsVariant> supportedMemOpsVariants();
+MemOpsVariant selectedMemOpsVariant();
+
+// Copies with the given variant regardless of the one selected, for tests and benchmarks.  The non-temporal threshold
+// applies as for flowMemcpy().
+void* flowMemcpyWith(MemOpsVariant variant, void* dst, const void* src, size_t n);
+int flowMemcmpWith(MemOpsVariant variant, const void* a, const void* b, size_t n);
+
+size_t flowMemcpyNonTemporalThreshold();
+// 0 disables non-temporal copies
+void setFlowMemcpyNonTemporalThreshold(size_t bytes);
+
+namespace detail {
+using MemcpyFn = void* (*)(void*, const void*, size_t);
+using MemcmpFn = int (*)(const void*, const void*, size_t);
+extern std::atomic<MemcpyFn> flowMemcpyImpl;
+extern std::atomic<MemcmpFn> flowMemcmpImpl;
+} // namespace detail
+
+// Below this many bytes the compiler's inlined memcpy()/memcmp() is faster than an indirect call, so only larger
+// sizes are dispatched
+constexpr size_t FLOW_MEMOPS_DISPATCH_BYTES = 256;
+
+// Same contract as memcpy(): the ranges must not overlap
+inline void* flowMemcpy(void* dst, const void* src, size_t n) {
+	if (n < FLOW_MEMOPS_DISPATCH_BYTES) {
+		return memcpy(dst, src, n);
+	}
+	return detail::flowMemcpyImpl.load(std::memory_order_relaxed)(dst, src, n);
+}
+
+// Same contract as memcmp(), except that only the sign of the result is meaningful
+inline int flowMemcmp(const void* a, const void* b, size_t n) {
+	if (n < FLOW_MEMOPS_DISPATCH_BYTES) {
+		return memcmp(a, b, n);
+	}
+	return detail::flowMemcmpImpl.load(std::memory_order_relaxed)(a, b, n);
+}
+
+#endif
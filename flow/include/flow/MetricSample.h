@@ -22,7 +22,11 @@
 #define METRIC_SAMPLE_H
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <map>
 #include <tuple>
+#include <vector>
 
 template <class T>
 struct MetricSample {
@@ -172,4 +176,300 @@ private:
 		return metric;
 	}
 };
+
+// A fixed size summary of the metric of a set of ordered keys, for when keeping every sampled key as MetricSample does
+// takes too much memory. Added keys are buffered and then merged into a sorted list of at most about |capacity|
+// weighted items. When the list outgrows that, each run of adjacent items weighing less than 2 * total / capacity in
+// all is collapsed into one item, which covers the range of keys of the run and counts its weight at one of its keys,
+// picked in proportion to weight. Later changes to a key in an item's range go to that item, so a removal cancels the
+// weight its key added wherever compaction moved it, and every item weighs exactly the live metric of its range.
+// An estimate is only off by part of the weight of the items whose ranges straddle its ends. That is a small multiple
+// of the live total / capacity, however much weight has come and gone, unless later additions concentrate in one
+// item's range, and it never exceeds the live total. Negative weights remove metric added earlier, and must not remove
+// more than their key added.
+template <class T>
+class MetricSketch {
+	struct Item {
+		T key; // Where the weight is counted
+		T first, last; // The range of keys whose weight the item holds
+		int64_t weight;
+	};
+
+	int capacity;
+	// The live total. flush() takes back removals which left an item negative, and drops the item.
+	mutable int64_t total = 0;
+	// Sorted with disjoint ranges, and prefix[i] is the weight of items[0, i). Queries merge pending into them first.
+	mutable std::vector<Item> items;
+	mutable std::vector<int64_t> prefix{ 0 };
+	mutable std::vector<Item> pending;
+
+	void flush() const {
+		if (pending.empty()) {
+			return;
+		}
+		auto byFirst = [](Item const& a, Item const& b) { return a.first < b.first; };
+		std::sort(pending.begin(), pending.end(), byFirst);
+		std::vector<Item> merged;
+		merged.reserve(items.size() + pending.size());
+		std::merge(items.begin(), items.end(), pending.begin(), pending.end(), std::back_inserter(merged), byFirst);
+		pending.clear();
+
+		// Items with overlapping ranges become one, counted at one of their keys picked in proportion to the weight
+		// added, and items whose keys have all been removed are dropped
+		int out = 0;
+		int64_t added = 0;
+		for (int i = 0; i < merged.size(); i++) {
+			if (out && !(merged[out - 1].last < merged[i].first)) {
+				Item& into = merged[out - 1];
+				if (into.last < merged[i].last) {
+					into.last = std::move(merged[i].last);
+				}
+				into.weight += merged[i].weight;
+				if (merged[i].weight > 0) {
+					added += merged[i].weight;
+					if (deterministicRandom()->randomInt64(0, added) < merged[i].weight) {
+						into.key = std::move(merged[i].key);
+					}
+				}
+			} else {
+				if (out && merged[out - 1].weight <= 0) {
+					total -= merged[--out].weight;
+				}
+				added = std::max<int64_t>(0, merged[i].weight);
+				merged[out++] = std::move(merged[i]);
+			}
+		}
+		if (out && merged[out - 1].weight <= 0) {
+			total -= merged[--out].weight;
+		}
+		merged.resize(out);
+		if (merged.size() > capacity) {
+			compact(merged);
+		}
+
+		items = std::move(merged);
+		prefix.resize(items.size() + 1);
+		for (int i = 0; i < items.size(); i++) {
+			prefix[i + 1] = prefix[i] + items[i].weight;
+		}
+	}
+
+	void compact(std::vector<Item>& merged) const {
+		int64_t const runLimit = std::max<int64_t>(1, 2 * total / capacity);
+		int out = 0;
+		for (int begin = 0; begin < merged.size();) {
+			int end = begin + 1;
+			int64_t runWeight = merged[begin].weight;
+			while (end < merged.size() && runWeight + merged[end].weight < runLimit) {
+				runWeight += merged[end++].weight;
+			}
+			int chosen = begin;
+			if (end - begin > 1 && runWeight > 0) {
+				int64_t r = deterministicRandom()->randomInt64(0, runWeight);
+				while (r >= merged[chosen].weight) {
+					r -= merged[chosen++].weight;
+				}
+			}
+			merged[out].key = std::move(merged[chosen].key);
+			merged[out].first = std::move(merged[begin].first);
+			merged[out].last = std::move(merged[end - 1].last);
+			merged[out++].weight = runWeight;
+			begin = end;
+		}
+		merged.resize(out);
+	}
+
+	int lowerBound(const T& key) const {
+		return std::lower_bound(items.begin(), items.end(), key, [](Item const& i, const T& k) { return i.key < k; }) -
+		       items.begin();
+	}
+
+public:
+	explicit MetricSketch(int capacity) : capacity(capacity) { ASSERT(capacity > 0); }
+
+	void add(const T& key, int64_t weight) {
+		if (!weight) {
+			return;
+		}
+		total += weight;
+		pending.push_back(Item{ key, key, key, weight });
+		if (pending.size() >= capacity) {
+			flush();
+		}
+	}
+
+	// Adds everything in |other| to this sketch. Each of its items is added as its weight at the key it is counted at,
+	// since the ranges of two sketches overlap and would chain into ever wider items. A later removal of a key from
+	// |other| therefore comes out of whichever item's range holds the key here.
+	void merge(MetricSketch const& other) {
+		other.flush();
+		for (auto const& item : other.items) {
+			pending.push_back(Item{ item.key, item.key, item.key, item.weight });
+		}
+		total += other.total;
+		flush();
+	}
+
+	int64_t getMetric(const T& key) const {
+		flush();
+		int i = lowerBound(key);
+		return i < items.size() && !(key < items[i].key) ? items[i].weight : 0;
+	}
+
+	// The estimated metric of the keys in [begin, end)
+	int64_t getEstimate(const T& begin, const T& end) const {
+		flush();
+		return std::max<int64_t>(0, prefix[lowerBound(end)] - prefix[lowerBound(begin)]);
+	}
+
+	// The retained keys in [begin, end), for callers which search over several sketches
+	std::vector<T> keys(const T& begin, const T& end) const {
+		flush();
+		std::vector<T> result;
+		for (int i = lowerBound(begin); i < items.size() && items[i].key < end; i++) {
+			result.push_back(items[i].key);
+		}
+		return result;
+	}
+
+	// The last retained key K in [begin, end) for which the estimate of [begin, K) is at most |offset|, or |begin|
+	T splitEstimate(const T& begin, const T& end, int64_t offset) const {
+		flush();
+		int const first = lowerBound(begin);
+		int const last = lowerBound(end);
+		if (first == last) {
+			return begin;
+		}
+		// The first index after |first| whose prefix exceeds the target, less one
+		int i = std::upper_bound(prefix.begin() + first + 1, prefix.begin() + last, prefix[first] + offset) -
+		        prefix.begin() - 1;
+		return items[i].key;
+	}
+
+	int64_t getTotal() const { return total; }
+	// The number of keys retained, which stays within about |capacity| once the sketch has been compacted
+	int size() const {
+		flush();
+		return items.size();
+	}
+};
+
+// Splits [begin, end) at one of |candidates| as MetricSketch::splitEstimate() does, using |estimate(begin, key)|
+template <class T, class Estimate>
+T splitSketchEstimate(std::vector<T> candidates, const T& begin, int64_t offset, Estimate const& estimate) {
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+	auto it = std::partition_point(
+	    candidates.begin(), candidates.end(), [&](const T& key) { return estimate(begin, key) <= offset; });
+	return it == candidates.begin() ? begin : *(it - 1);
+}
+
+// MetricSample's interface in fixed memory. Like TransientMetricSample, metrics smaller than |metricUnitsPerSample| are
+// sampled with probability proportional to their size and then counted as |metricUnitsPerSample|. Removals are
+// negative metrics, which cancel what their key added in the sketch, so the error of estimates follows the metric
+// currently sampled rather than all that was ever added.
+template <class T>
+struct SketchMetricSample {
+	MetricSketch<T> sketch;
+	int64_t metricUnitsPerSample = 0;
+
+	SketchMetricSample(int64_t metricUnitsPerSample, int capacity)
+	  : sketch(capacity), metricUnitsPerSample(metricUnitsPerSample) {}
+
+	// Returns the sampled metric value (possibly 0, possibly increased by the sampling factor)
+	int64_t add(const T& key, int64_t metric) {
+		metric = sampleMetric(metric, metricUnitsPerSample);
+		sketch.add(key, metric);
+		return metric;
+	}
+
+	static int64_t sampleMetric(int64_t metric, int64_t metricUnitsPerSample) {
+		int64_t mag = std::abs(metric);
+		if (mag && mag < metricUnitsPerSample) {
+			if (deterministicRandom()->random01() >= (double)mag / metricUnitsPerSample) {
+				return 0;
+			}
+			metric = metric < 0 ? -metricUnitsPerSample : metricUnitsPerSample;
+		}
+		return metric;
+	}
+
+	void merge(SketchMetricSample const& other) { sketch.merge(other.sketch); }
+
+	int64_t getMetric(const T& key) const { return sketch.getMetric(key); }
+	int64_t getEstimate(const T& begin, const T& end) const { return sketch.getEstimate(begin, end); }
+	T splitEstimate(const T& begin, const T& end, int64_t offset) const {
+		return sketch.splitEstimate(begin, end, offset);
+	}
+};
+
+// TransientMetricSample's interface in bounded memory. Each sampled metric goes into the sketch of the window its
+// expiration falls in, rounded up to a multiple of |window| seconds, and poll() drops whole windows as they expire.
+template <class T>
+struct TransientSketchMetricSample {
+	std::map<double, SketchMetricSample<T>> windows; // By expiration
+	int64_t metricUnitsPerSample;
+	int capacity;
+	double window;
+
+	TransientSketchMetricSample(int64_t metricUnitsPerSample, int capacity, double window)
+	  : metricUnitsPerSample(metricUnitsPerSample), capacity(capacity), window(window) {
+		ASSERT(window > 0);
+	}
+
+	// Returns the sampled metric value (possibly 0, possibly increased by the sampling factor)
+	int64_t addAndExpire(const T& key, int64_t metric, double expiration) {
+		metric = SketchMetricSample<T>::sampleMetric(metric, metricUnitsPerSample);
+		if (metric) {
+			windowFor(expiration).add(key, metric);
+		}
+		return metric;
+	}
+
+	void poll() {
+		double now = ::now();
+		while (windows.size() && windows.begin()->first <= now) {
+			windows.erase(windows.begin());
+		}
+	}
+
+	void merge(TransientSketchMetricSample const& other) {
+		for (auto const& [expiration, sample] : other.windows) {
+			windowFor(expiration).merge(sample);
+		}
+	}
+
+	int64_t getMetric(const T& key) const {
+		int64_t metric = 0;
+		for (auto const& [expiration, sample] : windows) {
+			metric += sample.getMetric(key);
+		}
+		return metric;
+	}
+
+	int64_t getEstimate(const T& begin, const T& end) const {
+		int64_t estimate = 0;
+		for (auto const& [expiration, sample] : windows) {
+			estimate += sample.getEstimate(begin, end);
+		}
+		return estimate;
+	}
+
+	T splitEstimate(const T& begin, const T& end, int64_t offset) const {
+		std::vector<T> candidates;
+		for (auto const& [expiration, sample] : windows) {
+			auto keys = sample.sketch.keys(begin, end);
+			candidates.insert(candidates.end(), keys.begin(), keys.end());
+		}
+		return splitSketchEstimate(std::move(candidates), begin, offset, [this](const T& b, const T& e) {
+			return getEstimate(b, e);
+		});
+	}
+
+private:
+	SketchMetricSample<T>& windowFor(double expiration) {
+		double end = std::ceil(expiration / window) * window;
+		return windows.try_emplace(end, metricUnitsPerSample, capacity).first->second;
+	}
+};
 #endif
@@ -40,44 +40,62 @@ struct ReliablePacket : FastAllocated<ReliablePacket> {
 	void remove(); // Deletes this and cont chain, unlinks prev and next
 };
 
+// The lanes of an UnsentPacketQueue, highest priority first. Packets are sent in order within a lane, and a higher
+// priority lane only takes over from a lower priority one at a packet boundary, so that small latency-critical
+// packets do not wait behind bulk payloads queued earlier on the same connection.
+enum class SendLane : uint8_t { Control = 0, Default = 1, Bulk = 2 };
+
 class UnsentPacketQueue : NonCopyable {
 public:
-	UnsentPacketQueue()
-	  : unsent_first(0), unsent_last(0),
-	    sendQueueLatencyHistogram(
-	        Histogram::getHistogram("UnsentPacketQueue"_sr, "QueueWait"_sr, Histogram::Unit::milliseconds)) {}
+	static constexpr int LANE_COUNT = 3;
+
+	UnsentPacketQueue();
 
 	~UnsentPacketQueue() {
 		discardAll();
-		unsent_first = (PacketBuffer*)0xDEADBEEF;
-		unsent_last = (PacketBuffer*)0xCAFEBABE;
-		sendQueueLatencyHistogram = Reference<Histogram>(nullptr);
+		for (auto& lane : lanes) {
+			lane.first = (PacketBuffer*)0xDEADBEEF;
+			lane.last = (PacketBuffer*)0xCAFEBABE;
+			lane.sendQueueLatencyHistogram = Reference<Histogram>(nullptr);
+		}
 	}
 
 	// Get a PacketBuffer to write new packets into
-	PacketBuffer* getWriteBuffer(size_t sizeHint = 0) {
-		if (!unsent_last) {
-			ASSERT(!unsent_first);
-			unsent_first = unsent_last = PacketBuffer::create(sizeHint);
+	PacketBuffer* getWriteBuffer(size_t sizeHint = 0, SendLane lane = SendLane::Default) {
+		Lane& l = lanes[(int)lane];
+		if (!l.last) {
+			ASSERT(!l.first);
+			l.first = l.last = PacketBuffer::create(sizeHint);
+			l.lastWritten = 0;
 		};
-		return unsent_last;
-	}
-	// Call after potentially adding to the chain returned by getWriteBuffer()
-	void setWriteBuffer(PacketBuffer* pb) { unsent_last = pb; }
-
-	// Prepend the given range of packetBuffers to the beginning of the unsent queue
-	void prependWriteBuffer(PacketBuffer* first, PacketBuffer* last) {
-		last->next = unsent_first;
-		unsent_first = first;
-		if (!unsent_last)
-			unsent_last = last;
+		return l.last;
 	}
+	// Call after potentially adding to the chain returned by getWriteBuffer(). Everything written to the lane since
+	// the previous call must be whole packets.
+	void setWriteBuffer(PacketBuffer* pb, SendLane lane = SendLane::Default);
+
+	// Prepend the given range of packetBuffers to the beginning of the unsent queue. They are sent before any other
+	// lane is started.
+	void prependWriteBuffer(PacketBuffer* first, PacketBuffer* last);
 
 	// false if there is anything unsent
-	bool empty() const { return !unsent_first || unsent_first->bytes_sent == unsent_first->bytes_written; }
+	bool empty() const {
+		for (const auto& lane : lanes) {
+			if (!lane.empty()) {
+				return false;
+			}
+		}
+		return true;
+	}
 
-	// Get the next PacketBuffer to send data from
-	PacketBuffer* getUnsent() const { return unsent_first; }
+	// Get the next PacketBuffer to send data from. The chain starting at it holds the packets of a single lane.
+	PacketBuffer* getUnsent() const { return lanes[activeLane].first; }
+	// Returns how many bytes from getUnsent() should go into the next write: the remainder of the current packet if
+	// a higher priority lane is waiting, and otherwise no limit.
+	int getSendLimit() const;
+	// Returns how long the next write may be held back so that more small packets can be coalesced into it, or 0 if
+	// it should happen now. Only applies when PACKET_COALESCE_DELAY_US is set.
+	double getCoalesceDelay() const;
 	// Call after sending bytes from getUnsent()
 	void sent(int bytes);
 
@@ -85,9 +103,27 @@ public:
 	void discardAll();
 
 private:
-	PacketBuffer *unsent_first, *unsent_last; // Both nullptr, or inclusive range of PacketBuffers that haven't been
-	                                          // sent.  The last one may have space for more packets to be written.
-	Reference<Histogram> sendQueueLatencyHistogram;
+	struct Lane {
+		PacketBuffer *first = nullptr, *last = nullptr; // Both nullptr, or inclusive range of PacketBuffers that
+		                                                // haven't been sent.  The last one may have space for more
+		                                                // packets to be written.
+		int lastWritten = 0; // last->bytes_written at the previous setWriteBuffer()
+		// Sizes of the unsent groups of packets, in the order they were written. Their ends are where a higher
+		// priority lane may take over.
+		Deque<int64_t> packetBytes;
+		int64_t frontBytesSent = 0; // Bytes of packetBytes.front() which have been sent
+		int64_t unsentBytes = 0;
+		double oldestUnsentTime = 0; // Only kept up to date while PACKET_COALESCE_DELAY_US is set
+		Reference<Histogram> sendQueueLatencyHistogram;
+
+		bool empty() const { return !first || first->bytes_sent == first->bytes_written; }
+	};
+
+	// Picks the highest priority lane with anything to send, unless the active lane is in the middle of a packet.
+	void selectLane();
+
+	Lane lanes[LANE_COUNT];
+	int activeLane = (int)SendLane::Default;
 };
 
 class ReliablePacketList : NonCopyable {
@@ -24,6 +24,7 @@
 #include "flow/BooleanParam.h"
 #include "flow/Trace.h"
 #include "flow/IPAddress.h"
+#include "flow/ProtocolVersion.h"
 
 FDB_BOOLEAN_PARAM(NetworkAddressFromHostname);
 
@@ -76,20 +77,12 @@ struct NetworkAddress {
 	bool isTLS() const { return (flags & FLAG_TLS) != 0; }
 	bool isV6() const { return ip.isV6(); }
 
-	size_t hash() const {
-		size_t result = 0;
-		if (ip.isV6()) {
-			uint16_t* ptr = (uint16_t*)ip.toV6().data();
-			result = ((size_t)ptr[5] << 32) | ((size_t)ptr[6] << 16) | ptr[7];
-		} else {
-			result = ip.toV4();
-		}
-		return (result << 16) + port;
-	}
+	size_t hash() const { return ip.hash(port); }
 
-	static NetworkAddress parse(std::string const&); // May throw connection_string_invalid
-	static Optional<NetworkAddress> parseOptional(std::string const&);
-	static std::vector<NetworkAddress> parseList(std::string const&);
+	// These do not allocate, other than for parseList()'s result
+	static NetworkAddress parse(std::string_view); // May throw connection_string_invalid
+	static Optional<NetworkAddress> parseOptional(std::string_view);
+	static std::vector<NetworkAddress> parseList(std::string_view);
 	std::string toString() const;
 
 	template <class Ar>
@@ -97,14 +90,14 @@ struct NetworkAddress {
 		if constexpr (is_fb_function<Ar>) {
 			serializer(ar, ip, port, flags, fromHostname);
 		} else {
-			if (ar.isDeserializing && !ar.protocolVersion().hasIPv6()) {
+			if (ar.isDeserializing && !archiveHasFeature<ProtocolVersion::IPv6>(ar)) {
 				uint32_t ipV4;
 				serializer(ar, ipV4, port, flags);
 				ip = IPAddress(ipV4);
 			} else {
 				serializer(ar, ip, port, flags);
 			}
-			if (ar.protocolVersion().hasNetworkAddressHostnameFlag()) {
+			if (archiveHasFeature<ProtocolVersion::NetworkAddressHostnameFlag>(ar)) {
 				serializer(ar, fromHostname);
 			}
 		}
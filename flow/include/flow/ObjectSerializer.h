@@ -23,6 +23,7 @@
 #include "flow/Arena.h"
 #include "flow/flat_buffers.h"
 #include "flow/ProtocolVersion.h"
+#include "flow/SerializationStats.h"
 
 #include <unordered_map>
 #include <any>
@@ -84,7 +85,13 @@ public:
 				ASSERT(false);
 			}
 		}
-		load_members(data, context, items...);
+		if (SerializationStats::enabled()) [[unlikely]] {
+			double start = SerializationStats::start();
+			load_members(data, context, items...);
+			SerializationStats::recordRead(file_identifier, static_cast<ReaderImpl*>(this)->size(), start);
+		} else {
+			load_members(data, context, items...);
+		}
 	}
 
 	template <class Item>
@@ -107,24 +114,32 @@ public:
 	static constexpr bool ownsUnderlyingMemory = false;
 
 	template <class VersionOptions>
-	ObjectReader(const uint8_t* data, VersionOptions vo) : _data(data) {
+	ObjectReader(const uint8_t* data, VersionOptions vo) : _data(data), _size(0) {
+		vo.read(*this);
+	}
+
+	template <class VersionOptions>
+	ObjectReader(StringRef data, VersionOptions vo) : _data(data.begin()), _size(data.size()) {
 		vo.read(*this);
 	}
 
 	template <class T, class VersionOptions>
 	static T fromStringRef(StringRef sr, VersionOptions vo) {
 		T t;
-		ObjectReader reader(sr.begin(), vo);
+		ObjectReader reader(sr, vo);
 		reader.deserialize(t);
 		return t;
 	}
 
 	const uint8_t* data() { return _data; }
+	// The size of the input including any protocol version, or 0 if it was not given
+	size_t size() const { return _size; }
 
 	Arena& arena() { return _arena; }
 
 private:
 	const uint8_t* _data;
+	size_t _size;
 	Arena _arena;
 };
 
@@ -143,16 +158,18 @@ public:
 
 	template <class VersionOptions>
 	ArenaObjectReader(Arena const& arena, const StringRef& input, VersionOptions vo)
-	  : _data(input.begin()), _arena(arena) {
+	  : _data(input.begin()), _size(input.size()), _arena(arena) {
 		vo.read(*this);
 	}
 
 	const uint8_t* data() { return _data; }
+	size_t size() const { return _size; }
 
 	Arena& arena() { return _arena; }
 
 private:
 	const uint8_t* _data;
+	size_t _size;
 	Arena _arena;
 };
 
@@ -262,7 +279,13 @@ public:
 		ASSERT(data == nullptr); // object serializer can only serialize one object
 		MemoryHelper memoryHelper(this);
 		SaveContext context(this, memoryHelper);
-		save_members(context, file_identifier, items...);
+		if (SerializationStats::enabled()) [[unlikely]] {
+			double start = SerializationStats::start();
+			save_members(context, file_identifier, items...);
+			SerializationStats::recordWrite(file_identifier, size, start);
+		} else {
+			save_members(context, file_identifier, items...);
+		}
 		ASSERT(memoryHelper.getNumAllocations() == 1);
 	}
 
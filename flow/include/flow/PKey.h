@@ -21,11 +21,19 @@
 #ifndef FLOW_PKEY_H
 #define FLOW_PKEY_H
 
+#include <list>
 #include <memory>
+#include <string>
 #include <string_view>
+#include <unordered_map>
+#include <vector>
 #include <openssl/evp.h>
 #include "flow/Arena.h"
 
+template <class T>
+class Future;
+class IThreadPool;
+
 enum class PKeyAlgorithm {
 	UNSUPPORTED,
 	RSA,
@@ -121,4 +129,57 @@ public:
 	// Create a PublicKey independent of this key
 	PublicKey toPublic() const;
 };
+
+// One signature of a batch passed to verifySignatures()
+struct SignatureCheck {
+	PublicKey key;
+	StringRef data;
+	StringRef signature;
+	const EVP_MD* digest = nullptr;
+};
+
+// Verifies each check on the calling thread and returns whether each one passed. The digest contexts are kept per
+// thread, and consecutive checks with the same key and digest share one EVP_DigestVerifyInit().
+std::vector<bool> verifySignatures(std::vector<SignatureCheck> const& checks);
+
+// A thread pool for verifySignaturesAsync()
+Reference<IThreadPool> createSignatureVerifierPool(int threads);
+
+// As verifySignatures(), but batches of at least FLOW_KNOBS->SIGNATURE_VERIFY_OFFLOAD_THRESHOLD checks are split
+// across |pool| in chunks of FLOW_KNOBS->SIGNATURE_VERIFY_CHUNK_SIZE instead of blocking the network thread. |arena|
+// must own the memory the checks refer to.
+Future<std::vector<bool>> verifySignaturesAsync(Reference<IThreadPool> pool,
+                                                std::vector<SignatureCheck> checks,
+                                                Arena arena);
+
+// A bounded least recently used set of tokens whose signatures have verified, so that a token presented with every
+// request is verified once rather than on every use. Entries are keyed by the ID of the signing key and a SHA-256 hash
+// of the token, and lapse when the token expires. Not thread safe.
+class VerifiedTokenCache {
+	struct Entry {
+		std::string key;
+		double expiresAt;
+	};
+	int capacity_;
+	std::list<Entry> lru; // Most recently used first
+	std::unordered_map<std::string, std::list<Entry>::iterator> index;
+
+	static std::string cacheKey(StringRef keyId, StringRef token);
+
+public:
+	explicit VerifiedTokenCache(int capacity);
+
+	// Whether |token|, signed by |keyId|, has verified and not expired by |now|. A hit makes the token most recent.
+	bool contains(StringRef keyId, StringRef token, double now);
+
+	// Records that |token| verified and is valid until |expiresAt|, evicting the least recently used token if full
+	void insert(StringRef keyId, StringRef token, double expiresAt);
+
+	// Forgets every token signed by |keyId|, e.g. when that key is removed from the public key set
+	void eraseKey(StringRef keyId);
+
+	int size() const { return static_cast<int>(index.size()); }
+	int capacity() const { return capacity_; }
+};
+
 #endif /*FLOW_PKEY_H*/
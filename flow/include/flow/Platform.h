@@ -37,6 +37,7 @@
 #define FDB_EXIT_ABORT 3
 #define FDB_EXIT_MAIN_ERROR 10
 #define FDB_EXIT_MAIN_EXCEPTION 11
+#define FDB_EXIT_PERFORMANCE_REGRESSION 12
 #define FDB_EXIT_NO_MEM 20
 #define FDB_EXIT_INIT_SEMAPHORE 21
 
@@ -302,6 +303,10 @@ void setMemoryQuota(size_t limit);
 void* allocate(size_t length, bool allowLargePages, bool includeGuardPages);
 
 void setAffinity(int proc);
+// The CPUs the calling thread may run on, so that it can be restored with setAffinity(procs) after pinning it with
+// setAffinity(proc). Empty where the platform does not report it.
+std::vector<int> getAffinity();
+void setAffinity(std::vector<int> const& procs);
 
 void threadSleep(double seconds);
 
@@ -20,16 +20,55 @@
 
 #ifndef FLOW_PROCESS_EVENTS_H
 #define FLOW_PROCESS_EVENTS_H
-#include <functional>
 #include <any>
+#include <functional>
+#include <typeinfo>
+#include <vector>
 
 #include "flow/flow.h"
 
 namespace ProcessEvents {
 
+// Event names are interned to dense ids the first time they are subscribed to or looked up with eventId(), so that
+// triggering by id does no string hashing. Ids are never reused.
+using EventId = uint32_t;
+
+EventId eventId(StringRef name);
+// Returns the id of a name which has already been interned, without interning it
+Optional<EventId> findEventId(StringRef name);
+StringRef eventName(EventId id);
+
+// A trigger's payload, passed to subscribers by reference rather than copied into a std::any. Payloads given to the
+// string based trigger() wrap the std::any they were passed.
+class Payload {
+	const void* data = nullptr;
+	const std::type_info* type = nullptr;
+	const std::any* any = nullptr;
+	std::any (*makeAny)(const void*) = nullptr;
+
+public:
+	template <class T>
+	explicit Payload(T const& value)
+	  : data(&value), type(&typeid(T)), makeAny([](const void* p) { return std::any(*static_cast<T const*>(p)); }) {}
+	explicit Payload(std::any const& any) : any(&any) {}
+
+	// Returns nullptr if the payload is not a T
+	template <class T>
+	T const* get() const {
+		if (any) {
+			return std::any_cast<T>(any);
+		}
+		return *type == typeid(T) ? static_cast<T const*>(data) : nullptr;
+	}
+
+	// Copies the payload into a std::any, for callbacks which take one
+	std::any toAny() const { return any ? *any : makeAny(data); }
+};
+
 // A callback is never allowed to throw. Since std::function can't
 // take noexcept signatures, this is enforced at runtime
 using Callback = std::function<void(StringRef, std::any const&, Error const&)>;
+using PayloadCallback = std::function<void(EventId, Payload const&, Error const&)>;
 
 class Event : NonCopyable {
 	void* impl;
@@ -37,11 +76,19 @@ class Event : NonCopyable {
 public:
 	Event(StringRef name, Callback callback);
 	Event(std::vector<StringRef> name, Callback callback);
+	Event(EventId id, PayloadCallback callback);
+	Event(std::vector<EventId> ids, PayloadCallback callback);
 	~Event();
 };
 
 void uncancellableEvent(StringRef name, Callback callback);
 void trigger(StringRef name, std::any const& data, Error const& e);
+void trigger(EventId id, Payload const& payload, Error const& e);
+
+template <class T>
+void trigger(EventId id, T const& data, Error const& e) {
+	trigger(id, Payload(data), e);
+}
 
 } // namespace ProcessEvents
 
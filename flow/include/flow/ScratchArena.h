@@ -0,0 +1,181 @@
+/*
+ * ScratchArena.h
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLOW_SCRATCH_ARENA_H
+#define FLOW_SCRATCH_ARENA_H
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+#include "flow/Arena.h"
+#include "flow/Error.h"
+
+// A thread local bump allocator for temporaries which do not outlive the run loop task that creates them.
+//
+// Allocation is a pointer bump in a chunk the thread keeps for reuse, and freeing is a no-op; instead the whole arena
+// is rewound in O(1), either by a ScratchScope or by the network thread at the end of every run loop task. Memory from
+// the scratch arena must therefore never be held across a wait(), and destructors of objects placed in it are not run
+// unless the owner (e.g. a container using ScratchAllocator) runs them.
+class ScratchArena : NonCopyable {
+	struct Chunk {
+		Chunk* next;
+		size_t size; // including this header
+	};
+
+public:
+	// A position to rewind to
+	struct Mark {
+		Chunk* chunk;
+		size_t used;
+		size_t bytesInUse;
+	};
+
+	// The calling thread's scratch arena
+	static ScratchArena& local() {
+		thread_local ScratchArena arena;
+		return arena;
+	}
+
+	ScratchArena() = default;
+	~ScratchArena();
+
+	[[nodiscard]] void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+		if (current) {
+			size_t start = (used + alignment - 1) & ~(alignment - 1);
+			if (start + size <= current->size) {
+				bytesInUse_ += start + size - used;
+				used = start + size;
+				if (bytesInUse_ > highWaterMark_) {
+					highWaterMark_ = bytesInUse_;
+				}
+				return reinterpret_cast<uint8_t*>(current) + start;
+			}
+		}
+		return allocateSlow(size, alignment);
+	}
+
+	template <class T>
+	[[nodiscard]] T* allocate(size_t n) {
+		return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+	}
+
+	Mark mark() const { return Mark{ current, used, bytesInUse_ }; }
+
+	// Frees everything allocated since |m| was taken, which must be from this arena and not already rewound past
+	void rewind(const Mark& m) {
+		current = m.chunk;
+		used = m.used;
+		bytesInUse_ = m.bytesInUse;
+	}
+
+	// Frees everything. Chunks are kept for reuse, up to SCRATCH_ARENA_MAX_RETAINED_BYTES, so no ScratchScope may be
+	// active on this arena. An arena which a ScratchScope grew and rewound is empty, but still gives back the excess.
+	void reset() {
+		if (capacity_ > retainLimit()) {
+			releaseExcessChunks();
+		} else if (bytesInUse_ != 0) {
+			current = chunks;
+			used = sizeof(Chunk);
+		}
+		bytesInUse_ = 0;
+	}
+
+	// Bytes allocated and not yet freed, including alignment padding and chunk tails skipped over
+	size_t bytesInUse() const { return bytesInUse_; }
+	// The most bytes in use at once since the arena was created or resetHighWaterMark() was called
+	size_t highWaterMark() const { return highWaterMark_; }
+	void resetHighWaterMark() { highWaterMark_ = bytesInUse_; }
+	// Bytes held in chunks, whether in use or not
+	size_t capacity() const { return capacity_; }
+
+private:
+	void* allocateSlow(size_t size, size_t alignment);
+	void releaseExcessChunks();
+	static size_t retainLimit();
+
+	Chunk* chunks = nullptr; // the first chunk; the rest follow through next
+	Chunk* current = nullptr;
+	size_t used = 0; // bytes of current, including its header
+	size_t bytesInUse_ = 0;
+	size_t highWaterMark_ = 0;
+	size_t capacity_ = 0;
+};
+
+// Frees everything allocated from the calling thread's scratch arena during its lifetime. Scopes nest.
+class ScratchScope : NonCopyable {
+public:
+	ScratchScope() : arena(ScratchArena::local()), start(arena.mark()) {}
+	~ScratchScope() { arena.rewind(start); }
+
+	ScratchArena& getArena() { return arena; }
+
+private:
+	ScratchArena& arena;
+	ScratchArena::Mark start;
+};
+
+// Adapts the calling thread's scratch arena to standard containers, like ArenaAllocator does for Arena. The container
+// must not outlive the enclosing ScratchScope or run loop task, and must be used on the thread which created it.
+template <class T>
+class ScratchAllocator {
+public:
+	using value_type = T;
+	using size_type = size_t;
+	using difference_type = ptrdiff_t;
+
+	ScratchAllocator() noexcept = default;
+	template <class U>
+	ScratchAllocator(const ScratchAllocator<U>&) noexcept {}
+
+	T* allocate(size_t n) { return ScratchArena::local().allocate<T>(n); }
+	void deallocate(T*, size_t) noexcept {}
+
+	template <class U>
+	bool operator==(const ScratchAllocator<U>&) const noexcept {
+		return true;
+	}
+	template <class U>
+	bool operator!=(const ScratchAllocator<U>&) const noexcept {
+		return false;
+	}
+
+	template <class U>
+	struct rebind {
+		using other = ScratchAllocator<U>;
+	};
+
+	using is_always_equal = std::true_type;
+};
+
+// A VectorRef of |size| value-initialized elements in the calling thread's scratch arena. It cannot grow, since
+// VectorRef grows into an Arena.
+template <class T>
+VectorRef<T> scratchVectorRef(int size) {
+	static_assert(std::is_trivially_destructible_v<T>, "scratch memory is freed without running destructors");
+	T* data = ScratchArena::local().allocate<T>(size);
+	for (int i = 0; i < size; i++) {
+		new (&data[i]) T();
+	}
+	return VectorRef<T>(data, size);
+}
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * SecureMemory.h
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLOW_SECURE_MEMORY_H
+#define FLOW_SECURE_MEMORY_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Memory for secrets: keys, tokens and anything else allocated with WipeAfterUse.
+//
+// Secure memory is locked into RAM, so it is never written to swap, and is excluded from core dumps where the platform
+// supports it. It is wiped when freed. Allocations of up to secureMemoryMaxPooledSize bytes are served from size
+// classes in a pool which grows by slabs of SECURE_MEMORY_POOL_BYTES; larger ones get mappings of their own, which are
+// cached for reuse once freed, up to SECURE_MEMORY_MAPPING_CACHE_BYTES. Locking can fail (e.g. when RLIMIT_MEMLOCK is
+// low), in which case the memory is still excluded from core dumps and wiped, and getSecureMemoryStats() says so.
+constexpr size_t secureMemoryMaxPooledSize = 8192;
+
+// Never returns null. |size| must be passed back to freeSecure().
+[[nodiscard]] void* allocateSecure(size_t size);
+void freeSecure(void* ptr, size_t size);
+
+// Zeroes |size| bytes at |ptr| in a way the compiler may not elide, even though the memory is about to be freed
+void secureWipe(void* ptr, size_t size);
+
+struct SecureMemoryStats {
+	size_t poolBytes = 0; // mapped for the pool's slabs
+	size_t pooledBytesInUse = 0; // handed out from the pool, rounded up to size classes
+	size_t unpooledBytesInUse = 0; // handed out in mappings of their own, rounded up to pages
+	size_t cachedBytes = 0; // in freed mappings kept for reuse
+	int64_t lockFailures = 0; // mappings which could not be locked into RAM
+	int64_t dumpExclusionFailures = 0; // mappings which could not be excluded from core dumps
+};
+SecureMemoryStats getSecureMemoryStats();
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * SerializationStats.h
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLOW_SERIALIZATION_STATS_H
+#define FLOW_SERIALIZATION_STATS_H
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "flow/FileIdentifier.h"
+
+// What ObjectWriter and ObjectReader spend on each root type, keyed by its FileIdentifier
+struct SerializationTypeStats {
+	FileIdentifier fileIdentifier = 0;
+	int64_t messagesWritten = 0;
+	int64_t bytesWritten = 0;
+	double writeSeconds = 0;
+	int64_t messagesRead = 0;
+	int64_t bytesRead = 0; // only for readers which know the size of their input
+	double readSeconds = 0;
+
+	int64_t messages() const { return messagesWritten + messagesRead; }
+	int64_t bytes() const { return bytesWritten + bytesRead; }
+	double seconds() const { return writeSeconds + readSeconds; }
+};
+
+// Opt-in accounting of object serialization by message type, for finding the types which dominate network bandwidth
+// or serialization CPU.
+//
+// While disabled, which is the default unless SERIALIZATION_STATS_ENABLED is set, serializing costs one relaxed load.
+// While enabled, each root object serialized or deserialized also costs two clock reads and an update to a table
+// private to the calling thread. Times are wall clock and include any serialization nested inside the object's own.
+class SerializationStats {
+public:
+	static bool enabled() { return enabledFlag.load(std::memory_order_relaxed); }
+	static void setEnabled(bool enabled) { enabledFlag.store(enabled, std::memory_order_relaxed); }
+
+	// A timestamp to pass to recordWrite() or recordRead()
+	static double start();
+	static void recordWrite(FileIdentifier fileIdentifier, size_t bytes, double startTime);
+	static void recordRead(FileIdentifier fileIdentifier, size_t bytes, double startTime);
+
+	// Totals across all threads since the process started, in no particular order
+	static std::vector<SerializationTypeStats> get();
+	static SerializationTypeStats get(FileIdentifier fileIdentifier);
+	// The |count| types with the most bytes, or the most seconds if |bySeconds|
+	static std::vector<SerializationTypeStats> top(std::vector<SerializationTypeStats> stats,
+	                                               int count,
+	                                               bool bySeconds);
+
+	// Logs a SerializationMetrics event covering the time since the previous call. Its TopBytes and TopSeconds details
+	// list up to SERIALIZATION_STATS_TRACE_MAX_TYPES types, each as "FileIdentifier:Messages:Bytes:Seconds", separated
+	// by spaces.
+	static void trace();
+
+private:
+	static std::atomic<bool> enabledFlag;
+};
+
+#endif
@@ -0,0 +1,240 @@
+/*
+ * SimulatedNetwork.h
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLOW_SIMULATED_NETWORK_H
+#define FLOW_SIMULATED_NETWORK_H
+#pragma once
+
+#include <map>
+#include <memory>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "flow/flow.h"
+#include "flow/network.h"
+#include "flow/serialize.h"
+#include "flow/IConnection.h"
+#include "flow/TLSConfig.actor.h"
+
+// A deterministic, single threaded INetwork which runs in virtual time, for modelling the performance of many logical
+// processes inside one real one.
+//
+// Every task runs on a simulated process, which has a CPU of its own: each task costs the process taskCpuSeconds of
+// virtual time, plus anything charged with chargeCpu(), and tasks which become ready while the CPU is busy queue for
+// it. Connections between processes deliver bytes after the latency of the link between their IP addresses, and a
+// link transmits at most its bandwidth, so messages queue behind each other. Time only advances when no task is ready,
+// so a model of thousands of peers runs as fast as the real CPU can run its tasks.
+//
+// Actors run on the process of the task which resumed them, and move with onProcess(). There are no threads:
+// startThread and UDP sockets are unsupported, and onMainThread() must be called on the thread which runs the network.
+// It is unrelated to the fault injecting simulator, and nothing in it is random.
+class SimulatedNetwork final : public INetwork, public INetworkConnections, NonCopyable {
+public:
+	struct LinkModel {
+		double latency; // seconds from the last byte being transmitted to it arriving
+		double bandwidth; // bytes per second, or 0 for unlimited
+	};
+
+	struct LinkStats {
+		int64_t bytes = 0;
+		int64_t writes = 0;
+		double busySeconds = 0; // spent transmitting
+		double maxQueueingSeconds = 0; // the longest a write waited for earlier ones to be transmitted
+	};
+
+	struct Process : NonCopyable {
+		std::string name;
+		NetworkAddress address;
+		double taskCpuSeconds;
+
+		// Statistics, in virtual time
+		int64_t tasks = 0;
+		double cpuSeconds = 0;
+		double queueingSeconds = 0; // total time tasks were ready but waited for the CPU
+		double maxQueueingSeconds = 0;
+
+		Process(std::string name, NetworkAddress address, double taskCpuSeconds)
+		  : name(std::move(name)), address(address), taskCpuSeconds(taskCpuSeconds) {}
+
+	private:
+		friend class SimulatedNetwork;
+		double cpuBusyUntil = 0;
+	};
+
+	SimulatedNetwork();
+	~SimulatedNetwork();
+
+	// Processes live as long as the network. |taskCpuSeconds| defaults to SIMULATED_NETWORK_TASK_CPU_SECONDS.
+	Process* newProcess(std::string const& name, NetworkAddress address, Optional<double> taskCpuSeconds = {});
+	// The process of the running task. Before any process is created, and outside of tasks, this is a process with no
+	// address.
+	Process* getCurrentProcess() const { return currentProcess; }
+	// Ready after moving the calling actor to |process|
+	Future<Void> onProcess(Process* process, TaskPriority taskID = TaskPriority::DefaultYield);
+	// Adds |seconds| to the CPU cost of the running task, delaying what it does afterwards
+	void chargeCpu(double seconds) { currentTaskCpuSeconds += seconds; }
+
+	// Links are directional and between IP addresses; those not set use the default, which is made of the
+	// SIMULATED_NETWORK_LATENCY and SIMULATED_NETWORK_BANDWIDTH knobs.
+	void setDefaultLink(LinkModel model) { defaultLink = model; }
+	void setLink(IPAddress const& from, IPAddress const& to, LinkModel model) { links[{ from, to }].model = model; }
+	LinkStats getLinkStats(IPAddress const& from, IPAddress const& to) const;
+
+	int64_t getTasksRun() const { return tasksRun; }
+
+	// INetwork interface
+	double now() const override { return currentTime; }
+	double timer() override { return timerOffset + currentTime; }
+	double timer_monotonic() override { return currentTime; }
+	Future<Void> delay(double seconds, TaskPriority taskID) override;
+	Future<Void> orderedDelay(double seconds, TaskPriority taskID) override;
+	Future<Void> yield(TaskPriority taskID) override;
+	bool check_yield(TaskPriority taskID) override;
+	TaskPriority getCurrentTask() const override { return currentTaskID; }
+	void setCurrentTask(TaskPriority taskID) override { currentTaskID = taskID; }
+	flowGlobalType global(int id) const override { return (globals.size() > id) ? globals[id] : nullptr; }
+	void setGlobal(size_t id, flowGlobalType v) override {
+		ASSERT(id < globals.size());
+		globals[id] = v;
+	}
+	// Makes run() return once the running task finishes
+	void stop() override;
+	void addStopCallback(std::function<void()> fn) override { stopCallbacks.emplace_back(std::move(fn)); }
+	bool isSimulated() const override { return true; }
+	bool isOnMainThread() const override { return std::this_thread::get_id() == mainThread; }
+	void onMainThread(Promise<Void>&& signal, TaskPriority taskID) override;
+	THREAD_HANDLE startThread(THREAD_FUNC_RETURN (*func)(void*), void* arg, int stackSize, const char* name) override;
+	// Runs tasks in virtual time order until stop() is called or no task is left
+	void run() override;
+	const TLSConfig& getTLSConfig() const override { return tlsConfig; }
+	void getDiskBytes(std::string const& directory, int64_t& free, int64_t& total) override;
+	bool isAddressOnThisHost(NetworkAddress const& addr) const override {
+		return addr.ip == currentProcess->address.ip;
+	}
+	bool checkRunnable() override { return !started.exchange(true); }
+#ifdef ENABLE_SAMPLING
+	ActorLineageSet& getActorLineageSet() override { return actorLineageSet; }
+#endif
+	ProtocolVersion protocolVersion() const override { return currentProtocolVersion(); }
+
+	// INetworkConnections interface. Connections are between processes of this network, and TLS is ignored.
+	Future<Reference<IConnection>> connect(NetworkAddress toAddr,
+	                                       boost::asio::ip::tcp::socket* existingSocket = nullptr) override;
+	Future<Reference<IConnection>> connectExternal(NetworkAddress toAddr) override { return connect(toAddr); }
+	Future<Reference<IUDPSocket>> createUDPSocket(NetworkAddress toAddr) override;
+	Future<Reference<IUDPSocket>> createUDPSocket(bool isV6) override;
+	void addMockTCPEndpoint(const std::string& host,
+	                        const std::string& service,
+	                        const std::vector<NetworkAddress>& addresses) override {
+		mockDNS.add(host, service, addresses);
+	}
+	void removeMockTCPEndpoint(const std::string& host, const std::string& service) override {
+		mockDNS.remove(host, service);
+	}
+	void parseMockDNSFromString(const std::string& s) override { mockDNS = DNSCache::parseFromString(s); }
+	std::string convertMockDNSToString() override { return mockDNS.toString(); }
+	// Only mock endpoints resolve
+	Future<std::vector<NetworkAddress>> resolveTCPEndpoint(const std::string& host,
+	                                                       const std::string& service) override;
+	Future<std::vector<NetworkAddress>> resolveTCPEndpointWithDNSCache(const std::string& host,
+	                                                                   const std::string& service) override {
+		return resolveTCPEndpoint(host, service);
+	}
+	std::vector<NetworkAddress> resolveTCPEndpointBlocking(const std::string& host,
+	                                                       const std::string& service) override;
+	std::vector<NetworkAddress> resolveTCPEndpointBlockingWithDNSCache(const std::string& host,
+	                                                                   const std::string& service) override {
+		return resolveTCPEndpointBlocking(host, service);
+	}
+	Reference<IListener> listen(NetworkAddress localAddr) override;
+
+private:
+	class Connection;
+	class Listener;
+	friend class Connection;
+	friend class Listener;
+
+	struct Task {
+		double time;
+		TaskPriority taskID;
+		uint64_t sequence; // keeps tasks with the same time and priority in FIFO order
+		double readyTime; // when the task became ready, before any wait for the CPU
+		Process* process;
+		std::function<void()>* action;
+
+		// Ordering is reversed for priority_queue
+		bool operator<(Task const& rhs) const {
+			if (time != rhs.time) {
+				return time > rhs.time;
+			}
+			if (taskID != rhs.taskID) {
+				return taskID < rhs.taskID;
+			}
+			return sequence > rhs.sequence;
+		}
+	};
+
+	struct Link {
+		Optional<LinkModel> model;
+		double busyUntil = 0;
+		double lastArrival = 0;
+		LinkStats stats;
+	};
+
+	// The effects of a task, such as the tasks it schedules and the bytes it writes, happen when the CPU work charged
+	// to it so far is done
+	double taskTime() const { return currentTime + currentTaskCpuSeconds; }
+	void post(Process* process, double time, TaskPriority taskID, std::function<void()> action);
+	Future<Void> schedule(Process* process, double time, TaskPriority taskID);
+	// Returns when |bytes| written by the running task arrive from |from| to |to|
+	double transmit(IPAddress const& from, IPAddress const& to, int64_t bytes);
+	Link& getLink(IPAddress const& from, IPAddress const& to);
+	static NetworkAddress currentProcessAddress();
+	static NetworkAddressList currentProcessAddresses();
+
+	double currentTime = 0;
+	double timerOffset;
+	TaskPriority currentTaskID = TaskPriority::DefaultYield;
+	Process* currentProcess;
+	double currentTaskCpuSeconds = 0;
+	uint64_t tasksIssued = 0;
+	int64_t tasksRun = 0;
+	std::priority_queue<Task, std::vector<Task>> tasks;
+
+	std::vector<std::unique_ptr<Process>> processes;
+	LinkModel defaultLink;
+	std::map<std::pair<IPAddress, IPAddress>, Link> links;
+	std::map<std::pair<IPAddress, uint16_t>, Listener*> listeners;
+	uint16_t nextEphemeralPort = 40000;
+	DNSCache mockDNS;
+
+	std::vector<flowGlobalType> globals;
+	std::vector<std::function<void()>> stopCallbacks;
+	bool stopped = false;
+	std::atomic<bool> started = false;
+	std::thread::id mainThread;
+	TLSConfig tlsConfig;
+#ifdef ENABLE_SAMPLING
+	ActorLineageSet actorLineageSet;
+#endif
+};
+
+#endif
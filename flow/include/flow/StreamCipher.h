@@ -22,6 +22,7 @@
 
 #include "flow/Arena.h"
 #include "flow/FastRef.h"
+#include "flow/SecureMemory.h"
 #include "flow/flow.h"
 
 #include <openssl/aes.h>
@@ -40,7 +41,7 @@ class StreamCipherKey : NonCopyable {
 	static std::unique_ptr<StreamCipherKey> globalKey;
 	static std::unordered_map<UID, StreamCipherKey*> cipherKeys;
 	UID id;
-	std::unique_ptr<uint8_t[]> arr;
+	uint8_t* arr; // from the secure memory pool
 	int keySize;
 
 public:
@@ -48,10 +49,10 @@ public:
 	~StreamCipherKey();
 
 	int size() const { return keySize; }
-	uint8_t* data() const { return arr.get(); }
+	uint8_t* data() const { return arr; }
 	void initializeKey(uint8_t* data, int len);
-	void initializeRandomTestKey() { deterministicRandom()->randomBytes(arr.get(), keySize); }
-	void reset() { memset(arr.get(), 0, keySize); }
+	void initializeRandomTestKey() { deterministicRandom()->randomBytes(arr, keySize); }
+	void reset() { secureWipe(arr, keySize); }
 
 	static bool isGlobalKeyPresent();
 	static void allocGlobalCipherKey();
@@ -0,0 +1,98 @@
+/*
+ * StripedCounter.h
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2022 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLOW_STRIPED_COUNTER_H
+#define FLOW_STRIPED_COUNTER_H
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// TODO: We should make this dependent on the CPU. Maybe cmake
+// can set this variable properly?
+constexpr size_t MAX_CACHE_LINE_SIZE = 64;
+
+namespace detail {
+
+// Threads are numbered in the order they first update a striped counter, so that threads started together use
+// different stripes
+inline size_t stripedCounterThreadIndex() {
+	static std::atomic<size_t> nextIndex{ 0 };
+	static thread_local size_t index = nextIndex.fetch_add(1, std::memory_order_relaxed);
+	return index;
+}
+
+} // namespace detail
+
+// |N| counters which many threads update at once, for statistics which would otherwise be a contended atomic.
+//
+// Each thread adds to one of |Stripes| copies of the counters, each on a cache line of its own, and reads sum the
+// copies. Updates from different threads therefore only share a cache line when there are more threads than stripes,
+// while a read costs a cache miss per stripe, and does not see a consistent snapshot of updates made during it. The
+// counters are zero after construction, which is constant initialization, so they are safe to update from static
+// initializers.
+template <size_t N, size_t Stripes = 16>
+class StripedCounters {
+	static_assert(N * sizeof(std::atomic<int64_t>) <= MAX_CACHE_LINE_SIZE, "a stripe must fit in a cache line");
+
+public:
+	constexpr StripedCounters() = default;
+	StripedCounters(StripedCounters const&) = delete;
+	StripedCounters& operator=(StripedCounters const&) = delete;
+
+	void add(size_t counter, int64_t delta) {
+		stripes[detail::stripedCounterThreadIndex() % Stripes].values[counter].fetch_add(delta,
+		                                                                                  std::memory_order_relaxed);
+	}
+
+	int64_t get(size_t counter) const {
+		int64_t sum = 0;
+		for (auto const& stripe : stripes) {
+			sum += stripe.values[counter].load(std::memory_order_relaxed);
+		}
+		return sum;
+	}
+
+private:
+	struct alignas(MAX_CACHE_LINE_SIZE) Stripe {
+		std::array<std::atomic<int64_t>, N> values{};
+	};
+	std::array<Stripe, Stripes> stripes{};
+};
+
+// A single striped counter
+class StripedCounter {
+public:
+	constexpr StripedCounter() = default;
+
+	void add(int64_t delta) { counters.add(0, delta); }
+	void operator+=(int64_t delta) { add(delta); }
+	void operator-=(int64_t delta) { add(-delta); }
+	void operator++() { add(1); }
+
+	int64_t get() const { return counters.get(0); }
+
+private:
+	StripedCounters<1> counters;
+};
+
+#endif
@@ -245,11 +245,17 @@ public:
 	}
 
 	void destroy() override {
-		// This assert assures that all ThreadMultiCallbacks remove themselves as a holder from
-		// every ThreadCallback they hold prior to destruction, because if they do not then this
-		// assert will fire, so ThreadCallback does not attempt to destroy its MultiCallbackHolder
-		// linked list or verify that it is empty.
-		UNSTOPPABLE_ASSERT(callbacks.empty());
+		// Callbacks are only still here if the future is destroyed before it is set. They are removed as holders
+		// before being destroyed, so that every ThreadMultiCallback removes itself as a holder from every
+		// ThreadCallback it holds prior to destruction, and ThreadCallback does not attempt to destroy its
+		// MultiCallbackHolder linked list or verify that it is empty. Callbacks which keep the future alive cannot
+		// be here, and the default ThreadCallback::destroy() asserts.
+		while (callbacks.size()) {
+			auto cb = callbacks.back();
+			callbacks.pop_back();
+			cb->destroyHolder(cb->getHolder(this));
+			cb->destroy();
+		}
 		delete this;
 	}
 
@@ -272,15 +278,11 @@ public:
 	Error error;
 	ThreadCallback* callback;
 
-	bool isReady() {
-		ThreadSpinLockHolder holder(mutex);
-		return isReadyUnsafe();
-	}
+	// status only moves forward from Unset, and is stored after the value or error it publishes, so these checks do
+	// not need |mutex|. Polling and blocking waiters on other threads no longer contend with the thread setting it.
+	bool isReady() { return status.load(std::memory_order_acquire) >= Set; }
 
-	bool isError() {
-		ThreadSpinLockHolder holder(mutex);
-		return isErrorUnsafe();
-	}
+	bool isError() { return status.load(std::memory_order_acquire) == ErrorSet; }
 
 	int getErrorCode() {
 		ThreadSpinLockHolder holder(mutex);
@@ -371,9 +373,13 @@ public:
 		} else {
 			this->mutex.leave();
 
-			// Thread safe because status is now ErrorSet and callback is nullptr, meaning than callback cannot change
+			// Thread safe because status is now ErrorSet and callback is nullptr, meaning than callback cannot change.
+			// A callback may release the last reference to this, so hold one until it and any other callbacks of a
+			// ThreadMultiCallback have returned.
+			this->addref();
 			int userParam = 0;
 			func->error(err, userParam);
+			this->delref();
 		}
 
 		return true;
@@ -552,9 +558,13 @@ public:
 		} else {
 			this->mutex.leave();
 
-			// Thread safe because status is now Set and callback is nullptr, meaning than callback cannot change
+			// Thread safe because status is now Set and callback is nullptr, meaning than callback cannot change.
+			// A callback may release the last reference to this, so hold one until it and any other callbacks of a
+			// ThreadMultiCallback have returned.
+			this->addref();
 			int userParam = 0;
 			func->fire(Void(), userParam);
+			this->delref();
 		}
 	}
 
@@ -564,6 +574,12 @@ public:
 	}
 };
 
+// Where a continuation passed to ThreadFuture::then() runs
+enum class ContinuationExecutor {
+	Inline, // On the thread which sets the future, or the calling thread if it is already set
+	MainThread, // On the network thread, through onMainThreadVoid()
+};
+
 template <class T>
 class ThreadFuture {
 public:
@@ -592,6 +608,14 @@ public:
 	}
 	bool clearCallback(ThreadCallback* cb) { return sav->clearCallback(cb); }
 
+	// Returns a future for f(ErrorOr<T>), called once this future is set. An Error thrown by f is sent through the
+	// returned future. Unlike going through safeThreadFutureToFuture(), an Inline continuation never touches the
+	// network thread.
+	template <class F>
+	ThreadFuture<decltype(std::declval<F>()(std::declval<ErrorOr<T>>()))> then(
+	    F f,
+	    ContinuationExecutor executor = ContinuationExecutor::Inline);
+
 	void cancel() { extractPtr()->cancel(); }
 
 	ThreadFuture() : sav(0) {}
@@ -646,6 +670,72 @@ private:
 	ThreadSingleAssignmentVar<T>* sav;
 };
 
+// The callback behind ThreadFuture::then(). It deletes itself once it has run, or when the source is destroyed without
+// being set, in which case the result is broken_promise. It does not hold a reference to the source, which would keep
+// a source that is never set alive forever; the source holds one of its own while it calls back.
+template <class T, class F>
+struct ThreadContinuation final : public ThreadCallback, public FastAllocated<ThreadContinuation<T, F>> {
+	using R = decltype(std::declval<F>()(std::declval<ErrorOr<T>>()));
+
+	ThreadContinuation(ThreadSingleAssignmentVar<T>* source,
+	                   F f,
+	                   ThreadSingleAssignmentVar<R>* result,
+	                   ContinuationExecutor executor)
+	  : source(source), f(std::move(f)), result(result), executor(executor) {}
+
+	bool canFire(int notMadeActive) const override { return true; }
+	void fire(const Void& unused, int& userParam) override { schedule(); }
+	void error(const Error&, int& userParam) override { schedule(); }
+	void destroy() override {
+		result->sendError(broken_promise());
+		result->delref();
+		delete this;
+	}
+
+	void schedule() {
+		if (executor == ContinuationExecutor::MainThread) {
+			// The source only holds a reference to itself until this returns
+			source->addref();
+			onMainThreadVoid([this]() {
+				ThreadFuture<T> keepSource(source);
+				run();
+			});
+		} else {
+			run();
+		}
+	}
+
+	void run() {
+		try {
+			ErrorOr<T> input = source->isError() ? ErrorOr<T>(source->error) : ErrorOr<T>(source->get());
+			result->send(f(std::move(input)));
+		} catch (Error& e) {
+			result->sendError(e);
+		}
+		result->delref();
+		delete this;
+	}
+
+	ThreadSingleAssignmentVar<T>* source;
+	F f;
+	ThreadSingleAssignmentVar<R>* result;
+	ContinuationExecutor executor;
+};
+
+template <class T>
+template <class F>
+ThreadFuture<decltype(std::declval<F>()(std::declval<ErrorOr<T>>()))> ThreadFuture<T>::then(
+    F f,
+    ContinuationExecutor executor) {
+	using R = decltype(std::declval<F>()(std::declval<ErrorOr<T>>()));
+	auto result = new ThreadSingleAssignmentVar<R>();
+	result->addref(); // For the continuation
+	auto continuation = new ThreadContinuation<T, F>(sav, std::move(f), result, executor);
+	int unused = 0;
+	sav->callOrSetAsCallback(continuation, unused, 0);
+	return ThreadFuture<R>(result);
+}
+
 // A callback class used to convert a ThreadFuture into a Future
 template <class T>
 struct CompletionCallback final : public ThreadCallback, ReferenceCounted<CompletionCallback<T>> {
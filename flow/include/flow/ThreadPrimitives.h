@@ -22,10 +22,13 @@
 #define FLOW_THREADPRIMITIVES_H
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <array>
+#include <thread>
 
 #include "flow/Error.h"
+#include "flow/StripedCounter.h"
 #include "flow/Trace.h"
 
 #if defined(__linux__) || defined(__FreeBSD__)
@@ -45,9 +48,50 @@
 #include <drd.h>
 #endif
 
-// TODO: We should make this dependent on the CPU. Maybe cmake
-// can set this variable properly?
-constexpr size_t MAX_CACHE_LINE_SIZE = 64;
+inline void spinPause() {
+#if defined(__aarch64__)
+	__asm__ volatile("isb");
+#elif defined(__powerpc64__)
+	__asm__ volatile("or 27,27,27" ::: "memory");
+#else
+	_mm_pause();
+#endif
+}
+
+// Estimates how long a thread should spin before it parks in the kernel, from the durations (in timestampCounter()
+// ticks) of recent waits or lock holds. Waits which are usually longer than MAX_TICKS are not worth spinning for.
+class AdaptiveSpin {
+public:
+#if defined(__aarch64__)
+	static constexpr int64_t MAX_TICKS = 200; // The generic timer usually runs at tens of MHz
+#else
+	static constexpr int64_t MAX_TICKS = 20000;
+#endif
+	static constexpr int64_t MIN_TICKS = MAX_TICKS / 20;
+
+	uint64_t budget() const {
+		int64_t twice = 2 * average.load(std::memory_order_relaxed);
+		return twice > MAX_TICKS ? 0 : std::max(twice, MIN_TICKS);
+	}
+
+	void record(uint64_t ticks) {
+		int64_t avg = average.load(std::memory_order_relaxed);
+		int64_t t = std::min<uint64_t>(ticks, 1 << 30);
+		average.store(avg + (t - avg) / 8, std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<int64_t> average{ MAX_TICKS / 4 };
+};
+
+// How often a Mutex or Event had to wait, and how the waits ended. Only collected where the futex based
+// implementations are used (Linux).
+struct LockContentionStats {
+	uint64_t acquisitions = 0; // Mutex::enter() or Event::block() calls
+	uint64_t contended = 0; // ... which could not proceed immediately
+	uint64_t spun = 0; // ... and then succeeded while spinning
+	uint64_t parked = 0; // ... or slept in the kernel
+};
 
 class alignas(MAX_CACHE_LINE_SIZE) ThreadSpinLock {
 public:
@@ -63,14 +107,14 @@ public:
 #endif
 	}
 	void enter() {
-		while (isLocked.test_and_set(std::memory_order_acquire))
-#if defined(__aarch64__)
-			__asm__ volatile("isb");
-#elif defined(__powerpc64__)
-			__asm__ volatile("or 27,27,27" ::: "memory");
-#else
-			_mm_pause();
-#endif
+		// Spinning is bounded, so that a holder which was descheduled gets the CPU back
+		for (int spins = 0; isLocked.test_and_set(std::memory_order_acquire); ++spins) {
+			if (spins < MAX_PAUSES) {
+				spinPause();
+			} else {
+				std::this_thread::yield();
+			}
+		}
 #if VALGRIND
 		ANNOTATE_RWLOCK_ACQUIRED(this, true);
 #endif
@@ -87,6 +131,8 @@ public:
 	}
 
 private:
+	static constexpr int MAX_PAUSES = 1000;
+
 	ThreadSpinLock(const ThreadSpinLock&);
 	void operator=(const ThreadSpinLock&);
 	std::atomic_flag isLocked = ATOMIC_FLAG_INIT;
@@ -133,10 +179,20 @@ public:
 	void set();
 	void block();
 
+	LockContentionStats getContentionStats() const;
+
 private:
 #ifdef _WIN32
 	void* ev;
-#elif defined(__linux__) || defined(__FreeBSD__)
+#elif defined(__linux__)
+	// A futex based semaphore. block() spins for a while before parking, and set() wakes at most one parked thread.
+	std::atomic<int32_t> count{ 0 };
+	std::atomic<int32_t> waiters{ 0 };
+	AdaptiveSpin spin;
+	std::atomic<uint64_t> acquisitions{ 0 }, contended{ 0 }, spun{ 0 }, parked{ 0 };
+
+	bool tryConsume();
+#elif defined(__FreeBSD__)
 	sem_t sem;
 #elif defined(__APPLE__)
 	mach_port_t self;
@@ -155,8 +211,21 @@ public:
 	void enter();
 	void leave();
 
+	LockContentionStats getContentionStats() const;
+
 private:
+#if defined(__linux__)
+	// A futex based lock (mutex 3 of Drepper's "Futexes Are Tricky") which spins for about twice its recent hold time
+	// before parking. The counters are only written while the lock is held.
+	std::atomic<int32_t> state{ 0 }; // 0: unlocked, 1: locked, 2: locked and there may be parked threads
+	std::atomic<uintptr_t> owner{ 0 };
+	int recursion = 0;
+	uint64_t acquiredAt = 0;
+	AdaptiveSpin spin;
+	std::atomic<uint64_t> acquisitions{ 0 }, contended{ 0 }, spun{ 0 }, parked{ 0 };
+#else
 	void* impl;
+#endif
 };
 
 class MutexHolder {
@@ -26,24 +26,7 @@
 #include <random>
 
 #include "flow/flow.h"
-
-struct opTimer {
-	double start = timer();
-	char const* name;
-	int opCount;
-
-	opTimer(char const* name, int opCount) : name(name), opCount(opCount) {}
-
-	~opTimer() { printf("%s: %0.1f Kop/s\n", name, (opCount / 1000.0) / (timer() - start)); }
-};
-
-template <typename F, typename T>
-void timedRun(char const* name, T& t, F f) {
-	opTimer timer(name, t.size());
-	for (auto& i : t) {
-		f(i);
-	}
-}
+#include "flow/UnitTest.h"
 
 template <typename K>
 struct MapHarness {
@@ -78,42 +61,79 @@ struct MapHarness {
 	result lower_bound(K const& k) const { return result(s.lower_bound(k)); }
 	result upper_bound(K const& k) const { return result(s.upper_bound(k)); }
 	void erase(K const& k) { s.erase(k); }
+	void clear() { s.clear(); }
 };
 
+// Benchmarks each operation of |tree| with runBenchmark(), as "<name>/<operation>", over |keyCount| (default 1e6) keys
+// from |generateKey|. Inserts and erases restore the tree untimed after every run.
 template <typename T, typename F>
-void treeBenchmark(T& tree, F generateKey) {
+void treeBenchmark(const UnitTestParameters& params, std::string const& name, T& tree, F generateKey) {
 	std::mt19937_64 urng(deterministicRandom()->randomUInt32());
 
 	using key = typename T::key_type;
 
-	int keyCount = 1000000;
+	int keyCount = params.getInt("keyCount").orDefault(1000000);
 
 	std::vector<key> keys;
 	for (int i = 0; i < keyCount; i++) {
 		keys.push_back(generateKey());
 	}
 
-	timedRun("insert", keys, [&tree](key const& k) { tree.insert(k); });
-	timedRun("find", keys, [&tree](key const& k) { ASSERT(tree.find(k) != tree.not_found()); });
-	timedRun("lower_bound", keys, [&tree](key const& k) { ASSERT(tree.lower_bound(k) != tree.not_found()); });
-	timedRun("upper_bound", keys, [&tree](key const& k) { tree.upper_bound(k); });
+	auto insertAll = [&]() {
+		for (auto const& k : keys) {
+			tree.insert(k);
+		}
+	};
+	runBenchmark(params, name + "/insert", keys.size(), insertAll, [&]() { tree.clear(); });
+	insertAll();
+	runBenchmark(params, name + "/find", keys.size(), [&]() {
+		for (auto const& k : keys) {
+			ASSERT(tree.find(k) != tree.not_found());
+		}
+	});
+	runBenchmark(params, name + "/lower_bound", keys.size(), [&]() {
+		for (auto const& k : keys) {
+			ASSERT(tree.lower_bound(k) != tree.not_found());
+		}
+	});
+	runBenchmark(params, name + "/upper_bound", keys.size(), [&]() {
+		for (auto const& k : keys) {
+			tree.upper_bound(k);
+		}
+	});
 
 	std::sort(keys.begin(), keys.end());
 	keys.resize(std::unique(keys.begin(), keys.end()) - keys.begin());
 
-	auto iter = tree.lower_bound(*keys.begin());
-	timedRun("scan", keys, [&iter](key const& k) {
-		ASSERT(k == *iter);
-		++iter;
+	runBenchmark(params, name + "/scan", keys.size(), [&]() {
+		auto iter = tree.lower_bound(*keys.begin());
+		for (auto const& k : keys) {
+			ASSERT(k == *iter);
+			++iter;
+		}
+		ASSERT(iter == tree.end());
+	});
+	runBenchmark(params, name + "/find_sorted", keys.size(), [&]() {
+		for (auto const& k : keys) {
+			ASSERT(tree.find(k) != tree.end());
+		}
 	});
-	ASSERT(iter == tree.end());
-
-	timedRun("find (sorted)", keys, [&tree](key const& k) { ASSERT(tree.find(k) != tree.end()); });
 
 	std::shuffle(keys.begin(), keys.end(), urng);
 
-	timedRun("erase", keys, [&tree](key const& k) { tree.erase(k); });
-	ASSERT(tree.begin() == tree.end());
+	runBenchmark(
+	    params,
+	    name + "/erase",
+	    keys.size(),
+	    [&]() {
+		    for (auto const& k : keys) {
+			    tree.erase(k);
+		    }
+	    },
+	    [&]() {
+		    ASSERT(tree.begin() == tree.end());
+		    insertAll();
+	    });
 }
 
 static inline StringRef randomStr(Arena& arena) {
@@ -46,6 +46,7 @@
 #include "flow/flow.h"
 
 #include <cinttypes>
+#include <functional>
 
 class UnitTestParameters {
 	Optional<std::string> dataDir;
@@ -79,6 +80,84 @@ public:
 	void setDataDir(std::string const&);
 };
 
+// Repeatable microbenchmarks for performance test cases. A benchmark is run for a number of warm-up runs which are not
+// measured, then for a number of measured repetitions, optionally pinned to one CPU. The result is summarized by the
+// median time per run and its median absolute deviation, which unlike a mean and standard deviation are not skewed by
+// the occasional run that is descheduled.
+//
+// Options are read from the test parameters:
+//   benchmarkWarmup       unmeasured runs (default 1)
+//   benchmarkRepetitions  measured runs (default 5)
+//   benchmarkCpu          CPU to pin the benchmark thread to with setAffinity() (default: not pinned)
+//   benchmarkOutput       file each result is written to as it is recorded, one JSON object per line. The first
+//                         result recorded by a process truncates it.
+//   benchmarkBaseline     results file from an earlier run to compare against. Recording a result which regressed
+//                         from its baseline fails the test with test_failed().
+//   benchmarkThreshold    slowdown relative to the baseline which counts as a regression (default 0.1)
+struct BenchmarkResult {
+	std::string name;
+	int64_t opsPerRun = 0;
+	int warmupRuns = 0;
+	int cpu = -1;
+	// The CPUs the thread could run on before prepareBenchmark() pinned it, which recordBenchmark() restores
+	std::vector<int> savedAffinity;
+	// The frequency and governor of the CPU the benchmark ran on when it started, where the OS reports them. They do
+	// not control the frequency; the governor is recorded so that results taken without "performance" stand out.
+	double cpuMHz = 0;
+	std::string cpuGovernor;
+	// Measured runs requested; runSeconds holds the ones which have completed
+	int repetitions = 0;
+	std::vector<double> runSeconds;
+	// FastAllocator allocations on the benchmark thread during the measured runs, per operation, or -1 if the build
+	// does not count them (see fastAllocatorAllocations())
+	double allocationsPerOp = -1;
+	double medianSeconds = 0;
+	// Median absolute deviation of runSeconds
+	double madSeconds = 0;
+
+	double nsPerOp() const { return opsPerRun > 0 ? medianSeconds * 1e9 / opsPerRun : 0; }
+	std::string toJSON() const;
+	// Parses a line written by toJSON(). Only the fields needed to compare against a baseline are restored.
+	static Optional<BenchmarkResult> fromJSON(std::string const& line);
+	// Sets medianSeconds and madSeconds from runSeconds
+	void summarize();
+	// Whether this result is slower than |baseline| by more than |threshold| and by more than its own noise
+	bool regressedFrom(BenchmarkResult const& baseline, double threshold) const;
+};
+
+// Runs |body|, which performs |opsPerRun| operations, as configured by |params| and prints and records the result.
+// |afterRun|, if given, runs untimed after every run, e.g. to restore the state which the body consumes.
+BenchmarkResult runBenchmark(const UnitTestParameters& params,
+                             std::string const& name,
+                             int64_t opsPerRun,
+                             std::function<void()> const& body,
+                             std::function<void()> const& afterRun = {});
+// Like runBenchmark(), but only returns the result, without printing, recording or comparing it
+BenchmarkResult measureBenchmark(const UnitTestParameters& params,
+                                 std::string const& name,
+                                 int64_t opsPerRun,
+                                 std::function<void()> const& body,
+                                 std::function<void()> const& afterRun = {});
+
+// For benchmarks whose runs are asynchronous: prepareBenchmark() reads the options and pins the thread, the caller
+// performs the warm-up runs, times the measured runs into runSeconds and sets allocationsPerOp, and recordBenchmark()
+// restores the thread's affinity, then summarizes, prints, records and compares the result.
+BenchmarkResult prepareBenchmark(const UnitTestParameters& params, std::string const& name, int64_t opsPerRun);
+void recordBenchmark(const UnitTestParameters& params, BenchmarkResult& result);
+// Runs an asynchronous benchmark that way on the network thread, timing each run until the future |body| returns is
+// ready. Defined in EventLoopBenchmark.actor.cpp.
+Future<Void> runEventLoopBenchmark(UnitTestParameters const& params,
+                                   std::string const& name,
+                                   int64_t const& opsPerRun,
+                                   std::function<Future<Void>()> const& body);
+
+// The results recorded by runBenchmark() so far in this process
+std::vector<BenchmarkResult> const& benchmarkResults();
+
+// Returns FDB_EXIT_PERFORMANCE_REGRESSION if any result recorded so far regressed from its baseline, and otherwise
+// FDB_EXIT_SUCCESS, for a test runner to use as its exit code after the failed tests have been reported.
+int finishBenchmarks();
+
 // Unit test definition structured as a linked list item
 struct UnitTest {
 	typedef Future<Void> (*TestFunction)(const UnitTestParameters& params);
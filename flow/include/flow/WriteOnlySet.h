@@ -159,6 +159,7 @@ public:
 
 class ActorLineage;
 extern template class WriteOnlySet<ActorLineage, unsigned, 1024>;
+extern template class WriteOnlyVariable<ActorLineage, unsigned>;
 
 using ActorLineageSet = WriteOnlySet<ActorLineage, unsigned, 1024>;
 #endif
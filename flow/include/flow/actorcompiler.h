@@ -31,6 +31,8 @@ T wait(const Future<T>&) = delete;
 void wait(const Never&) = delete;
 template <class T>
 T waitNext(const FutureStream<T>&) = delete;
+template <class T>
+ErrorOr<T> waitErrorOr(const Future<T>&) = delete;
 
 #endif
 #endif
@@ -42,6 +44,8 @@ class Future;
 class Never;
 template <typename T>
 class FutureStream;
+template <typename T>
+class ErrorOr;
 
 // These are for intellisense to do proper type inferring, etc. They are no included at build time.
 #ifndef NO_INTELLISENSE
@@ -56,6 +60,8 @@ T wait(const Future<T>&);
 void wait(const Never&);
 template <class T>
 T waitNext(const FutureStream<T>&);
+template <class T>
+ErrorOr<T> waitErrorOr(const Future<T>&);
 #endif
 
 #endif
@@ -712,6 +712,16 @@ struct StackLineage : LineageProperties<StackLineage> {
 	StringRef actorName;
 };
 
+// What an actor is doing, as reported by the continuous lineage sampler (see ActorLineageSampler.h). The sampler reads
+// these from its own thread, possibly after the actor is gone, so both must refer to static strings.
+struct OperationLineage : LineageProperties<OperationLineage> {
+	static const std::string_view name;
+	StringRef role;
+	StringRef operation;
+
+	bool isSet(StringRef OperationLineage::*member) const { return (this->*member).size() > 0; }
+};
+
 #ifdef ENABLE_SAMPLING
 struct LineageScope {
 	LineageReference* oldLineage;
@@ -138,12 +138,8 @@ ErrorOr<T> errorOr(T t) {
 
 ACTOR template <class T>
 Future<ErrorOr<T>> errorOr(Future<T> f) {
-	try {
-		T t = wait(f);
-		return ErrorOr<T>(t);
-	} catch (Error& e) {
-		return ErrorOr<T>(e);
-	}
+	ErrorOr<T> t = waitErrorOr(f);
+	return t;
 }
 
 ACTOR template <class T>
@@ -433,7 +433,7 @@ public:
 		if (bytes > 0) {
 			valgrindCheck(data, bytes, "serializeBytes");
 			void* p = writeBytes(bytes);
-			memcpy(p, data, bytes);
+			flowMemcpy(p, data, bytes);
 		}
 	}
 	template <class T>
@@ -792,7 +792,8 @@ private:
 	void readVersion(VersionOptions vo) {
 		vo.read(*this);
 		if (m_protocolVersion.hasObjectSerializerFlag()) {
-			objectReader = ObjectReader(reinterpret_cast<const uint8_t*>(begin), AssumeVersion(m_protocolVersion));
+			objectReader = ObjectReader(StringRef(reinterpret_cast<const uint8_t*>(begin), end - begin),
+			                            AssumeVersion(m_protocolVersion));
 		}
 	}
 };
@@ -896,7 +897,7 @@ struct PacketWriter {
 
 	void serializeBytes(const void* data, int bytes) {
 		if (bytes <= buffer->bytes_unwritten()) {
-			memcpy(buffer->data() + buffer->bytes_written, data, bytes);
+			flowMemcpy(buffer->data() + buffer->bytes_written, data, bytes);
 			buffer->bytes_written += bytes;
 		} else {
 			serializeBytesAcrossBoundary(data, bytes);
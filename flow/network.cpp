@@ -110,100 +110,219 @@ BitFlipper* BitFlipper::flipper() {
 	return static_cast<BitFlipper*>(res);
 }
 
-bool IPAddress::operator==(const IPAddress& rhs) const {
-	return addr == rhs.addr;
-}
-
-bool IPAddress::operator!=(const IPAddress& addr) const {
-	return !(*this == addr);
-}
-
-bool IPAddress::operator<(const IPAddress& rhs) const {
-	return addr < rhs.addr;
-}
-
-std::string IPAddress::toString() const {
-	if (isV6()) {
-		return boost::asio::ip::address_v6(std::get<IPAddressStore>(addr)).to_string();
-	} else {
-		auto ip = std::get<uint32_t>(addr);
-		return format("%d.%d.%d.%d", (ip >> 24) & 0xff, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
+namespace {
+
+// Parses the decimal number at the front of |s| if it is at most |maxValue|. Leading zeros are accepted, as the
+// sscanf() this replaced accepted them in ports, but signs and whitespace are not.
+bool parseDecimal(std::string_view& s, uint32_t maxValue, uint32_t& value) {
+	int digits = 0;
+	value = 0;
+	while (digits < s.size() && s[digits] >= '0' && s[digits] <= '9') {
+		value = value * 10 + (s[digits++] - '0');
+		if (value > maxValue) {
+			return false;
+		}
 	}
+	s.remove_prefix(digits);
+	return digits > 0;
 }
 
-Optional<IPAddress> IPAddress::parse(std::string const& str) {
-	try {
-		auto addr = boost::asio::ip::address::from_string(str);
-		return addr.is_v6() ? IPAddress(addr.to_v6().to_bytes()) : IPAddress(addr.to_v4().to_ulong());
-	} catch (...) {
-		return Optional<IPAddress>();
+// NetworkAddress::parse() used to read its numbers with sscanf()'s %d, and cluster files written for it may depend on
+// that. As %d does, this skips whitespace and a sign before the decimal number at the front of |s|, but only accepts
+// a negative number if it is zero.
+bool parseScanfDecimal(std::string_view& s, uint32_t maxValue, uint32_t& value) {
+	while (!s.empty() && isspace(static_cast<unsigned char>(s[0]))) {
+		s.remove_prefix(1);
 	}
-}
-
-bool IPAddress::isValid() const {
-	if (isV6()) {
-		const auto& ip = std::get<IPAddressStore>(addr);
-		return std::any_of(ip.begin(), ip.end(), [](uint8_t part) { return part != 0; });
+	bool negative = !s.empty() && s[0] == '-';
+	if (!s.empty() && (s[0] == '+' || s[0] == '-')) {
+		s.remove_prefix(1);
+	}
+	return parseDecimal(s, maxValue, value) && !(negative && value);
+}
+
+// Parses the one to four digit hexadecimal group at the front of |s|
+bool parseHexGroup(std::string_view& s, uint16_t& value) {
+	int digits = 0;
+	value = 0;
+	for (; digits < s.size() && digits < 5; digits++) {
+		char c = s[digits];
+		int nibble = c >= '0' && c <= '9'   ? c - '0'
+		             : c >= 'a' && c <= 'f' ? c - 'a' + 10
+		             : c >= 'A' && c <= 'F' ? c - 'A' + 10
+		                                    : -1;
+		if (nibble < 0) {
+			break;
+		}
+		value = (value << 4) | nibble;
+	}
+	s.remove_prefix(digits);
+	return digits > 0 && digits <= 4;
+}
+
+// With |asScanf|, octets are read as NetworkAddress::parse() always read them, with parseScanfDecimal(), so leading
+// zeros are decimal. Otherwise the address must be in the form inet_pton() accepts.
+bool parseIPv4(std::string_view s, uint32_t& ip, bool asScanf = false) {
+	ip = 0;
+	for (int i = 0; i < 4; i++) {
+		if (i) {
+			if (s.empty() || s[0] != '.') {
+				return false;
+			}
+			s.remove_prefix(1);
+		}
+		uint32_t octet;
+		if (asScanf) {
+			if (!parseScanfDecimal(s, 255, octet)) {
+				return false;
+			}
+		} else if ((s.size() > 1 && s[0] == '0' && s[1] >= '0' && s[1] <= '9') || !parseDecimal(s, 255, octet)) {
+			// An octet with a leading zero, e.g. "01", is octal to inet_aton() and rejected by inet_pton(), so it is
+			// rejected here rather than read as decimal
+			return false;
+		}
+		ip = (ip << 8) | octet;
 	}
-	return std::get<uint32_t>(addr) != 0;
+	return s.empty();
 }
 
-NetworkAddress NetworkAddress::parse(std::string const& s) {
-	if (s.empty()) {
-		throw connection_string_invalid();
+bool parseIPv6(std::string_view s, IPAddress::IPAddressStore& store) {
+	if (auto zone = s.find('%'); zone != s.npos) {
+		s = s.substr(0, zone);
+	}
+	uint16_t groups[8];
+	int count = 0;
+	int gap = -1; // The number of groups before "::"
+	if (s.substr(0, 2) == "::") {
+		gap = 0;
+		s.remove_prefix(2);
+	}
+	while (!s.empty()) {
+		if (count < 7 && s.find(':') == s.npos && s.find('.') != s.npos) {
+			// An IPv4 address in the last 32 bits
+			uint32_t v4;
+			if (!parseIPv4(s, v4)) {
+				return false;
+			}
+			groups[count++] = uint16_t(v4 >> 16);
+			groups[count++] = uint16_t(v4);
+			break;
+		}
+		if (count == 8 || !parseHexGroup(s, groups[count++])) {
+			return false;
+		}
+		if (s.empty()) {
+			break;
+		}
+		if (s[0] != ':' || s.size() == 1) {
+			return false;
+		}
+		s.remove_prefix(1);
+		if (s[0] == ':') {
+			if (gap >= 0) {
+				return false;
+			}
+			gap = count;
+			s.remove_prefix(1);
+		}
+	}
+	// "::" stands for at least one group
+	if (gap < 0 ? count != 8 : count == 8) {
+		return false;
 	}
+	store.fill(0);
+	int const tail = gap < 0 ? 0 : count - gap;
+	for (int i = 0; i < count; i++) {
+		int position = i < count - tail ? i : 8 - count + i;
+		store[2 * position] = uint8_t(groups[i] >> 8);
+		store[2 * position + 1] = uint8_t(groups[i]);
+	}
+	return true;
+}
 
-	bool isTLS = false;
+Optional<NetworkAddress> parseNetworkAddress(std::string_view s) {
 	NetworkAddressFromHostname fromHostname = NetworkAddressFromHostname::False;
-	std::string f = s;
-	const auto& pos = f.find("(fromHostname)");
-	if (pos != std::string::npos) {
+	if (auto pos = s.find("(fromHostname)"); pos != s.npos) {
 		fromHostname = NetworkAddressFromHostname::True;
-		f = f.substr(0, pos);
+		s = s.substr(0, pos);
 	}
-	if (f.size() > 4 && strcmp(f.c_str() + f.size() - 4, ":tls") == 0) {
+	bool isTLS = false;
+	if (s.size() > 4 && s.substr(s.size() - 4) == ":tls") {
 		isTLS = true;
-		f = f.substr(0, f.size() - 4);
+		s.remove_suffix(4);
+	}
+	while (!s.empty() && isspace(static_cast<unsigned char>(s[0]))) {
+		s.remove_prefix(1);
 	}
 
-	if (f[0] == '[') {
+	Optional<IPAddress> ip;
+	if (!s.empty() && s[0] == '[') {
 		// IPv6 address/port pair is represented as "[ip]:port"
-		auto addrEnd = f.find_first_of(']');
-		if (addrEnd == std::string::npos || f[addrEnd + 1] != ':') {
-			throw connection_string_invalid();
+		auto addrEnd = s.find(']');
+		if (addrEnd == s.npos || addrEnd + 1 == s.size() || s[addrEnd + 1] != ':') {
+			return Optional<NetworkAddress>();
 		}
-
-		auto port = std::stoi(f.substr(addrEnd + 2));
-		auto addr = IPAddress::parse(f.substr(1, addrEnd - 1));
-		if (!addr.present()) {
-			throw connection_string_invalid();
+		ip = IPAddress::parse(s.substr(1, addrEnd - 1));
+		s.remove_prefix(addrEnd + 2);
+	} else {
+		auto colon = s.find(':');
+		uint32_t v4;
+		if (colon == s.npos || !parseIPv4(s.substr(0, colon), v4, true)) {
+			return Optional<NetworkAddress>();
 		}
-		return NetworkAddress(addr.get(), port, true, isTLS, fromHostname);
+		ip = IPAddress(v4);
+		s.remove_prefix(colon + 1);
+	}
+	uint32_t port;
+	if (!ip.present() || !parseScanfDecimal(s, 65535, port) || !s.empty()) {
+		return Optional<NetworkAddress>();
+	}
+	return NetworkAddress(ip.get(), port, true, isTLS, fromHostname);
+}
+
+} // namespace
+
+std::string IPAddress::toString() const {
+	if (isV6()) {
+		return boost::asio::ip::address_v6(addr).to_string();
 	} else {
-		// TODO: Use IPAddress::parse
-		int a, b, c, d, port, count = -1;
-		if (sscanf(f.c_str(), "%d.%d.%d.%d:%d%n", &a, &b, &c, &d, &port, &count) < 5 || count != f.size())
-			throw connection_string_invalid();
-		return NetworkAddress((a << 24) + (b << 16) + (c << 8) + d, port, true, isTLS, fromHostname);
+		auto ip = toV4();
+		return format("%d.%d.%d.%d", (ip >> 24) & 0xff, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
 	}
 }
 
-Optional<NetworkAddress> NetworkAddress::parseOptional(std::string const& s) {
-	try {
-		return NetworkAddress::parse(s);
-	} catch (Error& e) {
-		ASSERT(e.code() == error_code_connection_string_invalid);
-		return Optional<NetworkAddress>();
+Optional<IPAddress> IPAddress::parse(std::string_view str) {
+	uint32_t v4;
+	if (parseIPv4(str, v4)) {
+		return IPAddress(v4);
+	}
+	IPAddressStore v6;
+	if (parseIPv6(str, v6)) {
+		return IPAddress(v6);
 	}
+	return Optional<IPAddress>();
 }
 
-std::vector<NetworkAddress> NetworkAddress::parseList(std::string const& addrs) {
+NetworkAddress NetworkAddress::parse(std::string_view s) {
+	auto address = parseNetworkAddress(s);
+	if (!address.present()) {
+		throw connection_string_invalid();
+	}
+	return address.get();
+}
+
+Optional<NetworkAddress> NetworkAddress::parseOptional(std::string_view s) {
+	return parseNetworkAddress(s);
+}
+
+std::vector<NetworkAddress> NetworkAddress::parseList(std::string_view addrs) {
 	// Split addrs on ',' and parse them individually
 	std::vector<NetworkAddress> coord;
-	for (int p = 0; p < addrs.length();) {
-		int pComma = addrs.find_first_of(',', p);
+	coord.reserve(std::count(addrs.begin(), addrs.end(), ',') + 1);
+	for (size_t p = 0; p < addrs.size();) {
+		size_t pComma = addrs.find(',', p);
 		if (pComma == addrs.npos) {
-			pComma = addrs.length();
+			pComma = addrs.size();
 		}
 		coord.push_back(NetworkAddress::parse(addrs.substr(p, pComma - p)));
 		p = pComma + 1;
@@ -244,37 +363,118 @@ std::string formatIpPort(const IPAddress& ip, uint16_t port) {
 	return format(patt, ip.toString().c_str(), port);
 }
 
+DNSCache::DNSCache(const std::map<std::string, std::vector<NetworkAddress>>& dnsCache) {
+	for (const auto& [key, addresses] : dnsCache) {
+		auto colonPos = key.find_last_of(':');
+		Entry& entry = hostnameToEntry[key];
+		entry.host = key.substr(0, colonPos);
+		entry.service = colonPos == key.npos ? std::string() : key.substr(colonPos + 1);
+		entry.addresses = addresses;
+	}
+}
+
+double DNSCache::currentTime() const {
+	return clock ? clock() : now();
+}
+
+DNSCache::Entry* DNSCache::lookup(const std::string& host, const std::string& service) {
+	auto it = hostnameToEntry.find(host + ":" + service);
+	if (it == hostnameToEntry.end()) {
+		return nullptr;
+	}
+	if (it->second.expireTime <= currentTime()) {
+		hostnameToEntry.erase(it);
+		return nullptr;
+	}
+	return &it->second;
+}
+
 Optional<std::vector<NetworkAddress>> DNSCache::find(const std::string& host, const std::string& service) {
-	auto it = hostnameToAddresses.find(host + ":" + service);
-	if (it != hostnameToAddresses.end()) {
-		return it->second;
+	Entry* entry = lookup(host, service);
+	if (entry != nullptr && !entry->isNegative()) {
+		return entry->addresses;
 	}
 	return {};
 }
 
-void DNSCache::add(const std::string& host, const std::string& service, const std::vector<NetworkAddress>& addresses) {
-	hostnameToAddresses[host + ":" + service] = addresses;
+bool DNSCache::findNegative(const std::string& host, const std::string& service) {
+	Entry* entry = lookup(host, service);
+	return entry != nullptr && entry->isNegative();
+}
+
+bool DNSCache::needsRefresh(const std::string& host, const std::string& service) {
+	Entry* entry = lookup(host, service);
+	if (entry == nullptr || entry->isNegative() || entry->refreshing || entry->refreshTime > currentTime()) {
+		return false;
+	}
+	entry->refreshing = true;
+	return true;
+}
+
+void DNSCache::refreshFailed(const std::string& host, const std::string& service, double retryDelay) {
+	Entry* entry = lookup(host, service);
+	if (entry != nullptr && !entry->isNegative()) {
+		entry->refreshing = false;
+		entry->refreshTime = std::min(entry->expireTime, currentTime() + retryDelay);
+	}
+}
+
+void DNSCache::add(const std::string& host,
+                   const std::string& service,
+                   const std::vector<NetworkAddress>& addresses,
+                   double ttl,
+                   double refreshFraction) {
+	ASSERT(!addresses.empty());
+	Entry& entry = hostnameToEntry[host + ":" + service];
+	entry.host = host;
+	entry.service = service;
+	entry.addresses = addresses;
+	entry.refreshing = false;
+	if (ttl > 0) {
+		entry.expireTime = currentTime() + ttl;
+		entry.refreshTime = currentTime() + ttl * std::clamp(refreshFraction, 0.0, 1.0);
+	} else {
+		entry.expireTime = std::numeric_limits<double>::infinity();
+		entry.refreshTime = std::numeric_limits<double>::infinity();
+	}
+}
+
+void DNSCache::addNegative(const std::string& host, const std::string& service, double ttl) {
+	if (ttl <= 0) {
+		remove(host, service);
+		return;
+	}
+	Entry& entry = hostnameToEntry[host + ":" + service];
+	entry.host = host;
+	entry.service = service;
+	entry.addresses.clear();
+	entry.refreshing = false;
+	entry.expireTime = currentTime() + ttl;
+	entry.refreshTime = entry.expireTime;
 }
 
 void DNSCache::remove(const std::string& host, const std::string& service) {
-	auto it = hostnameToAddresses.find(host + ":" + service);
-	if (it != hostnameToAddresses.end()) {
-		hostnameToAddresses.erase(it);
+	auto it = hostnameToEntry.find(host + ":" + service);
+	if (it != hostnameToEntry.end()) {
+		hostnameToEntry.erase(it);
 	}
 }
 
 void DNSCache::clear() {
-	hostnameToAddresses.clear();
+	hostnameToEntry.clear();
 }
 
 std::string DNSCache::toString() {
 	std::string ret;
-	for (auto it = hostnameToAddresses.begin(); it != hostnameToAddresses.end(); ++it) {
-		if (it != hostnameToAddresses.begin()) {
+	for (auto it = hostnameToEntry.begin(); it != hostnameToEntry.end(); ++it) {
+		const std::vector<NetworkAddress>& addresses = it->second.addresses;
+		if (addresses.empty()) {
+			continue;
+		}
+		if (!ret.empty()) {
 			ret += ';';
 		}
 		ret += it->first + ',';
-		const std::vector<NetworkAddress>& addresses = it->second;
 		for (int i = 0; i < addresses.size(); ++i) {
 			ret += addresses[i].toString();
 			if (i != addresses.size() - 1) {
@@ -342,6 +542,66 @@ TEST_CASE("/flow/DNSCache") {
 	return Void();
 }
 
+TEST_CASE("/flow/DNSCache/expiration") {
+	DNSCache dnsCache;
+	double t = 1000.0;
+	dnsCache.setClock([&t]() { return t; });
+	std::vector<NetworkAddress> networkAddresses = { NetworkAddress(IPAddress(0x13131313), 1) };
+
+	// Entries with a TTL of zero never expire.
+	dnsCache.add("testhost1", "port1", networkAddresses);
+	t += 1e9;
+	ASSERT(dnsCache.find("testhost1", "port1").present());
+	ASSERT(!dnsCache.needsRefresh("testhost1", "port1"));
+
+	// An entry which is past its refresh time is reported for refresh exactly once, and is still returned.
+	dnsCache.add("testhost1", "port1", networkAddresses, 100.0, 0.5);
+	t += 49.0;
+	ASSERT(!dnsCache.needsRefresh("testhost1", "port1"));
+	t += 1.0;
+	ASSERT(dnsCache.needsRefresh("testhost1", "port1"));
+	ASSERT(!dnsCache.needsRefresh("testhost1", "port1"));
+	ASSERT(dnsCache.find("testhost1", "port1").present());
+
+	// A failed refresh keeps the addresses, and the entry is due for refresh again after the retry delay
+	dnsCache.refreshFailed("testhost1", "port1", 10.0);
+	ASSERT(!dnsCache.needsRefresh("testhost1", "port1"));
+	ASSERT(dnsCache.find("testhost1", "port1").present());
+	t += 10.0;
+	ASSERT(dnsCache.needsRefresh("testhost1", "port1"));
+	dnsCache.add("testhost1", "port1", networkAddresses, 100.0, 1.0);
+	ASSERT(!dnsCache.needsRefresh("testhost1", "port1"));
+
+	// An expired entry is dropped on lookup.
+	dnsCache.add("testhost2", "port2", networkAddresses, 100.0);
+	ASSERT(dnsCache.size() == 2);
+	t += 99.0;
+	ASSERT(dnsCache.find("testhost2", "port2").present());
+	t += 1.0;
+	ASSERT(!dnsCache.find("testhost2", "port2").present());
+	ASSERT(dnsCache.size() == 1);
+
+	// Negative entries are not returned by find(), are omitted from toString(), and expire like positive ones.
+	dnsCache.addNegative("testhost3", "port3", 100.0);
+	ASSERT(dnsCache.findNegative("testhost3", "port3"));
+	ASSERT(!dnsCache.find("testhost3", "port3").present());
+	ASSERT(!dnsCache.needsRefresh("testhost3", "port3"));
+	ASSERT(dnsCache.toString().find("testhost3") == std::string::npos);
+	t += 100.0;
+	ASSERT(!dnsCache.findNegative("testhost3", "port3"));
+	dnsCache.addNegative("testhost3", "port3", 100.0);
+	dnsCache.add("testhost3", "port3", networkAddresses, 100.0);
+	ASSERT(!dnsCache.findNegative("testhost3", "port3"));
+	ASSERT(dnsCache.find("testhost3", "port3").present());
+
+	// A non-positive negative TTL disables negative caching.
+	dnsCache.addNegative("testhost3", "port3", 0.0);
+	ASSERT(!dnsCache.findNegative("testhost3", "port3"));
+	ASSERT(!dnsCache.find("testhost3", "port3").present());
+
+	return Void();
+}
+
 TEST_CASE("/flow/DNSCacheParsing") {
 	std::string dnsCacheString;
 	ASSERT(DNSCache::parseFromString(dnsCacheString).toString() == dnsCacheString);
@@ -428,6 +688,99 @@ TEST_CASE("/flow/network/ipaddress") {
 	return Void();
 }
 
+TEST_CASE("/flow/network/parseIPAddress") {
+	// Every string boost::asio accepts parses to the same address, and every one it rejects is rejected
+	std::vector<std::string> inputs = { "0.0.0.0",
+		                                "1.2.3.4",
+		                                "255.255.255.255",
+		                                "256.1.1.1",
+		                                "1.2.3",
+		                                "1.2.3.4.5",
+		                                "1..2.3",
+		                                "1.2.3.4 ",
+		                                "-1.2.3.4",
+		                                "01.2.3.4",
+		                                "1.2.3.04",
+		                                "1.2.3.00",
+		                                "1.0.3.0",
+		                                "",
+		                                "::",
+		                                "::1",
+		                                "1::",
+		                                "1:2:3:4:5:6:7:8",
+		                                "1:2:3:4:5:6:7:8:9",
+		                                "1:2:3:4:5:6:7::8",
+		                                "1:2:3:4:5:6:7::",
+		                                "1::2::3",
+		                                ":::",
+		                                ":1:2:3:4:5:6:7",
+		                                "1:2:3:4:5:6:7:",
+		                                "2001:DB8::ABCD",
+		                                "2001:db8::12345",
+		                                "2001:db8::g",
+		                                "::ffff:1.2.3.4",
+		                                "::1.2.3.4",
+		                                "1:2:3:4:5:6:1.2.3.4",
+		                                "1:2:3:4:5:6:7:1.2.3.4",
+		                                "::1.2.3",
+		                                "fe80::1%eth0",
+		                                "[::1]" };
+	for (auto const& input : inputs) {
+		boost::system::error_code ec;
+		auto expected = boost::asio::ip::make_address(input, ec);
+		auto parsed = IPAddress::parse(input);
+		ASSERT_EQ(parsed.present(), !ec);
+		if (parsed.present()) {
+			auto ip =
+			    expected.is_v6() ? IPAddress(expected.to_v6().to_bytes()) : IPAddress(expected.to_v4().to_ulong());
+			ASSERT(parsed.get() == ip);
+		}
+	}
+
+	ASSERT(!IPAddress::parse("01.2.3.4").present());
+	ASSERT(!IPAddress::parse("::ffff:1.2.3.010").present());
+	ASSERT(!IPAddress::parse(" 1.2.3.4").present());
+
+	// NetworkAddress keeps accepting what it did when it was parsed with sscanf("%d.%d.%d.%d:%d"): leading zeros are
+	// decimal, and whitespace and a sign may come before each number. The address is normalized.
+	for (auto compatible : { "010.000.003.004:4500",
+	                         "10.0.3.4:04500",
+	                         " 10. 0.\t3.+4: 4500",
+	                         "+10.-0.3.4:+4500",
+	                         "0010.0.3.4:4500" }) {
+		auto address = NetworkAddress::parse(compatible);
+		ASSERT(address == NetworkAddress(0x0a000304, 4500, true, false));
+		ASSERT(address.toString() == "10.0.3.4:4500");
+	}
+	ASSERT(NetworkAddress::parse("010.0.3.4:4500:tls").isTLS());
+	ASSERT(NetworkAddress::parse("[::1]: 4500").port == 4500);
+	// But not what never parsed to the address written
+	for (auto bad :
+	     { "10 .0.3.4:4500", "10.0.3.4 :4500", "-10.0.3.4:4500", "10.0.3.4:-1", "256.0.3.4:4500", "1.2.3.4:+-1" }) {
+		ASSERT(!NetworkAddress::parseOptional(bad).present());
+	}
+
+	// IPv4-mapped IPv6 addresses are the IPv4 address they map
+	ASSERT(IPAddress::parse("::ffff:1.2.3.4").get() == IPAddress(0x01020304));
+	ASSERT(IPAddress::parse("::ffff:1.2.3.4").get().isV4());
+	ASSERT(IPAddress(0x01020304) < IPAddress::parse("::1").get());
+	ASSERT(IPAddress::parse("::1").get() < IPAddress::parse("::2").get());
+	ASSERT(IPAddress(1).hash() != IPAddress(2).hash());
+	static_assert(sizeof(IPAddress) == 16);
+
+	ASSERT(NetworkAddress::parse("1.2.3.4:4500") == NetworkAddress(0x01020304, 4500, true, false));
+	ASSERT(NetworkAddress::parse("1.2.3.4:4500:tls").isTLS());
+	ASSERT(NetworkAddress::parse("[::1]:0").ip == IPAddress::parse("::1").get());
+	for (auto bad : { "1.2.3.4", "1.2.3.4:", "1.2.3.4:65536", "1.2.3.4:45a", "[::1]", "[::1]4500", "[::1:4500", ":" }) {
+		ASSERT(!NetworkAddress::parseOptional(bad).present());
+	}
+	auto list = NetworkAddress::parseList("1.2.3.4:1,[::1]:2:tls,5.6.7.8:3(fromHostname)");
+	ASSERT_EQ(list.size(), 3);
+	ASSERT(list[1].isV6() && list[1].isTLS() && list[1].port == 2);
+	ASSERT(list[2].fromHostname);
+	return Void();
+}
+
 TEST_CASE("/flow/network/ipV6Preferred") {
 	std::vector<NetworkAddress> addresses;
 	for (int i = 0; i < 50; ++i) {
@@ -97,6 +97,26 @@ void verifyData(StringRef value, int numObjects) {
 	}
 }
 
+// Serializes newField only for peers which know about tenants, as a real serializer would for a field added with them
+struct FeatureGatedStruct {
+	int oldField{ 0 };
+	int newField{ 0 };
+
+	template <class Archive>
+	void serialize(Archive& ar) {
+		serializer(ar, oldField);
+		if (archiveHasFeature<ProtocolVersion::Tenants>(ar)) {
+			serializer(ar, newField);
+		}
+	}
+};
+
+struct StaticVersionArchive {
+	using StaticVersion = StaticProtocolVersion<ProtocolVersion::Tenants::protocolVersion>;
+};
+static_assert(archiveHasFeature<ProtocolVersion::Tenants>(StaticVersionArchive{}));
+static_assert(!archiveHasFeature<ProtocolVersion::GcTxnGenerations>(StaticVersionArchive{}));
+
 } // namespace
 
 TEST_CASE("flow/serialize/Downgrade/WriteOld") {
@@ -126,3 +146,58 @@ TEST_CASE("flow/serialize/Downgrade/WriteNew") {
 	verifyData(writer.toStringRef(), numObjects);
 	return Void();
 }
+
+TEST_CASE("/flow/serialize/ProtocolFeatures") {
+	std::vector<ProtocolVersion> versions = { ProtocolVersion(),
+		                                      ProtocolVersion::withWatches(),
+		                                      ProtocolVersion::withTenants(),
+		                                      ProtocolVersion(ProtocolVersion::Tenants::protocolVersion - 1),
+		                                      defaultProtocolVersion,
+		                                      ProtocolVersion(futureProtocolVersionValue) };
+	for (int i = 0; i < 100; ++i) {
+		versions.push_back(ProtocolVersion(deterministicRandom()->randomInt64(ProtocolVersion::withWatches().version(),
+		                                                                      defaultProtocolVersionValue + 1)));
+	}
+	for (auto version : versions) {
+		ProtocolFeatures features = version.features();
+#define CHECK_PROTOCOL_FEATURE(v, x)                                                                                   \
+	ASSERT(features.has##x() == version.has##x());                                                                     \
+	ASSERT(features.has<ProtocolVersion::x>() == version.has##x());
+		FDB_PROTOCOL_VERSION_FEATURES(CHECK_PROTOCOL_FEATURE)
+#undef CHECK_PROTOCOL_FEATURE
+	}
+
+	for (auto version : { ProtocolVersion::withSpanContext(), ProtocolVersion::withTenants() }) {
+		FeatureGatedStruct in;
+		in.oldField = 1;
+		in.newField = 2;
+		BinaryWriter writer(IncludeVersion(version));
+		writer << in;
+		ASSERT(archiveHasFeature<ProtocolVersion::Tenants>(writer) == version.hasTenants());
+
+		BinaryReader reader(writer.toValue(), IncludeVersion());
+		FeatureGatedStruct out;
+		reader >> out;
+		reader.assertEnd();
+		ASSERT(archiveHasFeature<ProtocolVersion::Tenants>(reader) == version.hasTenants());
+		ASSERT_EQ(out.oldField, 1);
+		ASSERT_EQ(out.newField, version.hasTenants() ? 2 : 0);
+	}
+
+	// Feature tests follow later changes of the version
+	BinaryWriter writer(IncludeVersion(ProtocolVersion::withSpanContext()));
+	ASSERT(!archiveHasFeature<ProtocolVersion::Tenants>(writer));
+	writer.setProtocolVersion(ProtocolVersion::withTenants());
+	ASSERT(archiveHasFeature<ProtocolVersion::Tenants>(writer));
+
+	// NetworkAddress only carries its hostname flag from the version which added it
+	NetworkAddress address(IPAddress(0x7f000001), 4500, true, false, NetworkAddressFromHostname::True);
+	for (auto version : { ProtocolVersion::withNetworkAddressHostnameFlag(),
+	                      ProtocolVersion(ProtocolVersion::NetworkAddressHostnameFlag::protocolVersion - 1) }) {
+		NetworkAddress read = BinaryReader::fromStringRef<NetworkAddress>(
+		    BinaryWriter::toValue(address, IncludeVersion(version)), IncludeVersion());
+		ASSERT(read == address);
+		ASSERT_EQ(read.fromHostname, version.hasNetworkAddressHostnameFlag());
+	}
+	return Void();
+}
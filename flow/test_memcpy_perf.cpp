@@ -8,6 +8,7 @@
 #include <stdlib.h>
 
 #include "flow/rte_memcpy.h"
+#include "flow/MemOps.h"
 #include "flow/IRandom.h"
 #include "flow/UnitTest.h"
 #include "flow/flow.h"
@@ -338,4 +339,49 @@ TEST_CASE("performance/memcpy/rte") {
 
 #endif // defined (__linux__) || defined (__FreeBSD__)
 
+/* Measures each flowMemcpy()/flowMemcmp() variant this CPU supports, from cache sized copies up to ones which take the
+ * non-temporal path. Each measurement moves |bytes| (default 256MB) */
+TEST_CASE("performance/memcpy/variants") {
+	const int64_t bytes = params.getInt("bytes").orDefault(256 << 20);
+	const size_t sizes[] = { 64, 256, 1024, 4096, 65536, 1 << 20, 16 << 20, 64 << 20 };
+	const size_t maxSize = 64 << 20;
+	std::vector<uint8_t> src(maxSize), dst(maxSize);
+	for (size_t i = 0; i < maxSize; i++) {
+		src[i] = (uint8_t)i;
+	}
+	memcpy(dst.data(), src.data(), maxSize);
+
+	printf("\n** flowMemcpy() variants (selected: %s, non-temporal from %zu bytes) **\n",
+	       memOpsVariantName(selectedMemOpsVariant()),
+	       flowMemcpyNonTemporalThreshold());
+	printf("%-8s %10s %14s %14s\n", "Variant", "Size", "Copy (GB/s)", "Compare (GB/s)");
+	for (auto variant : supportedMemOpsVariants()) {
+		for (size_t size : sizes) {
+			// At least a few copies of the largest sizes
+			int iterations = std::max<int64_t>(4, bytes / size);
+
+			double start = timer_monotonic();
+			for (int i = 0; i < iterations; i++) {
+				flowMemcpyWith(variant, dst.data(), src.data(), size);
+			}
+			double copySeconds = timer_monotonic() - start;
+
+			int result = 0;
+			start = timer_monotonic();
+			for (int i = 0; i < iterations; i++) {
+				result |= flowMemcmpWith(variant, dst.data(), src.data(), size);
+			}
+			double compareSeconds = timer_monotonic() - start;
+			ASSERT(result == 0);
+
+			printf("%-8s %10zu %14.2f %14.2f\n",
+			       memOpsVariantName(variant),
+			       size,
+			       (double)size * iterations / copySeconds / 1e9,
+			       (double)size * iterations / compareSeconds / 1e9);
+		}
+	}
+	return Void();
+}
+
 void forceLinkMemcpyPerfTests() {}